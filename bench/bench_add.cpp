@@ -0,0 +1,70 @@
+// Stages a synthetic tree with `add .` at increasing thread counts
+// (MINIGIT_THREADS) and reports files/s, MB/s and the speedup over one thread for each.
+// Rows beyond the hardware thread count show scheduling overhead, not scaling, so a
+// meaningful sweep needs a multi-core machine.
+//
+// Usage: bench_add [file_count] [file_bytes] [max_threads]
+
+#include "../minigit.h"
+#include "../thread_pool.h"
+#include "bench_util.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+
+namespace fs = std::filesystem;
+
+int main(int argc, char* argv[]) {
+    int file_count = argc > 1 ? std::atoi(argv[1]) : 50000;
+    std::size_t file_bytes = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 4096;
+    std::size_t max_threads = argc > 3 ? std::strtoull(argv[3], nullptr, 10) : 8;
+    std::size_t hardware_threads = ThreadPool::default_threads();
+
+    std::cout << "files=" << file_count << " file_bytes=" << file_bytes
+              << " hardware_threads=" << hardware_threads << "\n";
+    if (hardware_threads < std::min<std::size_t>(max_threads, 2)) {
+        std::cerr << "Warning: only " << hardware_threads
+                  << " hardware thread; the sweep cannot show add scaling on this machine.\n";
+    }
+    std::cout << std::left << std::setw(10) << "threads" << std::setw(12) << "seconds" << std::setw(12) << "files/s"
+              << std::setw(10) << "MB/s" << "speedup\n";
+
+    double single_thread_seconds = 0;
+    for (std::size_t threads = 1; threads <= max_threads; threads *= 2) {
+        setenv("MINIGIT_THREADS", std::to_string(threads).c_str(), 1);
+        bench::ScratchDir scratch;
+
+        std::mt19937_64 rng(11);
+        for (int i = 0; i < file_count; ++i) {
+            fs::path dir = fs::path("src") / ("m" + std::to_string(i % 97)) / ("p" + std::to_string(i % 13));
+            fs::create_directories(dir);
+            std::ofstream(dir / ("f" + std::to_string(i) + ".txt"), std::ios::binary)
+                << bench::synthetic_text(rng, file_bytes);
+        }
+
+        double seconds = 0;
+        {
+            bench::Quiet quiet;
+            MiniGit mg;
+            mg.init();
+            bench::Timer timer;
+            mg.add(std::vector<std::string>{"."});
+            seconds = timer.seconds();
+        }
+        if (threads == 1) {
+            single_thread_seconds = seconds;
+        }
+        std::cout << std::left << std::setw(10) << threads << std::fixed << std::setprecision(3) << std::setw(12)
+                  << seconds << std::setprecision(0) << std::setw(12) << file_count / seconds << std::setprecision(1)
+                  << std::setw(10) << bench::mb_per_second(static_cast<std::uintmax_t>(file_count) * file_bytes, seconds)
+                  << std::setprecision(2) << single_thread_seconds / seconds
+                  << (threads > hardware_threads ? "x (oversubscribed)" : "x") << "\n";
+    }
+    unsetenv("MINIGIT_THREADS");
+    return 0;
+}
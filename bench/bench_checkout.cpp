@@ -0,0 +1,79 @@
+// Switching between two branches that differ in a few files of a large tree. Checkout
+// diffs the two commits' trees, so only the differing paths are checked against the
+// stat cache and rewritten; every other file is left untouched.
+//
+// Usage: bench_checkout [file_count] [changed_files] [switches]
+
+#include "../minigit.h"
+#include "bench_util.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+int main(int argc, char* argv[]) {
+    int file_count = argc > 1 ? std::atoi(argv[1]) : 100000;
+    int changed = argc > 2 ? std::atoi(argv[2]) : 10;
+    int switches = argc > 3 ? std::atoi(argv[3]) : 20;
+
+    bench::ScratchDir scratch;
+    std::vector<std::string> names;
+    for (int i = 0; i < file_count; ++i) {
+        fs::path dir = fs::path("d" + std::to_string(i / 1000)) / ("e" + std::to_string((i / 100) % 10));
+        fs::create_directories(dir);
+        names.push_back((dir / ("f" + std::to_string(i) + ".txt")).string());
+        std::ofstream(names.back(), std::ios::binary) << "content " << i << "\n";
+    }
+
+    bench::Timer timer;
+    {
+        bench::Quiet quiet;
+        MiniGit mg;
+        mg.init();
+        mg.add(std::vector<std::string>{"."});
+        mg.commit("initial");
+        mg.branch("other");
+        mg.checkout("other");
+    }
+    // "other" changes a few files spread over the tree
+    {
+        bench::Quiet quiet;
+        std::vector<std::string> paths;
+        for (int i = 0; i < changed; ++i) {
+            paths.push_back(names[(static_cast<size_t>(i) * 7919) % names.size()]);
+            std::ofstream(paths.back(), std::ios::binary) << "other " << i << "\n";
+        }
+        MiniGit mg;
+        mg.add(paths);
+        mg.commit("change on other");
+    }
+    double setup_seconds = timer.seconds();
+
+    // Each switch is a fresh instance, like a separate CLI invocation
+    timer.reset();
+    {
+        bench::Quiet quiet;
+        for (int i = 0; i < switches; ++i) {
+            MiniGit mg;
+            mg.checkout(i % 2 == 0 ? "main" : "other");
+        }
+    }
+    double switch_ms = timer.seconds() * 1e3 / switches;
+
+    std::string probe = names[0];
+    std::ifstream in(probe);
+    std::string line;
+    std::getline(in, line);
+
+    std::cout << "files=" << file_count << " changed=" << changed << " switches=" << switches << "\n"
+              << std::fixed << std::setprecision(3)
+              << "setup_seconds=" << setup_seconds << "\n"
+              << "checkout_ms=" << switch_ms << "\n"
+              << "final_content_of_" << probe << "=" << line << "\n";
+    return 0;
+}
@@ -0,0 +1,86 @@
+// Object store growth and add time for versions of one large text file, stored whole
+// (chunking off) and as content-defined chunks. Two edit patterns: appending about 64 KB
+// per version (a growing log), and inserting a short line at a few random offsets (an
+// edited document). Each pattern and mode runs in its own fresh repository.
+//
+// Usage: bench_chunking [file_mb] [versions]
+
+#include "bench_util.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+struct Result {
+    std::uintmax_t first_bytes = 0;  // Object store after the first version
+    std::uintmax_t growth_bytes = 0; // Added by all later versions
+    double add_seconds = 0;          // add + commit of the later versions
+};
+
+template <typename Edit>
+static Result run(const std::string& threshold, const std::string& initial, int versions, Edit edit) {
+    setenv("MINIGIT_CHUNK_THRESHOLD", threshold.c_str(), 1);
+    bench::ScratchDir scratch;
+    {
+        bench::Quiet quiet;
+        MiniGit().init();
+    }
+    std::mt19937_64 rng(11);
+    std::string text = initial;
+    Result result;
+    for (int v = 0; v < versions; ++v) {
+        if (v > 0) {
+            edit(rng, text);
+        }
+        std::ofstream("data.txt", std::ios::binary | std::ios::trunc) << text;
+        bench::Timer timer;
+        bench::commit_files({"data.txt"}, "version " + std::to_string(v));
+        if (v == 0) {
+            result.first_bytes = bench::directory_bytes(".minigit/objects");
+        } else {
+            result.add_seconds += timer.seconds();
+        }
+    }
+    result.growth_bytes = bench::directory_bytes(".minigit/objects") - result.first_bytes;
+    return result;
+}
+
+int main(int argc, char* argv[]) {
+    int file_mb = argc > 1 ? std::atoi(argv[1]) : 32;
+    int versions = argc > 2 ? std::atoi(argv[2]) : 20;
+    std::mt19937_64 rng(5);
+    std::string initial = bench::synthetic_text(rng, static_cast<std::size_t>(file_mb) << 20);
+
+    auto append = [](std::mt19937_64& r, std::string& text) { text += bench::synthetic_text(r, 64 * 1024); };
+    auto insert = [](std::mt19937_64& r, std::string& text) {
+        for (int i = 0; i < 4; ++i) {
+            std::size_t at = text.find('\n', r() % text.size());
+            text.insert(at == std::string::npos ? text.size() : at + 1, "inserted_key = " + std::to_string(r() % 1000) + "\n");
+        }
+    };
+
+    std::cout << "file_mb=" << file_mb << " versions=" << versions << std::fixed << "\n";
+    for (const char* pattern : {"append", "insert"}) {
+        Result whole, chunked;
+        if (std::string(pattern) == "append") {
+            whole = run("0", initial, versions, append);
+            chunked = run("1048576", initial, versions, append);
+        } else {
+            whole = run("0", initial, versions, insert);
+            chunked = run("1048576", initial, versions, insert);
+        }
+        int later = versions > 1 ? versions - 1 : 1;
+        for (const auto& mode : {std::make_pair("whole", whole), std::make_pair("chunked", chunked)}) {
+            std::cout << std::setprecision(2) << pattern << " " << mode.first
+                      << " first_mb=" << mode.second.first_bytes / (1024.0 * 1024.0)
+                      << " growth_kb_per_version=" << mode.second.growth_bytes / 1024.0 / later
+                      << " add_ms_per_version=" << mode.second.add_seconds * 1e3 / later << "\n";
+        }
+        std::cout << std::setprecision(1) << pattern << " growth_reduction="
+                  << (chunked.growth_bytes ? static_cast<double>(whole.growth_bytes) / chunked.growth_bytes : 0.0) << "x\n";
+    }
+    unsetenv("MINIGIT_CHUNK_THRESHOLD");
+    return 0;
+}
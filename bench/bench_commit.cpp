@@ -0,0 +1,102 @@
+// Commit cost in a large tree after a one-file change. With tree objects a commit
+// stores only the trees on the path to the changed file (plus the small commit object);
+// the old format wrote the whole path -> blob snapshot into every commit. The old
+// format's size is computed from the same index, and its latency is approximated by
+// serializing, hashing and compressing that snapshot, which is what each commit paid.
+//
+// Usage: bench_commit [file_count] [commits]
+
+#include "../minigit.h"
+#include "../index.h"
+#include "../utils.h"
+#include "bench_util.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// Bytes of loose and packed objects, leaving out objects/info (the commit-graph)
+static std::uintmax_t object_bytes() {
+    std::uintmax_t total = 0;
+    for (auto it = fs::recursive_directory_iterator(".minigit/objects"); it != fs::recursive_directory_iterator(); ++it) {
+        if (it->is_directory() && it->path().filename() == "info") {
+            it.disable_recursion_pending();
+        } else if (it->is_regular_file()) {
+            total += it->file_size();
+        }
+    }
+    return total;
+}
+
+int main(int argc, char* argv[]) {
+    int file_count = argc > 1 ? std::atoi(argv[1]) : 100000;
+    int commit_runs = argc > 2 ? std::atoi(argv[2]) : 10;
+
+    bench::ScratchDir scratch;
+    std::vector<std::string> names;
+    for (int i = 0; i < file_count; ++i) {
+        fs::path dir = fs::path("d" + std::to_string(i / 1000)) / ("e" + std::to_string((i / 100) % 10));
+        fs::create_directories(dir);
+        names.push_back((dir / ("f" + std::to_string(i) + ".txt")).string());
+        std::ofstream(names.back(), std::ios::binary) << "content " << i << "\n";
+    }
+
+    bench::Timer timer;
+    {
+        bench::Quiet quiet;
+        MiniGit mg;
+        mg.init();
+        mg.add(std::vector<std::string>{"."});
+        mg.commit("initial");
+    }
+    double initial_seconds = timer.seconds();
+
+    // One-file change per commit; each commit gets a fresh instance, like a CLI invocation
+    double commit_seconds = 0;
+    std::uintmax_t commit_bytes = 0;
+    for (int run = 0; run < commit_runs; ++run) {
+        const std::string& name = names[(run * 7919) % names.size()];
+        std::ofstream(name, std::ios::binary) << "changed " << run << "\n";
+        bench::Quiet quiet;
+        {
+            MiniGit mg;
+            mg.add(name);
+        }
+        std::uintmax_t before = object_bytes();
+        timer.reset();
+        {
+            MiniGit mg;
+            mg.commit("change " + std::to_string(run));
+        }
+        commit_seconds += timer.seconds();
+        commit_bytes += object_bytes() - before;
+    }
+
+    // The old format: the whole snapshot as text in the commit
+    std::map<std::string, std::string> snapshot;
+    Index(".minigit/index").for_each([&snapshot](const std::string& path, const IndexEntry& entry) {
+        snapshot.emplace(path, entry.hash);
+    });
+    timer.reset();
+    std::string legacy = "parent: 0000000000000000000000000000000000000000\nmessage: change\nauthor: default_user\ntimestamp: 0\n---snapshot---\n";
+    for (const auto& pair : snapshot) {
+        legacy += pair.first + " " + pair.second + "\n";
+    }
+    std::string legacy_hash = Utils::hashObject("commit", legacy);
+    std::string legacy_compressed = Utils::compress(Utils::objectHeader("commit", legacy.size()) + legacy);
+    double legacy_ms = timer.seconds() * 1e3;
+
+    std::cout << "files=" << file_count << " commits=" << commit_runs << "\n"
+              << std::fixed << std::setprecision(3)
+              << "initial_add_and_commit_seconds=" << initial_seconds << "\n"
+              << "tree_commit_ms=" << commit_seconds * 1e3 / commit_runs << "\n"
+              << "tree_commit_bytes=" << commit_bytes / commit_runs << " (commit + changed trees, compressed)\n"
+              << "snapshot_commit_bytes=" << legacy.size() << " raw, " << legacy_compressed.size() << " compressed\n"
+              << "snapshot_serialize_ms=" << legacy_ms << " (serialize + hash + compress only)\n";
+    return 0;
+}
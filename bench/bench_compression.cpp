@@ -0,0 +1,74 @@
+// Measures the object store at each zlib compression level:
+// on-disk bytes under .minigit/objects and add/checkout throughput. The checkout starts
+// from a branch without the files, so every file is written.
+//
+// Usage: bench_compression [file_count] [file_bytes]
+
+#include "../minigit.h"
+#include "bench_util.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+int main(int argc, char* argv[]) {
+    int file_count = argc > 1 ? std::atoi(argv[1]) : 2000;
+    std::size_t file_bytes = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 8 * 1024;
+    const int levels[] = {0, 1, 6, 9};
+
+    std::cout << "files=" << file_count << " file_bytes=" << file_bytes << "\n";
+    std::cout << std::left << std::setw(8) << "level" << std::setw(16) << "objects_bytes" << std::setw(10) << "ratio"
+              << std::setw(14) << "add_MB/s" << std::setw(14) << "checkout_MB/s" << "\n";
+
+    for (int level : levels) {
+        setenv("MINIGIT_COMPRESSION", std::to_string(level).c_str(), 1);
+        bench::ScratchDir scratch;
+
+        std::mt19937_64 rng(42);
+        std::vector<std::string> names;
+        std::uintmax_t raw_bytes = 0;
+        for (int i = 0; i < file_count; ++i) {
+            names.push_back("file" + std::to_string(i) + ".conf");
+            std::ofstream(names.back(), std::ios::binary) << bench::synthetic_text(rng, file_bytes);
+            raw_bytes += file_bytes;
+        }
+
+        double add_seconds = 0;
+        double checkout_seconds = 0;
+        {
+            bench::Quiet quiet;
+            MiniGit mg;
+            mg.init();
+            std::ofstream("base.txt", std::ios::binary) << "base\n";
+            mg.add("base.txt");
+            mg.commit("base");
+            mg.branch("base");
+
+            bench::Timer timer;
+            for (const std::string& name : names) {
+                mg.add(name);
+            }
+            add_seconds = timer.seconds();
+
+            mg.commit("benchmark");
+            mg.checkout("base"); // Removes the files again
+
+            timer.reset();
+            mg.checkout("main");
+            checkout_seconds = timer.seconds();
+        }
+
+        std::uintmax_t object_bytes = bench::directory_bytes(scratch.path() / ".minigit" / "objects");
+        std::cout << std::left << std::setw(8) << level << std::setw(16) << object_bytes << std::setw(10)
+                  << std::fixed << std::setprecision(3) << static_cast<double>(object_bytes) / raw_bytes
+                  << std::setw(14) << std::setprecision(1) << bench::mb_per_second(raw_bytes, add_seconds)
+                  << std::setw(14) << bench::mb_per_second(raw_bytes, checkout_seconds) << "\n";
+    }
+    unsetenv("MINIGIT_COMPRESSION");
+    return 0;
+}
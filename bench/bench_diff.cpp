@@ -0,0 +1,113 @@
+// `diff` between two commits that differ in a few files of a large tree, and
+// Diff::unified on a large file with a few edits. The commit diff walks the two trees
+// and only reads the differing directories and blobs; the file diff skips the common
+// leading and trailing lines with a byte compare before splitting and hashing lines.
+//
+// Usage: bench_diff [file_count] [changed_files] [runs]
+
+#include "../minigit.h"
+#include "../diff.h"
+#include "bench_util.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+int main(int argc, char* argv[]) {
+    int file_count = argc > 1 ? std::atoi(argv[1]) : 100000;
+    int changed = argc > 2 ? std::atoi(argv[2]) : 10;
+    int runs = argc > 3 ? std::atoi(argv[3]) : 20;
+
+    bench::ScratchDir scratch;
+    std::vector<std::string> names;
+    for (int i = 0; i < file_count; ++i) {
+        fs::path dir = fs::path("d" + std::to_string(i / 1000)) / ("e" + std::to_string((i / 100) % 10));
+        fs::create_directories(dir);
+        names.push_back((dir / ("f" + std::to_string(i) + ".txt")).string());
+        std::ofstream(names.back(), std::ios::binary) << "content " << i << "\n";
+    }
+    {
+        bench::Quiet quiet;
+        MiniGit mg;
+        mg.init();
+        mg.add(std::vector<std::string>{"."});
+        mg.commit("initial");
+        mg.branch("other");
+        mg.checkout("other");
+    }
+    {
+        bench::Quiet quiet;
+        std::vector<std::string> paths;
+        for (int i = 0; i < changed; ++i) {
+            paths.push_back(names[(static_cast<size_t>(i) * 7919) % names.size()]);
+            std::ofstream(paths.back(), std::ios::binary) << "other " << i << "\n";
+        }
+        MiniGit mg;
+        mg.add(paths);
+        mg.commit("change on other");
+    }
+
+    // Each run is a fresh instance, like a separate CLI invocation; the output is kept
+    // to check that every changed file was reported
+    std::ostringstream output;
+    bench::Timer timer;
+    for (int i = 0; i < runs; ++i) {
+        output.str("");
+        std::streambuf* previous = std::cout.rdbuf(output.rdbuf());
+        {
+            MiniGit mg;
+            mg.diff("main", "other");
+        }
+        std::cout.rdbuf(previous);
+    }
+    double commit_diff_ms = timer.seconds() * 1e3 / runs;
+    std::string text = output.str();
+    size_t reported = 0;
+    for (size_t pos = text.find("diff --git"); pos != std::string::npos; pos = text.find("diff --git", pos + 1)) {
+        ++reported;
+    }
+    if (reported != static_cast<size_t>(changed)) {
+        std::cerr << "Error: expected " << changed << " changed files, diff reported " << reported << std::endl;
+        return 1;
+    }
+
+    // One large file: 100,000 lines, ten single-line edits spread through it
+    std::string old_text, new_text;
+    for (int i = 0; i < 100000; ++i) {
+        std::string line = "    value_" + std::to_string(i) + " = compute(" + std::to_string(i * 31 % 1000) + ");\n";
+        old_text += line;
+        new_text += i % 10000 == 5000 ? "    changed();\n" : line;
+    }
+    timer.reset();
+    for (int i = 0; i < runs; ++i) {
+        output.str("");
+        Diff::unified(old_text, new_text, output);
+    }
+    double file_diff_ms = timer.seconds() * 1e3 / runs;
+
+    // The same size with a change at each end, so nothing can be skipped
+    std::string ends_text = new_text;
+    ends_text[4] = '#';
+    ends_text[ends_text.size() - 3] = '#';
+    timer.reset();
+    for (int i = 0; i < runs; ++i) {
+        output.str("");
+        Diff::unified(old_text, ends_text, output);
+    }
+    double full_diff_ms = timer.seconds() * 1e3 / runs;
+
+    std::cout << "files=" << file_count << " changed=" << changed << " runs=" << runs << "\n"
+              << std::fixed << std::setprecision(3)
+              << "commit_diff_ms=" << commit_diff_ms << "\n"
+              << "large_file_bytes=" << old_text.size() << "\n"
+              << "large_file_diff_ms=" << file_diff_ms << " (10 edits)\n"
+              << "large_file_full_diff_ms=" << full_diff_ms << " (edits at both ends too)\n"
+              << "large_file_mb_per_s=" << bench::mb_per_second(old_text.size() * 2, full_diff_ms / 1e3) << "\n";
+    return 0;
+}
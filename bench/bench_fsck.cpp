@@ -0,0 +1,71 @@
+// `fsck` throughput. A repository with `files` files of `file_size` bytes and a short history
+// is generated, plus one large file stored as chunks, and fsck is timed with the objects
+// loose and again after `gc` packed them. MB/s counts the content bytes fsck re-hashed, as
+// it reports them itself.
+//
+// Usage: bench_fsck [files] [file_size] [large_mb]
+
+#include "bench_util.h"
+
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+// Runs fsck once and returns the MB it says it checked, or -1 if it found problems
+static double run_fsck(double& seconds) {
+    std::ostringstream output;
+    std::streambuf* saved_out = std::cout.rdbuf(output.rdbuf());
+    std::streambuf* saved_err = std::cerr.rdbuf(output.rdbuf());
+    bench::Timer timer;
+    MiniGit().fsck();
+    seconds = timer.seconds();
+    std::cout.rdbuf(saved_out);
+    std::cerr.rdbuf(saved_err);
+    // "Checked <n> objects (...), <mb> MB in ..."
+    std::string text = output.str();
+    size_t mb = text.find(" MB in ");
+    size_t start = text.rfind(' ', mb - 1);
+    if (mb == std::string::npos || text.find("No problems found.") == std::string::npos) {
+        return -1;
+    }
+    return std::atof(text.c_str() + start + 1);
+}
+
+static void report(const char* label) {
+    double seconds = 0;
+    double megabytes = run_fsck(seconds);
+    if (megabytes < 0) {
+        std::cerr << "Error: fsck reported problems on a clean repository" << std::endl;
+        exit(1);
+    }
+    std::cout << std::fixed << std::setprecision(1) << label << " checked_mb=" << megabytes
+              << " fsck_ms=" << seconds * 1e3 << " mb_per_s=" << (seconds > 0 ? megabytes / seconds : 0.0) << "\n";
+}
+
+int main(int argc, char* argv[]) {
+    bench::RepoShape shape;
+    shape.files = argc > 1 ? std::atoi(argv[1]) : 20000;
+    shape.file_size = argc > 2 ? std::atoi(argv[2]) : 4096;
+    int large_mb = argc > 3 ? std::atoi(argv[3]) : 64;
+    shape.depth = 20;
+    shape.branches = 2;
+
+    bench::ScratchDir scratch;
+    bench::generate_repo(shape);
+    {
+        std::mt19937_64 rng(3);
+        std::ofstream("large.bin", std::ios::binary) << bench::synthetic_text(rng, static_cast<std::size_t>(large_mb) << 20);
+    }
+    bench::commit_files({"large.bin"}, "large file");
+
+    std::cout << "files=" << shape.files << " file_size=" << shape.file_size << " large_mb=" << large_mb << "\n";
+    report("loose ");
+    {
+        bench::Quiet quiet;
+        MiniGit().gc();
+    }
+    report("packed");
+    return 0;
+}
@@ -0,0 +1,95 @@
+// Mark-and-sweep `prune`. A repository with `files` files and a short history is generated,
+// then `rounds` rounds of rewriting and re-adding `garbage` files leave all but the last
+// round's blobs unreachable (like abandoned work). Every loose object is backdated past the
+// grace period and `prune --expire now` is timed, first with the reachable objects loose and
+// then after `gc` packed them. A second prune with nothing left to delete shows the cost of
+// marking and scanning alone.
+//
+// Usage: bench_gc [files] [garbage] [rounds]
+
+#include "bench_util.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+static std::size_t count_loose_objects() {
+    std::size_t count = 0;
+    for (const auto& entry : fs::directory_iterator(".minigit/objects")) {
+        std::string name = entry.path().filename().string();
+        if (entry.is_directory() && name.size() == 2) {
+            for (const auto& object : fs::directory_iterator(entry.path())) {
+                count += object.is_regular_file();
+            }
+        }
+    }
+    return count;
+}
+
+// Sets every loose object's mtime a day back, past any grace period
+static void backdate_loose_objects() {
+    auto day_ago = fs::file_time_type::clock::now() - std::chrono::hours(24);
+    for (const auto& entry : fs::recursive_directory_iterator(".minigit/objects")) {
+        if (entry.is_regular_file() && entry.path().parent_path().filename() != "pack") {
+            fs::last_write_time(entry.path(), day_ago);
+        }
+    }
+}
+
+static void time_prune(const char* label) {
+    std::size_t before = count_loose_objects();
+    std::uintmax_t bytes = bench::directory_bytes(".minigit/objects");
+    bench::Timer timer;
+    {
+        bench::Quiet quiet;
+        MiniGit().prune(0);
+    }
+    double seconds = timer.seconds();
+    std::size_t after = count_loose_objects();
+    std::cout << std::fixed << std::setprecision(1) << label << " loose_before=" << before << " pruned=" << before - after
+              << " reclaimed_kb=" << (bytes - bench::directory_bytes(".minigit/objects")) / 1024
+              << " prune_ms=" << seconds * 1e3 << "\n";
+}
+
+int main(int argc, char* argv[]) {
+    bench::RepoShape shape;
+    shape.files = argc > 1 ? std::atoi(argv[1]) : 20000;
+    int garbage = argc > 2 ? std::atoi(argv[2]) : 10000;
+    int rounds = argc > 3 ? std::atoi(argv[3]) : 5;
+    shape.depth = 20;
+    shape.branches = 2;
+    shape.file_size = 256;
+    garbage = std::min(garbage, shape.files);
+
+    bench::ScratchDir scratch;
+    bench::generate_repo(shape);
+    std::mt19937_64 rng(7);
+    std::vector<std::string> paths;
+    for (int i = 0; i < garbage; ++i) {
+        paths.push_back(bench::synthetic_path(i));
+    }
+    for (int round = 0; round < rounds; ++round) {
+        for (const std::string& path : paths) {
+            std::ofstream(path, std::ios::binary) << bench::synthetic_text(rng, shape.file_size);
+        }
+        bench::Quiet quiet;
+        MiniGit().add(paths);
+    }
+
+    std::cout << "files=" << shape.files << " garbage_files=" << garbage << " rounds=" << rounds << "\n";
+    backdate_loose_objects();
+    time_prune("loose ");
+    time_prune("clean ");
+    {
+        bench::Quiet quiet;
+        MiniGit().gc();
+    }
+    backdate_loose_objects();
+    time_prune("packed");
+    return 0;
+}
@@ -0,0 +1,159 @@
+// History traversals over a long synthetic history: log walks every commit, `log -n 20`
+// only the newest ones, and a three-way merge needs ancestry checks and a merge-base search.
+// The commit cache reads and parses each commit once (metadata only; snapshots on
+// demand), so a second traversal in the same MiniGit instance touches no objects.
+// With the commit-graph file, the merge-base search is pruned by generation number and
+// only walks the commits above the fork point, without reading their objects.
+//
+// Usage: bench_history [commit_count] [fork_depth]
+
+#include "../minigit.h"
+#include "../object_writer.h"
+#include "../utils.h"
+#include "bench_util.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+namespace fs = std::filesystem;
+
+// Writes a commit object in the snapshot format directly, bypassing the index
+static std::string write_commit(const std::string& parent, const std::string& parent2,
+                                long timestamp, const std::string& snapshot) {
+    std::string data = "parent: " + parent + "\n";
+    if (!parent2.empty()) {
+        data += "parent2: " + parent2 + "\n";
+    }
+    data += "message: synthetic commit\nauthor: bench\ntimestamp: " + std::to_string(timestamp) +
+            "\n---snapshot---\n" + snapshot;
+    ObjectWriter writer(".minigit/objects", 1);
+    ObjectId id;
+    if (!writer.begin("commit", data.size()) || !writer.write(data.data(), data.size()) ||
+        !writer.finish(id) || !writer.install(fs::path(".minigit/objects") / id.hex().substr(0, 2) / id.hex().substr(2))) {
+        std::cerr << "Error: could not write commit" << std::endl;
+        exit(1);
+    }
+    return id.hex();
+}
+
+static std::string write_blob(const std::string& content) {
+    ObjectWriter writer(".minigit/objects", 1);
+    ObjectId id;
+    writer.begin("blob", content.size());
+    writer.write(content.data(), content.size());
+    writer.finish(id);
+    writer.install(fs::path(".minigit/objects") / id.hex().substr(0, 2) / id.hex().substr(2));
+    return id.hex();
+}
+
+int main(int argc, char* argv[]) {
+    int commit_count = argc > 1 ? std::atoi(argv[1]) : 100000;
+    int fork_depth = argc > 2 ? std::atoi(argv[2]) : 10;
+
+    bench::ScratchDir scratch;
+    {
+        bench::Quiet quiet;
+        MiniGit mg;
+        mg.init();
+    }
+
+    // Mainline of commit_count commits; "feature" forks fork_depth commits below the tip
+    // and adds a file of its own, so merging it needs a real merge-base search
+    bench::Timer timer;
+    std::string main_snapshot = "a.txt " + write_blob("a\n") + "\n";
+    std::string feature_snapshot = main_snapshot + "b.txt " + write_blob("b\n") + "\n";
+    std::string tip;
+    std::string fork_point;
+    long timestamp = 1000000000;
+    for (int i = 0; i < commit_count; ++i) {
+        tip = write_commit(tip, "", timestamp++, main_snapshot);
+        if (i == commit_count - 1 - fork_depth) {
+            fork_point = tip;
+        }
+    }
+    std::string feature = fork_point.empty() ? tip : fork_point;
+    for (int i = 0; i < 5; ++i) {
+        feature = write_commit(feature, "", timestamp++, feature_snapshot);
+    }
+    Utils::writeFile(std::string(".minigit/refs/heads/main"), tip);
+    Utils::writeFile(std::string(".minigit/refs/heads/feature"), feature);
+    std::ofstream("a.txt") << "a\n";
+    double generate_seconds = timer.seconds();
+
+    double log_cold;
+    double log_warm;
+    double log_first_20;
+    {
+        bench::Quiet quiet;
+        MiniGit mg;
+        LogOptions options;
+        options.max_count = 20;
+        timer.reset();
+        mg.log(options);
+        log_first_20 = timer.seconds();
+    }
+    {
+        bench::Quiet quiet;
+        MiniGit mg;
+        timer.reset();
+        mg.log();
+        log_cold = timer.seconds();
+        timer.reset();
+        mg.log();
+        log_warm = timer.seconds();
+    }
+    // Each merge starts from the same state: main at its tip and only a.txt checked out
+    std::string index_before = Utils::readFile(".minigit/index");
+    auto run_merge = [&]() {
+        Utils::writeFile(std::string(".minigit/refs/heads/main"), tip);
+        Utils::writeFile(std::string(".minigit/index"), index_before);
+        fs::remove("b.txt");
+        std::ostringstream merge_output;
+        // Captured rather than silenced, to check the merge really completed
+        std::streambuf* out = std::cout.rdbuf(merge_output.rdbuf());
+        std::streambuf* err = std::cerr.rdbuf(merge_output.rdbuf());
+        bench::Timer merge_timer;
+        {
+            MiniGit mg; // Fresh cache: the merge pays for reading the history itself
+            mg.merge("feature");
+        }
+        double seconds = merge_timer.seconds();
+        std::cout.rdbuf(out);
+        std::cerr.rdbuf(err);
+        if (merge_output.str().find("Merge commit created") == std::string::npos) {
+            std::cerr << "Error: merge did not complete:\n" << merge_output.str();
+            exit(1);
+        }
+        return seconds;
+    };
+
+    // Without a commit-graph the merge reads the whole mainline, and the merge commit
+    // then writes the first commit-graph file
+    double merge_no_graph = run_merge();
+
+    double graph_write;
+    {
+        bench::Quiet quiet;
+        timer.reset();
+        MiniGit mg;
+        mg.write_commit_graph();
+        graph_write = timer.seconds();
+    }
+    double merge_graph = run_merge();
+
+    std::cout << "commits=" << commit_count << " fork_depth=" << fork_depth << "\n"
+              << std::fixed << std::setprecision(3)
+              << "generate_seconds=" << generate_seconds << "\n"
+              << "log_cold_seconds=" << log_cold << " ("
+              << (log_cold > 0 ? commit_count / log_cold : 0.0) << " commits/s)\n"
+              << "log_warm_seconds=" << log_warm << "\n"
+              << "log_n20_cold_seconds=" << log_first_20 << "\n"
+              << "merge_without_graph_seconds=" << merge_no_graph << " (includes writing the first commit-graph)\n"
+              << "commit_graph_write_seconds=" << graph_write << "\n"
+              << "merge_with_graph_seconds=" << merge_graph << " (includes updating the commit-graph)\n";
+    return 0;
+}
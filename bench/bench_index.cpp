@@ -0,0 +1,85 @@
+// No-op add against a large staging area: with the stat cache an unchanged file
+// is a binary search in the mapped index plus one lstat, with no hashing or rewrite.
+//
+// Usage: bench_index [file_count] [adds]
+
+#include "../index.h"
+#include "../minigit.h"
+#include "../utils.h"
+#include "bench_util.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/stat.h>
+
+namespace fs = std::filesystem;
+
+int main(int argc, char* argv[]) {
+    int file_count = argc > 1 ? std::atoi(argv[1]) : 100000;
+    int adds = argc > 2 ? std::atoi(argv[2]) : 200;
+
+    bench::ScratchDir scratch;
+    {
+        bench::Quiet quiet;
+        MiniGit mg;
+        mg.init();
+    }
+
+    // Build the working tree and stage it directly through Index (one save instead of
+    // file_count separate adds)
+    std::vector<std::string> names;
+    for (int i = 0; i < file_count; ++i) {
+        fs::path dir = "d" + std::to_string(i / 1000);
+        fs::create_directories(dir);
+        names.push_back((dir / ("f" + std::to_string(i) + ".txt")).string());
+        std::ofstream(names.back(), std::ios::binary) << "content " << i << "\n";
+    }
+    // Let the filesystem clock move past the files' mtimes so none of them is racily clean
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    bench::Timer timer;
+    {
+        Index index(".minigit/index");
+        for (const std::string& name : names) {
+            struct stat st;
+            lstat(name.c_str(), &st);
+            IndexEntry entry;
+            entry.hash = Utils::hashObject("blob", Utils::readFile(name));
+            entry.set_stat(st);
+            index.set(name, entry);
+        }
+        index.save();
+    }
+    double stage_seconds = timer.seconds();
+    std::uintmax_t index_bytes = fs::file_size(".minigit/index");
+
+    std::mt19937_64 rng(3);
+    timer.reset();
+    {
+        bench::Quiet quiet;
+        for (int i = 0; i < adds; ++i) {
+            MiniGit mg; // A fresh instance per add, like a separate process invocation
+            mg.add(names[rng() % names.size()]);
+        }
+    }
+    double noop_ms = timer.seconds() * 1e3 / adds;
+
+    timer.reset();
+    std::size_t entries = 0;
+    Index(".minigit/index").for_each([&entries](const std::string&, const IndexEntry&) { ++entries; });
+    double snapshot_ms = timer.seconds() * 1e3;
+
+    std::cout << "files=" << file_count << " index_bytes=" << index_bytes << "\n"
+              << std::fixed << std::setprecision(3)
+              << "initial_stage_seconds=" << stage_seconds << "\n"
+              << "noop_add_ms=" << noop_ms << "\n"
+              << "full_snapshot_ms=" << snapshot_ms << " (" << entries << " entries)\n";
+    return 0;
+}
@@ -0,0 +1,100 @@
+// Three-way merge of two branches that both edit the same `changes` files, at opposite ends,
+// so every one of them goes through the line-level merge and merges cleanly. The rest of
+// the `files` files are identical on all sides. The merge is timed with 1 worker thread and
+// with the default (one per hardware thread), each from the same starting state.
+//
+// Usage: bench_merge [files] [changes] [file_size]
+
+#include "../thread_pool.h"
+#include "bench_util.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// Applies edit to the content of every path and commits them
+template <typename Edit>
+static void edit_and_commit(const std::vector<std::string>& paths, const std::string& message, Edit edit) {
+    for (const std::string& path : paths) {
+        std::ifstream in(path, std::ios::binary);
+        std::stringstream content;
+        content << in.rdbuf();
+        in.close();
+        std::ofstream(path, std::ios::binary | std::ios::trunc) << edit(content.str());
+    }
+    bench::commit_files(paths, message);
+}
+
+static std::string read_ref(const std::string& branch) {
+    std::ifstream in(".minigit/refs/heads/" + branch);
+    std::string hash;
+    in >> hash;
+    return hash;
+}
+
+int main(int argc, char* argv[]) {
+    bench::RepoShape shape;
+    shape.files = argc > 1 ? std::atoi(argv[1]) : 20000;
+    shape.changes = argc > 2 ? std::atoi(argv[2]) : 4000;
+    shape.file_size = argc > 3 ? std::atoi(argv[3]) : 4096;
+    shape.depth = 0;
+    shape.branches = 0;
+
+    bench::ScratchDir scratch;
+    bench::generate_repo(shape);
+    std::vector<std::string> paths;
+    for (int i = 0; i < shape.changes && i < shape.files; ++i) {
+        paths.push_back(bench::synthetic_path(i * (shape.files / shape.changes)));
+    }
+    {
+        bench::Quiet quiet;
+        MiniGit().branch("topic");
+        MiniGit().checkout("topic");
+    }
+    edit_and_commit(paths, "topic", [](const std::string& text) { return text + "\ntopic_edit = 1\n"; });
+    {
+        bench::Quiet quiet;
+        MiniGit().checkout("main");
+    }
+    edit_and_commit(paths, "main", [](const std::string& text) { return "main_edit = 2\n" + text; });
+    std::string main_before = read_ref("main");
+    {
+        bench::Quiet quiet;
+        MiniGit().branch("main-before");
+    }
+
+    std::cout << "files=" << shape.files << " merged_files=" << paths.size() << " file_size=" << shape.file_size
+              << " hardware_threads=" << ThreadPool::default_threads() << "\n";
+    for (std::string threads : {"1", ""}) {
+        if (threads.empty()) {
+            unsetenv("MINIGIT_THREADS");
+        } else {
+            setenv("MINIGIT_THREADS", threads.c_str(), 1);
+        }
+        bench::Timer timer;
+        std::ostringstream output;
+        {
+            std::streambuf* saved = std::cout.rdbuf(output.rdbuf());
+            MiniGit().merge("topic");
+            std::cout.rdbuf(saved);
+        }
+        double seconds = timer.seconds();
+        bool clean = output.str().find("Merge commit created") != std::string::npos;
+        std::cout << std::fixed << std::setprecision(1) << "threads=" << (threads.empty() ? "default" : threads)
+                  << " merge_ms=" << seconds * 1e3 << " files_per_s=" << paths.size() / seconds
+                  << (clean ? "" : " (merge did not complete cleanly)") << "\n";
+
+        // Back to the state before the merge for the next run
+        bench::Quiet quiet;
+        MiniGit().checkout("main-before");
+        std::ofstream(".minigit/refs/heads/main", std::ios::trunc) << main_before;
+        MiniGit().checkout("main");
+    }
+    return 0;
+}
@@ -0,0 +1,102 @@
+// Line-level three-way merge (Diff::merge3) on generated files. Three cases:
+//   disjoint  - both sides edit, insert and delete lines far apart: merges cleanly, and
+//               the result is checked against the expected text
+//   overlap   - both sides change the same lines differently: one conflict block each
+//   rewrite   - one side rewrites most lines, the worst case for the diff
+// Before the line merge every one of these was a whole-file conflict.
+//
+// Usage: bench_merge3 [lines] [reps]
+
+#include "../diff.h"
+#include "bench_util.h"
+
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+static std::string join(const std::vector<std::string>& lines) {
+    std::string text;
+    for (const std::string& line : lines) {
+        text += line;
+        text += "\n";
+    }
+    return text;
+}
+
+// Runs the merge reps times, prints timing and returns the conflict count
+static size_t run(const char* name, const std::string& base, const std::string& ours,
+                  const std::string& theirs, int reps, std::string& result) {
+    size_t conflicts = 0;
+    bench::Timer timer;
+    for (int rep = 0; rep < reps; ++rep) {
+        conflicts = Diff::merge3(base, ours, theirs, "ours", "theirs", result);
+    }
+    double seconds = timer.seconds() / reps;
+    std::uintmax_t bytes = base.size() + ours.size() + theirs.size();
+    std::cout << std::fixed << std::setprecision(3)
+              << name << "_ms=" << seconds * 1e3
+              << " mb_per_s=" << bench::mb_per_second(bytes, seconds)
+              << " conflicts=" << conflicts << "\n";
+    return conflicts;
+}
+
+int main(int argc, char* argv[]) {
+    int line_count = argc > 1 ? std::atoi(argv[1]) : 100000;
+    int reps = argc > 2 ? std::atoi(argv[2]) : 5;
+
+    std::mt19937_64 rng(42);
+    std::vector<std::string> base(line_count);
+    for (int i = 0; i < line_count; ++i) {
+        base[i] = "    value_" + std::to_string(i) + " = compute(" + std::to_string(rng() % 100000) + ", config.limit);";
+    }
+    std::string base_text = join(base);
+    std::cout << "lines=" << line_count << " bytes=" << base_text.size() << " reps=" << reps << "\n";
+
+    // Disjoint: ours edits lines with i % 100 == 10 and inserts a line every 500;
+    // theirs edits lines with i % 100 == 60 and deletes one line every 700
+    std::vector<std::string> ours, theirs, expected;
+    for (int i = 0; i < line_count; ++i) {
+        if (i % 500 == 10) {
+            ours.push_back("    // ours inserted " + std::to_string(i));
+            expected.push_back(ours.back());
+        }
+        ours.push_back(i % 100 == 10 ? base[i] + " // ours" : base[i]);
+        if (i % 700 == 30) {
+            continue;
+        }
+        theirs.push_back(i % 100 == 60 ? base[i] + " // theirs" : base[i]);
+        expected.push_back(i % 100 == 10 ? ours.back() : theirs.back());
+    }
+    std::string result;
+    size_t conflicts = run("disjoint", base_text, join(ours), join(theirs), reps, result);
+    if (conflicts != 0 || result != join(expected)) {
+        std::cerr << "Error: disjoint merge produced a wrong result" << std::endl;
+        return 1;
+    }
+
+    // Overlap: every 1000th line changed differently on both sides
+    ours = base;
+    theirs = base;
+    for (int i = 0; i < line_count; i += 1000) {
+        ours[i] += " // ours";
+        theirs[i] += " // theirs";
+    }
+    run("overlap", base_text, join(ours), join(theirs), reps, result);
+
+    // Rewrite: theirs changes three lines in four; ours a scattered few
+    ours = base;
+    theirs = base;
+    for (int i = 0; i < line_count; ++i) {
+        if (i % 4 != 0) {
+            theirs[i] = "    rewritten_" + std::to_string(rng() % 1000000) + "();";
+        }
+        if (i % 5000 == 0) {
+            ours[i] += " // ours";
+        }
+    }
+    run("rewrite", base_text, join(ours), join(theirs), reps, result);
+    return 0;
+}
@@ -0,0 +1,99 @@
+// Edits one file many times, then compares loose storage against a repacked
+// store: total bytes and the cost of reading random objects back out.
+//
+// Usage: bench_pack [file_kb] [versions] [reads]
+
+#include "../minigit.h"
+#include "../pack.h"
+#include "../utils.h"
+#include "bench_util.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+int main(int argc, char* argv[]) {
+    std::size_t file_kb = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 256;
+    int versions = argc > 2 ? std::atoi(argv[2]) : 200;
+    int reads = argc > 3 ? std::atoi(argv[3]) : 2000;
+
+    bench::ScratchDir scratch;
+    fs::path objects = scratch.path() / ".minigit" / "objects";
+    std::mt19937_64 rng(7);
+    std::string text = bench::synthetic_text(rng, file_kb * 1024);
+
+    {
+        bench::Quiet quiet;
+        MiniGit mg;
+        mg.init();
+        for (int v = 0; v < versions; ++v) {
+            // Each version rewrites a few lines somewhere in the file
+            for (int edit = 0; edit < 3; ++edit) {
+                std::size_t at = rng() % (text.size() - 32);
+                text.replace(at, 16, "edited " + std::to_string(v) + "       ").resize(file_kb * 1024);
+            }
+            std::ofstream("data.conf", std::ios::binary) << text;
+            mg.add("data.conf");
+            mg.commit("version " + std::to_string(v));
+        }
+    }
+
+    // Loose objects live in fanout directories: objects/ab/cdef... (objects/info holds the commit-graph)
+    std::vector<std::string> loose;
+    for (const auto& entry : fs::recursive_directory_iterator(objects)) {
+        if (entry.is_regular_file() && entry.path().parent_path().filename().string().size() == 2) {
+            loose.push_back(entry.path().parent_path().filename().string() + entry.path().filename().string());
+        }
+    }
+    std::uintmax_t loose_bytes = bench::directory_bytes(objects);
+
+    bench::Timer timer;
+    for (int i = 0; i < reads; ++i) {
+        const std::string& hash = loose[rng() % loose.size()];
+        std::string raw = Utils::readFile((objects / hash.substr(0, 2) / hash.substr(2)).string());
+        std::string content;
+        Utils::decompress(raw, content);
+    }
+    double loose_us = timer.seconds() * 1e6 / reads;
+
+    timer.reset();
+    {
+        bench::Quiet quiet;
+        MiniGit mg;
+        mg.repack();
+    }
+    double repack_seconds = timer.seconds();
+    std::uintmax_t pack_bytes = bench::directory_bytes(objects);
+
+    fs::path idx;
+    for (const auto& entry : fs::directory_iterator(objects / "pack")) {
+        if (entry.path().extension() == ".idx") {
+            idx = entry.path();
+        }
+    }
+    PackReader reader(idx);
+    timer.reset();
+    for (int i = 0; i < reads; ++i) {
+        std::string type;
+        std::string content;
+        if (!reader.read(loose[rng() % loose.size()], type, content)) {
+            std::cerr << "Error: object missing from pack" << std::endl;
+            return 1;
+        }
+    }
+    double pack_us = timer.seconds() * 1e6 / reads;
+
+    std::cout << "file_kb=" << file_kb << " versions=" << versions << " objects=" << loose.size() << "\n"
+              << std::fixed << std::setprecision(1)
+              << "loose_bytes=" << loose_bytes << " pack_bytes=" << pack_bytes
+              << " ratio=" << std::setprecision(4) << static_cast<double>(pack_bytes) / loose_bytes << "\n"
+              << std::setprecision(1) << "repack_seconds=" << repack_seconds << "\n"
+              << "random_read_us loose=" << loose_us << " packed=" << pack_us << "\n";
+    return 0;
+}
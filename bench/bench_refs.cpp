@@ -0,0 +1,77 @@
+// Branch lookups and listing with many branches, first as loose files and then after
+// `pack-refs`. The branches are written as loose ref files directly (like a CI system
+// creating short-lived branches), all pointing at the one commit of a small repository.
+// A lookup is timed through `diff <branch> <branch>`, which resolves both names and then
+// finds nothing to compare; each runs in a fresh MiniGit like a separate command.
+//
+// Usage: bench_refs [branches] [lookups]
+
+#include "bench_util.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+namespace fs = std::filesystem;
+
+static std::string branch_name(int i) {
+    return "ci/job-" + std::to_string(i);
+}
+
+// Mean microseconds per resolve of two random branches
+static double time_lookups(std::mt19937_64& rng, int branches, int lookups) {
+    bench::Timer timer;
+    for (int i = 0; i < lookups; ++i) {
+        bench::Quiet quiet;
+        MiniGit().diff(branch_name(rng() % branches), branch_name(rng() % branches));
+    }
+    return timer.seconds() * 1e6 / lookups;
+}
+
+static double time_list() {
+    bench::Timer timer;
+    {
+        bench::Quiet quiet;
+        MiniGit().branch_list();
+    }
+    return timer.seconds() * 1e3;
+}
+
+int main(int argc, char* argv[]) {
+    int branches = argc > 1 ? std::atoi(argv[1]) : 100000;
+    int lookups = argc > 2 ? std::atoi(argv[2]) : 2000;
+
+    bench::ScratchDir scratch;
+    std::ofstream("file.txt") << "content\n";
+    {
+        bench::Quiet quiet;
+        MiniGit().init();
+    }
+    bench::commit_files({"file.txt"}, "initial");
+    std::string head;
+    std::ifstream(".minigit/refs/heads/main") >> head;
+
+    bench::Timer timer;
+    fs::create_directories(".minigit/refs/heads/ci");
+    for (int i = 0; i < branches; ++i) {
+        std::ofstream(".minigit/refs/heads/" + branch_name(i)) << head;
+    }
+    std::cout << "branches=" << branches << " lookups=" << lookups << std::fixed << std::setprecision(1)
+              << " write_loose_ms=" << timer.seconds() * 1e3 << "\n";
+
+    std::mt19937_64 rng(3);
+    std::cout << "loose  list_ms=" << time_list() << " resolve_us=" << time_lookups(rng, branches, lookups) << "\n";
+
+    timer.reset();
+    {
+        bench::Quiet quiet;
+        MiniGit().pack_refs();
+    }
+    double pack_ms = timer.seconds() * 1e3;
+    std::cout << "packed list_ms=" << time_list() << " resolve_us=" << time_lookups(rng, branches, lookups)
+              << " pack_refs_ms=" << pack_ms << " packed_refs_kb=" << fs::file_size(".minigit/packed-refs") / 1024.0
+              << "\n";
+    return 0;
+}
@@ -0,0 +1,107 @@
+// Resolving abbreviated commit hashes and revision expressions. A history of `commits`
+// commits is generated, and `rev-parse` of random 8-digit abbreviations and of HEAD~n is
+// timed with the objects loose, after `gc` packed them, and with the commit-graph padded
+// to `extra_ids` more commits (random ids, not in the history) to show how a lookup
+// scales with the number of objects. Each lookup runs in a fresh MiniGit like a separate
+// command. full_scan_ms is the cost of listing every object, which a lookup avoids.
+//
+// Usage: bench_revparse [commits] [extra_ids] [lookups]
+
+#include "../commit_graph.h"
+#include "bench_util.h"
+
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// Mean microseconds per rev-parse of each revision
+static double time_rev_parse(const std::vector<std::string>& revisions) {
+    bench::Timer timer;
+    for (const std::string& revision : revisions) {
+        bench::Quiet quiet;
+        MiniGit().rev_parse({revision});
+    }
+    return timer.seconds() * 1e6 / revisions.size();
+}
+
+// Runs rev-parse once and checks that it printed the expected hash
+static bool resolves_to(const std::string& revision, const std::string& hash) {
+    std::ostringstream output;
+    std::streambuf* saved = std::cout.rdbuf(output.rdbuf());
+    MiniGit().rev_parse({revision});
+    std::cout.rdbuf(saved);
+    return output.str() == hash + "\n";
+}
+
+static double full_scan_ms() {
+    bench::Timer timer;
+    std::size_t files = 0;
+    for (const auto& entry : fs::recursive_directory_iterator(".minigit/objects")) {
+        files += entry.is_regular_file();
+    }
+    return files ? timer.seconds() * 1e3 : 0.0;
+}
+
+static void report(const char* label, const std::vector<std::string>& prefixes, const std::vector<std::string>& ancestry) {
+    std::cout << std::fixed << std::setprecision(1) << label << " abbrev_us=" << time_rev_parse(prefixes)
+              << " ancestry_us=" << time_rev_parse(ancestry) << " full_scan_ms=" << full_scan_ms() << "\n";
+}
+
+int main(int argc, char* argv[]) {
+    bench::RepoShape shape;
+    shape.depth = argc > 1 ? std::atoi(argv[1]) : 2000;
+    int extra_ids = argc > 2 ? std::atoi(argv[2]) : 1000000;
+    int lookups = argc > 3 ? std::atoi(argv[3]) : 500;
+    shape.files = 200;
+    shape.changes = 2;
+    shape.file_size = 64;
+    shape.branches = 0;
+
+    bench::ScratchDir scratch;
+    bench::generate_repo(shape);
+    CommitGraph graph(".minigit/objects/info/commit-graph");
+    std::vector<CommitGraph::Record> records;
+    graph.records(records);
+    std::mt19937_64 rng(9);
+    std::vector<std::string> prefixes, ancestry;
+    for (int i = 0; i < lookups; ++i) {
+        const CommitGraph::Record& record = records[rng() % records.size()];
+        prefixes.push_back(record.id.hex().substr(0, 8));
+        ancestry.push_back("HEAD~" + std::to_string(rng() % (shape.depth / 2)));
+    }
+    std::string expected;
+    for (const auto& record : records) {
+        if (record.id.hex().compare(0, 8, prefixes[0]) == 0) {
+            expected = record.id.hex();
+        }
+    }
+    if (!resolves_to(prefixes[0], expected)) {
+        std::cerr << "Error: rev-parse " << prefixes[0] << " did not resolve to " << expected << std::endl;
+        return 1;
+    }
+
+    std::cout << "commits=" << records.size() << " lookups=" << lookups << "\n";
+    report("loose ", prefixes, ancestry);
+    {
+        bench::Quiet quiet;
+        MiniGit().gc();
+    }
+    report("packed", prefixes, ancestry);
+
+    for (int i = 0; i < extra_ids; ++i) {
+        CommitGraph::Record record;
+        for (unsigned char& byte : record.id.bytes) {
+            byte = static_cast<unsigned char>(rng());
+        }
+        records.push_back(record);
+    }
+    CommitGraph::write(".minigit/objects/info/commit-graph", records);
+    std::cout << "graph_ids=" << records.size() << "\n";
+    report("padded", prefixes, ancestry);
+    return 0;
+}
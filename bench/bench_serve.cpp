@@ -0,0 +1,173 @@
+// Commands per second through `minigit serve --stdio` against one process per command.
+// Both run the same cycle of read-only commands (status, log, diff of the last commit,
+// config) on a generated repository, one command at a time like a script would. The
+// server's answers are checked against the output of the separate processes first.
+//
+// Usage: bench_serve [commands] [files] [depth]
+
+#include "bench_util.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <sys/wait.h>
+
+namespace fs = std::filesystem;
+
+// A running `minigit serve --stdio` with pipes to both ends
+class Server {
+public:
+    explicit Server(const std::string& binary) {
+        int to_child[2], from_child[2];
+        if (pipe(to_child) != 0 || pipe(from_child) != 0) {
+            std::cerr << "Error: could not create pipes" << std::endl;
+            exit(1);
+        }
+        pid = fork();
+        if (pid == 0) {
+            dup2(to_child[0], STDIN_FILENO);
+            dup2(from_child[1], STDOUT_FILENO);
+            close(to_child[1]);
+            close(from_child[0]);
+            execl(binary.c_str(), binary.c_str(), "serve", "--stdio", static_cast<char*>(nullptr));
+            _exit(127);
+        }
+        close(to_child[0]);
+        close(from_child[1]);
+        requests = fdopen(to_child[1], "w");
+        responses = fdopen(from_child[0], "r");
+    }
+    ~Server() {
+        std::fputs("quit\n", requests);
+        std::fclose(requests);
+        std::fclose(responses);
+        waitpid(pid, nullptr, 0);
+    }
+
+    // Sends one request and returns its response line
+    std::string request(const std::string& line) {
+        std::fputs((line + "\n").c_str(), requests);
+        std::fflush(requests);
+        std::string response;
+        int c;
+        while ((c = std::fgetc(responses)) != EOF && c != '\n') {
+            response += static_cast<char>(c);
+        }
+        return response;
+    }
+
+private:
+    pid_t pid;
+    FILE* requests;
+    FILE* responses;
+};
+
+// stdout of one command run as its own process
+static std::string process_output(const std::string& binary, const std::string& command) {
+    std::string output;
+    FILE* pipe = popen((binary + " " + command + " 2>/dev/null").c_str(), "r");
+    char buffer[4096];
+    size_t n;
+    while ((n = std::fread(buffer, 1, sizeof(buffer), pipe)) > 0) {
+        output.append(buffer, n);
+    }
+    pclose(pipe);
+    return output;
+}
+
+// The "stdout" field of a response, unescaped (only the escapes the server writes)
+static std::string response_stdout(const std::string& response) {
+    size_t start = response.find("\"stdout\":\"");
+    std::string out;
+    for (size_t i = start + 10; i < response.size() && response[i] != '"'; ++i) {
+        if (response[i] != '\\') {
+            out += response[i];
+            continue;
+        }
+        char escaped = response[++i];
+        if (escaped == 'n') out += '\n';
+        else if (escaped == 't') out += '\t';
+        else if (escaped == 'u') {
+            out += static_cast<char>(std::stoi(response.substr(i + 1, 4), nullptr, 16));
+            i += 4;
+        } else out += escaped;
+    }
+    return out;
+}
+
+int main(int argc, char* argv[]) {
+    int commands = argc > 1 ? std::atoi(argv[1]) : 400;
+    bench::RepoShape shape;
+    shape.files = argc > 2 ? std::atoi(argv[2]) : 2000;
+    shape.depth = argc > 3 ? std::atoi(argv[3]) : 100;
+    shape.file_size = 256;
+    std::string binary = bench::default_minigit_binary();
+    if (!fs::exists(binary)) {
+        std::cerr << "Error: " << binary << " not found (build it with make)" << std::endl;
+        return 1;
+    }
+
+    bench::ScratchDir scratch;
+    bench::generate_repo(shape);
+    // The diff is of the last commit (its parent is the second commit `log` lists)
+    std::string log = process_output(binary, "log");
+    size_t first = log.find("\ncommit ");
+    size_t second = log.find("\ncommit ", first + 1);
+    std::string tip = log.substr(first + 8, 40);
+    std::string parent = log.substr(second + 8, 40);
+    std::vector<std::string> cycle = {"status", "log", "diff " + parent + " " + tip, "config core.compression"};
+
+    {
+        Server server(binary);
+        for (const std::string& command : cycle) {
+            std::string response = server.request(command);
+            if (response.find("\"ok\":true") == std::string::npos ||
+                response_stdout(response) != process_output(binary, command)) {
+                std::cerr << "Error: serve answered '" << command << "' differently: " << response.substr(0, 200) << std::endl;
+                return 1;
+            }
+        }
+    }
+
+    std::cout << "files=" << shape.files << " commits=" << shape.depth << " commands=" << commands
+              << std::fixed << std::setprecision(1) << "\n";
+    std::vector<double> spawn_ms(cycle.size()), serve_ms(cycle.size());
+    bench::Timer timer;
+    for (int i = 0; i < commands; ++i) {
+        bench::Timer one;
+        std::vector<std::string> args;
+        std::string command = cycle[i % cycle.size()];
+        for (size_t pos = 0, end; pos < command.size(); pos = end + 1) {
+            end = command.find(' ', pos);
+            if (end == std::string::npos) end = command.size();
+            args.push_back(command.substr(pos, end - pos));
+        }
+        bench::run_program(binary, args);
+        spawn_ms[i % cycle.size()] += one.seconds() * 1e3;
+    }
+    double spawn_seconds = timer.seconds();
+
+    Server server(binary);
+    server.request("status"); // Start-up, outside the timing like a warm server
+    timer.reset();
+    for (int i = 0; i < commands; ++i) {
+        bench::Timer one;
+        server.request(cycle[i % cycle.size()]);
+        serve_ms[i % cycle.size()] += one.seconds() * 1e3;
+    }
+    double serve_seconds = timer.seconds();
+
+    int per_command = commands / static_cast<int>(cycle.size());
+    for (size_t c = 0; c < cycle.size(); ++c) {
+        std::cout << std::setprecision(3) << "  " << cycle[c].substr(0, cycle[c].find(' '))
+                  << "_ms process=" << spawn_ms[c] / per_command << " serve=" << serve_ms[c] / per_command << "\n";
+    }
+    std::cout << std::setprecision(1) << "process_per_command_cps=" << commands / spawn_seconds
+              << " serve_cps=" << commands / serve_seconds
+              << " speedup=" << std::setprecision(2) << spawn_seconds / serve_seconds << "x\n";
+    return 0;
+}
@@ -0,0 +1,99 @@
+// Heap allocations and peak heap use of merge and checkout on a large snapshot. Global
+// operator new/delete are replaced to count every allocation made by MiniGit in this
+// process. The repository has `files` files; a topic branch and main each rewrite
+// `changes` of them, then checkout switches from topic to main and main merges topic.
+//
+// Usage: bench_snapshot [files] [changes]
+
+#include "bench_util.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <malloc.h> // For malloc_usable_size
+#include <new>
+#include <string>
+#include <vector>
+
+namespace {
+std::atomic<std::uint64_t> allocations(0);
+std::atomic<std::uint64_t> allocated_bytes(0);
+std::atomic<std::int64_t> live_bytes(0);
+std::atomic<std::int64_t> peak_live_bytes(0);
+
+void* counted_alloc(std::size_t size) {
+    void* p = std::malloc(size ? size : 1);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    std::size_t usable = malloc_usable_size(p);
+    ++allocations;
+    allocated_bytes += usable;
+    std::int64_t live = live_bytes += static_cast<std::int64_t>(usable);
+    std::int64_t peak = peak_live_bytes.load();
+    while (live > peak && !peak_live_bytes.compare_exchange_weak(peak, live)) {
+    }
+    return p;
+}
+
+void counted_free(void* p) {
+    if (p) {
+        live_bytes -= static_cast<std::int64_t>(malloc_usable_size(p));
+        std::free(p);
+    }
+}
+} // namespace
+
+void* operator new(std::size_t size) { return counted_alloc(size); }
+void* operator new[](std::size_t size) { return counted_alloc(size); }
+void operator delete(void* p) noexcept { counted_free(p); }
+void operator delete[](void* p) noexcept { counted_free(p); }
+void operator delete(void* p, std::size_t) noexcept { counted_free(p); }
+void operator delete[](void* p, std::size_t) noexcept { counted_free(p); }
+
+// Runs fn in a fresh MiniGit (like one CLI invocation) and prints its allocation profile
+template <typename Fn>
+static void measure(const char* name, Fn fn) {
+    std::uint64_t start_allocations = allocations;
+    std::uint64_t start_bytes = allocated_bytes;
+    std::int64_t start_live = live_bytes;
+    peak_live_bytes = start_live;
+    bench::Timer timer;
+    {
+        bench::Quiet quiet;
+        MiniGit mg;
+        fn(mg);
+    }
+    double seconds = timer.seconds();
+    std::cout << std::fixed << std::setprecision(1) << name << "_ms=" << seconds * 1e3
+              << " allocations=" << allocations - start_allocations
+              << " allocated_mb=" << (allocated_bytes - start_bytes) / (1024.0 * 1024.0)
+              << " peak_heap_mb=" << (peak_live_bytes - start_live) / (1024.0 * 1024.0) << "\n";
+}
+
+int main(int argc, char* argv[]) {
+    bench::RepoShape shape;
+    shape.files = argc > 1 ? std::atoi(argv[1]) : 200000;
+    shape.changes = argc > 2 ? std::atoi(argv[2]) : 100;
+    shape.file_size = 64;
+    shape.depth = 0;
+    shape.branches = 0;
+
+    bench::ScratchDir scratch;
+    bench::generate_repo(shape);
+    std::mt19937_64 rng(7);
+    {
+        bench::Quiet quiet;
+        MiniGit().branch("topic");
+        MiniGit().checkout("topic");
+    }
+    // Topic rewrites files of group 1 and main those of group 0, so the merge is clean
+    bench::commit_files(bench::rewrite_files(rng, shape, 1, 2, shape.changes), "topic");
+
+    std::cout << "files=" << shape.files << " changes_per_side=" << shape.changes << "\n";
+    measure("checkout", [](MiniGit& mg) { mg.checkout("main"); });
+    bench::commit_files(bench::rewrite_files(rng, shape, 0, 2, shape.changes), "main");
+    measure("merge", [](MiniGit& mg) { mg.merge("topic"); });
+    return 0;
+}
@@ -0,0 +1,139 @@
+// `status` on a large clean tree, and after touching or modifying a few files. Status
+// walks the tree with the parallel scanner and only hashes files whose stat data no
+// longer matches the index; touched files that still hash the same are written back
+// to the index, so the following run skips them again. The last part runs the same
+// with `minigit daemon` watching the tree, where status only looks at changed paths.
+//
+// Usage: bench_status [file_count] [runs] [threads...]
+
+#include "../minigit.h"
+#include "../fsmonitor.h"
+#include "bench_util.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/time.h> // For utimes
+
+namespace fs = std::filesystem;
+
+// Runs status in a fresh instance (like a CLI invocation) with the given thread count
+static double time_status(const std::string& threads, std::string* output = nullptr) {
+    setenv("MINIGIT_THREADS", threads.c_str(), 1);
+    std::ostringstream sink;
+    std::streambuf* previous = std::cout.rdbuf(sink.rdbuf());
+    bench::Timer timer;
+    {
+        MiniGit mg;
+        mg.status();
+    }
+    double seconds = timer.seconds();
+    std::cout.rdbuf(previous);
+    if (output) {
+        *output = sink.str();
+    }
+    return seconds;
+}
+
+int main(int argc, char* argv[]) {
+    int file_count = argc > 1 ? std::atoi(argv[1]) : 100000;
+    int runs = argc > 2 ? std::atoi(argv[2]) : 5;
+    std::vector<std::string> thread_counts;
+    for (int i = 3; i < argc; ++i) {
+        thread_counts.push_back(argv[i]);
+    }
+    if (thread_counts.empty()) {
+        thread_counts = {"1", std::to_string(std::max<size_t>(2, std::thread::hardware_concurrency()))};
+    }
+
+    bench::ScratchDir scratch;
+    std::vector<std::string> names;
+    for (int i = 0; i < file_count; ++i) {
+        fs::path dir = fs::path("d" + std::to_string(i / 1000)) / ("e" + std::to_string((i / 100) % 10));
+        fs::create_directories(dir);
+        names.push_back((dir / ("f" + std::to_string(i) + ".txt")).string());
+        std::ofstream(names.back(), std::ios::binary) << "content " << i << "\n";
+    }
+    {
+        bench::Quiet quiet;
+        MiniGit mg;
+        mg.init();
+        mg.add(std::vector<std::string>{"."});
+        mg.commit("initial");
+    }
+
+    std::cout << "files=" << file_count << " runs=" << runs << " cores=" << std::thread::hardware_concurrency() << "\n"
+              << std::fixed << std::setprecision(3);
+    for (const std::string& threads : thread_counts) {
+        time_status(threads); // Warm the page and dentry caches
+        double total = 0;
+        for (int run = 0; run < runs; ++run) {
+            total += time_status(threads);
+        }
+        std::cout << "clean_status_ms threads=" << threads << " " << total * 1e3 / runs << "\n";
+    }
+
+    // 100 touched files (same content, new mtime) and 10 modified ones
+    struct timeval later[2];
+    gettimeofday(&later[0], nullptr);
+    later[0].tv_sec += 10;
+    later[1] = later[0];
+    for (int i = 0; i < 100; ++i) {
+        utimes(names[(static_cast<size_t>(i) * 997) % names.size()].c_str(), later);
+    }
+    for (int i = 0; i < 10; ++i) {
+        std::ofstream(names[(static_cast<size_t>(i) * 7919) % names.size()], std::ios::binary) << "modified " << i << "\n";
+    }
+    const std::string& threads = thread_counts.back();
+    std::string output;
+    double first = time_status(threads, &output);
+    double second = time_status(threads);
+    size_t reported = 0;
+    for (size_t pos = output.find("modified:"); pos != std::string::npos; pos = output.find("modified:", pos + 1)) {
+        ++reported;
+    }
+    if (reported != 10) {
+        std::cerr << "Error: expected 10 modified files, status reported " << reported << std::endl;
+        return 1;
+    }
+    std::cout << "dirty_status_ms first=" << first * 1e3 << " (re-hashes 110, refreshes the index) next=" << second * 1e3 << "\n";
+
+    // Same again with the daemon: the first status scans once to get a token
+    FsMonitor monitor(fs::current_path());
+    std::thread daemon([&monitor] {
+        bench::Quiet quiet;
+        monitor.run();
+    });
+    std::string token;
+    std::vector<std::string> changed;
+    bool reset;
+    while (!FsMonitor::query(fs::current_path(), "", token, changed, reset)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    time_status(threads);
+    double total = 0;
+    for (int run = 0; run < runs; ++run) {
+        total += time_status(threads);
+    }
+    for (int i = 0; i < 10; ++i) {
+        std::ofstream(names[(static_cast<size_t>(i) * 7919 + 1) % names.size()], std::ios::binary) << "again " << i << "\n";
+    }
+    double dirty = time_status(threads, &output);
+    FsMonitor::stop(fs::current_path());
+    daemon.join();
+    reported = 0;
+    for (size_t pos = output.find("modified:"); pos != std::string::npos; pos = output.find("modified:", pos + 1)) {
+        ++reported;
+    }
+    if (reported != 20) {
+        std::cerr << "Error: expected 20 modified files with the daemon, status reported " << reported << std::endl;
+        return 1;
+    }
+    std::cout << "daemon_status_ms clean=" << total * 1e3 / runs << " after_10_writes=" << dirty * 1e3 << "\n";
+    return 0;
+}
@@ -0,0 +1,271 @@
+// End-to-end benchmark suite, run by `make bench`. Generates a synthetic repository
+// (bench::generate_repo) and times the minigit binary on it: status, log, diff, checkout,
+// merge, add and commit. Every run is a separate process, so the numbers include start-up
+// and exit like a real invocation, and the peak RSS and I/O belong to that run alone.
+// Each operation gets untimed warmup runs first; an untimed setup step before every run
+// puts the repository back into the state the operation needs.
+//
+// Reported per operation: wall time (min/median/mean/max), peak RSS (largest over the
+// runs), and bytes read and written through system calls (mean over the runs; files
+// read through mmap, such as the index and packs, are not counted). The results are
+// printed as a table and, with --json, written as JSON for tracking across builds.
+//
+// Usage: bench_suite [--files N] [--file-size BYTES] [--depth N] [--branches N]
+//                    [--branch-commits N] [--changes N] [--seed N] [--warmup N] [--reps N]
+//                    [--json PATH] [--label TEXT] [--minigit PATH] [--out DIR]
+// --out generates the repository into DIR and keeps it; no timings are taken.
+
+#include "bench_util.h"
+
+#include <algorithm>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+struct Operation {
+    std::string name;
+    std::function<void(int)> setup;                     // Untimed, before run i
+    std::function<std::vector<std::string>(int)> args;  // Command line of run i
+};
+
+static std::string minigit_binary;
+
+static bool run_minigit(const std::vector<std::string>& args, bench::Sample* sample = nullptr) {
+    return bench::run_program(minigit_binary, args, sample);
+}
+
+// Runs the command, failing the suite if it does not succeed
+static void must_run(const std::vector<std::string>& args) {
+    if (!run_minigit(args)) {
+        std::cerr << "Error: minigit " << args[0] << " failed" << std::endl;
+        exit(1);
+    }
+}
+
+static std::string read_ref(const std::string& branch) {
+    std::ifstream in(".minigit/refs/heads/" + branch);
+    std::string hash;
+    in >> hash;
+    return hash;
+}
+
+struct Result {
+    std::string name;
+    std::vector<double> ms;  // Sorted
+    double mean_ms = 0;
+    long peak_rss_kb = 0;
+    std::uint64_t read_bytes = 0;
+    std::uint64_t written_bytes = 0;
+};
+
+static Result measure(const Operation& op, int warmup, int reps) {
+    Result result;
+    result.name = op.name;
+    std::uint64_t read_total = 0, written_total = 0;
+    for (int i = 0; i < warmup + reps; ++i) {
+        if (op.setup) {
+            op.setup(i);
+        }
+        bench::Sample sample;
+        std::vector<std::string> args = op.args(i);
+        if (!run_minigit(args, &sample)) {
+            std::cerr << "Error: minigit " << args[0] << " failed during " << op.name << std::endl;
+            exit(1);
+        }
+        if (i < warmup) {
+            continue;
+        }
+        result.ms.push_back(sample.seconds * 1e3);
+        result.peak_rss_kb = std::max(result.peak_rss_kb, sample.peak_rss_kb);
+        read_total += sample.read_bytes;
+        written_total += sample.written_bytes;
+    }
+    std::sort(result.ms.begin(), result.ms.end());
+    for (double ms : result.ms) {
+        result.mean_ms += ms / reps;
+    }
+    result.read_bytes = read_total / reps;
+    result.written_bytes = written_total / reps;
+    return result;
+}
+
+static std::string json_string(const std::string& text) {
+    std::string out = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+        }
+        if (static_cast<unsigned char>(c) >= 0x20) {
+            out += c;
+        }
+    }
+    return out + "\"";
+}
+
+static void write_json(std::ostream& out, const std::string& label, const bench::RepoShape& shape,
+                       int warmup, int reps, double generate_seconds, std::uintmax_t repo_bytes,
+                       const std::vector<Result>& results) {
+    out << std::fixed << std::setprecision(3)
+        << "{\n"
+        << "  \"label\": " << json_string(label) << ",\n"
+        << "  \"timestamp\": " << std::time(nullptr) << ",\n"
+        << "  \"compiler\": " << json_string(__VERSION__) << ",\n"
+        << "  \"cores\": " << std::thread::hardware_concurrency() << ",\n"
+        << "  \"shape\": {\"files\": " << shape.files << ", \"file_size\": " << shape.file_size
+        << ", \"depth\": " << shape.depth << ", \"branches\": " << shape.branches
+        << ", \"branch_commits\": " << shape.branch_commits << ", \"changes\": " << shape.changes
+        << ", \"seed\": " << shape.seed << "},\n"
+        << "  \"warmup\": " << warmup << ",\n"
+        << "  \"reps\": " << reps << ",\n"
+        << "  \"generate_ms\": " << generate_seconds * 1e3 << ",\n"
+        << "  \"repo_bytes\": " << repo_bytes << ",\n"
+        << "  \"operations\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result& r = results[i];
+        out << "    {\"name\": " << json_string(r.name)
+            << ", \"wall_ms\": {\"min\": " << r.ms.front() << ", \"median\": " << r.ms[r.ms.size() / 2]
+            << ", \"mean\": " << r.mean_ms << ", \"max\": " << r.ms.back() << "}"
+            << ", \"peak_rss_kb\": " << r.peak_rss_kb << ", \"read_bytes\": " << r.read_bytes
+            << ", \"written_bytes\": " << r.written_bytes << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+}
+
+int main(int argc, char* argv[]) {
+    bench::RepoShape shape;
+    int warmup = 1;
+    int reps = 5;
+    std::string json_path, label, out_dir;
+    minigit_binary = bench::default_minigit_binary();
+    for (int i = 1; i < argc; ++i) {
+        std::string flag = argv[i];
+        if (i + 1 >= argc) {
+            std::cerr << "Error: " << flag << " needs a value" << std::endl;
+            return 1;
+        }
+        std::string value = argv[++i];
+        if (flag == "--files") shape.files = std::atoi(value.c_str());
+        else if (flag == "--file-size") shape.file_size = std::strtoull(value.c_str(), nullptr, 10);
+        else if (flag == "--depth") shape.depth = std::atoi(value.c_str());
+        else if (flag == "--branches") shape.branches = std::atoi(value.c_str());
+        else if (flag == "--branch-commits") shape.branch_commits = std::atoi(value.c_str());
+        else if (flag == "--changes") shape.changes = std::atoi(value.c_str());
+        else if (flag == "--seed") shape.seed = std::strtoull(value.c_str(), nullptr, 10);
+        else if (flag == "--warmup") warmup = std::atoi(value.c_str());
+        else if (flag == "--reps") reps = std::atoi(value.c_str());
+        else if (flag == "--json") json_path = value;
+        else if (flag == "--label") label = value;
+        else if (flag == "--minigit") minigit_binary = fs::absolute(value).string();
+        else if (flag == "--out") out_dir = value;
+        else {
+            std::cerr << "Error: unknown option " << flag << std::endl;
+            return 1;
+        }
+    }
+    if (shape.files <= shape.branches + 1 || shape.depth < 1 || shape.branches < 0 || shape.changes < 1 || reps < 1 || warmup < 0) {
+        std::cerr << "Error: need files > branches + 1, depth >= 1, changes >= 1 and reps >= 1" << std::endl;
+        return 1;
+    }
+    if (json_path.size()) {
+        json_path = fs::absolute(json_path).string();
+    }
+
+    bench::Timer timer;
+    if (!out_dir.empty()) {
+        fs::create_directories(out_dir);
+        fs::current_path(out_dir);
+        bench::generate_repo(shape);
+        std::cout << "Generated " << shape.files << " files and " << shape.depth << " commits in "
+                  << fs::current_path().string() << " (" << timer.seconds() << " s)\n";
+        return 0;
+    }
+    if (!fs::exists(minigit_binary)) {
+        std::cerr << "Error: " << minigit_binary << " not found (build it with make, or pass --minigit)" << std::endl;
+        return 1;
+    }
+    bench::ScratchDir scratch;
+    bench::generate_repo(shape);
+    double generate_seconds = timer.seconds();
+    std::uintmax_t repo_bytes = bench::directory_bytes(".minigit");
+
+    // An unmerged topic branch and the main commit it will be merged into
+    std::mt19937_64 rng(shape.seed + 1);
+    int groups = shape.branches + 1;
+    must_run({"branch", "bench-topic"});
+    must_run({"checkout", "bench-topic"});
+    for (int k = 1; k <= shape.branch_commits; ++k) {
+        bench::commit_files(bench::rewrite_files(rng, shape, groups - 1, groups, shape.changes), "topic " + std::to_string(k));
+    }
+    must_run({"checkout", "main"});
+    std::string previous_main = read_ref("main");
+    bench::commit_files(bench::rewrite_files(rng, shape, 0, groups, shape.changes), "main before bench-topic");
+    std::string merge_base = read_ref("main");
+    if (groups == 1) {
+        std::cerr << "Warning: with no branches the topic and main share files; merges may conflict" << std::endl;
+    }
+
+    std::vector<Operation> ops;
+    ops.push_back({"status", nullptr, [](int) { return std::vector<std::string>{"status"}; }});
+    ops.push_back({"log", nullptr, [](int) { return std::vector<std::string>{"log"}; }});
+    ops.push_back({"diff", nullptr, [&](int) { return std::vector<std::string>{"diff", previous_main, merge_base}; }});
+    ops.push_back({"checkout", nullptr, [](int i) {
+        return std::vector<std::string>{"checkout", i % 2 == 0 ? "bench-topic" : "main"};
+    }});
+    ops.push_back({"merge", [&](int i) {
+        must_run({"checkout", merge_base});
+        must_run({"branch", "bench-merge-" + std::to_string(i)});
+        must_run({"checkout", "bench-merge-" + std::to_string(i)});
+    }, [](int) { return std::vector<std::string>{"merge", "bench-topic"}; }});
+    ops.push_back({"add", [&](int) {
+        bench::rewrite_files(rng, shape, 0, groups, shape.changes);
+    }, [](int) { return std::vector<std::string>{"add", "."}; }});
+    ops.push_back({"commit", [&](int) {
+        std::vector<std::string> args{"add"};
+        for (const std::string& path : bench::rewrite_files(rng, shape, 0, groups, shape.changes)) {
+            args.push_back(path);
+        }
+        must_run(args);
+    }, [](int i) { return std::vector<std::string>{"commit", "-m", "bench " + std::to_string(i)}; }});
+
+    std::vector<Result> results;
+    for (const Operation& op : ops) {
+        results.push_back(measure(op, warmup, reps));
+        if (op.name == "checkout") {
+            must_run({"checkout", "main"});
+        } else if (op.name == "merge" && read_ref("bench-merge-" + std::to_string(warmup + reps - 1)) == merge_base) {
+            std::cerr << "Error: merge did not create a merge commit" << std::endl;
+            return 1;
+        }
+    }
+
+    std::cout << "files=" << shape.files << " file_size=" << shape.file_size << " depth=" << shape.depth
+              << " branches=" << shape.branches << " warmup=" << warmup << " reps=" << reps
+              << std::fixed << std::setprecision(3) << " generate_s=" << generate_seconds
+              << " repo_mb=" << repo_bytes / (1024.0 * 1024.0) << "\n"
+              << std::left << std::setw(10) << "operation" << std::right << std::setw(12) << "median_ms"
+              << std::setw(12) << "min_ms" << std::setw(12) << "max_ms" << std::setw(12) << "rss_kb"
+              << std::setw(14) << "read_kb" << std::setw(14) << "written_kb" << "\n";
+    for (const Result& r : results) {
+        std::cout << std::left << std::setw(10) << r.name << std::right << std::setw(12) << r.ms[r.ms.size() / 2]
+                  << std::setw(12) << r.ms.front() << std::setw(12) << r.ms.back() << std::setw(12) << r.peak_rss_kb
+                  << std::setw(14) << r.read_bytes / 1024.0 << std::setw(14) << r.written_bytes / 1024.0 << "\n";
+    }
+    if (!json_path.empty()) {
+        std::ofstream out(json_path);
+        write_json(out, label, shape, warmup, reps, generate_seconds, repo_bytes, results);
+        if (!out) {
+            std::cerr << "Error: could not write " << json_path << std::endl;
+            return 1;
+        }
+        std::cout << "Wrote " << json_path << "\n";
+    }
+    return 0;
+}
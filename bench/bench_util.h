@@ -0,0 +1,256 @@
+#ifndef BENCH_UTIL_H
+#define BENCH_UTIL_H
+
+// Small helpers shared by the benchmark programs in bench/.
+// Each benchmark drives the MiniGit class directly inside a scratch repository.
+
+#include "../minigit.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/resource.h> // For wait4
+#include <sys/wait.h>
+#include <unistd.h>   // For mkdtemp, fork, execv
+
+namespace bench {
+
+namespace fs = std::filesystem;
+
+// Wall-clock stopwatch reporting seconds
+class Timer {
+public:
+    Timer() : start(std::chrono::steady_clock::now()) {}
+    void reset() { start = std::chrono::steady_clock::now(); }
+    double seconds() const {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+private:
+    std::chrono::steady_clock::time_point start;
+};
+
+// Creates a scratch directory under /tmp, makes it the working directory
+// (MiniGit always operates on the current directory) and removes it afterwards
+class ScratchDir {
+public:
+    ScratchDir() : previous(fs::current_path()) {
+        char tmpl[] = "/tmp/minigit-bench-XXXXXX";
+        if (mkdtemp(tmpl) == nullptr) {
+            std::cerr << "Error: could not create scratch directory" << std::endl;
+            exit(1);
+        }
+        dir = tmpl;
+        fs::current_path(dir);
+    }
+    ~ScratchDir() {
+        fs::current_path(previous);
+        fs::remove_all(dir);
+    }
+    const fs::path& path() const { return dir; }
+
+private:
+    fs::path previous;
+    fs::path dir;
+};
+
+// Silences std::cout and std::cerr while alive; MiniGit reports every step it takes
+class Quiet {
+public:
+    Quiet() : out(std::cout.rdbuf(sink.rdbuf())), err(std::cerr.rdbuf(sink.rdbuf())) {}
+    ~Quiet() {
+        std::cout.rdbuf(out);
+        std::cerr.rdbuf(err);
+    }
+
+private:
+    std::ostringstream sink;
+    std::streambuf* out;
+    std::streambuf* err;
+};
+
+// Total size in bytes of all regular files below a directory
+inline std::uintmax_t directory_bytes(const fs::path& dir) {
+    std::uintmax_t total = 0;
+    for (const auto& entry : fs::recursive_directory_iterator(dir)) {
+        if (entry.is_regular_file()) {
+            total += entry.file_size();
+        }
+    }
+    return total;
+}
+
+// Deterministic text that looks like a config file: repeated keys, varying values
+inline std::string synthetic_text(std::mt19937_64& rng, std::size_t bytes) {
+    static const char* keys[] = {"listen_port", "max_connections", "log_level", "timeout_ms",
+                                 "upstream_host", "cache_size", "enable_tls", "worker_threads"};
+    std::string text;
+    text.reserve(bytes + 64);
+    while (text.size() < bytes) {
+        text += keys[rng() % 8];
+        text += " = ";
+        text += std::to_string(rng() % 100000);
+        text += "\n";
+    }
+    text.resize(bytes);
+    return text;
+}
+
+// Throughput in MB/s, guarding against a zero duration
+inline double mb_per_second(std::uintmax_t bytes, double seconds) {
+    return seconds > 0 ? (bytes / (1024.0 * 1024.0)) / seconds : 0.0;
+}
+
+// One run of a program: wall time, peak RSS and bytes read and written through system calls
+struct Sample {
+    double seconds = 0;
+    long peak_rss_kb = 0;
+    std::uint64_t read_bytes = 0;
+    std::uint64_t written_bytes = 0;
+};
+
+// The minigit binary `make` builds next to bench/
+inline std::string default_minigit_binary() {
+    return (fs::read_symlink("/proc/self/exe").parent_path().parent_path() / "minigit").string();
+}
+
+// Runs a program with args, output discarded, and fills sample if given. The child is
+// left a zombie until its /proc/<pid>/io has been read, then reaped for its resource usage.
+inline bool run_program(const std::string& program, const std::vector<std::string>& args, Sample* sample = nullptr) {
+    std::vector<char*> argv{const_cast<char*>(program.c_str())};
+    for (const std::string& arg : args) {
+        argv.push_back(const_cast<char*>(arg.c_str()));
+    }
+    argv.push_back(nullptr);
+
+    bench::Timer timer;
+    pid_t pid = fork();
+    if (pid < 0) {
+        return false;
+    }
+    if (pid == 0) {
+        int null_fd = open("/dev/null", O_WRONLY);
+        dup2(null_fd, STDOUT_FILENO);
+        dup2(null_fd, STDERR_FILENO);
+        execv(argv[0], argv.data());
+        _exit(127);
+    }
+    siginfo_t info;
+    waitid(P_PID, pid, &info, WEXITED | WNOWAIT);
+    double seconds = timer.seconds();
+    std::ifstream io("/proc/" + std::to_string(pid) + "/io");
+    std::string key;
+    std::uint64_t value;
+    std::uint64_t rchar = 0, wchar = 0;
+    while (io >> key >> value) {
+        if (key == "rchar:") {
+            rchar = value;
+        } else if (key == "wchar:") {
+            wchar = value;
+        }
+    }
+    int status;
+    struct rusage usage;
+    wait4(pid, &status, 0, &usage);
+    if (sample) {
+        sample->seconds = seconds;
+        sample->peak_rss_kb = usage.ru_maxrss;
+        sample->read_bytes = rchar;
+        sample->written_bytes = wchar;
+    }
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// Shape of a synthetic repository built by generate_repo
+struct RepoShape {
+    int files = 10000;            // Files in the initial commit
+    std::size_t file_size = 1024; // Bytes per file
+    int depth = 50;               // Commits on main after the initial one
+    int branches = 4;             // Feature branches merged back into main along the way
+    int branch_commits = 3;       // Commits on each feature branch
+    int changes = 20;             // Files rewritten by each commit
+    std::uint64_t seed = 1;
+};
+
+// Path of synthetic file i: 100 files per directory, ten directories per parent
+inline std::string synthetic_path(int i) {
+    return "d" + std::to_string(i / 1000) + "/e" + std::to_string((i / 100) % 10) + "/f" + std::to_string(i) + ".txt";
+}
+
+// Rewrites `count` random files of one group and returns their paths. The files are split
+// into `groups` groups by index, so commits to different groups never touch the same file.
+inline std::vector<std::string> rewrite_files(std::mt19937_64& rng, const RepoShape& shape, int group, int groups, int count) {
+    std::vector<std::string> paths;
+    int members = (shape.files - group + groups - 1) / groups;
+    for (int k = 0; k < count && members > 0; ++k) {
+        paths.push_back(synthetic_path(static_cast<int>(rng() % members) * groups + group));
+        std::ofstream(paths.back(), std::ios::binary) << synthetic_text(rng, shape.file_size);
+    }
+    return paths;
+}
+
+// Stages the given paths and commits them, each step in a fresh MiniGit like a CLI call
+inline void commit_files(const std::vector<std::string>& paths, const std::string& message) {
+    Quiet quiet;
+    MiniGit().add(paths);
+    MiniGit().commit(message);
+}
+
+// Builds the repository described by shape in the current directory. Main gets `depth`
+// commits; feature branch b forks after commit (b + 1) * depth / (branches + 1), gets
+// `branch_commits` commits, and is merged back after one more commit on main. Main only
+// rewrites files of group 0 and branch b only those of group b + 1, so every merge is clean.
+// The same shape and seed always give the same files.
+inline void generate_repo(const RepoShape& shape) {
+    std::mt19937_64 rng(shape.seed);
+    for (int i = 0; i < shape.files; ++i) {
+        std::string path = synthetic_path(i);
+        fs::create_directories(fs::path(path).parent_path());
+        std::ofstream(path, std::ios::binary) << synthetic_text(rng, shape.file_size);
+    }
+    {
+        Quiet quiet;
+        MiniGit().init();
+        MiniGit().add(std::vector<std::string>{"."});
+        MiniGit().commit("initial");
+    }
+
+    int groups = shape.branches + 1;
+    int next_branch = 0;
+    for (int c = 1; c <= shape.depth; ++c) {
+        commit_files(rewrite_files(rng, shape, 0, groups, shape.changes), "main " + std::to_string(c));
+        while (next_branch < shape.branches && c >= (next_branch + 1) * shape.depth / groups) {
+            std::string name = "feature-" + std::to_string(next_branch);
+            {
+                Quiet quiet;
+                MiniGit().branch(name);
+                MiniGit().checkout(name);
+            }
+            for (int k = 1; k <= shape.branch_commits; ++k) {
+                commit_files(rewrite_files(rng, shape, next_branch + 1, groups, shape.changes), name + " " + std::to_string(k));
+            }
+            {
+                Quiet quiet;
+                MiniGit().checkout("main");
+            }
+            commit_files(rewrite_files(rng, shape, 0, groups, shape.changes), "main before " + name);
+            {
+                Quiet quiet;
+                MiniGit().merge(name);
+            }
+            ++next_branch;
+        }
+    }
+}
+
+} // namespace bench
+
+#endif // BENCH_UTIL_H
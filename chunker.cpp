@@ -0,0 +1,55 @@
+#include "chunker.h"
+
+namespace
+{
+
+// Masks over the top bits, which depend on the last 64 bytes: 2 bits stricter than the
+// average's 16 before it, 2 bits looser after it
+const uint64_t MASK_SMALL = ~0ULL << (64 - 18);
+const uint64_t MASK_LARGE = ~0ULL << (64 - 14);
+
+// 256 fixed pseudo-random values (splitmix64), one per byte value
+struct GearTable
+{
+    uint64_t values[256];
+    GearTable()
+    {
+        uint64_t state = 0x6d696e69676974ULL; // "minigit"
+        for (uint64_t &value : values)
+        {
+            uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+            value = z ^ (z >> 31);
+        }
+    }
+};
+
+const GearTable gear;
+
+} // namespace
+
+size_t Chunker::next_cut(const unsigned char *data, size_t length)
+{
+    if (length <= MIN_SIZE)
+    {
+        return length;
+    }
+    size_t end = length < MAX_SIZE ? length : MAX_SIZE;
+    size_t normal = end < AVERAGE_SIZE ? end : AVERAGE_SIZE;
+    uint64_t hash = 0;
+    size_t i = MIN_SIZE; // No cut can fall inside the minimum size, so it is not hashed
+    for (; i < normal; ++i)
+    {
+        hash = (hash << 1) + gear.values[data[i]];
+        if ((hash & MASK_SMALL) == 0)
+            return i + 1;
+    }
+    for (; i < end; ++i)
+    {
+        hash = (hash << 1) + gear.values[data[i]];
+        if ((hash & MASK_LARGE) == 0)
+            return i + 1;
+    }
+    return end;
+}
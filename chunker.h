@@ -0,0 +1,23 @@
+#ifndef CHUNKER_H
+#define CHUNKER_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Content-defined chunking (FastCDC) for large files. A gear hash rolls over the bytes and a
+// chunk ends where its top bits are all zero, so boundaries depend only on the nearby
+// content: an insert or append moves the boundaries around the edit and nowhere else, and
+// every other chunk keeps its id. Chunks shorter than the average face a stricter mask than
+// longer ones (normalized chunking), which keeps sizes close to the average.
+class Chunker {
+public:
+    static const size_t MIN_SIZE = 16 * 1024;
+    static const size_t AVERAGE_SIZE = 64 * 1024;
+    static const size_t MAX_SIZE = 256 * 1024;
+
+    // Length of the chunk that starts at data, given the length bytes available from there.
+    // Returns length when the data ends before a boundary (only final at the end of the file).
+    static size_t next_cut(const unsigned char* data, size_t length);
+};
+
+#endif // CHUNKER_H
@@ -0,0 +1,180 @@
+#include "commit_cache.h"
+#include "commit_graph.h"
+#include "trace.h"
+#include <algorithm>
+
+CommitCache::CommitCache(InfoLoader info_loader, SnapshotLoader snapshot_loader)
+    : load_info(std::move(info_loader)), load_snapshot(std::move(snapshot_loader))
+{
+}
+
+uint32_t CommitCache::id(const std::string &hash)
+{
+    if (hash.empty())
+    {
+        return NONE;
+    }
+    auto it = ids.find(hash);
+    if (it != ids.end())
+    {
+        Trace::count(Trace::COMMIT_CACHE_HITS);
+        return it->second;
+    }
+    Trace::count(Trace::COMMIT_CACHE_MISSES);
+    Node node;
+    node.parents[0] = node.parents[1] = NONE;
+    node.parents_resolved = false;
+    node.graph_row = graph ? graph->find(hash) : CommitGraph::NONE;
+    if (node.graph_row != CommitGraph::NONE)
+    {
+        node.info.timestamp = static_cast<std::time_t>(graph->timestamp(node.graph_row));
+        node.generation = graph->generation(node.graph_row);
+        node.info_loaded = false;
+    }
+    else
+    {
+        ++reads;
+        if (!load_info(hash, node.info))
+        {
+            return NONE; // Not cached, so a commit written later can still be found
+        }
+        node.generation = 0;
+        node.info_loaded = true;
+    }
+    node.info.hash = hash;
+    uint32_t new_id = static_cast<uint32_t>(nodes.size());
+    nodes.push_back(std::move(node));
+    ids.emplace(hash, new_id);
+    return new_id;
+}
+
+const CommitInfo &CommitCache::info(uint32_t commit_id)
+{
+    Node &node = nodes[commit_id];
+    if (!node.info_loaded)
+    {
+        ++reads;
+        CommitInfo loaded;
+        if (load_info(node.info.hash, loaded))
+        {
+            loaded.hash = node.info.hash;
+            node.info = loaded;
+        }
+        else
+        {
+            // Object unreadable: keep what the graph knows
+            for (int which = 0; which < 2; ++which)
+            {
+                uint32_t row = graph->parent(node.graph_row, which);
+                std::string &parent_hash = which == 0 ? node.info.parent_hash : node.info.second_parent_hash;
+                parent_hash = row == CommitGraph::NONE ? "" : graph->id(row);
+            }
+        }
+        node.info_loaded = true;
+    }
+    return node.info;
+}
+
+uint32_t CommitCache::parent(uint32_t commit_id, int which)
+{
+    if (!nodes[commit_id].parents_resolved)
+    {
+        // id() may grow the vector, so the hashes are copied and the node looked up again
+        std::string first_hash;
+        std::string second_hash;
+        uint32_t row = nodes[commit_id].graph_row;
+        if (row != CommitGraph::NONE)
+        {
+            uint32_t first_row = graph->parent(row, 0);
+            uint32_t second_row = graph->parent(row, 1);
+            first_hash = first_row == CommitGraph::NONE ? "" : graph->id(first_row);
+            second_hash = second_row == CommitGraph::NONE ? "" : graph->id(second_row);
+        }
+        else
+        {
+            first_hash = nodes[commit_id].info.parent_hash;
+            second_hash = nodes[commit_id].info.second_parent_hash;
+        }
+        uint32_t first = id(first_hash);
+        uint32_t second = id(second_hash);
+        Node &node = nodes[commit_id];
+        node.parents[0] = first;
+        node.parents[1] = second;
+        node.parents_resolved = true;
+    }
+    return nodes[commit_id].parents[which];
+}
+
+uint32_t CommitCache::generation(uint32_t commit_id)
+{
+    if (nodes[commit_id].generation != 0)
+    {
+        return nodes[commit_id].generation;
+    }
+    // Commits outside the graph: compute parents first, iteratively, since the part of
+    // history the graph does not cover can be arbitrarily deep
+    std::vector<uint32_t> stack(1, commit_id);
+    while (!stack.empty())
+    {
+        uint32_t current = stack.back();
+        uint32_t value = 1;
+        bool ready = true;
+        for (int which = 0; which < 2; ++which)
+        {
+            uint32_t p = parent(current, which);
+            if (p == NONE)
+                continue;
+            if (nodes[p].generation == 0)
+            {
+                if (stack.size() > nodes.size())
+                {
+                    return 1; // Cycle in a corrupt history; give up rather than loop
+                }
+                stack.push_back(p);
+                ready = false;
+            }
+            else
+            {
+                value = std::max(value, nodes[p].generation + 1);
+            }
+        }
+        if (ready)
+        {
+            nodes[current].generation = value;
+            stack.pop_back();
+        }
+    }
+    return nodes[commit_id].generation;
+}
+
+std::shared_ptr<const CommitCache::Snapshot> CommitCache::snapshot(uint32_t commit_id)
+{
+    for (auto it = snapshots.begin(); it != snapshots.end(); ++it)
+    {
+        if (it->first == commit_id)
+        {
+            snapshots.splice(snapshots.begin(), snapshots, it); // Most recently used first
+            Trace::count(Trace::SNAPSHOT_CACHE_HITS);
+            return snapshots.front().second;
+        }
+    }
+    Trace::count(Trace::SNAPSHOT_CACHE_MISSES);
+    auto parsed = std::make_shared<Snapshot>();
+    if (!load_snapshot(nodes[commit_id].info.hash, *parsed))
+    {
+        parsed->clear();
+    }
+    snapshots.emplace_front(commit_id, parsed);
+    if (snapshots.size() > SNAPSHOT_CACHE_SIZE)
+    {
+        snapshots.pop_back();
+    }
+    return parsed;
+}
+
+void CommitCache::clear()
+{
+    nodes.clear();
+    ids.clear();
+    snapshots.clear();
+}
@@ -0,0 +1,91 @@
+#ifndef COMMIT_CACHE_H
+#define COMMIT_CACHE_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <list>
+#include <memory>
+#include <ctime>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+
+class CommitGraph; // commit_graph.h
+
+// Commit metadata without the snapshot: all that history traversals need
+struct CommitInfo {
+    std::string hash;
+    std::string parent_hash;
+    std::string second_parent_hash;
+    std::string message;
+    std::string author;
+    std::string tree_hash; // Empty for commits that store the flat snapshot
+    std::time_t timestamp = 0;
+};
+
+// Cache of parsed commits for the lifetime of a MiniGit instance, plus the commit graph
+// it implies. Each commit is read and parsed once; its snapshot is only parsed when
+// asked for. Commits get dense integer ids in load order, so traversals can use vectors
+// indexed by id instead of sets of hash strings. Commits covered by the commit-graph
+// file take their parents, generation and timestamp from it, and their objects are
+// only read if their message or author is needed.
+class CommitCache {
+public:
+    static const uint32_t NONE = UINT32_MAX;
+
+    using Snapshot = std::map<std::string, std::string>;
+    using InfoLoader = std::function<bool(const std::string& hash, CommitInfo& info)>;
+    using SnapshotLoader = std::function<bool(const std::string& hash, Snapshot& snapshot)>;
+
+    CommitCache(InfoLoader info_loader, SnapshotLoader snapshot_loader);
+
+    // Commit-graph consulted before reading commit objects; it must outlive the cache
+    void set_graph(const CommitGraph* commit_graph) { graph = commit_graph; }
+
+    // Id of a commit, reading its metadata on first use; NONE if it cannot be read
+    uint32_t id(const std::string& hash);
+    const std::string& hash(uint32_t id) const { return nodes[id].info.hash; }
+    std::time_t timestamp(uint32_t id) const { return nodes[id].info.timestamp; }
+    // Full metadata, reading the commit object if it was only known from the graph
+    const CommitInfo& info(uint32_t id);
+
+    // First and second parent ids (NONE when absent), resolved on first use
+    uint32_t parent(uint32_t id, int which);
+
+    // Generation number: 1 for a root commit, else one more than the largest among its
+    // parents. Taken from the commit-graph when it covers the commit, else computed.
+    uint32_t generation(uint32_t id);
+
+    // Commit objects read so far (commits served by the graph alone do not count)
+    size_t objects_read() const { return reads; }
+
+    // The commit's snapshot, parsed on demand; the few most recent ones stay cached
+    std::shared_ptr<const Snapshot> snapshot(uint32_t id);
+
+    size_t size() const { return nodes.size(); }
+    void clear();
+
+private:
+    struct Node {
+        CommitInfo info;
+        uint32_t parents[2];
+        uint32_t graph_row;  // CommitGraph::NONE if the graph does not cover it
+        uint32_t generation; // 0 until known
+        bool parents_resolved;
+        bool info_loaded;
+    };
+
+    InfoLoader load_info;
+    SnapshotLoader load_snapshot;
+    const CommitGraph* graph = nullptr;
+    size_t reads = 0;
+    std::vector<Node> nodes;
+    std::unordered_map<std::string, uint32_t> ids;
+
+    // Small LRU of parsed snapshots: a merge touches three, a checkout two
+    static const size_t SNAPSHOT_CACHE_SIZE = 4;
+    std::list<std::pair<uint32_t, std::shared_ptr<const Snapshot>>> snapshots;
+};
+
+#endif // COMMIT_CACHE_H
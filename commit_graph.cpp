@@ -0,0 +1,243 @@
+#include "commit_graph.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const char GRAPH_MAGIC[4] = {'M', 'C', 'G', 'R'};
+const uint32_t GRAPH_VERSION = 1;
+const size_t ID_LEN = 20;
+const size_t ROW_SIZE = 20;
+const size_t HEADER_SIZE = 8 + 256 * 4;
+
+uint32_t read_u32(const unsigned char *p)
+{
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+           (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+uint64_t read_u64(const unsigned char *p)
+{
+    return static_cast<uint64_t>(read_u32(p)) | (static_cast<uint64_t>(read_u32(p + 4)) << 32);
+}
+
+void put_u32(std::string &out, uint32_t v)
+{
+    for (int i = 0; i < 4; ++i)
+        out.push_back(static_cast<char>((v >> (8 * i)) & 0xff));
+}
+
+void put_u64(std::string &out, uint64_t v)
+{
+    for (int i = 0; i < 8; ++i)
+        out.push_back(static_cast<char>((v >> (8 * i)) & 0xff));
+}
+
+} // namespace
+
+CommitGraph::CommitGraph(const fs::path &path)
+    : file(path.string()), is_valid(false), count(0), fanout(nullptr), ids(nullptr), rows(nullptr)
+{
+    if (!file.valid() || file.size() < HEADER_SIZE + ID_LEN || std::memcmp(file.data(), GRAPH_MAGIC, 4) != 0)
+    {
+        return;
+    }
+    const unsigned char *base = reinterpret_cast<const unsigned char *>(file.data());
+    if (read_u32(base + 4) != GRAPH_VERSION)
+    {
+        return;
+    }
+    fanout = base + 8;
+    count = read_u32(fanout + 255 * 4);
+    if (file.size() != HEADER_SIZE + static_cast<size_t>(count) * (ID_LEN + ROW_SIZE) + ID_LEN)
+    {
+        return;
+    }
+    ids = fanout + 256 * 4;
+    rows = ids + static_cast<size_t>(count) * ID_LEN;
+    is_valid = true;
+}
+
+uint32_t CommitGraph::find(const std::string &hash) const
+{
+    ObjectId id;
+    if (!is_valid || !ObjectId::fromHex(hash, id))
+    {
+        return NONE;
+    }
+    uint32_t lo = id.bytes[0] == 0 ? 0 : read_u32(fanout + (id.bytes[0] - 1) * 4);
+    uint32_t hi = read_u32(fanout + id.bytes[0] * 4);
+    while (lo < hi)
+    {
+        uint32_t mid = lo + (hi - lo) / 2;
+        int cmp = std::memcmp(ids + static_cast<size_t>(mid) * ID_LEN, id.bytes, ID_LEN);
+        if (cmp == 0)
+            return mid;
+        if (cmp < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return NONE;
+}
+
+std::string CommitGraph::id(uint32_t row) const
+{
+    return Utils::toHex(ids + static_cast<size_t>(row) * ID_LEN, ID_LEN);
+}
+
+void CommitGraph::find_prefix(std::string_view prefix, std::vector<std::string> &out) const
+{
+    uint32_t first = 0;
+    uint32_t last = 0;
+    if (!is_valid || !ObjectId::prefixRange(prefix, fanout, ids, first, last))
+    {
+        return;
+    }
+    for (uint32_t row = first; row < last; ++row)
+        out.push_back(id(row));
+}
+
+uint32_t CommitGraph::parent(uint32_t row, int which) const
+{
+    return read_u32(rows + static_cast<size_t>(row) * ROW_SIZE + which * 4);
+}
+
+uint32_t CommitGraph::generation(uint32_t row) const
+{
+    return read_u32(rows + static_cast<size_t>(row) * ROW_SIZE + 8);
+}
+
+int64_t CommitGraph::timestamp(uint32_t row) const
+{
+    return static_cast<int64_t>(read_u64(rows + static_cast<size_t>(row) * ROW_SIZE + 12));
+}
+
+void CommitGraph::records(std::vector<Record> &out) const
+{
+    out.reserve(out.size() + count);
+    for (uint32_t row = 0; row < count; ++row)
+    {
+        Record record;
+        std::memcpy(record.id.bytes, ids + static_cast<size_t>(row) * ID_LEN, ID_LEN);
+        for (int which = 0; which < 2; ++which)
+        {
+            uint32_t p = parent(row, which);
+            if (p != NONE)
+                std::memcpy(record.parents[record.parent_count++].bytes, ids + static_cast<size_t>(p) * ID_LEN, ID_LEN);
+        }
+        record.timestamp = timestamp(row);
+        out.push_back(record);
+    }
+}
+
+bool CommitGraph::write(const fs::path &path, std::vector<Record> records)
+{
+    std::sort(records.begin(), records.end(), [](const Record &a, const Record &b)
+              { return a.id < b.id; });
+    records.erase(std::unique(records.begin(), records.end(), [](const Record &a, const Record &b)
+                              { return a.id == b.id; }),
+                  records.end());
+
+    // Resolve parents to rows
+    size_t n = records.size();
+    std::vector<uint32_t> parent_rows(n * 2, NONE);
+    for (size_t i = 0; i < n; ++i)
+    {
+        for (int which = 0; which < records[i].parent_count; ++which)
+        {
+            const ObjectId &p = records[i].parents[which];
+            auto it = std::lower_bound(records.begin(), records.end(), p, [](const Record &r, const ObjectId &id)
+                                       { return r.id < id; });
+            if (it == records.end() || it->id != p)
+            {
+                return false;
+            }
+            parent_rows[i * 2 + which] = static_cast<uint32_t>(it - records.begin());
+        }
+    }
+
+    // Generation numbers, parents first (iterative, since histories can be very deep)
+    std::vector<uint32_t> generations(n, 0);
+    std::vector<uint32_t> stack;
+    for (size_t start = 0; start < n; ++start)
+    {
+        if (generations[start] != 0)
+            continue;
+        stack.push_back(static_cast<uint32_t>(start));
+        while (!stack.empty())
+        {
+            uint32_t row = stack.back();
+            uint32_t generation = 1;
+            bool ready = true;
+            for (int which = 0; which < 2; ++which)
+            {
+                uint32_t p = parent_rows[row * 2 + which];
+                if (p == NONE)
+                    continue;
+                if (generations[p] == 0)
+                {
+                    if (stack.size() > n)
+                    {
+                        std::cerr << "Error: Cycle in commit history; not writing the commit-graph." << std::endl;
+                        return false;
+                    }
+                    stack.push_back(p);
+                    ready = false;
+                }
+                else
+                {
+                    generation = std::max(generation, generations[p] + 1);
+                }
+            }
+            if (ready)
+            {
+                generations[row] = generation;
+                stack.pop_back();
+            }
+        }
+    }
+
+    std::string buffer(GRAPH_MAGIC, 4);
+    put_u32(buffer, GRAPH_VERSION);
+    uint32_t fan[256] = {0};
+    for (const Record &r : records)
+        ++fan[r.id.bytes[0]];
+    uint32_t running = 0;
+    for (int b = 0; b < 256; ++b)
+    {
+        running += fan[b];
+        put_u32(buffer, running);
+    }
+    for (const Record &r : records)
+        buffer.append(reinterpret_cast<const char *>(r.id.bytes), ID_LEN);
+    for (size_t i = 0; i < n; ++i)
+    {
+        put_u32(buffer, parent_rows[i * 2]);
+        put_u32(buffer, parent_rows[i * 2 + 1]);
+        put_u32(buffer, generations[i]);
+        put_u64(buffer, static_cast<uint64_t>(records[i].timestamp));
+    }
+    Sha1Hasher hasher;
+    hasher.update(buffer.data(), buffer.size());
+    ObjectId checksum;
+    hasher.finish(checksum);
+    buffer.append(reinterpret_cast<const char *>(checksum.bytes), ID_LEN);
+
+    std::error_code ec;
+    fs::create_directories(path.parent_path(), ec);
+    LockFile lock;
+    if (!lock.acquire(path))
+    {
+        return false;
+    }
+    if (!lock.write(buffer.data(), buffer.size()) || !lock.commit())
+    {
+        std::cerr << "Error: Failed writing commit-graph file " << path.string() << std::endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,63 @@
+#ifndef COMMIT_GRAPH_H
+#define COMMIT_GRAPH_H
+
+#include "utils.h" // For MappedFile, ObjectId
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <filesystem>
+
+// The commit-graph file caches the shape of history, so ancestry and merge-base
+// queries can walk it without reading commit objects.
+//
+// objects/info/commit-graph: "MCGR" | u32 version | u32 fanout[256] | 20-byte ids (sorted)
+//   | rows | 20-byte SHA-1 of the preceding bytes
+//   row: u32 first parent | u32 second parent | u32 generation | u64 timestamp (20 bytes)
+//   Parents are row numbers (NONE when absent), and every parent of a commit in the
+//   file is in the file too. A root commit has generation 1; any other commit has one
+//   more than the largest generation among its parents, so an ancestor always has a
+//   smaller generation than its descendants.
+// All integers are little-endian.
+class CommitGraph {
+public:
+    static const uint32_t NONE = UINT32_MAX;
+
+    // One commit to write; parent_count is 0, 1 or 2
+    struct Record {
+        ObjectId id;
+        ObjectId parents[2];
+        int parent_count = 0;
+        int64_t timestamp = 0;
+    };
+
+    explicit CommitGraph(const std::filesystem::path& path);
+
+    bool valid() const { return is_valid; }
+    size_t size() const { return count; }
+
+    // Row of a commit, or NONE if the file does not cover it
+    uint32_t find(const std::string& hash) const;
+    // Appends the hex ids of the commits whose id starts with a hex prefix
+    void find_prefix(std::string_view prefix, std::vector<std::string>& out) const;
+    std::string id(uint32_t row) const;
+    uint32_t parent(uint32_t row, int which) const;
+    uint32_t generation(uint32_t row) const;
+    int64_t timestamp(uint32_t row) const;
+
+    // Every commit in the file, for rewriting it with more commits
+    void records(std::vector<Record>& out) const;
+
+    // Replaces the file with one covering the given commits (duplicates are fine).
+    // Returns false, leaving the old file alone, if a parent is missing from the list.
+    static bool write(const std::filesystem::path& path, std::vector<Record> records);
+
+private:
+    MappedFile file;
+    bool is_valid;
+    uint32_t count;
+    const unsigned char* fanout; // 256 little-endian u32
+    const unsigned char* ids;    // count * 20 bytes
+    const unsigned char* rows;   // count * 20 bytes
+};
+
+#endif // COMMIT_GRAPH_H
@@ -0,0 +1,192 @@
+#include "delta.h"
+#include <algorithm>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+
+namespace {
+
+// Matches shorter than this are cheaper as literal inserts
+const size_t BLOCK = 16;
+
+// Rabin-Karp style rolling hash over a BLOCK-sized window
+const uint32_t PRIME = 16777619u;
+
+uint32_t hash_block(const unsigned char* p)
+{
+    uint32_t h = 0;
+    for (size_t i = 0; i < BLOCK; ++i)
+    {
+        h = h * PRIME + p[i];
+    }
+    return h;
+}
+
+// PRIME^(BLOCK-1), the weight of the byte leaving the window
+uint32_t leading_weight()
+{
+    uint32_t w = 1;
+    for (size_t i = 1; i < BLOCK; ++i)
+    {
+        w *= PRIME;
+    }
+    return w;
+}
+
+void flush_insert(std::string &out, const unsigned char *data, size_t length)
+{
+    while (length > 0)
+    {
+        size_t n = length < 127 ? length : 127;
+        out.push_back(static_cast<char>(n));
+        out.append(reinterpret_cast<const char *>(data), n);
+        data += n;
+        length -= n;
+    }
+}
+
+} // namespace
+
+void Delta::putVarint(std::string &out, unsigned long long value)
+{
+    while (value >= 0x80)
+    {
+        out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+bool Delta::getVarint(const char *&p, const char *end, unsigned long long &value)
+{
+    value = 0;
+    int shift = 0;
+    while (p < end && shift < 64)
+    {
+        unsigned char byte = static_cast<unsigned char>(*p++);
+        value |= static_cast<unsigned long long>(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+        {
+            return true;
+        }
+        shift += 7;
+    }
+    return false;
+}
+
+std::string Delta::create(const std::string &base, const std::string &target)
+{
+    std::string out;
+    putVarint(out, base.size());
+    putVarint(out, target.size());
+
+    const unsigned char *b = reinterpret_cast<const unsigned char *>(base.data());
+    const unsigned char *t = reinterpret_cast<const unsigned char *>(target.data());
+    size_t tlen = target.size();
+
+    // Base offsets are indexed as 32-bit values below
+    if (base.size() < BLOCK || tlen < BLOCK || base.size() >= UINT32_MAX)
+    {
+        flush_insert(out, t, tlen);
+        return out;
+    }
+
+    // Index the base at every BLOCK-aligned offset. The table is lossy: a slot keeps the
+    // last offset that hashed to it, and every hit is verified with memcmp.
+    size_t blocks = base.size() / BLOCK;
+    size_t table_size = 1;
+    while (table_size < blocks * 2)
+    {
+        table_size <<= 1;
+    }
+    std::vector<uint32_t> table(table_size, 0); // offset + 1, 0 = empty
+    for (size_t i = 0; i < blocks; ++i)
+    {
+        table[hash_block(b + i * BLOCK) & (table_size - 1)] = static_cast<uint32_t>(i * BLOCK + 1);
+    }
+
+    const uint32_t weight = leading_weight();
+    size_t pos = 0;          // Start of the rolling window in the target
+    size_t pending = 0;      // Start of bytes not yet emitted
+    uint32_t h = hash_block(t);
+    while (pos + BLOCK <= tlen)
+    {
+        uint32_t slot = table[h & (table_size - 1)];
+        if (slot != 0 && std::memcmp(b + slot - 1, t + pos, BLOCK) == 0)
+        {
+            size_t boff = slot - 1;
+            size_t len = BLOCK;
+            // Extend the match forwards, then backwards into the pending literals
+            while (boff + len < base.size() && pos + len < tlen && b[boff + len] == t[pos + len])
+            {
+                ++len;
+            }
+            while (boff > 0 && pos > pending && b[boff - 1] == t[pos - 1])
+            {
+                --boff;
+                --pos;
+                ++len;
+            }
+            flush_insert(out, t + pending, pos - pending);
+            out.push_back(static_cast<char>(0x80));
+            putVarint(out, boff);
+            putVarint(out, len);
+            pos += len;
+            pending = pos;
+            if (pos + BLOCK <= tlen)
+            {
+                h = hash_block(t + pos);
+            }
+            continue;
+        }
+        if (pos + BLOCK < tlen)
+        {
+            h = (h - t[pos] * weight) * PRIME + t[pos + BLOCK];
+        }
+        ++pos;
+    }
+    flush_insert(out, t + pending, tlen - pending);
+    return out;
+}
+
+bool Delta::apply(const std::string &base, const char *delta, size_t length, std::string &output)
+{
+    const char *p = delta;
+    const char *end = delta + length;
+    unsigned long long base_size = 0;
+    unsigned long long result_size = 0;
+    if (!getVarint(p, end, base_size) || !getVarint(p, end, result_size) || base_size != base.size())
+    {
+        return false;
+    }
+
+    // result_size is read from the pack and may be corrupt: the output is never allowed to
+    // grow past it, and the up-front reservation is capped by the size of the inputs
+    output.clear();
+    output.reserve(std::min<unsigned long long>(result_size, base.size() + length));
+    while (p < end)
+    {
+        unsigned char op = static_cast<unsigned char>(*p++);
+        if (op & 0x80)
+        {
+            unsigned long long offset = 0;
+            unsigned long long len = 0;
+            if (!getVarint(p, end, offset) || !getVarint(p, end, len) || offset > base.size() ||
+                len > base.size() - offset || len > result_size - output.size())
+            {
+                return false;
+            }
+            output.append(base, offset, len);
+        }
+        else
+        {
+            if (op == 0 || static_cast<size_t>(end - p) < op || op > result_size - output.size())
+            {
+                return false;
+            }
+            output.append(p, op);
+            p += op;
+        }
+    }
+    return output.size() == result_size;
+}
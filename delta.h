@@ -0,0 +1,25 @@
+#ifndef DELTA_H
+#define DELTA_H
+
+#include <string>
+#include <cstddef>
+
+// Binary deltas between two versions of an object, used by packfiles.
+//
+// Format: varint(base size) varint(result size) followed by instructions:
+//   0x80 | 0x00, varint(offset), varint(length)  -> copy length bytes from the base at offset
+//   n (1..127), n literal bytes                    -> insert the literal bytes
+class Delta {
+public:
+    // Encodes target as a delta against base (may be larger than target if they share nothing)
+    static std::string create(const std::string& base, const std::string& target);
+
+    // Rebuilds the target from base and a delta; returns false if the delta is malformed
+    static bool apply(const std::string& base, const char* delta, size_t length, std::string& output);
+
+    // Varint helpers shared with the packfile code (7 bits per byte, high bit = continuation)
+    static void putVarint(std::string& out, unsigned long long value);
+    static bool getVarint(const char*& p, const char* end, unsigned long long& value);
+};
+
+#endif // DELTA_H
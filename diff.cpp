@@ -0,0 +1,531 @@
+#include "diff.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+
+namespace {
+
+// Below this many steps the minimal diff is always searched for
+const long MIN_COST_LIMIT = 256;
+
+// Bytes inspected by is_binary, like git
+const size_t BINARY_PROBE = 8000;
+
+struct Split
+{
+    long i1;
+    long i2;
+    bool min_lo; // The halves on each side of the split still need a minimal diff
+    bool min_hi;
+};
+
+// Linear-space Myers over two integer sequences, marking the lines that are not part of
+// the common subsequence. Diagonals are indexed by d = i1 - i2.
+class Myers
+{
+public:
+    Myers(const std::vector<uint32_t> &a, const std::vector<uint32_t> &b, std::vector<char> &changed_a, std::vector<char> &changed_b)
+        : a(a), b(b), changed_a(changed_a), changed_b(changed_b),
+          forward(a.size() + b.size() + 3), backward(a.size() + b.size() + 3)
+    {
+        // Diagonals run from -(b.size() + 1) to a.size() + 1
+        kvdf = forward.data() + b.size() + 1;
+        kvdb = backward.data() + b.size() + 1;
+        max_cost = std::max(MIN_COST_LIMIT, static_cast<long>(std::sqrt(static_cast<double>(a.size() + b.size()))));
+    }
+
+    void compare(long off1, long lim1, long off2, long lim2, bool need_min)
+    {
+        while (off1 < lim1 && off2 < lim2 && a[off1] == b[off2])
+        {
+            ++off1;
+            ++off2;
+        }
+        while (off1 < lim1 && off2 < lim2 && a[lim1 - 1] == b[lim2 - 1])
+        {
+            --lim1;
+            --lim2;
+        }
+        if (off1 == lim1)
+        {
+            std::fill(changed_b.begin() + off2, changed_b.begin() + lim2, 1);
+            return;
+        }
+        if (off2 == lim2)
+        {
+            std::fill(changed_a.begin() + off1, changed_a.begin() + lim1, 1);
+            return;
+        }
+        Split split = find_split(off1, lim1, off2, lim2, need_min);
+        compare(off1, split.i1, off2, split.i2, split.min_lo);
+        compare(split.i1, lim1, split.i2, lim2, split.min_hi);
+    }
+
+private:
+    const std::vector<uint32_t> &a;
+    const std::vector<uint32_t> &b;
+    std::vector<char> &changed_a;
+    std::vector<char> &changed_b;
+    std::vector<long> forward;
+    std::vector<long> backward;
+    long *kvdf; // Furthest i1 reached on each diagonal, searching forward from (off1, off2)
+    long *kvdb; // Smallest i1 reached on each diagonal, searching backward from (lim1, lim2)
+    long max_cost;
+
+    // Finds where a (near-)minimal edit path crosses its middle. The ranges have already
+    // lost their common prefix and suffix and are both non-empty.
+    Split find_split(long off1, long lim1, long off2, long lim2, bool need_min)
+    {
+        long dmin = off1 - lim2;
+        long dmax = lim1 - off2;
+        long fmid = off1 - off2;
+        long bmid = lim1 - lim2;
+        bool odd = ((fmid - bmid) & 1) != 0;
+        long fmin = fmid, fmax = fmid;
+        long bmin = bmid, bmax = bmid;
+        kvdf[fmid] = off1;
+        kvdb[bmid] = lim1;
+
+        for (long cost = 1;; ++cost)
+        {
+            // Forward step: extend every diagonal one edit further, then follow the snake
+            if (fmin > dmin)
+                kvdf[--fmin - 1] = -1;
+            else
+                ++fmin;
+            if (fmax < dmax)
+                kvdf[++fmax + 1] = -1;
+            else
+                --fmax;
+            for (long d = fmax; d >= fmin; d -= 2)
+            {
+                long i1 = kvdf[d - 1] >= kvdf[d + 1] ? kvdf[d - 1] + 1 : kvdf[d + 1];
+                long i2 = i1 - d;
+                while (i1 < lim1 && i2 < lim2 && a[i1] == b[i2])
+                {
+                    ++i1;
+                    ++i2;
+                }
+                kvdf[d] = i1;
+                if (odd && bmin <= d && d <= bmax && kvdb[d] <= i1)
+                    return {i1, i2, true, true};
+            }
+
+            // Backward step
+            if (bmin > dmin)
+                kvdb[--bmin - 1] = LONG_MAX_GUARD;
+            else
+                ++bmin;
+            if (bmax < dmax)
+                kvdb[++bmax + 1] = LONG_MAX_GUARD;
+            else
+                --bmax;
+            for (long d = bmax; d >= bmin; d -= 2)
+            {
+                long i1 = kvdb[d - 1] < kvdb[d + 1] ? kvdb[d - 1] : kvdb[d + 1] - 1;
+                long i2 = i1 - d;
+                while (i1 > off1 && i2 > off2 && a[i1 - 1] == b[i2 - 1])
+                {
+                    --i1;
+                    --i2;
+                }
+                kvdb[d] = i1;
+                if (!odd && fmin <= d && d <= fmax && i1 <= kvdf[d])
+                    return {i1, i2, true, true};
+            }
+
+            if (need_min || cost < max_cost)
+                continue;
+
+            // Too expensive: split at whichever search got furthest. The result is still a
+            // correct diff, just not necessarily the shortest.
+            long fbest = -1, fbest1 = -1;
+            for (long d = fmax; d >= fmin; d -= 2)
+            {
+                long i1 = std::min(kvdf[d], lim1);
+                long i2 = i1 - d;
+                if (lim2 < i2)
+                {
+                    i1 = lim2 + d;
+                    i2 = lim2;
+                }
+                if (fbest < i1 + i2)
+                {
+                    fbest = i1 + i2;
+                    fbest1 = i1;
+                }
+            }
+            long bbest = LONG_MAX_GUARD, bbest1 = LONG_MAX_GUARD;
+            for (long d = bmax; d >= bmin; d -= 2)
+            {
+                long i1 = std::max(off1, kvdb[d]);
+                long i2 = i1 - d;
+                if (i2 < off2)
+                {
+                    i1 = off2 + d;
+                    i2 = off2;
+                }
+                if (i1 + i2 < bbest)
+                {
+                    bbest = i1 + i2;
+                    bbest1 = i1;
+                }
+            }
+            if ((lim1 + lim2) - bbest < fbest - (off1 + off2))
+                return {fbest1, fbest - fbest1, true, false};
+            return {bbest1, bbest - bbest1, false, true};
+        }
+    }
+
+    static const long LONG_MAX_GUARD = 0x7fffffffffffL;
+};
+
+// Length of the common prefix of a and b (n bytes at most). Whole 32-byte blocks are
+// compared first; a fixed-size memcmp compiles to a few vector compares.
+size_t common_prefix(const char *a, const char *b, size_t n)
+{
+    size_t i = 0;
+    while (i + 32 <= n && std::memcmp(a + i, b + i, 32) == 0)
+        i += 32;
+    while (i < n && a[i] == b[i])
+        ++i;
+    return i;
+}
+
+// Length of the common suffix of the texts ending at a_end and b_end (n bytes at most)
+size_t common_suffix(const char *a_end, const char *b_end, size_t n)
+{
+    size_t i = 0;
+    while (i + 32 <= n && std::memcmp(a_end - i - 32, b_end - i - 32, 32) == 0)
+        i += 32;
+    while (i < n && a_end[-1 - static_cast<long>(i)] == b_end[-1 - static_cast<long>(i)])
+        ++i;
+    return i;
+}
+
+// "start,count" of a unified diff range; an empty range names the line before it
+std::string hunk_range(size_t from, size_t count)
+{
+    if (count == 1)
+        return std::to_string(from + 1);
+    return std::to_string(count == 0 ? from : from + 1) + "," + std::to_string(count);
+}
+
+void write_line(std::ostream &out, char marker, std::string_view line)
+{
+    out << marker << line;
+    if (line.empty() || line.back() != '\n')
+        out << "\n\\ No newline at end of file\n";
+}
+
+} // namespace
+
+std::vector<std::string_view> Diff::split_lines(std::string_view text)
+{
+    std::vector<std::string_view> lines;
+    size_t start = 0;
+    while (start < text.size())
+    {
+        size_t eol = text.find('\n', start);
+        size_t end = eol == std::string_view::npos ? text.size() : eol + 1;
+        lines.emplace_back(text.data() + start, end - start);
+        start = end;
+    }
+    return lines;
+}
+
+void Diff::Interner::grow()
+{
+    std::vector<Slot> old;
+    old.swap(slots);
+    slots.assign(old.empty() ? 1024 : old.size() * 2, Slot{0, std::string_view(), UINT32_MAX});
+    size_t mask = slots.size() - 1;
+    for (const Slot &slot : old)
+    {
+        if (slot.id == UINT32_MAX)
+            continue;
+        size_t pos = slot.hash & mask;
+        while (slots[pos].id != UINT32_MAX)
+            pos = (pos + 1) & mask;
+        slots[pos] = slot;
+    }
+}
+
+std::vector<uint32_t> Diff::Interner::intern(const std::vector<std::string_view> &lines)
+{
+    std::vector<uint32_t> ids;
+    ids.reserve(lines.size());
+    std::hash<std::string_view> hasher;
+    for (std::string_view line : lines)
+    {
+        if ((next_id + 1) * 2 > slots.size())
+            grow(); // Load factor stays under one half
+        uint64_t hash = hasher(line);
+        size_t mask = slots.size() - 1;
+        size_t pos = hash & mask;
+        while (slots[pos].id != UINT32_MAX && (slots[pos].hash != hash || slots[pos].line != line))
+            pos = (pos + 1) & mask;
+        if (slots[pos].id == UINT32_MAX)
+            slots[pos] = Slot{hash, line, next_id++};
+        ids.push_back(slots[pos].id);
+    }
+    return ids;
+}
+
+std::vector<Diff::Hunk> Diff::diff(const std::vector<uint32_t> &a, const std::vector<uint32_t> &b)
+{
+    std::vector<char> changed_a(a.size(), 0);
+    std::vector<char> changed_b(b.size(), 0);
+
+    // Lines that never occur on the other side are changed whatever the alignment, so
+    // only the rest go through Myers (big rewrites shrink to their shared lines)
+    uint32_t max_id = 0;
+    for (uint32_t id : a)
+        max_id = std::max(max_id, id);
+    for (uint32_t id : b)
+        max_id = std::max(max_id, id);
+    std::vector<char> in_a(static_cast<size_t>(max_id) + 1, 0);
+    std::vector<char> in_b(static_cast<size_t>(max_id) + 1, 0);
+    for (uint32_t id : a)
+        in_a[id] = 1;
+    for (uint32_t id : b)
+        in_b[id] = 1;
+    std::vector<uint32_t> kept_a, kept_b;
+    std::vector<size_t> index_a, index_b;
+    for (size_t i = 0; i < a.size(); ++i)
+    {
+        if (in_b[a[i]])
+        {
+            kept_a.push_back(a[i]);
+            index_a.push_back(i);
+        }
+        else
+            changed_a[i] = 1;
+    }
+    for (size_t i = 0; i < b.size(); ++i)
+    {
+        if (in_a[b[i]])
+        {
+            kept_b.push_back(b[i]);
+            index_b.push_back(i);
+        }
+        else
+            changed_b[i] = 1;
+    }
+
+    std::vector<char> kept_changed_a(kept_a.size(), 0);
+    std::vector<char> kept_changed_b(kept_b.size(), 0);
+    Myers myers(kept_a, kept_b, kept_changed_a, kept_changed_b);
+    myers.compare(0, static_cast<long>(kept_a.size()), 0, static_cast<long>(kept_b.size()), false);
+    for (size_t i = 0; i < kept_a.size(); ++i)
+        changed_a[index_a[i]] = kept_changed_a[i];
+    for (size_t i = 0; i < kept_b.size(); ++i)
+        changed_b[index_b[i]] = kept_changed_b[i];
+
+    // Unchanged lines pair up in order; each run of changes between them is one hunk
+    std::vector<Hunk> hunks;
+    size_t i = 0, j = 0;
+    while (i < a.size() || j < b.size())
+    {
+        if (i < a.size() && j < b.size() && !changed_a[i] && !changed_b[j])
+        {
+            ++i;
+            ++j;
+            continue;
+        }
+        Hunk hunk{i, 0, j, 0};
+        while (i < a.size() && changed_a[i])
+            ++i;
+        while (j < b.size() && changed_b[j])
+            ++j;
+        hunk.old_count = i - hunk.old_start;
+        hunk.new_count = j - hunk.new_start;
+        hunks.push_back(hunk);
+    }
+    return hunks;
+}
+
+void Diff::unified(const std::string &old_text, const std::string &new_text, std::ostream &out, size_t context)
+{
+    // 1. Skip the common leading and trailing lines; they are identical bytes in both texts
+    size_t limit = std::min(old_text.size(), new_text.size());
+    size_t prefix = common_prefix(old_text.data(), new_text.data(), limit);
+    if (prefix == old_text.size() && prefix == new_text.size())
+        return;
+    size_t eol = prefix == 0 ? std::string::npos : old_text.rfind('\n', prefix - 1);
+    size_t start = eol == std::string::npos ? 0 : eol + 1;
+    size_t suffix = common_suffix(old_text.data() + old_text.size(), new_text.data() + new_text.size(), limit - start);
+    size_t old_end = old_text.size() - suffix;
+    size_t new_end = new_text.size() - suffix;
+    bool at_line_start = (old_end == start || old_text[old_end - 1] == '\n') && (new_end == start || new_text[new_end - 1] == '\n');
+    if (!at_line_start)
+    {
+        eol = old_text.find('\n', old_end);
+        old_end = eol == std::string::npos ? old_text.size() : eol + 1;
+        new_end = new_text.size() - (old_text.size() - old_end);
+    }
+
+    // 2. Keep enough of the skipped lines for the context around the first and last change.
+    //    They are not diffed: repeated lines could otherwise let a change slide into them.
+    size_t context_start = start;
+    for (size_t i = 0; i < context && context_start > 0; ++i)
+    {
+        eol = context_start >= 2 ? old_text.rfind('\n', context_start - 2) : std::string::npos;
+        context_start = eol == std::string::npos ? 0 : eol + 1;
+    }
+    size_t context_end = old_end;
+    for (size_t i = 0; i < context && context_end < old_text.size(); ++i)
+    {
+        eol = old_text.find('\n', context_end);
+        context_end = eol == std::string::npos ? old_text.size() : eol + 1;
+    }
+    size_t trailing = context_end - old_end;
+    size_t first_line = static_cast<size_t>(std::count(old_text.begin(), old_text.begin() + context_start, '\n'));
+    size_t leading_lines = static_cast<size_t>(std::count(old_text.begin() + context_start, old_text.begin() + start, '\n'));
+    size_t trailing_lines = split_lines(std::string_view(old_text).substr(old_end, trailing)).size();
+
+    // 3. Diff the lines in between
+    std::vector<std::string_view> a = split_lines(std::string_view(old_text).substr(context_start, context_end - context_start));
+    std::vector<std::string_view> b = split_lines(std::string_view(new_text).substr(context_start, new_end + trailing - context_start));
+    Interner interner;
+    std::vector<uint32_t> a_ids = interner.intern(std::vector<std::string_view>(a.begin() + leading_lines, a.end() - trailing_lines));
+    std::vector<uint32_t> b_ids = interner.intern(std::vector<std::string_view>(b.begin() + leading_lines, b.end() - trailing_lines));
+    std::vector<Hunk> hunks = diff(a_ids, b_ids);
+    for (Hunk &hunk : hunks)
+    {
+        hunk.old_start += leading_lines;
+        hunk.new_start += leading_lines;
+    }
+
+    // 4. Changes closer than twice the context share one output hunk
+    for (size_t h = 0; h < hunks.size();)
+    {
+        size_t last = h;
+        while (last + 1 < hunks.size() &&
+               hunks[last + 1].old_start - (hunks[last].old_start + hunks[last].old_count) <= 2 * context)
+            ++last;
+        size_t old_from = hunks[h].old_start >= context ? hunks[h].old_start - context : 0;
+        size_t new_from = hunks[h].new_start - (hunks[h].old_start - old_from);
+        size_t last_old_end = hunks[last].old_start + hunks[last].old_count;
+        size_t old_to = std::min(a.size(), last_old_end + context);
+        size_t new_to = hunks[last].new_start + hunks[last].new_count + (old_to - last_old_end);
+
+        out << "@@ -" << hunk_range(first_line + old_from, old_to - old_from)
+            << " +" << hunk_range(first_line + new_from, new_to - new_from) << " @@\n";
+        size_t pos = old_from;
+        for (size_t k = h; k <= last; ++k)
+        {
+            for (; pos < hunks[k].old_start; ++pos)
+                write_line(out, ' ', a[pos]);
+            for (size_t i = 0; i < hunks[k].old_count; ++i)
+                write_line(out, '-', a[hunks[k].old_start + i]);
+            for (size_t i = 0; i < hunks[k].new_count; ++i)
+                write_line(out, '+', b[hunks[k].new_start + i]);
+            pos = hunks[k].old_start + hunks[k].old_count;
+        }
+        for (; pos < old_to; ++pos)
+            write_line(out, ' ', a[pos]);
+        h = last + 1;
+    }
+}
+
+bool Diff::is_binary(const std::string &text)
+{
+    return text.find('\0') < std::min(text.size(), BINARY_PROBE);
+}
+
+size_t Diff::merge3(const std::string &base, const std::string &ours, const std::string &theirs,
+                    const std::string &ours_label, const std::string &theirs_label, std::string &result)
+{
+    std::vector<std::string_view> base_lines = split_lines(base);
+    std::vector<std::string_view> ours_lines = split_lines(ours);
+    std::vector<std::string_view> theirs_lines = split_lines(theirs);
+    Interner interner;
+    std::vector<uint32_t> base_ids = interner.intern(base_lines);
+    std::vector<uint32_t> ours_ids = interner.intern(ours_lines);
+    std::vector<uint32_t> theirs_ids = interner.intern(theirs_lines);
+    std::vector<Hunk> ours_hunks = diff(base_ids, ours_ids);
+    std::vector<Hunk> theirs_hunks = diff(base_ids, theirs_ids);
+
+    result.clear();
+    result.reserve(std::max(ours.size(), theirs.size()));
+    auto append = [&result](const std::vector<std::string_view> &lines, size_t from, size_t to)
+    {
+        for (size_t k = from; k < to; ++k)
+            result.append(lines[k].data(), lines[k].size());
+    };
+    auto append_section = [&](const std::vector<std::string_view> &lines, size_t from, size_t to)
+    {
+        append(lines, from, to);
+        if (!result.empty() && result.back() != '\n')
+            result += '\n'; // A marker must start on its own line
+    };
+
+    // Walk both hunk lists in base order, grouping hunks whose base ranges overlap or touch.
+    // Outside hunks each side is the base shifted by the size changes of its earlier hunks.
+    size_t i = 0, j = 0;
+    size_t base_pos = 0;
+    long ours_shift = 0, theirs_shift = 0;
+    size_t conflicts = 0;
+    while (i < ours_hunks.size() || j < theirs_hunks.size())
+    {
+        bool take_ours = j == theirs_hunks.size() ||
+                         (i < ours_hunks.size() && ours_hunks[i].old_start <= theirs_hunks[j].old_start);
+        const Hunk &first = take_ours ? ours_hunks[i] : theirs_hunks[j];
+        size_t group_start = first.old_start;
+        size_t group_end = first.old_start + first.old_count;
+        long ours_delta = 0, theirs_delta = 0;
+        bool ours_changed = false, theirs_changed = false;
+        for (bool grew = true; grew;)
+        {
+            grew = false;
+            while (i < ours_hunks.size() && ours_hunks[i].old_start <= group_end)
+            {
+                const Hunk &h = ours_hunks[i++];
+                group_end = std::max(group_end, h.old_start + h.old_count);
+                ours_delta += static_cast<long>(h.new_count) - static_cast<long>(h.old_count);
+                ours_changed = grew = true;
+            }
+            while (j < theirs_hunks.size() && theirs_hunks[j].old_start <= group_end)
+            {
+                const Hunk &h = theirs_hunks[j++];
+                group_end = std::max(group_end, h.old_start + h.old_count);
+                theirs_delta += static_cast<long>(h.new_count) - static_cast<long>(h.old_count);
+                theirs_changed = grew = true;
+            }
+        }
+
+        append(base_lines, base_pos, group_start);
+        size_t ours_from = group_start + ours_shift, ours_to = group_end + ours_shift + ours_delta;
+        size_t theirs_from = group_start + theirs_shift, theirs_to = group_end + theirs_shift + theirs_delta;
+        bool same = ours_to - ours_from == theirs_to - theirs_from &&
+                    std::equal(ours_ids.begin() + ours_from, ours_ids.begin() + ours_to, theirs_ids.begin() + theirs_from);
+        if (!theirs_changed || same)
+        {
+            append(ours_lines, ours_from, ours_to);
+        }
+        else if (!ours_changed)
+        {
+            append(theirs_lines, theirs_from, theirs_to);
+        }
+        else
+        {
+            ++conflicts;
+            if (!result.empty() && result.back() != '\n')
+                result += '\n';
+            result += "<<<<<<< " + ours_label + "\n";
+            append_section(ours_lines, ours_from, ours_to);
+            result += "||||||| base\n";
+            append_section(base_lines, group_start, group_end);
+            result += "=======\n";
+            append_section(theirs_lines, theirs_from, theirs_to);
+            result += ">>>>>>> " + theirs_label + "\n";
+        }
+        base_pos = group_end;
+        ours_shift += ours_delta;
+        theirs_shift += theirs_delta;
+    }
+    append(base_lines, base_pos, base_lines.size());
+    return conflicts;
+}
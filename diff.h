@@ -0,0 +1,70 @@
+#ifndef DIFF_H
+#define DIFF_H
+
+#include <string>
+#include <string_view>
+#include <ostream>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// Line diffs and three-way line merges.
+//
+// Lines are interned to integer ids first, so the diff compares integers instead of
+// strings. The diff is Myers' O(ND) algorithm in its linear-space (middle snake) form,
+// after trimming the common prefix and suffix and setting aside lines that only occur
+// on one side. Past a cost limit it settles for a good split instead of the minimal
+// one, which keeps very different multi-megabyte inputs fast.
+class Diff {
+public:
+    // A region that differs: old lines [old_start, old_start + old_count) became
+    // new lines [new_start, new_start + new_count). Either count may be 0.
+    struct Hunk {
+        size_t old_start;
+        size_t old_count;
+        size_t new_start;
+        size_t new_count;
+    };
+
+    // Lines of text, each keeping its "\n" (the last one may lack it); views into text
+    static std::vector<std::string_view> split_lines(std::string_view text);
+
+    // Maps equal lines to equal ids; one interner must serve every sequence compared
+    class Interner {
+    public:
+        std::vector<uint32_t> intern(const std::vector<std::string_view>& lines);
+        size_t distinct() const { return next_id; }
+
+    private:
+        struct Slot {
+            uint64_t hash;
+            std::string_view line;
+            uint32_t id;
+        };
+        std::vector<Slot> slots; // Open addressing, power-of-two size
+        uint32_t next_id = 0;
+        void grow();
+    };
+
+    // Hunks turning a into b, in order
+    static std::vector<Hunk> diff(const std::vector<uint32_t>& a, const std::vector<uint32_t>& b);
+
+    // Writes the changes turning old_text into new_text as unified diff hunks ("@@ -a,b +c,d @@"
+    // followed by ' ', '-' and '+' lines), with context lines around each change. Hunks are
+    // written as they are found. The common leading and trailing lines are skipped with a
+    // byte compare and never split or hashed, so a small edit in a large file is cheap.
+    static void unified(const std::string& old_text, const std::string& new_text, std::ostream& out,
+                        size_t context = 3);
+
+    // True if the text looks binary (a NUL byte near the start), so it is not line-merged
+    static bool is_binary(const std::string& text);
+
+    // Three-way merge of ours and theirs against base. Regions changed on one side take
+    // that side; regions changed the same way on both take it once; overlapping different
+    // changes become conflict blocks labelled with ours_label/theirs_label.
+    // Returns the number of conflict blocks written to result.
+    static size_t merge3(const std::string& base, const std::string& ours, const std::string& theirs,
+                         const std::string& ours_label, const std::string& theirs_label, std::string& result);
+};
+
+#endif // DIFF_H
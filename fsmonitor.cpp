@@ -0,0 +1,392 @@
+#include "fsmonitor.h"
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const uint32_t WATCH_MASK = IN_CREATE | IN_DELETE | IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_MOVED_FROM |
+                            IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR | IN_DONT_FOLLOW;
+
+volatile std::sig_atomic_t stop_requested = 0;
+
+void on_signal(int)
+{
+    stop_requested = 1;
+}
+
+// Fills addr with the socket path; relative to the working directory if the absolute one
+// does not fit (MiniGit always runs in the repository root)
+void socket_address(const fs::path &repo_root, sockaddr_un &addr)
+{
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    std::string path = (repo_root / ".minigit" / "daemon.sock").string();
+    if (path.size() >= sizeof(addr.sun_path))
+    {
+        path = ".minigit/daemon.sock";
+    }
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+}
+
+int connect_daemon(const fs::path &repo_root)
+{
+    sockaddr_un addr;
+    socket_address(repo_root, addr);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    if (connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+bool send_all(int fd, const std::string &data)
+{
+    size_t sent = 0;
+    while (sent < data.size())
+    {
+        ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0)
+        {
+            return false;
+        }
+        sent += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// Reads until the peer closes the connection
+std::string read_all(int fd)
+{
+    std::string data;
+    char buffer[65536];
+    ssize_t n;
+    while ((n = read(fd, buffer, sizeof(buffer))) > 0)
+    {
+        data.append(buffer, static_cast<size_t>(n));
+    }
+    return data;
+}
+
+} // namespace
+
+FsMonitor::FsMonitor(const fs::path &repo_root)
+    : root(repo_root), ignore(repo_root), inotify_fd(-1), listen_fd(-1), sequence(0), reset_sequence(0)
+{
+    auto now = std::chrono::system_clock::now().time_since_epoch();
+    instance = std::to_string(std::chrono::duration_cast<std::chrono::nanoseconds>(now).count()) + "-" + std::to_string(getpid());
+}
+
+FsMonitor::~FsMonitor()
+{
+    if (inotify_fd >= 0)
+        close(inotify_fd);
+    if (listen_fd >= 0)
+        close(listen_fd);
+}
+
+void FsMonitor::record(const std::string &path)
+{
+    changed[path] = ++sequence;
+}
+
+bool FsMonitor::watch_tree(const std::string &dir, bool record_files)
+{
+    std::vector<std::string> pending{dir};
+    while (!pending.empty())
+    {
+        std::string rel = std::move(pending.back());
+        pending.pop_back();
+        fs::path full = rel.empty() ? root : root / rel;
+        int wd = inotify_add_watch(inotify_fd, full.c_str(), WATCH_MASK);
+        if (wd < 0)
+        {
+            if (errno == ENOSPC)
+            {
+                std::cerr << "Error: Out of inotify watches (see /proc/sys/fs/inotify/max_user_watches)." << std::endl;
+                return false;
+            }
+            continue; // Gone already
+        }
+        watches[wd] = rel;
+        std::error_code ec;
+        for (fs::directory_iterator it(full, ec), end; !ec && it != end; it.increment(ec))
+        {
+            std::string name = it->path().filename().string();
+            std::string path = rel.empty() ? name : rel + "/" + name;
+            bool is_dir = it->is_directory(ec) && !it->is_symlink(ec);
+            if (name == ".minigit" || ignore.ignored(path, is_dir))
+                continue;
+            if (is_dir)
+                pending.push_back(path);
+            else if (record_files)
+                record(path);
+        }
+    }
+    return true;
+}
+
+void FsMonitor::rewatch()
+{
+    for (const auto &watch : watches)
+    {
+        inotify_rm_watch(inotify_fd, watch.first);
+    }
+    watches.clear();
+    changed.clear();
+    ignore = IgnoreRules(root);
+    reset_sequence = ++sequence;
+    if (!watch_tree("", false))
+    {
+        reset_sequence = UINT64_MAX; // Incomplete: every client has to scan
+    }
+}
+
+void FsMonitor::read_events()
+{
+    alignas(inotify_event) char buffer[64 * 1024];
+    ssize_t n = read(inotify_fd, buffer, sizeof(buffer));
+    bool lost = false;
+    for (ssize_t pos = 0; pos < n;)
+    {
+        const inotify_event *event = reinterpret_cast<const inotify_event *>(buffer + pos);
+        pos += sizeof(inotify_event) + event->len;
+        if (event->mask & IN_Q_OVERFLOW)
+        {
+            lost = true;
+            continue;
+        }
+        auto watch = watches.find(event->wd);
+        if (watch == watches.end())
+            continue;
+        if (event->mask & IN_IGNORED)
+        {
+            watches.erase(watch); // The directory is gone; its parent reported that
+            continue;
+        }
+        if (event->len == 0)
+            continue; // About the watched directory itself
+        std::string dir = watch->second;
+        std::string name = event->name;
+        std::string path = dir.empty() ? name : dir + "/" + name;
+        if (dir.empty() && name == ".minigit")
+            continue;
+        if (dir.empty() && name == ".minigitignore")
+        {
+            lost = true; // Different paths are watched now
+            continue;
+        }
+        bool is_dir = (event->mask & IN_ISDIR) != 0;
+        if (ignore.ignored(path, is_dir))
+            continue;
+        record(path);
+        if (is_dir && (event->mask & IN_MOVED_FROM))
+        {
+            // Watches follow the directory, so the ones below it would report stale paths
+            for (auto it = watches.begin(); it != watches.end();)
+            {
+                if (it->second == path || it->second.compare(0, path.size() + 1, path + "/") == 0)
+                {
+                    inotify_rm_watch(inotify_fd, it->first);
+                    it = watches.erase(it);
+                }
+                else
+                    ++it;
+            }
+        }
+        if (is_dir && (event->mask & (IN_CREATE | IN_MOVED_TO)) && !watch_tree(path, true))
+        {
+            reset_sequence = UINT64_MAX;
+        }
+    }
+    if (lost)
+    {
+        std::cerr << "Warning: File system events were lost; clients will rescan once." << std::endl;
+        rewatch();
+    }
+}
+
+bool FsMonitor::serve(int client_fd)
+{
+    // One request line per connection
+    std::string request;
+    char c;
+    while (request.size() < 4096 && read(client_fd, &c, 1) == 1 && c != '\n')
+    {
+        request += c;
+    }
+    if (request == "stop")
+    {
+        send_all(client_fd, "bye\n");
+        return false;
+    }
+    if (request.compare(0, 6, "since ") != 0)
+    {
+        send_all(client_fd, "error unknown request\n");
+        return true;
+    }
+
+    std::string token = request.substr(6);
+    std::string current = instance + ":" + std::to_string(sequence);
+    size_t colon = token.rfind(':');
+    uint64_t since = 0;
+    bool valid = colon != std::string::npos && token.compare(0, colon, instance) == 0;
+    if (valid)
+    {
+        try
+        {
+            since = std::stoull(token.substr(colon + 1));
+        }
+        catch (...)
+        {
+            valid = false;
+        }
+    }
+    if (!valid || since < reset_sequence || reset_sequence == UINT64_MAX)
+    {
+        send_all(client_fd, "reset " + current + "\n");
+        return true;
+    }
+    std::string reply = "ok " + current + "\n";
+    for (const auto &entry : changed)
+    {
+        if (entry.second > since)
+        {
+            reply += entry.first;
+            reply += '\n';
+        }
+    }
+    send_all(client_fd, reply);
+    return true;
+}
+
+int FsMonitor::run()
+{
+    sockaddr_un addr;
+    socket_address(root, addr);
+    int existing = connect_daemon(root);
+    if (existing >= 0)
+    {
+        close(existing);
+        std::cerr << "Error: A daemon is already running for this repository." << std::endl;
+        return 1;
+    }
+    unlink(addr.sun_path); // Left behind by a daemon that did not exit cleanly
+
+    inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (inotify_fd < 0 || listen_fd < 0 ||
+        bind(listen_fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 || listen(listen_fd, 16) != 0)
+    {
+        std::cerr << "Error: Could not start the daemon: " << std::strerror(errno) << std::endl;
+        return 1;
+    }
+    if (!watch_tree("", false))
+    {
+        reset_sequence = UINT64_MAX;
+    }
+    std::signal(SIGINT, on_signal);
+    std::signal(SIGTERM, on_signal);
+    std::cout << "Watching " << root.string() << " (" << watches.size() << " directories)" << std::endl;
+
+    bool running = true;
+    while (running && !stop_requested)
+    {
+        pollfd fds[2] = {{inotify_fd, POLLIN, 0}, {listen_fd, POLLIN, 0}};
+        if (poll(fds, 2, -1) < 0)
+        {
+            continue; // EINTR from a signal
+        }
+        // Events first, so a client sees every change made before it connected
+        if (fds[0].revents & POLLIN)
+        {
+            read_events();
+        }
+        if (fds[1].revents & POLLIN)
+        {
+            int client = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (client >= 0)
+            {
+                // Drain what the kernel queued before the request arrived
+                while (poll(fds, 1, 0) > 0 && (fds[0].revents & POLLIN))
+                {
+                    read_events();
+                }
+                running = serve(client);
+                close(client);
+            }
+        }
+    }
+    unlink(addr.sun_path);
+    std::cout << "Daemon stopped." << std::endl;
+    return 0;
+}
+
+bool FsMonitor::query(const fs::path &repo_root, const std::string &token,
+                      std::string &new_token, std::vector<std::string> &paths, bool &reset)
+{
+    paths.clear();
+    int fd = connect_daemon(repo_root);
+    if (fd < 0)
+    {
+        return false;
+    }
+    bool sent = send_all(fd, "since " + (token.empty() ? std::string("none") : token) + "\n");
+    std::string reply = sent ? read_all(fd) : "";
+    close(fd);
+
+    size_t eol = reply.find('\n');
+    if (eol == std::string::npos)
+    {
+        return false;
+    }
+    std::string status = reply.substr(0, eol);
+    if (status.compare(0, 6, "reset ") == 0)
+    {
+        reset = true;
+        new_token = status.substr(6);
+        return true;
+    }
+    if (status.compare(0, 3, "ok ") != 0)
+    {
+        return false;
+    }
+    reset = false;
+    new_token = status.substr(3);
+    for (size_t pos = eol + 1; pos < reply.size();)
+    {
+        size_t end = reply.find('\n', pos);
+        if (end == std::string::npos)
+            end = reply.size();
+        paths.push_back(reply.substr(pos, end - pos));
+        pos = end + 1;
+    }
+    return true;
+}
+
+bool FsMonitor::stop(const fs::path &repo_root)
+{
+    int fd = connect_daemon(repo_root);
+    if (fd < 0)
+    {
+        return false;
+    }
+    send_all(fd, "stop\n");
+    read_all(fd);
+    close(fd);
+    return true;
+}
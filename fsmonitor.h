@@ -0,0 +1,54 @@
+#ifndef FSMONITOR_H
+#define FSMONITOR_H
+
+#include "worktree.h" // For IgnoreRules
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <filesystem>
+#include <unordered_map>
+
+// Filesystem monitor: `minigit daemon` watches the working tree with inotify and records
+// every path that changes, so commands can look at those paths instead of walking the tree.
+//
+// Clients ask over the Unix socket .minigit/daemon.sock:
+//   "since <token>\n" -> "ok <token>\n" + one changed path per line, or "reset <token>\n"
+//   "stop\n"          -> "bye\n", and the daemon exits
+// A token is "<instance>:<sequence>". The paths returned are those changed after the token
+// was issued; a directory path stands for everything below it. "reset" means the daemon
+// cannot say (it was restarted, or inotify overflowed) and the client must scan the whole
+// tree, keeping the new token for next time.
+class FsMonitor {
+public:
+    explicit FsMonitor(const std::filesystem::path& repo_root);
+    ~FsMonitor();
+
+    // Runs the daemon in the foreground until "stop", SIGINT or SIGTERM. Returns the exit code.
+    int run();
+
+    // Client side. Returns false if no daemon answers; reset is set when the client must scan.
+    static bool query(const std::filesystem::path& repo_root, const std::string& token,
+                      std::string& new_token, std::vector<std::string>& paths, bool& reset);
+    static bool stop(const std::filesystem::path& repo_root);
+
+private:
+    std::filesystem::path root;
+    IgnoreRules ignore;
+    int inotify_fd;
+    int listen_fd;
+    std::unordered_map<int, std::string> watches; // Watch descriptor -> directory ("" for the root)
+    std::unordered_map<std::string, uint64_t> changed; // Path -> sequence number of its last change
+    std::string instance;
+    uint64_t sequence;
+    uint64_t reset_sequence; // Tokens before this one get "reset"
+
+    void record(const std::string& path);
+    // Adds watches below dir; with record_files, also records every file found (for a
+    // directory that appeared, whose files may predate the watch)
+    bool watch_tree(const std::string& dir, bool record_files);
+    void rewatch(); // Drops every watch and starts over, after events were lost
+    void read_events();
+    bool serve(int client_fd); // Returns false on "stop"
+};
+
+#endif // FSMONITOR_H
@@ -0,0 +1,446 @@
+#include "index.h"
+#include "trace.h"
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string_view>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const char INDEX_MAGIC[4] = {'M', 'G', 'I', 'X'};
+const uint32_t INDEX_VERSION = 1;
+const size_t HEADER_SIZE = 12;
+const size_t ENTRY_FIXED = 62; // Bytes before the path in each entry
+const size_t CHECKSUM_SIZE = 20;
+
+// Entry flag: the path is conflicted and has no blob hash
+const uint32_t FLAG_CONFLICT = 1u << 0;
+
+uint32_t read_u32(const unsigned char *p)
+{
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+           (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+uint64_t read_u64(const unsigned char *p)
+{
+    return static_cast<uint64_t>(read_u32(p)) | (static_cast<uint64_t>(read_u32(p + 4)) << 32);
+}
+
+void put_u16(std::string &out, uint16_t v)
+{
+    out.push_back(static_cast<char>(v & 0xff));
+    out.push_back(static_cast<char>(v >> 8));
+}
+
+void put_u32(std::string &out, uint32_t v)
+{
+    for (int i = 0; i < 4; ++i)
+        out.push_back(static_cast<char>((v >> (8 * i)) & 0xff));
+}
+
+void put_u64(std::string &out, uint64_t v)
+{
+    for (int i = 0; i < 8; ++i)
+        out.push_back(static_cast<char>((v >> (8 * i)) & 0xff));
+}
+
+int64_t to_ns(const struct timespec &ts)
+{
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+} // namespace
+
+// --- IndexEntry ---
+
+void IndexEntry::set_stat(const struct stat &st)
+{
+    mtime_ns = to_ns(st.st_mtim);
+    ctime_ns = to_ns(st.st_ctim);
+    size = static_cast<uint64_t>(st.st_size);
+    ino = static_cast<uint64_t>(st.st_ino);
+    mode = static_cast<uint32_t>(st.st_mode);
+}
+
+bool IndexEntry::stat_matches(const struct stat &st) const
+{
+    return mtime_ns != 0 && mtime_ns == to_ns(st.st_mtim) && ctime_ns == to_ns(st.st_ctim) &&
+           size == static_cast<uint64_t>(st.st_size) && ino == static_cast<uint64_t>(st.st_ino) &&
+           mode == static_cast<uint32_t>(st.st_mode);
+}
+
+// --- Index ---
+
+Index::Index(const fs::path &index_file)
+    : file(index_file), count(0), offset_table(nullptr), file_mtime_ns(0), base_cleared(false), changed(false)
+{
+    open();
+}
+
+void Index::open()
+{
+    Trace::Span span("Index::open");
+    base.reset();
+    count = 0;
+    offset_table = nullptr;
+    overlay.clear();
+    base_cleared = false;
+    changed = false;
+
+    struct stat st;
+    if (stat(file.c_str(), &st) != 0)
+    {
+        return; // No index yet
+    }
+    file_mtime_ns = to_ns(st.st_mtim);
+
+    auto mapped = std::make_unique<MappedFile>(file.string());
+    if (!mapped->valid())
+    {
+        std::cerr << "Warning: Could not read index " << file.string() << std::endl;
+        return;
+    }
+    if (mapped->size() < 4 || std::memcmp(mapped->data(), INDEX_MAGIC, 4) != 0)
+    {
+        read_legacy_text(std::string(mapped->data(), mapped->size()));
+        return;
+    }
+
+    const unsigned char *data = reinterpret_cast<const unsigned char *>(mapped->data());
+    size_t size = mapped->size();
+    bool ok = size >= HEADER_SIZE + CHECKSUM_SIZE && read_u32(data + 4) == INDEX_VERSION;
+    uint32_t n = ok ? read_u32(data + 8) : 0;
+    ok = ok && HEADER_SIZE + static_cast<size_t>(n) * 4 + CHECKSUM_SIZE <= size;
+    // Bounds-check every entry once so lookups can trust the offsets
+    for (uint32_t i = 0; ok && i < n; ++i)
+    {
+        size_t offset = read_u32(data + HEADER_SIZE + i * 4);
+        ok = offset + ENTRY_FIXED <= size - CHECKSUM_SIZE &&
+             offset + ENTRY_FIXED + (data[offset + 60] | (data[offset + 61] << 8)) <= size - CHECKSUM_SIZE;
+    }
+    if (!ok)
+    {
+        std::cerr << "Warning: Index file " << file.string() << " is corrupt; treating the staging area as empty." << std::endl;
+        return;
+    }
+    count = n;
+    offset_table = data + HEADER_SIZE;
+    base = std::move(mapped);
+}
+
+void Index::read_legacy_text(const std::string &content)
+{
+    std::stringstream ss(content);
+    std::string line;
+    while (std::getline(ss, line))
+    {
+        size_t first_space = line.find(' ');
+        if (first_space != std::string::npos)
+        {
+            IndexEntry entry;
+            entry.hash = line.substr(first_space + 1);
+            overlay[line.substr(0, first_space)] = {false, entry};
+        }
+    }
+    base_cleared = true; // Nothing to merge with: the text file is fully in the overlay
+}
+
+std::string_view Index::base_path_view(uint32_t i) const
+{
+    const unsigned char *data = reinterpret_cast<const unsigned char *>(base->data());
+    const unsigned char *e = data + read_u32(offset_table + i * 4);
+    return std::string_view(reinterpret_cast<const char *>(e + ENTRY_FIXED), e[60] | (e[61] << 8));
+}
+
+void Index::base_entry(uint32_t i, std::string &path, IndexEntry &entry) const
+{
+    const unsigned char *data = reinterpret_cast<const unsigned char *>(base->data());
+    const unsigned char *e = data + read_u32(offset_table + i * 4);
+    entry.mtime_ns = static_cast<int64_t>(read_u64(e));
+    entry.ctime_ns = static_cast<int64_t>(read_u64(e + 8));
+    entry.size = read_u64(e + 16);
+    entry.ino = read_u64(e + 24);
+    entry.mode = read_u32(e + 32);
+    entry.flags = read_u32(e + 36);
+    if (entry.flags & FLAG_CONFLICT)
+    {
+        entry.hash.clear();
+    }
+    else
+    {
+        entry.hash.resize(40); // Reuses the caller's buffer when it walks many entries
+        Utils::toHex(e + 40, 20, &entry.hash[0]);
+    }
+    size_t len = e[60] | (e[61] << 8);
+    path.assign(reinterpret_cast<const char *>(e + ENTRY_FIXED), len);
+}
+
+bool Index::base_lookup(const std::string &path, IndexEntry &entry) const
+{
+    if (!base || base_cleared)
+    {
+        return false;
+    }
+    const unsigned char *data = reinterpret_cast<const unsigned char *>(base->data());
+    uint32_t lo = 0;
+    uint32_t hi = count;
+    while (lo < hi)
+    {
+        uint32_t mid = lo + (hi - lo) / 2;
+        const unsigned char *e = data + read_u32(offset_table + mid * 4);
+        std::string_view candidate(reinterpret_cast<const char *>(e + ENTRY_FIXED), e[60] | (e[61] << 8));
+        int cmp = candidate.compare(path);
+        if (cmp == 0)
+        {
+            std::string ignored;
+            base_entry(mid, ignored, entry);
+            return true;
+        }
+        if (cmp < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return false;
+}
+
+bool Index::lookup(const std::string &path, IndexEntry &entry) const
+{
+    auto it = overlay.find(path);
+    if (it != overlay.end())
+    {
+        if (it->second.removed)
+            return false;
+        entry = it->second.entry;
+        return true;
+    }
+    return base_lookup(path, entry);
+}
+
+void Index::set(const std::string &path, const IndexEntry &entry)
+{
+    overlay[path] = {false, entry};
+    changed = true;
+}
+
+void Index::remove(const std::string &path)
+{
+    overlay[path] = {true, IndexEntry()};
+    changed = true;
+}
+
+void Index::clear()
+{
+    overlay.clear();
+    base_cleared = true;
+    changed = true;
+}
+
+void Index::for_each(const std::function<void(const std::string &, const IndexEntry &)> &fn) const
+{
+    for_each("", fn);
+}
+
+void Index::for_each(const std::string &prefix, const std::function<void(const std::string &, const IndexEntry &)> &fn) const
+{
+    uint32_t n = (base && !base_cleared) ? count : 0;
+    uint32_t i = n;
+    if (prefix.empty())
+    {
+        i = 0;
+    }
+    else if (n > 0)
+    {
+        // Binary search for the first base path not below the prefix
+        const unsigned char *data = reinterpret_cast<const unsigned char *>(base->data());
+        uint32_t lo = 0;
+        uint32_t hi = n;
+        while (lo < hi)
+        {
+            uint32_t mid = lo + (hi - lo) / 2;
+            const unsigned char *e = data + read_u32(offset_table + mid * 4);
+            std::string_view candidate(reinterpret_cast<const char *>(e + ENTRY_FIXED), e[60] | (e[61] << 8));
+            if (candidate.compare(prefix) < 0)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        i = lo;
+    }
+    auto it = overlay.lower_bound(prefix);
+    auto below = [&prefix](std::string_view path)
+    { return path.compare(0, prefix.size(), prefix) == 0; };
+    std::string_view base_view; // Compared in place; path is only filled for fn
+    std::string path;
+    IndexEntry entry;
+    // Linear merge of the sorted base entries with the sorted overlay; the overlay wins on ties
+    while (i < n || it != overlay.end())
+    {
+        if (i < n)
+        {
+            base_view = base_path_view(i);
+            if (!below(base_view))
+                i = n;
+        }
+        if (it != overlay.end() && !below(it->first))
+            it = overlay.end();
+        if (i == n && it == overlay.end())
+            break;
+        if (it == overlay.end() || (i < n && base_view < it->first))
+        {
+            base_entry(i, path, entry);
+            fn(path, entry);
+            ++i;
+            continue;
+        }
+        if (i < n && base_view == it->first)
+        {
+            ++i;
+        }
+        if (!it->second.removed)
+        {
+            fn(it->first, it->second.entry);
+        }
+        ++it;
+    }
+}
+
+bool Index::is_racy(const IndexEntry &entry) const
+{
+    return file_mtime_ns != 0 && entry.mtime_ns >= file_mtime_ns;
+}
+
+bool Index::save()
+{
+    LockFile lock;
+    if (!lock.acquire(file))
+    {
+        return false;
+    }
+    return save(lock);
+}
+
+bool Index::save(LockFile &lock)
+{
+    Trace::Span span("Index::save");
+    // The lock file's timestamp is the index write time. An entry whose file was modified
+    // in that same tick (or later) cannot be trusted later, so its stat data is dropped.
+    struct stat st;
+    if (!lock.locked() || fstat(lock.descriptor(), &st) != 0)
+    {
+        std::cerr << "Error: Could not write index file " << file.string() << std::endl;
+        return false;
+    }
+    int64_t write_time_ns = to_ns(st.st_mtim);
+
+    // Entry count first, so the offset table can be sized before the entries are appended
+    uint32_t n = (base && !base_cleared) ? count : 0;
+    size_t total = 0;
+    {
+        uint32_t i = 0;
+        auto it = overlay.begin();
+        while (i < n || it != overlay.end())
+        {
+            int cmp = i == n ? 1 : (it == overlay.end() ? -1 : base_path_view(i).compare(it->first));
+            if (cmp < 0)
+            {
+                ++total;
+                ++i;
+                continue;
+            }
+            if (cmp == 0)
+                ++i;
+            if (!it->second.removed)
+                ++total;
+            ++it;
+        }
+    }
+
+    std::string buffer(INDEX_MAGIC, 4);
+    put_u32(buffer, INDEX_VERSION);
+    put_u32(buffer, static_cast<uint32_t>(total));
+    buffer.resize(HEADER_SIZE + total * 4);
+    buffer.reserve(base ? base->size() + overlay.size() * (ENTRY_FIXED + 64) : 0);
+    size_t slot = 0;
+    auto start_entry = [&]()
+    {
+        uint32_t offset = static_cast<uint32_t>(buffer.size());
+        for (int b = 0; b < 4; ++b)
+            buffer[HEADER_SIZE + slot * 4 + b] = static_cast<char>((offset >> (8 * b)) & 0xff);
+        ++slot;
+    };
+
+    // Linear merge as in for_each. Unchanged base entries are copied as raw bytes, only
+    // clearing the mtime of racy ones; overlay entries are encoded.
+    const unsigned char *data = base ? reinterpret_cast<const unsigned char *>(base->data()) : nullptr;
+    uint32_t i = 0;
+    auto it = overlay.begin();
+    while (i < n || it != overlay.end())
+    {
+        int cmp = i == n ? 1 : (it == overlay.end() ? -1 : base_path_view(i).compare(it->first));
+        if (cmp < 0)
+        {
+            const unsigned char *e = data + read_u32(offset_table + i * 4);
+            size_t length = ENTRY_FIXED + (e[60] | (e[61] << 8));
+            start_entry();
+            size_t at = buffer.size();
+            buffer.append(reinterpret_cast<const char *>(e), length);
+            if (static_cast<int64_t>(read_u64(e)) >= write_time_ns)
+                std::memset(&buffer[at], 0, 8);
+            ++i;
+            continue;
+        }
+        if (cmp == 0)
+            ++i;
+        if (it->second.removed)
+        {
+            ++it;
+            continue;
+        }
+        const std::string &path = it->first;
+        const IndexEntry &entry = it->second.entry;
+        ++it;
+        if (path.size() > 0xffff)
+        {
+            std::cerr << "Error: Path too long for the index: " << path.substr(0, 64) << "..." << std::endl;
+            return false;
+        }
+        start_entry();
+
+        bool racy = entry.mtime_ns >= write_time_ns;
+        put_u64(buffer, racy ? 0 : static_cast<uint64_t>(entry.mtime_ns));
+        put_u64(buffer, static_cast<uint64_t>(entry.ctime_ns));
+        put_u64(buffer, entry.size);
+        put_u64(buffer, entry.ino);
+        put_u32(buffer, entry.mode);
+        uint32_t flags = entry.hash.empty() ? (entry.flags | FLAG_CONFLICT) : (entry.flags & ~FLAG_CONFLICT);
+        put_u32(buffer, flags);
+        ObjectId id;
+        if (!entry.hash.empty() && !ObjectId::fromHex(entry.hash, id))
+        {
+            std::cerr << "Error: Invalid blob hash '" << entry.hash << "' for " << path << " in the index." << std::endl;
+            return false;
+        }
+        buffer.append(reinterpret_cast<const char *>(id.bytes), ObjectId::RAW_SIZE);
+        put_u16(buffer, static_cast<uint16_t>(path.size()));
+        buffer += path;
+    }
+    Sha1Hasher hasher;
+    hasher.update(buffer.data(), buffer.size());
+    ObjectId checksum;
+    hasher.finish(checksum);
+    buffer.append(reinterpret_cast<const char *>(checksum.bytes), CHECKSUM_SIZE);
+
+    if (!lock.write(buffer.data(), buffer.size()) || !lock.commit())
+    {
+        std::cerr << "Error: Failed writing index file " << file.string() << std::endl;
+        return false;
+    }
+    open();
+    return true;
+}
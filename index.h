@@ -0,0 +1,84 @@
+#ifndef INDEX_H
+#define INDEX_H
+
+#include "utils.h" // For MappedFile
+#include <string>
+#include <string_view>
+#include <map>
+#include <memory>
+#include <cstdint>
+#include <functional>
+#include <filesystem>
+#include <sys/stat.h>
+
+// One staged path: the blob hash plus the stat data of the file it was hashed from.
+// When a file's stat data still matches, add and status can skip re-hashing it.
+struct IndexEntry {
+    std::string hash; // Blob hash; empty for a path left conflicted by a merge
+    int64_t mtime_ns = 0;
+    int64_t ctime_ns = 0;
+    uint64_t size = 0;
+    uint64_t ino = 0;
+    uint32_t mode = 0;
+    uint32_t flags = 0;
+
+    // Records the stat data of the file the hash was computed from
+    void set_stat(const struct stat& st);
+    // True if st describes the same file version (an entry without stat data never matches)
+    bool stat_matches(const struct stat& st) const;
+};
+
+// The staging area, stored in .minigit/index (all integers little-endian):
+//   "MGIX" | u32 version | u32 count | u32 entry_offset[count] | entries | 20-byte SHA-1 of the preceding bytes
+//   entry: i64 mtime_ns | i64 ctime_ns | u64 size | u64 ino | u32 mode | u32 flags | 20-byte id | u16 path_len | path
+// Entries are sorted by path and the file is memory-mapped, so a lookup is a binary search
+// over the offset table without parsing the rest. Changes are kept in an overlay and merged
+// into a new file by save(). The old "path hash" text format is still read.
+class Index {
+public:
+    explicit Index(const std::filesystem::path& index_file);
+
+    bool lookup(const std::string& path, IndexEntry& entry) const;
+    void set(const std::string& path, const IndexEntry& entry);
+    void remove(const std::string& path);
+    void clear();
+
+    // Calls fn(path, entry) for every entry in path order
+    void for_each(const std::function<void(const std::string&, const IndexEntry&)>& fn) const;
+    // Same, for the entries whose path starts with prefix (found by binary search)
+    void for_each(const std::string& prefix, const std::function<void(const std::string&, const IndexEntry&)>& fn) const;
+
+    // True if the file may have changed within the same timestamp tick as the index write,
+    // in which case matching stat data proves nothing and the file must be re-hashed
+    bool is_racy(const IndexEntry& entry) const;
+
+    bool modified() const { return changed; }
+
+    // Writes the merged index through index.lock and renames it into place
+    bool save();
+    // Same, using a lock the caller took before reading the index (for read-modify-write updates)
+    bool save(LockFile& lock);
+
+private:
+    struct Change {
+        bool removed;
+        IndexEntry entry;
+    };
+
+    std::filesystem::path file;
+    std::unique_ptr<MappedFile> base; // The binary index on disk, if there is one
+    uint32_t count;
+    const unsigned char* offset_table;
+    int64_t file_mtime_ns;
+    std::map<std::string, Change> overlay;
+    bool base_cleared;
+    bool changed;
+
+    void open();
+    void read_legacy_text(const std::string& content);
+    std::string_view base_path_view(uint32_t i) const; // Points into the mapping
+    void base_entry(uint32_t i, std::string& path, IndexEntry& entry) const;
+    bool base_lookup(const std::string& path, IndexEntry& entry) const;
+};
+
+#endif // INDEX_H
@@ -2,11 +2,16 @@
 
 #include "minigit.h" // Includes MiniGit class and its methods
 #include "utils.h"   // Includes printErrorAndExit and isMiniGitRepo
+#include "server.h"  // For CommandServer (minigit serve)
 #include <iostream>
 #include <vector>
 #include <string>
 #include <numeric>   // For std::accumulate (used for reconstructing commit messages)
 #include <filesystem> // For std::filesystem::path (used by isMiniGitRepo indirectly)
+#include <sstream>   // For parsing log dates
+#include <iomanip>   // For std::get_time
+#include <ctime>     // For std::mktime
+#include <cstdlib>   // For std::strtol
 
 
 // Helper function to print usage instructions
@@ -16,14 +21,32 @@ void print_usage()
               << "\n"
               << "Available commands:\n"
               << "  init                      Initialize a new repository.\n"
-              << "  add <filepath>            Add a file to the staging area.\n"
+              << "  add <path>...             Add files or directories (e.g. '.') to the staging area.\n"
               << "  commit -m \"<message>\"   Record changes to the repository.\n"
-              << "  log                       Show commit history.\n"
+              << "  status                    Show staged, modified, deleted and untracked files.\n"
+              << "  daemon [stop]             Watch the working tree so status and add skip the full scan.\n"
+              << "  serve --stdio | --socket [<path>]\n"
+              << "                            Run commands read one per line, answering each with a JSON line.\n"
+              << "  log [-n <count>] [--since <date>] [--until <date>] [--author <name>]\n"
+              << "      [--first-parent] [--topo-order] [[--] <path>...]\n"
+              << "                            Show commit history (dates: YYYY-MM-DD [HH:MM:SS] or @<seconds>).\n"
               << "  branch <branch-name>      Create a new branch.\n"
+              << "  branch [--list]           List branches, marking the current one with '*'.\n"
               << "  checkout <name>           Switch branches or restore working tree files.\n"
-              << "  merge <branch-name>       Join two or more development histories together.\n";
-    // Add Diff Viewer usage if you implement the optional bonus later
-    // std::cout << "  diff <commit1> <commit2>  Show line-by-line differences between commits.\n";
+              << "  merge <branch-name>       Join two or more development histories together.\n"
+              << "  config <key> [<value>]    Get or set a repository option (e.g. core.compression 0-9).\n"
+              << "  repack                    Pack all objects into one delta-compressed packfile.\n"
+              << "  gc                        Pack refs, prune unreachable objects and repack the rest.\n"
+              << "  prune [--expire <seconds> | now]\n"
+              << "                            Delete unreachable loose objects older than the grace period.\n"
+              << "  pack-refs                 Move every branch into the sorted packed-refs file.\n"
+              << "  migrate-objects           Move objects from the old flat layout into fanout directories.\n"
+              << "  fsck                      Re-hash every object and check that everything referenced exists.\n"
+              << "  commit-graph write        Rewrite the commit-graph file used to speed up merges.\n"
+              << "  rev-parse <revision>...   Print the commit hash a revision names (e.g. HEAD~2, a1b2c3d^2).\n"
+              << "  diff [--cached | <commit1> <commit2>]\n"
+              << "                            Show changes: working tree vs index, index vs HEAD (--cached),\n"
+              << "                            or between two commits.\n";
 }
 
 // Function to check if repository is initialized (moved here for command argument validation)
@@ -31,23 +54,102 @@ void print_usage()
 // However, it's better to use the one from utils.h/cpp directly.
 // Let's rely on utils.h's isMiniGitRepo for consistency.
 
-int main(int argc, char* argv[])
+#define LOG_USAGE "[-n <count>] [--since <date>] [--until <date>] [--author <name>] [--first-parent] [--topo-order] [[--] <path>...]"
+
+// "YYYY-MM-DD", "YYYY-MM-DD HH:MM:SS" (local time) or "@<seconds since the epoch>"
+static bool parse_date(const std::string& text, std::time_t& time)
 {
-    // Check for minimum arguments (just 'minigit' itself)
-    if (argc < 2)
+    if (!text.empty() && text[0] == '@')
     {
-        print_usage();
-        return 1; // Exit with error
+        char* end = nullptr;
+        long long seconds = std::strtoll(text.c_str() + 1, &end, 10);
+        time = static_cast<std::time_t>(seconds);
+        return text.size() > 1 && *end == '\0';
     }
+    std::tm parts = {};
+    std::istringstream in(text);
+    in >> std::get_time(&parts, "%Y-%m-%d");
+    if (in.fail())
+    {
+        return false;
+    }
+    if (!(in >> std::ws).eof())
+    {
+        in >> std::get_time(&parts, "%H:%M:%S");
+        if (in.fail() || !(in >> std::ws).eof())
+        {
+            return false;
+        }
+    }
+    parts.tm_isdst = -1;
+    time = std::mktime(&parts);
+    return time != -1;
+}
 
-    std::string command = argv[1];
-    MiniGit mg; // Initialize MiniGit object
-
-    // Create a vector of arguments, excluding the program name (argv[0])
-    // The command itself (e.g., "init", "add") is args[0] in this vector.
-    // The actual command arguments start from args[1].
-    std::vector<std::string> args(argv + 1, argv + argc);
+// Options of "minigit log"; both "-n 5" and "-n5", "--since <date>" and "--since=<date>"
+static bool parse_log_options(const std::vector<std::string>& args, LogOptions& options)
+{
+    bool only_paths = false;
+    for (size_t i = 1; i < args.size(); ++i)
+    {
+        const std::string& arg = args[i];
+        if (only_paths || arg.empty() || arg[0] != '-')
+        {
+            options.paths.push_back(arg);
+            continue;
+        }
+        // The value of an option: attached ("-n5", "--since=<date>") or the next argument
+        auto value = [&](const std::string& name, std::string& out)
+        {
+            if (arg == name)
+            {
+                if (i + 1 == args.size())
+                    return false;
+                out = args[++i];
+                return true;
+            }
+            size_t skip = name.size() + (name.size() > 2 ? 1 : 0); // "--name=" or "-n"
+            if (arg.compare(0, name.size(), name) != 0 || arg.size() <= skip || (skip > name.size() && arg[name.size()] != '='))
+                return false;
+            out = arg.substr(skip);
+            return true;
+        };
+        std::string text;
+        if (arg == "--")
+            only_paths = true;
+        else if (arg == "--first-parent")
+            options.first_parent = true;
+        else if (arg == "--topo-order")
+            options.topo_order = true;
+        else if (value("-n", text) || value("--max-count", text))
+        {
+            char* end = nullptr;
+            options.max_count = std::strtol(text.c_str(), &end, 10);
+            if (text.empty() || *end != '\0' || options.max_count < 0)
+                return false;
+        }
+        else if (value("--since", text))
+        {
+            if (!parse_date(text, options.since))
+                return false;
+        }
+        else if (value("--until", text))
+        {
+            if (!parse_date(text, options.until))
+                return false;
+        }
+        else if (value("--author", text))
+            options.author = text;
+        else
+            return false;
+    }
+    return true;
+}
 
+// Runs one command; args[0] is the command name. Shared by the command line and `minigit serve`.
+static void run_command(MiniGit& mg, const std::vector<std::string>& args)
+{
+    const std::string& command = args[0];
     if (command == "init")
     {
         // Init command doesn't require repo to be initialized
@@ -65,13 +167,11 @@ int main(int argc, char* argv[])
 
         if (command == "add")
         {
-            if (args.size() < 2) // Expects "minigit add <filepath>"
+            if (args.size() < 2) // Expects "minigit add <path>..."
             {
-                printErrorAndExit("Invalid usage. Usage: minigit add <filepath>");
+                printErrorAndExit("Invalid usage. Usage: minigit add <path>...");
             }
-            // If you want to allow multiple files, you would loop through args from index 1
-            // For now, assuming single file as per original prompt
-            mg.add(args[1]);
+            mg.add(std::vector<std::string>(args.begin() + 1, args.end()));
         }
         else if (command == "commit")
         {
@@ -90,22 +190,42 @@ int main(int argc, char* argv[])
             }
             mg.commit(message);
         }
+        else if (command == "status")
+        {
+            if (args.size() != 1) // Expects "minigit status"
+            {
+                printErrorAndExit("Invalid usage. Usage: minigit status");
+            }
+            mg.status();
+        }
+        else if (command == "daemon")
+        {
+            if (args.size() > 2 || (args.size() == 2 && args[1] != "stop")) // Expects "minigit daemon [stop]"
+            {
+                printErrorAndExit("Invalid usage. Usage: minigit daemon [stop]");
+            }
+            mg.daemon(args.size() == 2 ? "stop" : "run");
+        }
         else if (command == "log")
         {
-            if (args.size() != 1) // Expects "minigit log"
+            LogOptions options;
+            if (!parse_log_options(args, options))
             {
-                printErrorAndExit("Invalid usage. Usage: minigit log");
+                printErrorAndExit("Invalid usage. Usage: minigit log " LOG_USAGE);
             }
-            mg.log();
+            mg.log(options);
         }
         else if (command == "branch")
         {
-            if (args.size() < 2) // Expects "minigit branch <branch-name>"
+            if (args.size() > 2) // Expects "minigit branch <branch-name>" or "minigit branch [--list]"
             {
-                printErrorAndExit("Invalid usage. Usage: minigit branch <branch-name>");
+                printErrorAndExit("Invalid usage. Usage: minigit branch <branch-name> | minigit branch [--list]");
             }
             // Additional validation for branch name can be done in MiniGit::branch
-            mg.branch(args[1]);
+            if (args.size() == 1 || args[1] == "--list")
+                mg.branch_list();
+            else
+                mg.branch(args[1]);
         }
         else if (command == "checkout")
         {
@@ -125,20 +245,140 @@ int main(int argc, char* argv[])
             // Additional validation for branch name can be done in MiniGit::merge
             mg.merge(args[1]);
         }
-        // --- Add 'else if' for Diff Viewer here if you implement it later ---
-        /*
-        else if (command == "diff") {
-            if (args.size() < 3 || args.size() > 3) { // Expects "minigit diff <commit1> <commit2>"
-                printErrorAndExit("Invalid usage. Usage: minigit diff <commit1> <commit2>");
+        else if (command == "config")
+        {
+            if (args.size() < 2 || args.size() > 3) // Expects "minigit config <key> [<value>]"
+            {
+                printErrorAndExit("Invalid usage. Usage: minigit config <key> [<value>]");
+            }
+            mg.config(args[1], args.size() == 3 ? args[2] : "");
+        }
+        else if (command == "repack" || command == "gc")
+        {
+            if (args.size() != 1) // Expects "minigit repack" or "minigit gc"
+            {
+                printErrorAndExit("Invalid usage. Usage: minigit " + command);
+            }
+            if (command == "gc")
+                mg.gc();
+            else
+                mg.repack();
+        }
+        else if (command == "prune")
+        {
+            // Expects "minigit prune [--expire <seconds> | now]"
+            long expire = -1; // gc.pruneExpire
+            bool valid = args.size() == 1;
+            if (args.size() == 3 && args[1] == "--expire")
+            {
+                char* end = nullptr;
+                expire = args[2] == "now" ? 0 : std::strtol(args[2].c_str(), &end, 10);
+                valid = expire >= 0 && (end == nullptr || (!args[2].empty() && *end == '\0'));
+            }
+            if (!valid)
+            {
+                printErrorAndExit("Invalid usage. Usage: minigit prune [--expire <seconds> | now]");
+            }
+            mg.prune(expire);
+        }
+        else if (command == "rev-parse")
+        {
+            if (args.size() < 2) // Expects "minigit rev-parse <revision>..."
+            {
+                printErrorAndExit("Invalid usage. Usage: minigit rev-parse <revision>...");
+            }
+            mg.rev_parse(std::vector<std::string>(args.begin() + 1, args.end()));
+        }
+        else if (command == "pack-refs")
+        {
+            if (args.size() != 1) // Expects "minigit pack-refs"
+            {
+                printErrorAndExit("Invalid usage. Usage: minigit pack-refs");
+            }
+            mg.pack_refs();
+        }
+        else if (command == "migrate-objects")
+        {
+            if (args.size() != 1) // Expects "minigit migrate-objects"
+            {
+                printErrorAndExit("Invalid usage. Usage: minigit migrate-objects");
+            }
+            mg.migrate_objects();
+        }
+        else if (command == "fsck")
+        {
+            if (args.size() != 1) // Expects "minigit fsck"
+            {
+                printErrorAndExit("Invalid usage. Usage: minigit fsck");
+            }
+            mg.fsck();
+        }
+        else if (command == "commit-graph")
+        {
+            if (args.size() != 2 || args[1] != "write") // Expects "minigit commit-graph write"
+            {
+                printErrorAndExit("Invalid usage. Usage: minigit commit-graph write");
+            }
+            mg.write_commit_graph();
+        }
+        else if (command == "diff")
+        {
+            if (args.size() == 1) // "minigit diff": working tree vs index
+            {
+                mg.diff_worktree();
+            }
+            else if (args.size() == 2 && args[1] == "--cached")
+            {
+                mg.diff_cached();
+            }
+            else if (args.size() == 3)
+            {
+                mg.diff(args[1], args[2]);
+            }
+            else
+            {
+                printErrorAndExit("Invalid usage. Usage: minigit diff [--cached | <commit1> <commit2>]");
             }
-            mg.diff(args[1], args[2]);
         }
-        */
         else // Catch-all for unknown commands after init check
         {
             printErrorAndExit("Unknown command: '" + command + "'");
         }
     }
+}
+
+int main(int argc, char* argv[])
+{
+    // Check for minimum arguments (just 'minigit' itself)
+    if (argc < 2)
+    {
+        print_usage();
+        return 1; // Exit with error
+    }
+
+    std::string command = argv[1];
+    MiniGit mg; // Initialize MiniGit object
 
+    // Create a vector of arguments, excluding the program name (argv[0])
+    // The command itself (e.g., "init", "add") is args[0] in this vector.
+    // The actual command arguments start from args[1].
+    std::vector<std::string> args(argv + 1, argv + argc);
+
+    if (command == "serve")
+    {
+        // Expects "minigit serve --stdio" or "minigit serve --socket [<path>]"
+        if (args.size() < 2 || args.size() > 3 || (args[1] != "--stdio" && args[1] != "--socket") ||
+            (args[1] == "--stdio" && args.size() != 2))
+        {
+            printErrorAndExit("Invalid usage. Usage: minigit serve --stdio | --socket [<path>]");
+        }
+        if (!isMiniGitRepo()) {
+            printErrorAndExit("Not a MiniGit repository. Run 'minigit init' first.");
+        }
+        CommandServer server(mg, [&mg](const std::vector<std::string>& request) { run_command(mg, request); });
+        return args[1] == "--stdio" ? server.serve_stdio()
+                                    : server.serve_socket(args.size() == 3 ? args[2] : ".minigit/serve.sock");
+    }
+    run_command(mg, args);
     return 0; // Success
-}
\ No newline at end of file
+}
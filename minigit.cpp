@@ -1,5 +1,16 @@
 #include "minigit.h"
 #include "utils.h" // For Utils::readFile, Utils::writeFile, Utils::createDirectory, Utils::sha1
+#include "pack.h"  // For PackReader, PackWriter
+#include "index.h" // For Index (binary staging area with stat cache)
+#include "thread_pool.h" // For ThreadPool::parallel_for
+#include "object_writer.h" // For ObjectWriter (streaming object writes)
+#include "commit_graph.h" // For CommitGraph (persistent parents and generation numbers)
+#include "diff.h" // For Diff::merge3 (line-level three-way merge)
+#include "worktree.h" // For WorktreeScanner, IgnoreRules
+#include "fsmonitor.h" // For FsMonitor (inotify daemon and its client)
+#include "trace.h" // For Trace::Span, Trace::count (MINIGIT_TRACE)
+#include "snapshot.h" // For Snapshot, PathPool (compact snapshots for merge and commit)
+#include "chunker.h" // For Chunker::next_cut (content-defined chunks of large files)
 #include <iostream>
 #include <fstream>
 #include <sstream>
@@ -7,18 +18,45 @@
 #include <iomanip> // For std::put_time, std::get_time, std::hex, std::setw, std::setfill
 #include <filesystem>
 #include <algorithm> // For std::set_union, std::max
-#include <set>       // For find_lca's ancestor history
-#include <queue>     // For std::queue in find_lca
+#include <cctype>    // For std::isdigit, std::tolower in resolve_commit
+#include <set>       // For std::set
+#include <queue>     // For std::queue in repack, std::priority_queue in log
+#include <cstdlib>   // For std::getenv
+#include <sys/stat.h> // For lstat
+#include <fcntl.h>    // For open in create_chunked_blob
+#include <unistd.h>   // For read, close
+#include <dirent.h>   // For opendir in prune_objects
+#include <atomic>     // For the counters of prune_objects
+#include <unordered_set> // For the marked objects in mark_reachable
 namespace fs = std::filesystem;
 
 // Constructor
 MiniGit::MiniGit()
+    : refs(fs::current_path() / ".minigit"),
+      commits([this](const std::string &hash, CommitInfo &info)
+              { return load_commit_info(hash, info); },
+              [this](const std::string &hash, CommitCache::Snapshot &snapshot)
+              {
+                  std::string type;
+                  std::string data;
+                  if (!read_object(hash, type, data) || type != "commit")
+                  {
+                      return false;
+                  }
+                  snapshot = parse_commit_data(hash, data).snapshot;
+                  return true;
+              })
 {
     repo_path = fs::current_path();
     objects_path = repo_path / ".minigit" / "objects";
     refs_path = repo_path / ".minigit" / "refs";
     head_path = repo_path / ".minigit" / "HEAD";
     index_path = repo_path / ".minigit" / "index"; // Staging area
+    config_path = repo_path / ".minigit" / "config";
+    fsmonitor_path = repo_path / ".minigit" / "fsmonitor";
+    packs_loaded = false;
+    load_commit_graph();
+    load_settings();
 }
 
 MiniGit::~MiniGit()
@@ -26,6 +64,309 @@ MiniGit::~MiniGit()
     // Destructor (nothing specific needed for this example)
 }
 
+namespace
+{
+// Identifies one version of a file or directory ("" if missing): a change of inode, size or
+// mtime means another process replaced or modified it
+std::string file_stamp(const fs::path &path)
+{
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0)
+    {
+        return "";
+    }
+    return std::to_string(st.st_ino) + ":" + std::to_string(st.st_size) + ":" +
+           std::to_string(st.st_mtim.tv_sec) + "." + std::to_string(st.st_mtim.tv_nsec);
+}
+
+// Calls fn(is_tree, hash, name) for every "<blob|tree> <40 hex> <name>" line of a tree
+// object, with views into content; false if a line is malformed
+template <typename Fn>
+bool parse_tree(const std::string &content, Fn fn)
+{
+    std::string_view text(content);
+    size_t pos = 0;
+    while (pos < text.size())
+    {
+        size_t eol = text.find('\n', pos);
+        if (eol == std::string_view::npos)
+            eol = text.size();
+        size_t type_end = text.find(' ', pos);
+        if (type_end == std::string_view::npos || type_end + 42 > eol || text[type_end + 41] != ' ')
+        {
+            return false;
+        }
+        fn(text.compare(pos, type_end - pos, "tree") == 0, text.substr(type_end + 1, 40),
+           text.substr(type_end + 42, eol - type_end - 42));
+        pos = eol + 1;
+    }
+    return true;
+}
+
+// Appends "<type> <hex> <name>\n" to a tree object being built
+void append_tree_line(std::string &content, const char *type, std::string_view hash, std::string_view name)
+{
+    content += type;
+    content += ' ';
+    content.append(hash.data(), hash.size());
+    content += ' ';
+    content.append(name.data(), name.size());
+    content += '\n';
+}
+
+// Streams a loose object file through a 64 KiB buffer: the zlib stream is inflated piece
+// by piece, the "<type> <size>\0" header is split off into type and size, and fn receives
+// the content. False with the reason in error if the stream or its header is damaged.
+bool stream_loose_object(const fs::path &path, std::string &type, uint64_t &size,
+                         const std::function<void(const char *, size_t)> &fn, std::string &error)
+{
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        error = std::string("cannot open: ") + std::strerror(errno);
+        return false;
+    }
+    z_stream zs{};
+    if (inflateInit(&zs) != Z_OK)
+    {
+        close(fd);
+        error = "cannot inflate";
+        return false;
+    }
+    const size_t CHUNK = 64 * 1024;
+    std::vector<char> in(CHUNK);
+    std::vector<char> out(CHUNK);
+    std::string header;
+    bool in_header = true;
+    bool bad_header = false;
+    uint64_t content_bytes = 0;
+    int ret = Z_OK;
+    while (ret != Z_STREAM_END)
+    {
+        ssize_t n = read(fd, in.data(), in.size());
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break; // Truncated stream (or a read error)
+        zs.next_in = reinterpret_cast<Bytef *>(in.data());
+        zs.avail_in = static_cast<uInt>(n);
+        while (zs.avail_in > 0 && ret != Z_STREAM_END)
+        {
+            zs.next_out = reinterpret_cast<Bytef *>(out.data());
+            zs.avail_out = static_cast<uInt>(out.size());
+            ret = inflate(&zs, Z_NO_FLUSH);
+            if (ret != Z_OK && ret != Z_STREAM_END)
+                break;
+            const char *data = out.data();
+            size_t length = out.size() - zs.avail_out;
+            if (in_header)
+            {
+                const char *nul = static_cast<const char *>(std::memchr(data, '\0', length));
+                size_t taken = nul ? static_cast<size_t>(nul - data) : length;
+                header.append(data, taken);
+                if (nul == nullptr)
+                {
+                    bad_header = header.size() > 64;
+                    if (bad_header)
+                        break;
+                    continue;
+                }
+                size_t space = header.find(' ');
+                std::string size_field = space == std::string::npos ? "" : header.substr(space + 1);
+                bad_header = space == std::string::npos || size_field.empty() || size_field.size() > 19 ||
+                             size_field.find_first_not_of("0123456789") != std::string::npos;
+                if (bad_header)
+                    break;
+                type = header.substr(0, space); // Known before fn sees any content
+                size = std::stoull(size_field);
+                in_header = false;
+                data += taken + 1;
+                length -= taken + 1;
+            }
+            content_bytes += length;
+            if (length > 0)
+                fn(data, length);
+        }
+        if ((ret != Z_OK && ret != Z_STREAM_END) || bad_header)
+            break;
+    }
+    inflateEnd(&zs);
+    close(fd);
+
+    if (!bad_header && ret != Z_STREAM_END)
+    {
+        error = "corrupt or truncated zlib stream";
+        return false;
+    }
+    if (in_header)
+    {
+        error = "malformed object header";
+        return false;
+    }
+    if (size != content_bytes)
+    {
+        error = "header says " + std::to_string(size) + " bytes, content has " + std::to_string(content_bytes);
+        return false;
+    }
+    return true;
+}
+
+bool is_hex_hash(std::string_view text)
+{
+    return text.size() == 40 && text.find_first_not_of("0123456789abcdef") == std::string_view::npos;
+}
+
+// Checks a commit against the format serialize_commit_data writes and parse_commit_data reads:
+// "parent: ", optional "parent2: ", "message: ", "author: ", "timestamp: " lines, then
+// either "tree: <hash>" or "---snapshot---" and one "<path> <blob>" line per file. Calls
+// ref(hash, kind) for each object it names; returns the first problem, "" if none.
+template <typename Fn>
+std::string check_commit(const std::string &content, Fn ref)
+{
+    std::istringstream in(content);
+    std::string line;
+    bool parent = false, message = false, author = false, timestamp = false, tree = false, snapshot = false;
+    while (std::getline(in, line))
+    {
+        if (snapshot)
+        {
+            size_t space = line.find(' ');
+            if (space == 0 || space == std::string::npos || !is_hex_hash(std::string_view(line).substr(space + 1)))
+                return "malformed snapshot line '" + line + "'";
+            ref(line.substr(space + 1), "blob");
+        }
+        else if (line.rfind("parent: ", 0) == 0 || line.rfind("parent2: ", 0) == 0)
+        {
+            std::string hash = line.substr(line.find(' ') + 1);
+            bool first = line[6] == ':';
+            if (first ? parent : !parent)
+                return first ? "more than one parent line" : "parent2 without parent";
+            if (!(first && hash.empty()) && !is_hex_hash(hash))
+                return "malformed parent '" + hash + "'";
+            if (!hash.empty())
+                ref(hash, "commit");
+            parent = true;
+        }
+        else if (line.rfind("message: ", 0) == 0)
+            message = true;
+        else if (line.rfind("author: ", 0) == 0)
+            author = true;
+        else if (line.rfind("timestamp: ", 0) == 0)
+        {
+            std::string value = line.substr(11);
+            size_t digits = value.rfind('-', 0) == 0 ? 1 : 0;
+            if (value.size() <= digits || value.size() > 19 || value.find_first_not_of("0123456789", digits) != std::string::npos)
+                return "malformed timestamp '" + value + "'";
+            timestamp = true;
+        }
+        else if (line.rfind("tree: ", 0) == 0)
+        {
+            if (!is_hex_hash(std::string_view(line).substr(6)))
+                return "malformed tree '" + line.substr(6) + "'";
+            ref(line.substr(6), "tree");
+            tree = true;
+        }
+        else if (line == "---snapshot---")
+            snapshot = true;
+    }
+    if (!parent || !message || !author || !timestamp)
+        return std::string("missing ") + (!parent ? "parent" : !message ? "message" : !author ? "author" : "timestamp") + " line";
+    if (tree == snapshot)
+        return tree ? "both a tree and a snapshot" : "neither a tree nor a snapshot";
+    return "";
+}
+} // namespace
+
+void MiniGit::load_commit_graph()
+{
+    fs::path graph_file = objects_path / "info" / "commit-graph";
+    commit_graph_stamp = file_stamp(graph_file);
+    commit_graph.reset(new CommitGraph(graph_file));
+    commits.set_graph(commit_graph->valid() ? commit_graph.get() : nullptr);
+}
+
+void MiniGit::refresh()
+{
+    load_settings();
+    index_trees.clear(); // Only used within one status; dropped so it cannot grow across commands
+    refs.clear_cache();   // Branches may have moved since the last command
+
+    // A repack by another process replaces packs and deletes the loose objects they hold
+    {
+        std::lock_guard<std::mutex> lock(packs_mutex);
+        if (packs_loaded && file_stamp(objects_path / "pack") != packs_stamp)
+        {
+            packs.clear();
+            packs_loaded = false;
+        }
+    }
+
+    // Cached commits refer to rows of the graph, so a new graph starts a new cache. Commits
+    // themselves never change, so an unchanged file keeps everything parsed so far.
+    if (file_stamp(objects_path / "info" / "commit-graph") != commit_graph_stamp)
+    {
+        commits.clear();
+        load_commit_graph();
+    }
+}
+
+void MiniGit::load_settings()
+{
+    // Compression level: MINIGIT_COMPRESSION overrides core.compression, which defaults to zlib's default
+    compression_level = -1;
+    std::map<std::string, std::string> settings = read_config();
+    std::string level = settings.count("core.compression") ? settings["core.compression"] : "";
+    if (const char *env_level = std::getenv("MINIGIT_COMPRESSION"))
+    {
+        level = env_level;
+    }
+    if (!level.empty())
+    {
+        try
+        {
+            compression_level = std::stoi(level);
+        }
+        catch (const std::exception &)
+        {
+            compression_level = -1;
+        }
+        if (compression_level < -1 || compression_level > 9)
+        {
+            std::cerr << "Warning: Ignoring invalid compression level '" << level << "' (expected -1..9)." << std::endl;
+            compression_level = -1;
+        }
+    }
+
+    // core.fsync: fsync objects and files before renaming them into place
+    std::string fsync_setting = settings.count("core.fsync") ? settings["core.fsync"] : "false";
+    Utils::setDurableWrites(fsync_setting == "true" || fsync_setting == "1");
+
+    // Worker threads: MINIGIT_THREADS overrides core.threads, which defaults to the hardware thread count
+    int threads = read_config_int("core.threads", 0);
+    if (const char *env_threads = std::getenv("MINIGIT_THREADS"))
+    {
+        threads = std::atoi(env_threads);
+    }
+    thread_count = threads > 0 ? static_cast<size_t>(threads) : ThreadPool::default_threads();
+
+    // Chunked storage: MINIGIT_CHUNK_THRESHOLD overrides core.chunkThreshold (bytes, default 8 MiB)
+    std::string threshold = settings.count("core.chunkThreshold") ? settings["core.chunkThreshold"] : "";
+    if (const char *env_threshold = std::getenv("MINIGIT_CHUNK_THRESHOLD"))
+    {
+        threshold = env_threshold;
+    }
+    chunk_threshold = 8LL << 20;
+    if (!threshold.empty())
+    {
+        char *end = nullptr;
+        long long value = std::strtoll(threshold.c_str(), &end, 10);
+        if (*end != '\0' || value < 0)
+            std::cerr << "Warning: Ignoring invalid chunk threshold '" << threshold << "' (expected bytes, 0 to disable)." << std::endl;
+        else
+            chunk_threshold = value;
+    }
+}
+
 void MiniGit::init()
 {
     fs::create_directories(objects_path);        // Stores blobs and commit objects
@@ -37,10 +378,10 @@ void MiniGit::init()
     std::cout << "Initialized empty MiniGit repository in " << (repo_path / ".minigit").string() << std::endl;
 }
 
-std::map<std::string, std::string> MiniGit::read_index()
+std::map<std::string, std::string> MiniGit::read_config()
 {
-    std::map<std::string, std::string> index_map;
-    std::string content = Utils::readFile(index_path.string());
+    std::map<std::string, std::string> settings;
+    std::string content = Utils::readFile(config_path.string());
     std::stringstream ss(content);
     std::string line;
     while (std::getline(ss, line))
@@ -48,98 +389,1842 @@ std::map<std::string, std::string> MiniGit::read_index()
         size_t first_space = line.find(' ');
         if (first_space != std::string::npos)
         {
-            std::string filepath = line.substr(0, first_space);
-            std::string blob_hash = line.substr(first_space + 1);
-            index_map[filepath] = blob_hash;
+            settings[line.substr(0, first_space)] = line.substr(first_space + 1);
         }
     }
-    return index_map;
+    return settings;
+}
+
+int MiniGit::read_config_int(const std::string &key, int default_value)
+{
+    std::map<std::string, std::string> settings = read_config();
+    if (!settings.count(key))
+    {
+        return default_value;
+    }
+    try
+    {
+        return std::stoi(settings[key]);
+    }
+    catch (const std::exception &)
+    {
+        std::cerr << "Warning: Ignoring non-numeric value for " << key << "." << std::endl;
+        return default_value;
+    }
 }
 
-void MiniGit::write_index(const std::map<std::string, std::string> &index_map)
+void MiniGit::config(const std::string &key, const std::string &value)
 {
+    if (key.empty() || key.find(' ') != std::string::npos)
+    {
+        std::cerr << "Error: Invalid config key '" << key << "'." << std::endl;
+        return;
+    }
+
+    std::map<std::string, std::string> settings = read_config();
+    if (value.empty())
+    {
+        if (settings.count(key))
+        {
+            std::cout << settings[key] << std::endl;
+        }
+        return;
+    }
+
+    settings[key] = value;
     std::stringstream ss;
-    for (const auto &pair : index_map)
+    for (const auto &pair : settings)
     {
         ss << pair.first << " " << pair.second << "\n";
     }
-    Utils::writeFile(index_path.string(), ss.str());
+    Utils::writeFile(config_path.string(), ss.str());
 }
 
-std::string MiniGit::create_blob(const std::string &filepath)
+fs::path MiniGit::object_path(const std::string &hash)
 {
-    std::string content = Utils::readFile(filepath);
-    if (content.empty() && !fs::exists(filepath))
+    // Fanout layout: objects/ab/cdef... keeps each directory small
+    if (hash.size() < 3)
     {
-        std::cerr << "Error: File not found or empty: " << filepath << std::endl;
-        return "";
+        return objects_path / hash;
+    }
+    return objects_path / hash.substr(0, 2) / hash.substr(2);
+}
+
+fs::path MiniGit::loose_object_file(const std::string &hash)
+{
+    if (hash.empty())
+    {
+        return fs::path();
     }
+    fs::path fanout = object_path(hash);
+    if (fs::exists(fanout))
+    {
+        return fanout;
+    }
+    fs::path flat = objects_path / hash; // Layout used before fanout directories
+    if (fs::exists(flat))
+    {
+        return flat;
+    }
+    return fs::path();
+}
+
+bool MiniGit::object_exists(const std::string &hash)
+{
+    if (hash.empty())
+    {
+        return false;
+    }
+    if (!loose_object_file(hash).empty())
+    {
+        return true;
+    }
+    load_packs();
+    for (const auto &pack : packs)
+    {
+        if (pack->contains(hash))
+        {
+            return true;
+        }
+    }
+    return false;
+}
 
-    std::string blob_hash = Utils::sha1(content);
+bool MiniGit::freshen_object(const std::string &hash)
+{
+    if (hash.empty())
+    {
+        return false;
+    }
+    // A write reusing an object prune is about to delete would otherwise lose it
+    fs::path loose = loose_object_file(hash);
+    if (!loose.empty())
+    {
+        utimensat(AT_FDCWD, loose.c_str(), nullptr, 0);
+        return true;
+    }
+    load_packs();
+    for (const auto &pack : packs)
+    {
+        if (pack->contains(hash))
+        {
+            utimensat(AT_FDCWD, pack->pack_file().c_str(), nullptr, 0);
+            return true;
+        }
+    }
+    return false;
+}
 
-    fs::path blob_path = objects_path / blob_hash;
-    Utils::writeFile(blob_path.string(), content);
+bool MiniGit::stored_object_type(const std::string &hash, std::string &type)
+{
+    fs::path path = loose_object_file(hash);
+    if (path.empty())
+    {
+        load_packs();
+        for (const auto &pack : packs)
+        {
+            if (pack->type(hash, type))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
 
-    std::cout << "Blob created for " << filepath << " with hash " << blob_hash << std::endl;
-    return blob_hash;
+    // "<type> <size>\0" inflates from well under a kilobyte of the stream
+    char raw[512];
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return false;
+    }
+    ssize_t length = read(fd, raw, sizeof(raw));
+    close(fd);
+    if (length < 0)
+    {
+        return false;
+    }
+    std::string header;
+    if (Utils::decompressPrefix(raw, static_cast<size_t>(length), 64, header))
+    {
+        size_t space = header.find(' ');
+        size_t nul = header.find('\0');
+        if (space != std::string::npos && nul != std::string::npos && space < nul)
+        {
+            type = header.substr(0, space);
+            return true;
+        }
+    }
+    // Not a compressed header: a legacy object, or a damaged one that read_stored_object judges
+    std::string content;
+    return read_stored_object(hash, type, content);
 }
 
-void MiniGit::add(const std::string &filepath)
+void MiniGit::load_packs()
 {
-    if (!fs::exists(filepath) || fs::is_directory(filepath))
+    std::lock_guard<std::mutex> lock(packs_mutex); // Blob writers call this from worker threads
+    if (packs_loaded)
     {
-        std::cerr << "Error: Cannot add '" << filepath << "'. File does not exist or is a directory." << std::endl;
         return;
     }
-
-    std::string blob_hash = create_blob(filepath);
-    if (blob_hash.empty())
+    packs_loaded = true;
+    packs.clear();
+    fs::path pack_dir = objects_path / "pack";
+    packs_stamp = file_stamp(pack_dir);
+    if (!fs::is_directory(pack_dir))
+    {
+        return;
+    }
+    for (const auto &entry : fs::directory_iterator(pack_dir))
+    {
+        if (entry.path().extension() != ".idx")
+        {
+            continue;
+        }
+        auto reader = std::make_unique<PackReader>(entry.path());
+        if (reader->valid())
+        {
+            packs.push_back(std::move(reader));
+        }
+        else
+        {
+            std::cerr << "Warning: Ignoring unreadable pack index " << entry.path().string() << std::endl;
+        }
+    }
+}
+
+std::vector<std::string> MiniGit::list_loose_objects()
+{
+    std::vector<std::string> hashes;
+    if (!fs::is_directory(objects_path))
+    {
+        return hashes;
+    }
+    auto is_hex = [](const std::string &name)
+    { return name.find_first_not_of("0123456789abcdef") == std::string::npos; };
+    for (const auto &entry : fs::directory_iterator(objects_path))
+    {
+        std::string name = entry.path().filename().string();
+        if (entry.is_directory() && name.size() == 2 && is_hex(name))
+        {
+            for (const auto &object : fs::directory_iterator(entry.path()))
+            {
+                std::string rest = object.path().filename().string();
+                if (object.is_regular_file() && rest.size() == 38 && is_hex(rest))
+                {
+                    hashes.push_back(name + rest);
+                }
+            }
+        }
+        else if (entry.is_regular_file() && name.size() == 40 && is_hex(name))
+        {
+            hashes.push_back(name); // Not yet migrated to the fanout layout
+        }
+    }
+    return hashes;
+}
+
+void MiniGit::migrate_objects()
+{
+    size_t moved = 0;
+    for (const auto &entry : fs::directory_iterator(objects_path))
+    {
+        std::string name = entry.path().filename().string();
+        if (!entry.is_regular_file() || name.size() != 40 || name.find_first_not_of("0123456789abcdef") != std::string::npos)
+        {
+            continue;
+        }
+        fs::path target = object_path(name);
+        std::error_code ec;
+        fs::create_directories(target.parent_path(), ec);
+        if (fs::exists(target))
+        {
+            fs::remove(entry.path(), ec); // Already present in the new layout
+        }
+        else
+        {
+            fs::rename(entry.path(), target, ec);
+        }
+        if (ec)
+        {
+            std::cerr << "Error: Could not migrate object " << name << ": " << ec.message() << std::endl;
+            continue;
+        }
+        ++moved;
+    }
+    std::cout << "Migrated " << moved << " object(s) to the fanout layout." << std::endl;
+}
+
+std::string MiniGit::write_object(const std::string &type, const std::string &content)
+{
+    Trace::Span span("write_object");
+    // Objects are immutable, so one that is already stored is never rewritten
+    std::string hash = Utils::hashObject(type, content);
+    if (freshen_object(hash))
+    {
+        return hash;
+    }
+
+    // The object is deflated into a unique temp file and renamed, so concurrent writers
+    // of the same object (e.g. two identical files staged in parallel) never see a partial file.
+    // The name is already known, so the writer does not hash the content a second time.
+    ObjectWriter writer(objects_path, compression_level);
+    ObjectId id;
+    ObjectId::fromHex(hash, id);
+    if (!writer.begin(type, content.size(), &id) || !writer.write(content.data(), content.size()) || !writer.finish(id))
+    {
+        printErrorAndExit("Could not write " + type + " object to " + objects_path.string());
+    }
+    if (!writer.install(object_path(hash)))
+    {
+        printErrorAndExit("Could not write object " + hash);
+    }
+    return hash;
+}
+
+bool MiniGit::read_object(const std::string &hash, std::string &type, std::string &content)
+{
+    if (!read_stored_object(hash, type, content))
+    {
+        return false;
+    }
+    if (type != "chunked")
+    {
+        return true;
+    }
+    std::string manifest = std::move(content);
+    content.clear();
+    type = "blob";
+    return read_chunks(manifest, [&content](const std::string &chunk)
+                       {
+                           content += chunk;
+                           return true;
+                       });
+}
+
+bool MiniGit::read_chunks(const std::string &manifest, const std::function<bool(const std::string &)> &fn)
+{
+    size_t pos = 0;
+    std::string type;
+    std::string chunk;
+    while (pos < manifest.size())
+    {
+        size_t eol = manifest.find('\n', pos);
+        if (eol == std::string::npos)
+            eol = manifest.size();
+        // "<40 hex> <size>"
+        if (eol < pos + 42 || manifest[pos + 40] != ' ')
+        {
+            std::cerr << "Error: Malformed chunk list." << std::endl;
+            return false;
+        }
+        std::string chunk_hash = manifest.substr(pos, 40);
+        unsigned long long size = std::strtoull(manifest.c_str() + pos + 41, nullptr, 10);
+        if (!read_stored_object(chunk_hash, type, chunk) || type != "blob" || chunk.size() != size)
+        {
+            std::cerr << "Error: Missing or damaged chunk " << chunk_hash << std::endl;
+            return false;
+        }
+        if (!fn(chunk))
+            return false;
+        pos = eol + 1;
+    }
+    return true;
+}
+
+bool MiniGit::checkout_blob(const std::string &hash, const fs::path &path)
+{
+    std::string type;
+    std::string content;
+    if (!read_stored_object(hash, type, content))
+    {
+        return false;
+    }
+    if (type != "chunked")
+    {
+        Utils::writeFile(path, content);
+        return true;
+    }
+    // Streamed into "<path>.lock", which is renamed over the file once complete
+    LockFile file;
+    if (!file.acquire(path))
+    {
+        return false;
+    }
+    struct stat existing;
+    if (stat(path.c_str(), &existing) == 0)
+    {
+        fchmod(file.descriptor(), existing.st_mode & 07777); // Keep the permissions of the file being replaced
+    }
+    return read_chunks(content, [&file](const std::string &chunk)
+                       { return file.write(chunk.data(), chunk.size()); }) &&
+           file.commit();
+}
+
+bool MiniGit::read_stored_object(const std::string &hash, std::string &type, std::string &content)
+{
+    Trace::Span span("read_object");
+    fs::path path = loose_object_file(hash);
+    std::string raw = path.empty() ? "" : Utils::readFile(path.string());
+    if (path.empty())
+    {
+        // Not loose; it may have been packed by repack
+        load_packs();
+        for (const auto &pack : packs)
+        {
+            if (pack->read(hash, type, content))
+            {
+                Trace::count(Trace::OBJECTS_READ);
+                Trace::count(Trace::PACKED_OBJECTS_READ);
+                Trace::count(Trace::OBJECT_BYTES_READ, content.size());
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // A zlib stream starts with a CMF/FLG pair whose 16-bit value is a multiple of 31 (RFC 1950).
+    // Only then is it worth trying to inflate; anything else is a legacy uncompressed object.
+    bool looks_compressed = raw.size() >= 2 && (static_cast<unsigned char>(raw[0]) & 0x0f) == 8 &&
+                            ((static_cast<unsigned char>(raw[0]) << 8) | static_cast<unsigned char>(raw[1])) % 31 == 0;
+    std::string inflated;
+    if (looks_compressed && Utils::decompress(raw, inflated))
+    {
+        size_t space = inflated.find(' ');
+        size_t nul = inflated.find('\0');
+        if (space != std::string::npos && nul != std::string::npos && space < nul)
+        {
+            std::string size_field = inflated.substr(space + 1, nul - space - 1);
+            // At most 19 digits, so the size always fits in 64 bits
+            bool digits = !size_field.empty() && size_field.size() <= 19 &&
+                          size_field.find_first_not_of("0123456789") == std::string::npos;
+            if (digits && std::stoull(size_field) == inflated.size() - nul - 1)
+            {
+                type = inflated.substr(0, space);
+                content = inflated.substr(nul + 1);
+                Trace::count(Trace::OBJECTS_READ);
+                Trace::count(Trace::OBJECT_BYTES_READ, content.size());
+                return true;
+            }
+        }
+    }
+
+    // Legacy object written before compression was introduced: the file is the raw content,
+    // named by it. Data that looks like zlib but does not inflate is only taken as raw when it
+    // hashes to the name; otherwise it is a damaged object, whose bytes must not be handed out.
+    if (looks_compressed && Utils::sha1(raw) != hash)
+    {
+        std::cerr << "Error: Object " << hash << " is corrupt (" << path.string() << ")." << std::endl;
+        return false;
+    }
+    type = raw.rfind("parent: ", 0) == 0 ? "commit" : "blob";
+    content = std::move(raw);
+    Trace::count(Trace::OBJECTS_READ);
+    Trace::count(Trace::OBJECT_BYTES_READ, content.size());
+    return true;
+}
+
+void MiniGit::repack()
+{
+    LockFile lock;
+    if (!lock.acquire(repo_path / ".minigit" / "gc"))
+    {
+        return;
+    }
+    repack_objects(nullptr, 0);
+}
+
+void MiniGit::repack_objects(const std::vector<ObjectId> *reachable, std::time_t cutoff)
+{
+    Trace::Span span("repack");
+    load_packs();
+
+    // 1. Everything currently stored, loose or packed
+    std::vector<std::string> loose = list_loose_objects();
+    std::set<std::string> all_objects(loose.begin(), loose.end());
+    std::vector<fs::path> old_packs;
+    uintmax_t bytes_before = 0;
+    for (const std::string &hash : loose)
+    {
+        bytes_before += fs::file_size(loose_object_file(hash));
+    }
+    for (const auto &pack : packs)
+    {
+        for (size_t i = 0; i < pack->object_count(); ++i)
+        {
+            all_objects.insert(pack->object_id(i));
+        }
+        old_packs.push_back(pack->pack_file());
+        bytes_before += fs::file_size(pack->pack_file());
+    }
+    if (all_objects.empty())
+    {
+        std::cout << "Nothing to pack." << std::endl;
+        return;
+    }
+
+    // 2. Walk the history reachable from every branch and HEAD so each blob and tree can be
+    //    grouped with the other versions of its path (those make good delta bases)
+    std::vector<std::string> commit_order;
+    std::map<std::string, std::vector<std::string>> blobs_by_path;
+    std::set<std::string> grouped;
+    std::queue<std::string> q;
+    std::set<std::string> visited;
+    std::vector<std::string> tips = {get_head_commit_hash()};
+    std::vector<std::pair<std::string, std::string>> branches;
+    refs.list(branches);
+    for (const auto &branch : branches)
+    {
+        tips.push_back(branch.second);
+    }
+    for (const std::string &tip : tips)
+    {
+        if (!tip.empty() && visited.insert(tip).second)
+        {
+            q.push(tip);
+        }
+    }
+    // Versions of a directory's tree are grouped like versions of a file. A subtree seen
+    // before was walked then, so directories shared between commits are read only once.
+    std::function<void(const std::string &, const std::string &)> group_tree =
+        [&](const std::string &tree_hash, const std::string &prefix)
+    {
+        if (!all_objects.count(tree_hash) || !grouped.insert(tree_hash).second)
+        {
+            return;
+        }
+        blobs_by_path["tree:" + prefix].push_back(tree_hash);
+        std::vector<TreeEntry> entries;
+        read_tree(tree_hash, entries);
+        for (const TreeEntry &entry : entries)
+        {
+            if (entry.is_tree)
+            {
+                group_tree(entry.hash, prefix + entry.name + "/");
+            }
+            else if (all_objects.count(entry.hash) && grouped.insert(entry.hash).second)
+            {
+                blobs_by_path[prefix + entry.name].push_back(entry.hash);
+            }
+        }
+    };
+    while (!q.empty())
+    {
+        std::string current = q.front();
+        q.pop();
+        uint32_t id = commits.id(current);
+        if (id == CommitCache::NONE)
+        {
+            continue;
+        }
+        CommitInfo c_obj = commits.info(id);
+        commit_order.push_back(current);
+        grouped.insert(current);
+        if (!c_obj.tree_hash.empty())
+        {
+            group_tree(c_obj.tree_hash, "");
+        }
+        else
+        {
+            for (const auto &pair : get_commit(current).snapshot)
+            {
+                if (all_objects.count(pair.second) && grouped.insert(pair.second).second)
+                {
+                    blobs_by_path[pair.first].push_back(pair.second); // Newest version first
+                }
+            }
+        }
+        for (const std::string &parent : {c_obj.parent_hash, c_obj.second_parent_hash})
+        {
+            if (!parent.empty() && visited.insert(parent).second)
+            {
+                q.push(parent);
+            }
+        }
+    }
+
+    // 3. Write the pack: commits (consecutive commits share most of their snapshot),
+    //    then every path's versions, then anything unreachable grouped by type
+    PackWriter writer(objects_path / "pack", compression_level,
+                      read_config_int("pack.window", 10), read_config_int("pack.depth", 50));
+    auto pack_object = [&](const std::string &hash, const std::string &group)
+    {
+        std::string type;
+        std::string content;
+        if (!read_stored_object(hash, type, content) || pack_type_code(type) == 0)
+        {
+            std::cerr << "Warning: Could not read object " << hash << "; leaving it out of the pack." << std::endl;
+            return false;
+        }
+        writer.add(hash, type, content, group.empty() ? type : group);
+        return true;
+    };
+    std::set<std::string> packed;
+    for (const std::string &hash : commit_order)
+    {
+        if (pack_object(hash, "commit"))
+            packed.insert(hash);
+    }
+    for (const auto &pair : blobs_by_path)
+    {
+        for (const std::string &hash : pair.second)
+        {
+            if (pack_object(hash, pair.first))
+                packed.insert(hash);
+        }
+    }
+    size_t exploded = 0;
+    size_t dropped = 0;
+    for (const std::string &hash : all_objects)
+    {
+        if (grouped.count(hash))
+            continue;
+        ObjectId id;
+        if (reachable != nullptr && ObjectId::fromHex(hash, id) &&
+            !std::binary_search(reachable->begin(), reachable->end(), id))
+        {
+            // Unreachable: a loose object is simply not packed (prune left only recent ones).
+            // One that exists only in a pack outlives the pack only while the pack is recent.
+            if (!loose_object_file(hash).empty())
+                continue;
+            struct stat st;
+            const auto holder = std::find_if(packs.begin(), packs.end(), [&hash](const std::unique_ptr<PackReader> &pack)
+                                             { return pack->contains(hash); });
+            if (holder == packs.end() || stat((*holder)->pack_file().c_str(), &st) != 0 || st.st_mtime < cutoff)
+            {
+                ++dropped;
+                continue;
+            }
+            std::string type;
+            std::string content;
+            ObjectWriter loose(objects_path, compression_level); // Keeps the name it had in the pack
+            fs::path target = object_path(hash);
+            if (!read_stored_object(hash, type, content) || !loose.begin(type, content.size(), &id) ||
+                !loose.write(content.data(), content.size()) || !loose.finish(id) || !loose.install(target))
+            {
+                std::cerr << "Warning: Could not unpack unreachable object " << hash << "; keeping it packed." << std::endl;
+                if (pack_object(hash, ""))
+                    packed.insert(hash);
+                continue;
+            }
+            struct timespec times[2] = {st.st_mtim, st.st_mtim}; // Keeps aging from when it was packed
+            utimensat(AT_FDCWD, target.c_str(), times, 0);
+            ++exploded;
+            continue;
+        }
+        if (pack_object(hash, ""))
+            packed.insert(hash);
+    }
+    if (!writer.finish())
+    {
+        return;
+    }
+
+    // 4. The new pack holds everything: drop the old packs and the packed loose objects
+    packs.clear();
+    packs_loaded = false;
+    for (const fs::path &old_pack : old_packs)
+    {
+        if (old_pack != writer.pack_file())
+        {
+            fs::remove(old_pack);
+            fs::remove(fs::path(old_pack).replace_extension(".idx"));
+        }
+    }
+    for (const std::string &hash : loose)
+    {
+        if (packed.count(hash))
+        {
+            fs::path file = loose_object_file(hash);
+            std::error_code ec;
+            fs::remove(file, ec);
+            if (file.parent_path() != objects_path)
+            {
+                fs::remove(file.parent_path(), ec); // Only succeeds once the fanout directory is empty
+            }
+        }
+    }
+
+    uintmax_t bytes_after = writer.pack_bytes();
+    std::cout << "Packed " << writer.objects() << " objects (" << writer.deltas() << " as deltas) into "
+              << writer.pack_file().filename().string() << std::endl;
+    if (dropped + exploded > 0)
+    {
+        std::cout << "Dropped " << dropped << " unreachable packed object(s); unpacked " << exploded
+                  << " recent one(s) to age out loose." << std::endl;
+    }
+    std::cout << "Object store: " << bytes_before << " bytes before, " << bytes_after << " bytes after ("
+              << std::fixed << std::setprecision(1)
+              << (bytes_before ? 100.0 * bytes_after / bytes_before : 0.0) << "%)" << std::endl;
+}
+
+void MiniGit::gc()
+{
+    Trace::Span span("gc");
+    LockFile lock;
+    if (!lock.acquire(repo_path / ".minigit" / "gc"))
+    {
+        return;
+    }
+    pack_refs();
+    std::time_t cutoff = prune_cutoff(-1);
+    std::vector<ObjectId> reachable;
+    if (prune_objects(cutoff, reachable))
+    {
+        repack_objects(&reachable, cutoff);
+    }
+    else
+    {
+        repack_objects(nullptr, 0); // Without a full mark, every object is kept
+    }
+    write_commit_graph();
+}
+
+void MiniGit::prune(long expire_seconds)
+{
+    LockFile lock;
+    if (!lock.acquire(repo_path / ".minigit" / "gc"))
+    {
+        return;
+    }
+    std::vector<ObjectId> reachable;
+    if (prune_objects(prune_cutoff(expire_seconds), reachable) && fs::exists(objects_path / "info" / "commit-graph"))
+    {
+        write_commit_graph(); // Drops pruned commits, which rev-parse would otherwise still find there
+    }
+}
+
+void MiniGit::fsck()
+{
+    Trace::Span span("fsck");
+    auto started = std::chrono::steady_clock::now();
+    load_packs();
+
+    // Every stored object: names are only looked up in here, so references are checked
+    // without touching the disk
+    std::vector<std::string> loose = list_loose_objects();
+    std::vector<ObjectId> known;
+    for (const std::string &hash : loose)
+    {
+        ObjectId id;
+        if (ObjectId::fromHex(hash, id))
+            known.push_back(id);
+    }
+    size_t packed_count = 0;
+    for (const auto &pack : packs)
+    {
+        for (size_t i = 0; i < pack->object_count(); ++i)
+        {
+            ObjectId id;
+            ObjectId::fromHex(pack->object_id(i), id);
+            known.push_back(id);
+        }
+        packed_count += pack->object_count();
+    }
+    std::sort(known.begin(), known.end());
+    known.erase(std::unique(known.begin(), known.end()), known.end());
+
+    // Each worker checks one object at a time, so memory stays at a few buffers per thread
+    std::vector<std::string> problems;
+    std::mutex problems_mutex;
+    std::atomic<unsigned long long> bytes(0);
+    auto check = [&](const std::string &hash, PackReader *pack)
+    {
+        std::vector<std::string> found;
+        uint64_t hashed = 0;
+        fsck_object(hash, pack, known, found, hashed);
+        bytes += hashed;
+        if (!found.empty())
+        {
+            std::lock_guard<std::mutex> lock(problems_mutex);
+            problems.insert(problems.end(), found.begin(), found.end());
+        }
+    };
+    ThreadPool::parallel_for(loose.size(), thread_count, [&](size_t i)
+                             { check(loose[i], nullptr); });
+    for (const auto &pack : packs)
+    {
+        ThreadPool::parallel_for(pack->object_count(), thread_count, [&](size_t i)
+                                 { check(pack->object_id(i), pack.get()); });
+    }
+
+    // What points into the store from outside it
+    auto exists = [&known](const std::string &hash)
+    {
+        ObjectId id;
+        return ObjectId::fromHex(hash, id) && std::binary_search(known.begin(), known.end(), id);
+    };
+    std::string head = get_head_commit_hash();
+    if (!head.empty() && !exists(head))
+        problems.push_back("HEAD: missing commit " + head);
+    std::vector<std::pair<std::string, std::string>> branches;
+    refs.list(branches);
+    for (const auto &branch : branches)
+    {
+        if (!exists(branch.second))
+            problems.push_back("branch " + branch.first + ": missing commit " + branch.second);
+    }
+    Index index(index_path);
+    index.for_each([&](const std::string &path, const IndexEntry &entry)
+                   {
+        if (!entry.hash.empty() && !exists(entry.hash))
+            problems.push_back("index entry " + path + ": missing blob " + entry.hash); });
+
+    std::sort(problems.begin(), problems.end());
+    for (const std::string &problem : problems)
+    {
+        std::cerr << "error: " << problem << std::endl;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    double megabytes = bytes / (1024.0 * 1024.0);
+    std::cout << "Checked " << loose.size() + packed_count << " objects (" << loose.size() << " loose, "
+              << packed_count << " packed), " << std::fixed << std::setprecision(1) << megabytes << " MB in "
+              << std::setprecision(2) << seconds << " s (" << std::setprecision(1)
+              << (seconds > 0 ? megabytes / seconds : 0.0) << " MB/s)." << std::endl;
+    if (!problems.empty())
+    {
+        printErrorAndExit("fsck found " + std::to_string(problems.size()) + " problem(s).");
+    }
+    std::cout << "No problems found." << std::endl;
+}
+
+void MiniGit::fsck_object(const std::string &hash, PackReader *pack, const std::vector<ObjectId> &known,
+                          std::vector<std::string> &problems, uint64_t &bytes)
+{
+    std::string where = (pack ? "packed object " : "loose object ") + hash;
+    std::string type;
+    std::string content; // Only for the types whose content is parsed below
+    ObjectId name;
+    ObjectId::fromHex(hash, name);
+    ObjectId actual;
+    if (pack != nullptr)
+    {
+        if (!pack->read(hash, type, content))
+        {
+            problems.push_back(where + ": cannot be read from " + pack->pack_file().filename().string());
+            return;
+        }
+        bytes += content.size();
+        if (type != "chunked")
+            ObjectId::fromHex(Utils::hashObject(type, content), actual);
+        // An object from before objects had a header is named by its content alone, and keeps
+        // that name when gc packs it
+        if (actual != name && (type == "blob" || type == "commit") && Utils::sha1(content) == hash)
+            actual = name;
+    }
+    else
+    {
+        Sha1Hasher hasher;
+        uint64_t size = 0;
+        std::string error;
+        bool hashed_header = false;
+        auto hash_header = [&]
+        {
+            std::string header = Utils::objectHeader(type, size);
+            hasher.update(header.data(), header.size());
+            hashed_header = true;
+        };
+        auto parsed = [&type]
+        { return type == "commit" || type == "tree" || type == "chunked"; };
+        bool ok = stream_loose_object(loose_object_file(hash), type, size, [&](const char *data, size_t length)
+                                      {
+            if (parsed())
+                content.append(data, length);
+            else
+            {
+                if (!hashed_header)
+                    hash_header();
+                hasher.update(data, length);
+            } }, error);
+        if (ok)
+        {
+            bytes += size;
+            if (!parsed())
+            {
+                if (!hashed_header) // Empty content never reaches the callback
+                    hash_header();
+                hasher.finish(actual);
+            }
+            else if (type != "chunked")
+                ObjectId::fromHex(Utils::hashObject(type, content), actual);
+        }
+        else
+        {
+            // An object written before compression is stored raw and named by that content; its
+            // type is told apart as read_stored_object does
+            std::string raw = Utils::readFile(loose_object_file(hash).string());
+            if (Utils::sha1(raw) != hash)
+            {
+                problems.push_back(where + ": " + error);
+                return;
+            }
+            type = raw.rfind("parent: ", 0) == 0 ? "commit" : "blob";
+            bytes += raw.size();
+            actual = name;
+            content = type == "commit" ? std::move(raw) : "";
+        }
+    }
+
+    auto exists = [&known](std::string_view other)
+    {
+        ObjectId id;
+        return ObjectId::fromHex(other, id) && std::binary_search(known.begin(), known.end(), id);
+    };
+    auto ref = [&](const std::string &other, const char *kind)
+    {
+        if (!exists(other))
+            problems.push_back(where + ": missing " + kind + " " + other);
+    };
+    if (type == "chunked")
+    {
+        // Named like the whole file's blob: the chunks are hashed in order as one stream, after
+        // a header holding the file size, which the chunk list gives up front
+        uint64_t total = 0;
+        for (size_t pos = 0; pos < content.size();)
+        {
+            size_t eol = std::min(content.find('\n', pos), content.size());
+            if (eol > pos + 41)
+                total += std::strtoull(content.c_str() + pos + 41, nullptr, 10);
+            pos = eol + 1;
+        }
+        Sha1Hasher whole_file;
+        std::string header = Utils::objectHeader("blob", total);
+        whole_file.update(header.data(), header.size());
+        bool complete = read_chunks(content, [&](const std::string &chunk)
+                                    {
+            whole_file.update(chunk.data(), chunk.size());
+            bytes += chunk.size();
+            return true; });
+        if (!complete)
+        {
+            problems.push_back(where + ": malformed chunk list, or a chunk is missing or damaged");
+            return;
+        }
+        whole_file.finish(actual);
+    }
+    if (actual != name)
+    {
+        problems.push_back(where + ": " + type + " content hashes to " + actual.hex());
+        return;
+    }
+
+    if (type == "commit")
+    {
+        std::string problem = check_commit(content, ref);
+        if (!problem.empty())
+            problems.push_back(where + ": " + problem);
+    }
+    else if (type == "tree")
+    {
+        std::string problem;
+        bool valid = parse_tree(content, [&](bool is_tree, std::string_view child, std::string_view child_name)
+                                {
+            if (!is_hex_hash(child) || child_name.empty() || child_name.find('/') != std::string_view::npos)
+                problem = "malformed entry '" + std::string(child_name) + "'";
+            else
+                ref(std::string(child), is_tree ? "tree" : "blob"); });
+        if (!valid || !problem.empty())
+            problems.push_back(where + ": " + (valid ? problem : "malformed tree"));
+    }
+    else if (type != "blob" && type != "chunked")
+    {
+        problems.push_back(where + ": unknown type '" + type + "'");
+    }
+}
+
+std::time_t MiniGit::prune_cutoff(long expire_seconds)
+{
+    if (expire_seconds < 0)
+    {
+        expire_seconds = read_config_int("gc.pruneExpire", 14 * 24 * 3600);
+    }
+    return std::time(nullptr) - static_cast<std::time_t>(std::max(expire_seconds, 0L));
+}
+
+bool MiniGit::mark_reachable(std::vector<ObjectId> &reachable)
+{
+    Trace::Span span("mark_reachable");
+    std::unordered_set<ObjectId, ObjectIdHash> marked;
+    // Each batch of objects is read in parallel; the batch bounds the memory held for results
+    const size_t batch_size = 16384;
+    auto mark = [&marked](std::string_view hex, std::vector<ObjectId> &queue)
+    {
+        ObjectId id;
+        if (ObjectId::fromHex(hex, id) && marked.insert(id).second)
+            queue.push_back(id);
+    };
+
+    // 1. Commits, from the commit-graph where it has them: only their ids are needed here
+    std::vector<std::string> tips = {get_head_commit_hash()};
+    std::vector<std::pair<std::string, std::string>> branches;
+    refs.list(branches);
+    for (const auto &branch : branches)
+    {
+        tips.push_back(branch.second);
+    }
+    std::vector<char> seen;
+    std::vector<uint32_t> stack;
+    std::vector<ObjectId> commit_ids;
+    for (const std::string &tip : tips)
+    {
+        if (tip.empty())
+            continue;
+        uint32_t id = commits.id(tip);
+        if (id == CommitCache::NONE)
+        {
+            std::cerr << "Error: Cannot read commit " << tip << std::endl;
+            return false;
+        }
+        stack.push_back(id);
+    }
+    while (!stack.empty())
+    {
+        uint32_t current = stack.back();
+        stack.pop_back();
+        if (current >= seen.size())
+            seen.resize(commits.size(), 0);
+        if (seen[current])
+            continue;
+        seen[current] = 1;
+        mark(commits.hash(current), commit_ids);
+        for (int which = 0; which < 2; ++which)
+        {
+            uint32_t parent = commits.parent(current, which);
+            if (parent != CommitCache::NONE)
+            {
+                stack.push_back(parent);
+                continue;
+            }
+            const CommitInfo &info = commits.info(current);
+            const std::string &parent_hash = which == 0 ? info.parent_hash : info.second_parent_hash;
+            if (!parent_hash.empty())
+            {
+                std::cerr << "Error: Cannot read commit " << parent_hash << std::endl;
+                return false;
+            }
+        }
+    }
+
+    // 2. Every commit's root tree (or flat snapshot), then the trees one level at a time,
+    //    so each level's objects are read in parallel. Blobs are only collected.
+    std::vector<ObjectId> blobs;
+    Index index(index_path);
+    index.for_each([&](const std::string &, const IndexEntry &entry)
+                   { mark(entry.hash, blobs); });
+    std::vector<ObjectId> level = std::move(commit_ids);
+    bool reading_commits = true;
+    while (!level.empty())
+    {
+        std::vector<ObjectId> next;
+        for (size_t begin = 0; begin < level.size(); begin += batch_size)
+        {
+            size_t count = std::min(batch_size, level.size() - begin);
+            std::vector<std::vector<std::pair<std::string, bool>>> children(count); // (hash, is_tree)
+            std::vector<char> failed(count, 0);
+            ThreadPool::parallel_for(count, thread_count, [&](size_t i)
+                                     {
+                std::string hash = level[begin + i].hex();
+                std::string type;
+                std::string content;
+                if (!read_stored_object(hash, type, content) || type != (reading_commits ? "commit" : "tree"))
+                {
+                    failed[i] = 1;
+                    return;
+                }
+                if (!reading_commits)
+                {
+                    failed[i] = !parse_tree(content, [&](bool is_tree, std::string_view child, std::string_view)
+                                            { children[i].emplace_back(std::string(child), is_tree); });
+                    return;
+                }
+                Commit commit = parse_commit_data(hash, content, false);
+                if (!commit.tree_hash.empty())
+                {
+                    children[i].emplace_back(commit.tree_hash, true);
+                    return;
+                }
+                for (const auto &pair : parse_commit_data(hash, content, true).snapshot)
+                    children[i].emplace_back(pair.second, false); });
+            for (size_t i = 0; i < count; ++i)
+            {
+                if (failed[i])
+                {
+                    std::cerr << "Error: Cannot read " << (reading_commits ? "commit " : "tree ") << level[begin + i].hex() << std::endl;
+                    return false;
+                }
+                for (const auto &child : children[i])
+                    mark(child.first, child.second ? next : blobs);
+            }
+        }
+        level = std::move(next);
+        reading_commits = false;
+    }
+
+    // 3. Blobs: only their type is read, to find chunked ones, whose chunks are reachable too
+    std::vector<char> missing(blobs.size(), 0);
+    std::vector<std::string> manifests(blobs.size());
+    ThreadPool::parallel_for(blobs.size(), thread_count, [&](size_t i)
+                             {
+        std::string hash = blobs[i].hex();
+        std::string type;
+        if (!stored_object_type(hash, type))
+            missing[i] = 1;
+        else if (type == "chunked")
+            missing[i] = !read_stored_object(hash, type, manifests[i]); });
+    size_t blob_count = blobs.size();
+    for (size_t i = 0; i < blob_count; ++i)
+    {
+        if (missing[i])
+        {
+            std::cerr << "Error: Cannot read blob " << blobs[i].hex() << std::endl;
+            return false;
+        }
+        // "<chunk hash> <size>" lines
+        std::string_view manifest(manifests[i]);
+        for (size_t pos = 0; pos + 40 <= manifest.size();)
+        {
+            mark(manifest.substr(pos, 40), blobs);
+            size_t eol = manifest.find('\n', pos);
+            if (eol == std::string_view::npos)
+                break;
+            pos = eol + 1;
+        }
+    }
+
+    reachable.assign(marked.begin(), marked.end());
+    std::sort(reachable.begin(), reachable.end());
+    return true;
+}
+
+bool MiniGit::prune_objects(std::time_t cutoff, std::vector<ObjectId> &reachable)
+{
+    Trace::Span span("prune");
+    auto started = std::chrono::steady_clock::now();
+    if (!mark_reachable(reachable))
+    {
+        std::cerr << "Error: Not pruning, since some reachable objects cannot be read." << std::endl;
+        return false;
+    }
+    auto marked = std::chrono::steady_clock::now();
+
+    // Sweep: an unreachable object is deleted only if it was last written before cutoff. A
+    // writer that reuses an object freshens its mtime (freshen_object), and objects being
+    // written by a concurrent add are newer than cutoff until long after that add finished.
+    std::atomic<size_t> removed(0);
+    std::atomic<size_t> recent(0);
+    std::atomic<unsigned long long> reclaimed(0);
+    auto sweep_file = [&](int dir_fd, const char *name, const std::string &hash)
+    {
+        ObjectId id;
+        bool is_object = !hash.empty();
+        if (is_object && (!ObjectId::fromHex(hash, id) || std::binary_search(reachable.begin(), reachable.end(), id)))
+            return; // Reachable, or not an object at all
+        struct stat st;
+        if (fstatat(dir_fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0 || !S_ISREG(st.st_mode))
+            return;
+        if (st.st_mtime >= cutoff)
+        {
+            recent += is_object;
+            return;
+        }
+        if (unlinkat(dir_fd, name, 0) == 0 && is_object)
+        {
+            ++removed;
+            reclaimed += static_cast<unsigned long long>(st.st_size);
+        }
+    };
+    // Calls fn(name) for every entry of a directory but . and ..
+    auto each_entry = [](DIR *dir, const std::function<void(const char *)> &fn)
+    {
+        while (struct dirent *entry = readdir(dir))
+        {
+            if (std::strcmp(entry->d_name, ".") != 0 && std::strcmp(entry->d_name, "..") != 0)
+                fn(entry->d_name);
+        }
+    };
+    ThreadPool::parallel_for(256, thread_count, [&](size_t i)
+                             {
+        static const char digits[] = "0123456789abcdef";
+        std::string fanout = {digits[i >> 4], digits[i & 15]};
+        DIR *dir = opendir((objects_path / fanout).c_str());
+        if (dir == nullptr)
+            return;
+        each_entry(dir, [&](const char *name)
+                   {
+            if (std::strlen(name) == 38)
+                sweep_file(dirfd(dir), name, fanout + name); });
+        closedir(dir); });
+    // Objects from before the fanout layout, and temp files left by interrupted writes
+    if (DIR *dir = opendir(objects_path.c_str()))
+    {
+        each_entry(dir, [&](const char *name)
+                   {
+            std::string file = name;
+            if (file.size() == 40)
+                sweep_file(dirfd(dir), name, file);
+            else if (file.rfind("tmp_obj_", 0) == 0)
+                sweep_file(dirfd(dir), name, ""); });
+        closedir(dir);
+    }
+
+    auto done = std::chrono::steady_clock::now();
+    auto ms = [](std::chrono::steady_clock::duration d)
+    { return std::chrono::duration_cast<std::chrono::milliseconds>(d).count(); };
+    std::cout << "Marked " << reachable.size() << " reachable objects in " << ms(marked - started) << " ms." << std::endl;
+    std::cout << "Pruned " << removed << " unreachable objects, reclaiming " << reclaimed << " bytes, in "
+              << ms(done - marked) << " ms; kept " << recent << " unreachable objects within the grace period." << std::endl;
+    return true;
+}
+
+void MiniGit::pack_refs()
+{
+    long packed = refs.pack();
+    if (packed >= 0)
+    {
+        std::cout << "Packed " << packed << " branches into packed-refs." << std::endl;
+    }
+}
+
+void MiniGit::write_commit_graph()
+{
+    std::vector<std::string> tips;
+    std::vector<std::pair<std::string, std::string>> branches;
+    refs.list(branches);
+    for (const auto &branch : branches)
+    {
+        tips.push_back(branch.second);
+    }
+    tips.push_back(get_head_commit_hash()); // Covers a detached HEAD
+    update_commit_graph(tips, true);
+
+    CommitGraph written(objects_path / "info" / "commit-graph");
+    if (written.valid())
+    {
+        std::cout << "Commit-graph: " << written.size() << " commits" << std::endl;
+    }
+}
+
+void MiniGit::update_commit_graph(const std::vector<std::string> &tips, bool rewrite)
+{
+    // Reopened rather than using commit_graph, which may predate commits made since
+    CommitGraph existing(objects_path / "info" / "commit-graph");
+    std::vector<CommitGraph::Record> records;
+    if (!rewrite && existing.valid())
+    {
+        existing.records(records);
+    }
+
+    std::vector<char> seen;
+    std::vector<uint32_t> stack;
+    for (const std::string &tip : tips)
+    {
+        uint32_t id = commits.id(tip);
+        if (id != CommitCache::NONE)
+        {
+            stack.push_back(id);
+        }
+    }
+    while (!stack.empty())
+    {
+        uint32_t current = stack.back();
+        stack.pop_back();
+        if (current >= seen.size())
+            seen.resize(commits.size(), 0);
+        if (seen[current])
+            continue;
+        seen[current] = 1;
+        if (!rewrite && existing.find(commits.hash(current)) != CommitGraph::NONE)
+            continue; // Its ancestors are in the file too
+
+        CommitGraph::Record record;
+        ObjectId::fromHex(commits.hash(current), record.id);
+        record.timestamp = commits.timestamp(current);
+        for (int which = 0; which < 2; ++which)
+        {
+            uint32_t parent = commits.parent(current, which);
+            if (parent == CommitCache::NONE)
+            {
+                const CommitInfo &info = commits.info(current);
+                if (!(which == 0 ? info.parent_hash : info.second_parent_hash).empty())
+                    return; // A parent cannot be read: leave the file as it is
+                continue;
+            }
+            ObjectId::fromHex(commits.hash(parent), record.parents[record.parent_count++]);
+            stack.push_back(parent);
+        }
+        records.push_back(record);
+    }
+    CommitGraph::write(objects_path / "info" / "commit-graph", std::move(records));
+}
+
+void MiniGit::write_index(const Snapshot &snapshot, bool stat_worktree)
+{
+    Trace::Span span("write_index");
+    Index index(index_path);
+    // One pass over the index and the snapshot, both in path order, finds the entries that
+    // differ; an unchanged entry keeps its cached stat data
+    std::vector<std::string> removed;
+    std::vector<size_t> updated; // Snapshot positions to write
+    size_t i = 0;
+    index.for_each([&](const std::string &path, const IndexEntry &entry)
+                   {
+                       while (i < snapshot.size() && snapshot.path(snapshot[i]) < path)
+                           updated.push_back(i++);
+                       if (i == snapshot.size() || snapshot.path(snapshot[i]) != path)
+                       {
+                           removed.push_back(path);
+                           return;
+                       }
+                       ObjectId staged; // All zero for a conflicted entry, like in the snapshot
+                       ObjectId::fromHex(entry.hash, staged);
+                       if (stat_worktree || staged != snapshot[i].blob)
+                           updated.push_back(i);
+                       ++i;
+                   });
+    while (i < snapshot.size())
+        updated.push_back(i++);
+
+    for (const std::string &path : removed)
+    {
+        index.remove(path);
+    }
+    for (size_t k : updated)
+    {
+        const SnapshotEntry &snapshot_entry = snapshot[k];
+        std::string path(snapshot.path(snapshot_entry));
+        IndexEntry entry;
+        struct stat st;
+        if (!snapshot_entry.conflicted())
+        {
+            entry.hash = snapshot_entry.blob.hex();
+            if (stat_worktree && lstat((repo_path / path).c_str(), &st) == 0)
+                entry.set_stat(st);
+        }
+        index.set(path, entry);
+    }
+    if (index.modified())
+    {
+        index.save();
+    }
+}
+
+std::string MiniGit::create_blob(const std::string &filepath)
+{
+    Trace::Span span("create_blob");
+    struct stat st;
+    if (stat(filepath.c_str(), &st) != 0)
+    {
+        return "";
+    }
+
+    if (chunk_threshold > 0 && st.st_size >= chunk_threshold)
+    {
+        return create_chunked_blob(filepath);
+    }
+
+    // Small files: one read, hash, and skip compression entirely if the blob is already stored
+    const off_t small_file_limit = 1 << 20;
+    if (st.st_size <= small_file_limit)
+    {
+        std::string content = Utils::readFile(filepath);
+        if (content.empty() && st.st_size > 0)
+        {
+            return "";
+        }
+        return write_object("blob", content);
+    }
+
+    // Large files are streamed: read once in chunks, never held in memory as a whole. The hash is
+    // only known at the end, so a blob that turns out to exist already is simply not installed.
+    ObjectWriter writer(objects_path, compression_level);
+    ObjectId id;
+    if (!writer.write_file(filepath, "blob", id))
+    {
+        return "";
+    }
+    std::string hash = id.hex();
+    if (!freshen_object(hash) && !writer.install(object_path(hash)))
+    {
+        return "";
+    }
+    return hash;
+}
+
+std::string MiniGit::create_chunked_blob(const std::string &filepath)
+{
+    Trace::Span span("create_chunked_blob");
+    int fd = open(filepath.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0)
+    {
+        if (fd >= 0)
+            close(fd);
+        return "";
+    }
+    // Named like any blob: the whole file, after its "blob <size>" header
+    Sha1Hasher whole_file;
+    std::string header = Utils::objectHeader("blob", static_cast<uint64_t>(st.st_size));
+    whole_file.update(header.data(), header.size());
+    uint64_t total = 0;
+    // The file is read once through a window holding at least one maximal chunk ahead of the
+    // cut point. Every chunk is hashed, but only new ones are compressed and written.
+    std::vector<unsigned char> window(4 * Chunker::MAX_SIZE);
+    size_t start = 0;
+    size_t filled = 0;
+    bool at_eof = false;
+    std::string manifest;
+    while (true)
+    {
+        if (!at_eof && filled - start < Chunker::MAX_SIZE)
+        {
+            std::memmove(window.data(), window.data() + start, filled - start);
+            filled -= start;
+            start = 0;
+            while (!at_eof && filled < window.size())
+            {
+                ssize_t n = read(fd, window.data() + filled, window.size() - filled);
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n < 0)
+                {
+                    close(fd);
+                    return "";
+                }
+                at_eof = n == 0;
+                filled += static_cast<size_t>(n);
+            }
+        }
+        if (start == filled)
+            break;
+        size_t length = Chunker::next_cut(window.data() + start, filled - start);
+        std::string chunk(reinterpret_cast<const char *>(window.data() + start), length);
+        whole_file.update(chunk.data(), chunk.size());
+        total += length;
+        manifest += write_object("blob", chunk) + " " + std::to_string(length) + "\n";
+        start += length;
+    }
+    close(fd);
+    if (total != static_cast<uint64_t>(st.st_size))
+    {
+        return ""; // The file changed size while it was read, so the header is wrong
+    }
+
+    std::string hash = whole_file.hexdigest();
+    if (!freshen_object(hash))
+    {
+        ObjectWriter writer(objects_path, compression_level);
+        ObjectId id;
+        ObjectId::fromHex(hash, id);
+        if (!writer.begin("chunked", manifest.size(), &id) || !writer.write(manifest.data(), manifest.size()) ||
+            !writer.finish(id) || !writer.install(object_path(hash)))
+        {
+            return "";
+        }
+    }
+    return hash;
+}
+
+std::string MiniGit::normalize_path(const std::string &path)
+{
+    fs::path p(path);
+    fs::path rel = p.is_absolute() ? p.lexically_relative(repo_path) : p.lexically_normal();
+    std::string result = rel.generic_string();
+    while (result.size() > 1 && result.back() == '/')
+    {
+        result.pop_back();
+    }
+    if (result.empty() || result == ".." || result.rfind("../", 0) == 0)
+    {
+        return "";
+    }
+    return result;
+}
+
+void MiniGit::collect_files(const std::string &dir, std::set<std::string> &files)
+{
+    IgnoreRules ignore(repo_path);
+    WorktreeScanner scanner(repo_path, ignore, thread_count);
+    std::vector<ScannedFile> scanned;
+    if (!scanner.scan(dir, scanned))
+    {
+        std::cerr << "Warning: Could not fully scan '" << dir << "'." << std::endl;
+    }
+    for (ScannedFile &file : scanned)
+    {
+        files.insert(files.end(), std::move(file.path));
+    }
+}
+
+void MiniGit::add(const std::string &filepath)
+{
+    add(std::vector<std::string>{filepath});
+}
+
+void MiniGit::add(const std::vector<std::string> &paths)
+{
+    Trace::Span span("add");
+    // 1. Expand the arguments into repo-relative files; directories are walked recursively
+    std::set<std::string> files;
+    std::vector<std::string> scanned_dirs; // Tracked files missing under these are staged as deletions
+    std::set<std::string> missing;
+    for (const std::string &arg : paths)
+    {
+        std::string rel = normalize_path(arg);
+        if (rel.empty())
+        {
+            std::cerr << "Error: '" << arg << "' is outside the repository." << std::endl;
+            continue;
+        }
+        struct stat st;
+        if (lstat((repo_path / rel).c_str(), &st) != 0)
+        {
+            missing.insert(rel);
+        }
+        else if (S_ISDIR(st.st_mode))
+        {
+            scanned_dirs.push_back(rel == "." ? "" : rel + "/"); // Walked once the index is loaded
+        }
+        else if (S_ISREG(st.st_mode))
+        {
+            files.insert(rel);
+        }
+        else
+        {
+            std::cerr << "Error: Cannot add '" << arg << "'. Not a regular file or directory." << std::endl;
+        }
+    }
+
+    // 2. Take the index lock before reading, so the single read-modify-write below cannot lose
+    //    a concurrent update
+    LockFile lock;
+    if (!lock.acquire(index_path))
+    {
+        return;
+    }
+    Index index(index_path);
+
+    // With the daemon running, only the paths that may have changed are looked at below the
+    // directories; otherwise they are walked
+    std::set<std::string> changed;
+    bool monitored = !scanned_dirs.empty() && worktree_changes(index, changed);
+    IgnoreRules ignore(repo_path);
+    for (const std::string &prefix : scanned_dirs)
+    {
+        if (!monitored)
+        {
+            collect_files(prefix.empty() ? "." : prefix.substr(0, prefix.size() - 1), files);
+            continue;
+        }
+        for (auto it = changed.lower_bound(prefix); it != changed.end() && it->compare(0, prefix.size(), prefix) == 0; ++it)
+        {
+            struct stat st;
+            if (lstat((repo_path / *it).c_str(), &st) == 0 && S_ISREG(st.st_mode) && !ignore.excluded(*it))
+                files.insert(*it);
+        }
+    }
+
+    // 3. Stat cache: files whose stat data still matches their entry are not read again
+    std::vector<std::string> to_hash;
+    std::vector<struct stat> to_hash_stat;
+    size_t unchanged = 0;
+    for (const std::string &file : files)
+    {
+        struct stat st;
+        if (lstat((repo_path / file).c_str(), &st) != 0)
+        {
+            continue; // Deleted since the scan
+        }
+        IndexEntry entry;
+        if (index.lookup(file, entry) && !entry.hash.empty() && entry.stat_matches(st) && !index.is_racy(entry))
+        {
+            ++unchanged;
+            continue;
+        }
+        to_hash.push_back(file);
+        to_hash_stat.push_back(st);
+    }
+
+    // 4. Read, hash and write blobs on the worker pool
+    std::vector<std::string> hashes(to_hash.size());
+    ThreadPool::parallel_for(to_hash.size(), thread_count, [&](size_t i)
+                             { hashes[i] = create_blob((repo_path / to_hash[i]).string()); });
+
+    // 5. Apply everything to the index and write it once
+    size_t staged = 0;
+    for (size_t i = 0; i < to_hash.size(); ++i)
+    {
+        if (hashes[i].empty())
+        {
+            std::cerr << "Failed to create blob for " << to_hash[i] << std::endl;
+            continue;
+        }
+        IndexEntry entry;
+        entry.hash = hashes[i];
+        entry.set_stat(to_hash_stat[i]);
+        index.set(to_hash[i], entry);
+        ++staged;
+        std::cout << "Added " << to_hash[i] << " to staging area." << std::endl;
+    }
+
+    std::vector<std::string> removed;
+    for (const std::string &path : missing)
+    {
+        IndexEntry entry;
+        if (index.lookup(path, entry))
+        {
+            removed.push_back(path);
+        }
+        else
+        {
+            std::cerr << "Error: Cannot add '" << path << "'. File does not exist." << std::endl;
+        }
+    }
+    if (monitored)
+    {
+        // Tracked files can only have disappeared among the changed paths
+        for (const std::string &path : changed)
+        {
+            IndexEntry entry;
+            bool inside = std::any_of(scanned_dirs.begin(), scanned_dirs.end(), [&path](const std::string &prefix)
+                                      { return path.compare(0, prefix.size(), prefix) == 0; });
+            if (inside && !files.count(path) && index.lookup(path, entry) && !fs::is_regular_file(fs::symlink_status(repo_path / path)))
+                removed.push_back(path);
+        }
+    }
+    else if (!scanned_dirs.empty())
+    {
+        index.for_each([&](const std::string &path, const IndexEntry &)
+                       {
+            for (const std::string &prefix : scanned_dirs)
+            {
+                // Gone, or no longer a file (e.g. replaced by a directory of the same name)
+                bool inside = path.compare(0, prefix.size(), prefix) == 0 || path + "/" == prefix;
+                if (inside && !files.count(path) && !fs::is_regular_file(fs::symlink_status(repo_path / path)))
+                {
+                    removed.push_back(path);
+                    break;
+                }
+            } });
+    }
+    for (const std::string &path : removed)
+    {
+        index.remove(path);
+        std::cout << "Removed " << path << " from staging area." << std::endl;
+    }
+
+    if (staged == 0 && removed.empty())
+    {
+        if (unchanged > 0)
+        {
+            std::cout << "Nothing to add; " << unchanged << " file(s) unchanged and already staged." << std::endl;
+        }
+        return; // The lock is released without touching the index
+    }
+    if (index.save(lock) && files.size() + removed.size() > 1)
+    {
+        std::cout << "Staged " << staged << " file(s), removed " << removed.size() << ", " << unchanged << " unchanged." << std::endl;
+    }
+}
+
+bool MiniGit::update_worktree(const std::string &from_commit, const std::string &to_commit)
+{
+    Trace::Span span("update_worktree");
+    // 1. Paths that differ between the two commits; no commit at all is the empty tree
+    struct Change
+    {
+        std::string path;
+        std::string old_blob; // "" if the path is new
+        std::string new_blob; // "" if the path goes away
+    };
+    std::vector<Change> changes;
+    auto record = [&changes](const std::string &path, const std::string &old_blob, const std::string &new_blob)
+    { changes.push_back({path, old_blob, new_blob}); };
+
+    uint32_t from_id = commits.id(from_commit);
+    uint32_t to_id = commits.id(to_commit);
+    if (to_id == CommitCache::NONE)
+    {
+        std::cerr << "Error: Could not retrieve commit object for " << to_commit << std::endl;
+        return false;
+    }
+    diff_commits(from_id, to_id, record);
+
+    // 2. Check every affected file against the stat cache (re-hashing only files whose stat
+    //    data changed): each must still hold the old version, or already hold the new one
+    LockFile lock;
+    if (!lock.acquire(index_path))
+    {
+        return false;
+    }
+    Index index(index_path);
+    std::vector<std::string> blocked;
+    std::vector<const Change *> deletions;
+    std::vector<const Change *> writes;
+    std::set<std::string> leaving; // Paths the target no longer has
+    for (const Change &change : changes)
+    {
+        if (change.new_blob.empty())
+            leaving.insert(change.path);
+    }
+    std::set<std::string> dirty;
+    bool monitored = worktree_changes(index, dirty);
+    for (const Change &change : changes)
+    {
+        fs::path full_path = repo_path / change.path;
+        IndexEntry known;
+        if (monitored && !dirty.count(change.path) && index.lookup(change.path, known) && !known.hash.empty())
+        {
+            // The daemon saw no change since status found this file clean
+            if (known.hash == change.old_blob)
+                (change.new_blob.empty() ? deletions : writes).push_back(&change);
+            else if (known.hash != change.new_blob)
+                blocked.push_back(change.path);
+            continue;
+        }
+        struct stat st;
+        if (lstat(full_path.c_str(), &st) != 0)
+        {
+            if (!change.new_blob.empty())
+                writes.push_back(&change); // Missing: nothing to lose
+            continue;
+        }
+        if (S_ISDIR(st.st_mode))
+        {
+            // A directory replaced by a file: fine if everything in it is going away too
+            bool emptied = true;
+            for (const auto &entry : fs::recursive_directory_iterator(full_path))
+            {
+                if (!entry.is_directory() && !leaving.count(fs::relative(entry.path(), repo_path).generic_string()))
+                {
+                    emptied = false;
+                    break;
+                }
+            }
+            if (!emptied)
+                blocked.push_back(change.path);
+            else if (!change.new_blob.empty())
+                writes.push_back(&change);
+            continue;
+        }
+        std::string current_blob;
+        IndexEntry entry;
+        if (index.lookup(change.path, entry) && !entry.hash.empty() && entry.stat_matches(st) && !index.is_racy(entry))
+        {
+            current_blob = entry.hash;
+        }
+        else
+        {
+            current_blob = Utils::hashObject("blob", Utils::readFile(full_path.string()));
+        }
+        if (current_blob == change.new_blob)
+            continue; // Already up to date
+        if (current_blob != change.old_blob)
+            blocked.push_back(change.path);
+        else if (change.new_blob.empty())
+            deletions.push_back(&change);
+        else
+            writes.push_back(&change);
+    }
+    if (!blocked.empty())
+    {
+        std::cerr << "Error: Your local changes to the following files would be overwritten:" << std::endl;
+        for (const std::string &path : blocked)
+        {
+            std::cerr << "    " << path << std::endl;
+        }
+        std::cerr << "Commit or remove them, then try again." << std::endl;
+        return false;
+    }
+
+    // 3. Deletions first (a file may be replaced by a directory of the same name), pruning
+    //    directories they leave empty
+    for (const Change *change : deletions)
+    {
+        std::error_code ec;
+        fs::path full_path = repo_path / change->path;
+        fs::remove(full_path, ec);
+        for (fs::path dir = full_path.parent_path(); dir != repo_path && fs::is_empty(dir, ec); dir = dir.parent_path())
+        {
+            fs::remove(dir, ec);
+        }
+    }
+
+    // 4. Writes in parallel; directories are created up front so workers never race on them
+    for (const Change *change : writes)
+    {
+        fs::path parent = (repo_path / change->path).parent_path();
+        std::error_code ec;
+        if (!fs::is_directory(parent, ec))
+        {
+            fs::create_directories(parent, ec);
+        }
+    }
+    std::vector<char> failed(writes.size(), 0);
+    ThreadPool::parallel_for(writes.size(), thread_count, [&](size_t i)
+                             {
+                                 if (!checkout_blob(writes[i]->new_blob, repo_path / writes[i]->path))
+                                 {
+                                     failed[i] = 1;
+                                 }
+                             });
+
+    // 5. The index follows the same changes, with fresh stat data for the files just written.
+    //    A file that could not be written gets no stat data, so status re-hashes it.
+    std::set<std::string> unwritten;
+    for (size_t i = 0; i < writes.size(); ++i)
+    {
+        if (failed[i])
+        {
+            std::cerr << "Warning: Could not restore file " << writes[i]->path << " (blob " << writes[i]->new_blob << ")." << std::endl;
+            unwritten.insert(writes[i]->path);
+        }
+    }
+    for (const Change &change : changes)
+    {
+        if (change.new_blob.empty())
+        {
+            index.remove(change.path);
+            continue;
+        }
+        IndexEntry entry;
+        entry.hash = change.new_blob;
+        struct stat st;
+        if (!unwritten.count(change.path) && lstat((repo_path / change.path).c_str(), &st) == 0)
+        {
+            entry.set_stat(st);
+        }
+        index.set(change.path, entry);
+    }
+    // The index is written after the files: stamp the lock now so they are not seen as racy
+    futimens(lock.descriptor(), nullptr);
+    if (index.modified() && !index.save(lock))
     {
-        std::cerr << "Failed to create blob for " << filepath << std::endl;
-        return;
+        return false;
     }
-
-    std::map<std::string, std::string> index_map = read_index();
-    index_map[filepath] = blob_hash;
-    write_index(index_map);
-
-    std::cout << "Added " << filepath << " to staging area." << std::endl;
+    return true;
 }
 
 std::string MiniGit::get_head_commit_hash()
 {
-    std::string head_content = Utils::readFile(head_path.string());
-    if (head_content.empty())
-    {
-        return "";
-    }
-
+    std::string head_content = refs.read_head();
     if (head_content.rfind("ref: ", 0) == 0)
     {
-        std::string ref_path = head_content.substr(5);
-        if (!fs::exists(repo_path / ".minigit" / ref_path))
-        {
-            return "";
-        }
-        return Utils::readFile((repo_path / ".minigit" / ref_path).string());
-    }
-    else
-    {
-        return head_content;
+        return refs.read(RefStore::head_branch(head_content));
     }
+    return head_content;
 }
 
 void MiniGit::update_head(const std::string &commit_hash, bool is_branch, const std::string &branch_name)
 {
-    if (is_branch)
+    // HEAD is only rewritten when it changes; a commit on a branch just moves the branch
+    std::string head_content = is_branch ? "ref: refs/heads/" + branch_name : commit_hash;
+    if (is_branch && !refs.update(branch_name, commit_hash))
     {
-        fs::path branch_file_path = refs_path / "heads" / branch_name;
-        Utils::writeFile(branch_file_path.string(), commit_hash);
-        Utils::writeFile(head_path.string(), "ref: " + (fs::path("refs") / "heads" / branch_name).string());
+        printErrorAndExit("Could not update branch '" + branch_name + "' to " + commit_hash);
     }
-    else
+    if (refs.read_head() != head_content && !refs.write_head(head_content))
     {
-        Utils::writeFile(head_path.string(), commit_hash);
+        printErrorAndExit("Could not update HEAD");
     }
 }
 
@@ -153,15 +2238,17 @@ void MiniGit::commit(const std::string &hash, const std::string &parent1_hash, c
     new_commit_obj.author = "MiniGit";
     new_commit_obj.timestamp = std::time(nullptr);
     new_commit_obj.snapshot = snapshot_map;
+    PathPool paths;
+    Snapshot snapshot(paths);
+    snapshot.assign(snapshot_map);
+    new_commit_obj.tree_hash = write_tree(snapshot);
 
-    std::string commit_data = serialize_commit_data(new_commit_obj);
-    Utils::writeFile((objects_path / new_commit_obj.hash).string(), commit_data);
+    new_commit_obj.hash = write_object("commit", serialize_commit_data(new_commit_obj));
+    update_commit_graph({new_commit_obj.hash});
 
-    std::string head_content = Utils::readFile(head_path.string());
-    if (head_content.rfind("ref: ", 0) == 0)
+    std::string branch_name = RefStore::head_branch(refs.read_head());
+    if (!branch_name.empty())
     {
-        std::string current_branch_ref_path = head_content.substr(5);
-        std::string branch_name = fs::path(current_branch_ref_path).filename().string();
         update_head(new_commit_obj.hash, true, branch_name);
     }
     else
@@ -172,15 +2259,49 @@ void MiniGit::commit(const std::string &hash, const std::string &parent1_hash, c
 
 void MiniGit::commit(const std::string &message)
 {
-    std::map<std::string, std::string> current_snapshot = read_index();
+    Trace::Span span("commit");
+    PathPool paths;
+    Snapshot current_snapshot(paths);
+    Index(index_path).for_each([&current_snapshot](const std::string &path, const IndexEntry &entry)
+                               {
+                                   ObjectId blob; // A conflicted entry has none
+                                   ObjectId::fromHex(entry.hash, blob);
+                                   current_snapshot.push_back(path, blob);
+                               });
 
     if (current_snapshot.empty())
     {
         std::cout << "Nothing to commit, working tree clean. (Staging area is empty)" << std::endl;
         return;
     }
+    std::vector<std::string_view> unmerged;
+    for (const SnapshotEntry &entry : current_snapshot)
+    {
+        if (entry.conflicted())
+            unmerged.push_back(current_snapshot.path(entry));
+    }
+    if (!unmerged.empty())
+    {
+        std::cerr << "Error: Cannot commit with unmerged paths, resolve and add them first:" << std::endl;
+        for (std::string_view path : unmerged)
+        {
+            std::cerr << "    " << path << std::endl;
+        }
+        return;
+    }
 
+    // The index keeps every tracked file after a commit, so an unchanged index means nothing is staged.
+    // Writing the tree only stores the directories that changed; equal root hashes mean equal snapshots.
     std::string parent_hash = get_head_commit_hash();
+    std::string tree_hash = write_tree(current_snapshot);
+    uint32_t parent_id = commits.id(parent_hash);
+    if (parent_id != CommitCache::NONE &&
+        (commits.info(parent_id).tree_hash.empty() ? *commits.snapshot(parent_id) == current_snapshot.to_map()
+                                                   : commits.info(parent_id).tree_hash == tree_hash))
+    {
+        std::cout << "Nothing to commit, working tree clean. (No changes staged since the last commit)" << std::endl;
+        return;
+    }
 
     Commit new_commit_obj;
     new_commit_obj.parent_hash = parent_hash;
@@ -188,18 +2309,14 @@ void MiniGit::commit(const std::string &message)
     new_commit_obj.message = message;
     new_commit_obj.author = "default_user";
     new_commit_obj.timestamp = std::time(nullptr);
-    new_commit_obj.snapshot = current_snapshot;
-
-    new_commit_obj.hash = Utils::sha1(serialize_commit_data(new_commit_obj));
+    new_commit_obj.tree_hash = tree_hash;
 
-    fs::path commit_obj_path = objects_path / new_commit_obj.hash;
-    Utils::writeFile(commit_obj_path.string(), serialize_commit_data(new_commit_obj));
+    new_commit_obj.hash = write_object("commit", serialize_commit_data(new_commit_obj));
+    update_commit_graph({new_commit_obj.hash});
 
-    std::string head_content = Utils::readFile(head_path.string());
-    if (head_content.rfind("ref: ", 0) == 0)
+    std::string branch_name = RefStore::head_branch(refs.read_head());
+    if (!branch_name.empty())
     {
-        std::string current_branch_ref_path = head_content.substr(5);
-        std::string branch_name = fs::path(current_branch_ref_path).filename().string();
         update_head(new_commit_obj.hash, true, branch_name);
         std::cout << "[" << branch_name << " " << new_commit_obj.hash.substr(0, 7) << "] " << message << std::endl;
     }
@@ -209,39 +2326,113 @@ void MiniGit::commit(const std::string &message)
         std::cout << "[detached HEAD " << new_commit_obj.hash.substr(0, 7) << "] " << message << std::endl;
     }
 
-    write_index({});
     std::cout << "Committed successfully." << std::endl;
 }
 
-void MiniGit::log()
+void MiniGit::log(const LogOptions &options)
 {
+    Trace::Span span("log");
     std::string current_commit_hash = get_head_commit_hash();
     if (current_commit_hash.empty())
     {
         std::cout << "No commits yet." << std::endl;
         return;
     }
+    std::vector<std::string> paths;
+    for (const std::string &arg : options.paths)
+    {
+        std::string rel = normalize_path(arg);
+        if (rel.empty())
+        {
+            std::cerr << "Error: '" << arg << "' is outside the repository." << std::endl;
+            return;
+        }
+        paths.push_back(rel == "." ? "" : rel);
+    }
+
+    // Commits waiting to be shown, newest first (highest generation first in topological
+    // order); ties go in the order they were queued. A commit is shown when it is taken
+    // from the queue and only then are its parents queued, so the walk touches just the
+    // commits it shows plus the queue's frontier.
+    struct Pending
+    {
+        uint32_t id;
+        uint32_t generation; // Only with topo_order
+        std::time_t timestamp;
+        uint64_t order;
+    };
+    auto later = [](const Pending &a, const Pending &b)
+    {
+        if (a.generation != b.generation)
+            return a.generation < b.generation;
+        if (a.timestamp != b.timestamp)
+            return a.timestamp < b.timestamp;
+        return a.order > b.order;
+    };
+    std::priority_queue<Pending, std::vector<Pending>, decltype(later)> queue(later);
+    std::vector<char> queued; // By commit id
+    uint64_t next_order = 0;
+    auto enqueue = [&](uint32_t id)
+    {
+        if (id == CommitCache::NONE)
+            return;
+        if (id >= queued.size())
+            queued.resize(std::max<size_t>(id + 1, queued.size() * 2), 0);
+        if (queued[id])
+            return;
+        queued[id] = 1;
+        queue.push({id, options.topo_order ? commits.generation(id) : 0, commits.timestamp(id), next_order++});
+    };
+    enqueue(commits.id(current_commit_hash));
 
-    std::cout << "Commit history:" << std::endl;
-    while (!current_commit_hash.empty())
+    // Output goes out in large blocks instead of a flush per line
+    std::string out = "Commit history:\n";
+    long shown = 0;
+    while (!queue.empty() && (options.max_count < 0 || shown < options.max_count))
     {
-        Commit c_obj = get_commit(current_commit_hash);
-        if (c_obj.hash.empty())
+        Pending next = queue.top();
+        queue.pop();
+        if (options.since && next.timestamp < options.since && !options.topo_order)
+            break; // In date order everything still queued is older
+        enqueue(commits.parent(next.id, 0));
+        if (!options.first_parent)
+            enqueue(commits.parent(next.id, 1));
+
+        if ((options.since && next.timestamp < options.since) || (options.until && next.timestamp > options.until))
+            continue;
+        if (!paths.empty())
         {
-            break;
+            // Shown if it changes a path relative to its first parent, and for a merge (unless
+            // only first parents are followed) relative to its second parent as well
+            uint32_t second = options.first_parent ? CommitCache::NONE : commits.parent(next.id, 1);
+            if (!paths_differ(commits.parent(next.id, 0), next.id, paths) ||
+                (second != CommitCache::NONE && !paths_differ(second, next.id, paths)))
+                continue;
         }
+        const CommitInfo &c_obj = commits.info(next.id); // Used before the cache can grow again
+        if (!options.author.empty() && c_obj.author.find(options.author) == std::string::npos)
+            continue;
 
-        std::cout << "\ncommit " << c_obj.hash << std::endl;
+        char date[64];
+        std::tm local_time;
+        localtime_r(&c_obj.timestamp, &local_time);
+        std::strftime(date, sizeof(date), "%a %b %e %H:%M:%S %Y", &local_time); // asctime's layout
+        out += "\ncommit " + c_obj.hash + "\n";
         if (!c_obj.second_parent_hash.empty())
         {
-            std::cout << "Merge: " << c_obj.parent_hash.substr(0, 7) << " " << c_obj.second_parent_hash.substr(0, 7) << std::endl;
+            out += "Merge: " + c_obj.parent_hash.substr(0, 7) + " " + c_obj.second_parent_hash.substr(0, 7) + "\n";
+        }
+        out += "Author: " + c_obj.author + "\n";
+        out += std::string("Date: ") + date + "\n";
+        out += "\n    " + c_obj.message + "\n";
+        ++shown;
+        if (out.size() >= 64 * 1024)
+        {
+            std::cout << out;
+            out.clear();
         }
-        std::cout << "Author: " << c_obj.author << std::endl;
-        std::cout << "Date: " << std::asctime(std::localtime(&c_obj.timestamp));
-        std::cout << "\n    " << c_obj.message << std::endl;
-
-        current_commit_hash = c_obj.parent_hash;
     }
+    std::cout << out << std::flush;
 }
 
 void MiniGit::branch(const std::string &branch_name)
@@ -252,12 +2443,25 @@ void MiniGit::branch(const std::string &branch_name)
         return;
     }
 
-    fs::path branch_file_path = refs_path / "heads" / branch_name;
-    if (fs::exists(branch_file_path))
+    if (!RefStore::valid_name(branch_name))
+    {
+        std::cerr << "Error: '" << branch_name << "' is not a valid branch name." << std::endl;
+        return;
+    }
+    if (!refs.read(branch_name).empty())
     {
         std::cout << "Branch '" << branch_name << "' already exists." << std::endl;
         return;
     }
+    // "a/b" is stored below refs/heads/a, so it cannot coexist with a branch "a"
+    for (size_t slash = branch_name.find('/'); slash != std::string::npos; slash = branch_name.find('/', slash + 1))
+    {
+        if (!refs.read(branch_name.substr(0, slash)).empty())
+        {
+            std::cerr << "Error: Cannot create '" << branch_name << "': branch '" << branch_name.substr(0, slash) << "' exists." << std::endl;
+            return;
+        }
+    }
 
     std::string current_commit_hash = get_head_commit_hash();
     if (current_commit_hash.empty())
@@ -266,110 +2470,707 @@ void MiniGit::branch(const std::string &branch_name)
         return;
     }
 
-    Utils::writeFile(branch_file_path.string(), current_commit_hash);
+    const std::string absent;
+    if (!refs.update(branch_name, current_commit_hash, &absent)) // Created only if still absent
+    {
+        return;
+    }
     std::cout << "Branch '" << branch_name << "' created at " << current_commit_hash.substr(0, 7) << std::endl;
 }
 
+void MiniGit::branch_list()
+{
+    std::vector<std::pair<std::string, std::string>> branches;
+    refs.list(branches);
+    std::string current = RefStore::head_branch(refs.read_head());
+    std::string out;
+    out.reserve(branches.size() * 24);
+    for (const auto &branch : branches)
+    {
+        out += branch.first == current ? "* " : "  ";
+        out += branch.first;
+        out += '\n';
+    }
+    std::cout << out << std::flush;
+}
+
 void MiniGit::checkout(const std::string &branch_name_or_commit_hash)
 {
+    Trace::Span span("checkout");
     std::string target_commit_hash;
     std::string resolved_ref_name;
 
-    fs::path branch_path = refs_path / "heads" / branch_name_or_commit_hash;
-    if (fs::exists(branch_path))
+    std::string branch_hash = refs.read(branch_name_or_commit_hash);
+    if (!branch_hash.empty())
     {
-        target_commit_hash = Utils::readFile(branch_path.string());
-        resolved_ref_name = "ref: " + (fs::path("refs") / "heads" / branch_name_or_commit_hash).string();
+        target_commit_hash = branch_hash;
+        resolved_ref_name = "ref: refs/heads/" + branch_name_or_commit_hash;
         std::cout << "Switching to branch '" << branch_name_or_commit_hash << "'" << std::endl;
     }
     else
     {
-        fs::path commit_obj_path = objects_path / branch_name_or_commit_hash;
-        if (!fs::exists(commit_obj_path))
+        std::string error;
+        target_commit_hash = resolve_commit(branch_name_or_commit_hash, error);
+        if (target_commit_hash.empty())
         {
-            std::cerr << "Error: Reference '" << branch_name_or_commit_hash << "' not found. Not a branch or a valid commit hash." << std::endl;
+            std::cerr << "Error: " << error << std::endl;
             return;
         }
-        target_commit_hash = branch_name_or_commit_hash;
         resolved_ref_name = target_commit_hash;
         std::cout << "Note: switching to 'detached HEAD' state." << std::endl;
     }
 
-    Commit target_commit = get_commit(target_commit_hash);
-    if (target_commit.hash.empty())
+    if (commits.id(target_commit_hash) == CommitCache::NONE)
     {
         std::cerr << "Error: Could not retrieve commit object for " << target_commit_hash << std::endl;
         return;
     }
 
-    // --- Start of FIX for checkout deleting source files (included in this complete version) ---
-    std::set<std::string> protected_files = {
-        ".minigit",                                                     // The repository itself
-        "main.cpp", "minigit.cpp", "minigit.h", "utils.cpp", "utils.h", // Source files
-        "Makefile",                                                     // Build script
-        "minigit"                                                       // The executable itself
+    // Only the paths that differ between HEAD and the target are written or deleted;
+    // untracked files are left alone
+    if (!update_worktree(get_head_commit_hash(), target_commit_hash))
+    {
+        return;
+    }
+    if (!refs.write_head(resolved_ref_name))
+    {
+        return;
+    }
+
+    std::cout << "HEAD is now at " << target_commit_hash.substr(0, 7) << std::endl;
+}
+
+void MiniGit::status()
+{
+    Trace::Span span("status");
+    std::string head_content = refs.read_head();
+    if (head_content.rfind("ref: ", 0) == 0)
+        std::cout << "On branch " << RefStore::head_branch(head_content) << "\n";
+    else
+        std::cout << "HEAD detached at " << head_content.substr(0, 7) << "\n";
+
+    // The index lock is only needed to save refreshed stat data; without it status still works
+    LockFile lock;
+    bool locked = lock.acquire(index_path, true);
+    Index index(index_path);
+
+    // 1. Staged changes: HEAD against the index
+    IndexEntries entries;
+    index.for_each([&entries](const std::string &path, const IndexEntry &entry)
+                   { entries.emplace_back(path, entry); });
+    std::vector<std::string> staged;
+    std::vector<std::string> unmerged;
+    for (const auto &entry : entries)
+    {
+        if (entry.second.hash.empty())
+            unmerged.push_back(entry.first); // Left conflicted by a merge
+    }
+    diff_head_index(entries, [&](const std::string &path, const std::string &old_blob, const std::string &new_blob)
+                    {
+                        if (new_blob.empty() && std::binary_search(unmerged.begin(), unmerged.end(), path))
+                            return;
+                        staged.push_back((old_blob.empty() ? "new file:   " : new_blob.empty() ? "deleted:    " : "modified:   ") + path);
+                    });
+
+    // 2. Find the files that may differ from the index. With the daemon, those are the paths
+    //    it saw change plus what the last status reported; otherwise the whole tree is walked
+    //    and paired with the index (both sorted by path).
+    IgnoreRules ignore(repo_path);
+    std::set<std::string> candidates;
+    std::string token;
+    bool monitored = worktree_changes(index, candidates, &token);
+    std::vector<std::string> untracked;
+    std::vector<std::string> deleted;
+    IndexEntries tracked;
+    std::vector<struct stat> tracked_stat;
+    if (monitored)
+    {
+        for (const std::string &path : candidates)
+        {
+            auto it = std::lower_bound(entries.begin(), entries.end(), path,
+                                       [](const std::pair<std::string, IndexEntry> &entry, const std::string &key)
+                                       { return entry.first < key; });
+            bool in_index = it != entries.end() && it->first == path;
+            if (in_index && it->second.hash.empty())
+                continue; // Unmerged
+            struct stat st;
+            bool exists = lstat((repo_path / path).c_str(), &st) == 0 && S_ISREG(st.st_mode);
+            if (in_index && !exists)
+                deleted.push_back(path);
+            else if (in_index)
+            {
+                tracked.push_back(*it);
+                tracked_stat.push_back(st);
+            }
+            else if (exists && !ignore.excluded(path))
+                untracked.push_back(path);
+        }
+    }
+    else
+    {
+        WorktreeScanner scanner(repo_path, ignore, thread_count);
+        std::vector<ScannedFile> files;
+        if (!scanner.scan("", files))
+        {
+            std::cerr << "Warning: Could not read every directory of the working tree." << std::endl;
+        }
+        size_t f = 0;
+        for (const auto &pair : entries)
+        {
+            const std::string &path = pair.first;
+            const IndexEntry &entry = pair.second;
+            for (; f < files.size() && files[f].path < path; ++f)
+                untracked.push_back(files[f].path);
+            if (f < files.size() && files[f].path == path)
+            {
+                if (!entry.hash.empty())
+                {
+                    tracked.emplace_back(path, entry);
+                    tracked_stat.push_back(files[f].st);
+                }
+                ++f;
+                continue;
+            }
+            // Not scanned: gone, or inside an ignored directory, where it is still tracked
+            if (entry.hash.empty())
+                continue;
+            struct stat st;
+            if (lstat((repo_path / path).c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+                deleted.push_back(path);
+            else
+            {
+                tracked.emplace_back(path, entry);
+                tracked_stat.push_back(st);
+            }
+        }
+        for (; f < files.size(); ++f)
+            untracked.push_back(files[f].path);
+    }
+
+    // 3. Only files whose stat data no longer matches are read and hashed, on the worker pool
+    enum State : char { CLEAN, MODIFIED, REFRESHED };
+    std::vector<char> states(tracked.size(), CLEAN);
+    ThreadPool::parallel_for(tracked.size(), thread_count, [&](size_t i)
+                             {
+        const IndexEntry &entry = tracked[i].second;
+        if (entry.stat_matches(tracked_stat[i]) && !index.is_racy(entry))
+            return;
+        std::string hash = Utils::hashObject("blob", Utils::readFile((repo_path / tracked[i].first).string()));
+        states[i] = hash == entry.hash ? REFRESHED : MODIFIED; });
+
+    std::vector<std::string> modified;
+    size_t refreshed = 0;
+    for (size_t i = 0; i < tracked.size(); ++i)
+    {
+        if (states[i] == MODIFIED)
+            modified.push_back(tracked[i].first);
+        else if (states[i] == REFRESHED)
+        {
+            // Same content with new stat data (e.g. touched): record it so the next run skips it
+            IndexEntry entry = tracked[i].second;
+            entry.set_stat(tracked_stat[i]);
+            index.set(tracked[i].first, entry);
+            ++refreshed;
+        }
+    }
+    if (locked && refreshed > 0)
+    {
+        index.save(lock);
+    }
+    if (!token.empty())
+    {
+        // What is not clean now must be looked at again next time, changed or not
+        std::vector<std::string> pending = modified;
+        pending.insert(pending.end(), deleted.begin(), deleted.end());
+        pending.insert(pending.end(), untracked.begin(), untracked.end());
+        save_worktree_token(token, pending);
+    }
+
+    // 4. Report
+    for (std::string &path : modified)
+        path = "modified:   " + path;
+    for (std::string &path : deleted)
+        path = "deleted:    " + path;
+    modified.insert(modified.end(), deleted.begin(), deleted.end());
+    std::sort(modified.begin(), modified.end(), [](const std::string &a, const std::string &b)
+              { return a.compare(12, std::string::npos, b, 12, std::string::npos) < 0; });
+    auto section = [](const char *title, const std::vector<std::string> &lines)
+    {
+        if (lines.empty())
+            return;
+        std::cout << "\n" << title << "\n";
+        for (const std::string &line : lines)
+            std::cout << "  " << line << "\n";
     };
+    section("Changes to be committed:", staged);
+    section("Unmerged paths:", unmerged);
+    section("Changes not staged for commit:", modified);
+    section("Untracked files:", untracked);
+    if (staged.empty() && unmerged.empty() && modified.empty())
+    {
+        std::cout << "\n" << (untracked.empty() ? "nothing to commit, working tree clean" : "nothing added to commit but untracked files present") << "\n";
+    }
+    std::cout.flush();
+}
+
+bool MiniGit::worktree_changes(const Index &index, std::set<std::string> &paths, std::string *new_token)
+{
+    // .minigit/fsmonitor: the daemon token status last used, then the paths it left unclean
+    std::istringstream state(Utils::readFile(fsmonitor_path.string()));
+    std::string token;
+    std::getline(state, token);
+    std::vector<std::string> changed;
+    std::string next_token;
+    bool reset = false;
+    if (!FsMonitor::query(repo_path, token, next_token, changed, reset))
+    {
+        if (new_token)
+            new_token->clear();
+        return false; // No daemon
+    }
+    if (new_token)
+        *new_token = next_token; // Valid even after a reset, if the caller scans from here on
+    if (reset || token.empty())
+    {
+        return false;
+    }
+
+    std::string line;
+    while (std::getline(state, line))
+    {
+        if (!line.empty())
+            paths.insert(line);
+    }
+    for (const std::string &path : changed)
+    {
+        paths.insert(path);
+        // A directory that was removed or renamed takes its tracked files with it
+        index.for_each(path + "/", [&paths](const std::string &tracked, const IndexEntry &)
+                       { paths.insert(tracked); });
+    }
+    return true;
+}
+
+void MiniGit::save_worktree_token(const std::string &token, const std::vector<std::string> &pending)
+{
+    std::string state = token + "\n";
+    for (const std::string &path : pending)
+    {
+        state += path + "\n";
+    }
+    Utils::writeFile(fsmonitor_path.string(), state);
+}
 
-    // First, iterate through the working directory and remove files/directories
-    // that are NOT protected and are NOT part of the new commit's snapshot.
-    // This handles deletions from the new commit.
-    for (const auto &entry : fs::directory_iterator(repo_path))
+void MiniGit::daemon(const std::string &action)
+{
+    if (action == "stop")
     {
-        std::string filename = entry.path().filename().string();
-        // If the entry is a protected file/directory, skip it.
-        if (protected_files.count(filename))
+        if (!FsMonitor::stop(repo_path))
         {
-            continue;
+            std::cerr << "Error: No daemon is running for this repository." << std::endl;
+        }
+        return;
+    }
+    FsMonitor monitor(repo_path);
+    monitor.run();
+}
+
+std::vector<std::string> MiniGit::find_objects_by_prefix(const std::string &prefix)
+{
+    std::vector<std::string> matches;
+    if (prefix.empty() || prefix.size() > 40 || prefix.find_first_not_of("0123456789abcdef") != std::string::npos)
+    {
+        return matches;
+    }
+    if (commit_graph && commit_graph->valid())
+    {
+        commit_graph->find_prefix(prefix, matches);
+    }
+    load_packs();
+    for (const auto &pack : packs)
+    {
+        pack->find_prefix(prefix, matches);
+    }
+    // Loose objects since the last repack: only objects/<first two digits> can hold them
+    if (prefix.size() >= 2)
+    {
+        std::string rest = prefix.substr(2);
+        std::error_code ec;
+        for (fs::directory_iterator it(objects_path / prefix.substr(0, 2), ec), end; !ec && it != end; it.increment(ec))
+        {
+            std::string name = it->path().filename().string();
+            if (name.size() == 38 && name.compare(0, rest.size(), rest) == 0)
+            {
+                matches.push_back(prefix.substr(0, 2) + name);
+            }
+        }
+    }
+    std::sort(matches.begin(), matches.end());
+    matches.erase(std::unique(matches.begin(), matches.end()), matches.end());
+    return matches;
+}
+
+std::string MiniGit::resolve_commit(const std::string &revision, std::string &error)
+{
+    const std::string not_found = "Reference '" + revision + "' not found. Not a branch or a valid commit hash.";
+    // Neither ~ nor ^ can be part of a branch name or hash, so the suffixes start at the first one
+    size_t suffixes = std::min(revision.find_first_of("~^"), revision.size());
+    std::string base = revision.substr(0, suffixes);
+    std::string within; // <branch>@<hash>: the tip of the branch
+    std::string hash;
+    if (base == "HEAD" || base == "@")
+    {
+        hash = get_head_commit_hash();
+        if (hash.empty())
+        {
+            error = "HEAD does not point to a commit yet.";
+            return "";
+        }
+    }
+    else if ((hash = refs.read(base)).empty())
+    {
+        size_t at = base.find('@');
+        if (at != std::string::npos && at > 0)
+        {
+            within = refs.read(base.substr(0, at));
+            if (within.empty())
+            {
+                error = "Branch '" + base.substr(0, at) + "' does not exist.";
+                return "";
+            }
+            base = base.substr(at + 1);
+        }
+        std::string prefix = base;
+        std::transform(prefix.begin(), prefix.end(), prefix.begin(), [](unsigned char c)
+                       { return static_cast<char>(std::tolower(c)); });
+        if (prefix.size() < 4)
+        {
+            error = not_found;
+            return "";
+        }
+        // Of the objects with the prefix, only commits count (and only those on the branch)
+        std::vector<std::string> candidates;
+        for (const std::string &match : find_objects_by_prefix(prefix))
+        {
+            if (commits.id(match) != CommitCache::NONE && (within.empty() || is_ancestor(match, within)))
+            {
+                candidates.push_back(match);
+            }
+        }
+        if (candidates.empty())
+        {
+            error = within.empty() ? not_found : "No commit '" + base + "' on branch '" + revision.substr(0, revision.find('@')) + "'.";
+            return "";
+        }
+        if (candidates.size() > 1)
+        {
+            error = "Short hash '" + base + "' is ambiguous. Candidates:";
+            for (const std::string &candidate : candidates)
+            {
+                const CommitInfo &info = commits.info(commits.id(candidate));
+                error += "\n  " + candidate + " " + info.message.substr(0, info.message.find('\n'));
+            }
+            return "";
+        }
+        hash = candidates[0];
+    }
+    uint32_t id = commits.id(hash);
+    if (id == CommitCache::NONE)
+    {
+        error = "'" + base + "' does not point to a commit.";
+        return "";
+    }
+
+    for (size_t pos = suffixes; pos < revision.size();)
+    {
+        char op = revision[pos++];
+        size_t digits = pos;
+        while (pos < revision.size() && std::isdigit(static_cast<unsigned char>(revision[pos])) && pos - digits < 9)
+            ++pos;
+        if ((op != '~' && op != '^') || (pos < revision.size() && revision[pos] != '~' && revision[pos] != '^'))
+        {
+            error = "Invalid revision '" + revision + "'.";
+            return "";
+        }
+        long n = pos > digits ? std::stol(revision.substr(digits, pos - digits)) : 1;
+        if (op == '^' && n > 2)
+        {
+            error = "Invalid revision '" + revision + "': a commit has at most two parents.";
+            return "";
+        }
+        // ~n: n first parents; ^n: the n-th parent (^0: the commit itself)
+        long steps = op == '~' ? n : (n > 0 ? 1 : 0);
+        int which = op == '~' ? 0 : static_cast<int>(n - 1);
+        for (long step = 0; step < steps; ++step)
+        {
+            id = commits.parent(id, which);
+            if (id == CommitCache::NONE)
+            {
+                error = "Revision '" + revision + "' goes beyond the history: " +
+                        (op == '^' && n == 2 ? "the commit is not a merge." : "the root commit has no parent.");
+                return "";
+            }
+        }
+    }
+    return commits.hash(id);
+}
+
+void MiniGit::rev_parse(const std::vector<std::string> &revisions)
+{
+    for (const std::string &revision : revisions)
+    {
+        std::string error;
+        std::string hash = resolve_commit(revision, error);
+        if (hash.empty())
+        {
+            std::cerr << "Error: " << error << std::endl;
+            return;
         }
+        std::cout << hash << "\n";
+    }
+    std::cout.flush();
+}
+
+void MiniGit::print_file_diff(const std::string &path, const std::string &old_blob, const std::string &new_blob,
+                              const std::string &old_content, const std::string &new_content)
+{
+    std::cout << "diff --git a/" << path << " b/" << path << "\n";
+    if (old_blob.empty())
+        std::cout << "new file\n";
+    else if (new_blob.empty())
+        std::cout << "deleted file\n";
+    std::cout << "index " << (old_blob.empty() ? "0000000" : old_blob.substr(0, 7)) << ".."
+              << (new_blob.empty() ? "0000000" : new_blob.substr(0, 7)) << "\n";
+    if (Diff::is_binary(old_content) || Diff::is_binary(new_content))
+    {
+        std::cout << "Binary files " << (old_blob.empty() ? "/dev/null" : "a/" + path) << " and "
+                  << (new_blob.empty() ? "/dev/null" : "b/" + path) << " differ\n";
+        return;
+    }
+    std::cout << "--- " << (old_blob.empty() ? "/dev/null" : "a/" + path) << "\n"
+              << "+++ " << (new_blob.empty() ? "/dev/null" : "b/" + path) << "\n";
+    Diff::unified(old_content, new_content, std::cout);
+}
+
+void MiniGit::diff(const std::string &commit1, const std::string &commit2)
+{
+    Trace::Span span("diff");
+    std::string error;
+    std::string from_hash = resolve_commit(commit1, error);
+    std::string to_hash = from_hash.empty() ? "" : resolve_commit(commit2, error);
+    if (to_hash.empty())
+    {
+        std::cerr << "Error: " << error << std::endl;
+        return;
+    }
+
+    // Only the paths that differ are read; with trees that costs time in proportion to
+    // the changed directories, not the size of the repository
+    diff_commits(commits.id(from_hash), commits.id(to_hash),
+                 [this](const std::string &path, const std::string &old_blob, const std::string &new_blob)
+                 {
+                     print_file_diff(path, old_blob, new_blob,
+                                     old_blob.empty() ? "" : get_file_content_from_blob_hash(old_blob),
+                                     new_blob.empty() ? "" : get_file_content_from_blob_hash(new_blob));
+                 });
+    std::cout.flush();
+}
+
+void MiniGit::diff_cached()
+{
+    Trace::Span span("diff_cached");
+    IndexEntries entries;
+    Index(index_path).for_each([&entries](const std::string &path, const IndexEntry &entry)
+                               { entries.emplace_back(path, entry); });
+    std::vector<std::string> unmerged;
+    for (const auto &entry : entries)
+    {
+        if (entry.second.hash.empty())
+            unmerged.push_back(entry.first); // Left conflicted by a merge
+    }
+    diff_head_index(entries, [&](const std::string &path, const std::string &old_blob, const std::string &new_blob)
+                    {
+                        if (new_blob.empty() && std::binary_search(unmerged.begin(), unmerged.end(), path))
+                            return;
+                        print_file_diff(path, old_blob, new_blob,
+                                        old_blob.empty() ? "" : get_file_content_from_blob_hash(old_blob),
+                                        new_blob.empty() ? "" : get_file_content_from_blob_hash(new_blob));
+                    });
+    for (const std::string &path : unmerged)
+        std::cout << "* Unmerged path " << path << "\n";
+    std::cout.flush();
+}
 
-        // If it's a file that is not in the target snapshot (meaning it's removed by checkout)
-        // or if it's a directory (we assume only tracked files are left as files, others removed)
-        if (!target_commit.snapshot.count(filename) || fs::is_directory(entry.path()))
+void MiniGit::diff_worktree()
+{
+    Trace::Span span("diff_worktree");
+    Index index(index_path);
+    std::vector<std::string> paths;
+    std::vector<IndexEntry> entries;
+    index.for_each([&](const std::string &path, const IndexEntry &entry)
+                   {
+                       paths.push_back(path);
+                       entries.push_back(entry);
+                   });
+
+    // Files whose stat data still matches their entry are skipped; the rest are read and
+    // hashed on the worker pool. Only the changed files keep their content.
+    enum State : char { UNCHANGED, MODIFIED, DELETED, UNMERGED };
+    std::vector<char> states(paths.size(), UNCHANGED);
+    std::vector<std::string> contents(paths.size());
+    std::vector<std::string> hashes(paths.size());
+    ThreadPool::parallel_for(paths.size(), thread_count, [&](size_t i)
+                             {
+        if (entries[i].hash.empty())
+        {
+            states[i] = UNMERGED;
+            return;
+        }
+        struct stat st;
+        if (lstat((repo_path / paths[i]).c_str(), &st) != 0 || !S_ISREG(st.st_mode))
         {
-            fs::remove_all(entry.path()); // Remove if not in snapshot or if it's a directory
+            states[i] = DELETED;
+            return;
         }
+        if (entries[i].stat_matches(st) && !index.is_racy(entries[i]))
+            return;
+        std::string content = Utils::readFile((repo_path / paths[i]).string());
+        std::string hash = Utils::hashObject("blob", content);
+        if (hash != entries[i].hash)
+        {
+            states[i] = MODIFIED;
+            contents[i] = std::move(content);
+            hashes[i] = std::move(hash);
+        } });
+
+    for (size_t i = 0; i < paths.size(); ++i)
+    {
+        if (states[i] == MODIFIED)
+            print_file_diff(paths[i], entries[i].hash, hashes[i], get_file_content_from_blob_hash(entries[i].hash), contents[i]);
+        else if (states[i] == DELETED)
+            print_file_diff(paths[i], entries[i].hash, "", get_file_content_from_blob_hash(entries[i].hash), "");
+        else if (states[i] == UNMERGED)
+            std::cout << "* Unmerged path " << paths[i] << "\n";
+    }
+    std::cout.flush();
+}
+
+void MiniGit::diff_commits(uint32_t from_id, uint32_t to_id,
+                          const std::function<void(const std::string &, const std::string &, const std::string &)> &fn)
+{
+    Trace::Span span("diff_commits");
+    // With trees on both sides, unchanged directories are skipped without being read
+    std::string from_tree = from_id == CommitCache::NONE ? "" : commits.info(from_id).tree_hash;
+    std::string to_tree = to_id == CommitCache::NONE ? "" : commits.info(to_id).tree_hash;
+    if ((from_id == CommitCache::NONE || !from_tree.empty()) && (to_id == CommitCache::NONE || !to_tree.empty()))
+    {
+        diff_trees(from_tree, to_tree, "", fn);
+        return;
     }
-    // --- End of FIX ---
 
-    // 4. Write files from target commit's snapshot to working directory
-    // This will overwrite existing files or create new ones from the snapshot.
-    for (const auto &pair : target_commit.snapshot)
+    // A flat snapshot on either side: walk both sorted maps together
+    static const CommitCache::Snapshot empty;
+    std::shared_ptr<const CommitCache::Snapshot> from_snapshot;
+    std::shared_ptr<const CommitCache::Snapshot> to_snapshot;
+    if (from_id != CommitCache::NONE)
+        from_snapshot = commits.snapshot(from_id);
+    if (to_id != CommitCache::NONE)
+        to_snapshot = commits.snapshot(to_id);
+    diff_snapshots(from_snapshot ? *from_snapshot : empty, to_snapshot ? *to_snapshot : empty, fn);
+}
+
+void MiniGit::diff_snapshots(const std::map<std::string, std::string> &from_snapshot,
+                             const std::map<std::string, std::string> &to_snapshot,
+                             const std::function<void(const std::string &, const std::string &, const std::string &)> &fn)
+{
+    auto a = from_snapshot.begin();
+    auto b = to_snapshot.begin();
+    while (a != from_snapshot.end() || b != to_snapshot.end())
     {
-        const std::string &filepath = pair.first;
-        const std::string &blob_hash = pair.second;
-        std::string content = get_file_content_from_blob_hash(blob_hash);
-        if (!content.empty())
+        if (b == to_snapshot.end() || (a != from_snapshot.end() && a->first < b->first))
         {
-            Utils::writeFile(repo_path / filepath, content);
+            fn(a->first, a->second, "");
+            ++a;
+        }
+        else if (a == from_snapshot.end() || b->first < a->first)
+        {
+            fn(b->first, "", b->second);
+            ++b;
         }
         else
         {
-            // Ensure file is created empty if blob content is empty (e.g., for empty files)
-            Utils::writeFile(repo_path / filepath, "");
-            std::cerr << "Warning: Could not fully restore file " << filepath << " (blob " << blob_hash << ") or it was empty." << std::endl;
+            if (a->second != b->second)
+                fn(a->first, a->second, b->second);
+            ++a;
+            ++b;
         }
     }
+}
 
-    // 5. Update HEAD and index
-    Utils::writeFile(head_path.string(), resolved_ref_name);
-    write_index(target_commit.snapshot);
+Commit MiniGit::get_commit(const std::string &commit_hash)
+{
+    Trace::Span span("get_commit");
+    uint32_t id = commits.id(commit_hash);
+    if (id == CommitCache::NONE)
+    {
+        return Commit();
+    }
+    const CommitInfo &info = commits.info(id);
+    Commit c_obj;
+    c_obj.hash = info.hash;
+    c_obj.parent_hash = info.parent_hash;
+    c_obj.second_parent_hash = info.second_parent_hash;
+    c_obj.message = info.message;
+    c_obj.author = info.author;
+    c_obj.timestamp = info.timestamp;
+    c_obj.snapshot = *commits.snapshot(id);
+    return c_obj;
+}
 
-    std::cout << "HEAD is now at " << target_commit_hash.substr(0, 7) << std::endl;
+bool MiniGit::load_commit_info(const std::string &commit_hash, CommitInfo &info)
+{
+    Trace::Span span("load_commit_info");
+    std::string type;
+    std::string commit_data;
+    if (!read_object(commit_hash, type, commit_data) || type != "commit" || commit_data.empty())
+    {
+        return false;
+    }
+    Commit c_obj = parse_commit_data(commit_hash, commit_data, false);
+    info.hash = c_obj.hash;
+    info.parent_hash = c_obj.parent_hash;
+    info.second_parent_hash = c_obj.second_parent_hash;
+    info.message = c_obj.message;
+    info.author = c_obj.author;
+    info.timestamp = c_obj.timestamp;
+    info.tree_hash = c_obj.tree_hash;
+    return true;
 }
 
-Commit MiniGit::get_commit(const std::string &commit_hash)
+bool MiniGit::load_snapshot(const std::string &commit_hash, Snapshot &snapshot)
 {
-    fs::path commit_obj_path = objects_path / commit_hash;
-    std::string commit_data = Utils::readFile(commit_obj_path.string());
-    if (commit_data.empty())
+    Trace::Span span("load_snapshot");
+    snapshot.clear();
+    uint32_t id = commits.id(commit_hash);
+    if (id == CommitCache::NONE)
     {
-        return Commit();
+        return false;
+    }
+    std::string tree_hash = commits.info(id).tree_hash;
+    if (tree_hash.empty())
+    {
+        snapshot.assign(*commits.snapshot(id)); // Old commit with a flat snapshot
+        return true;
     }
-    return parse_commit_data(commit_hash, commit_data);
+    std::string prefix;
+    flatten_tree(tree_hash, prefix, snapshot);
+    snapshot.sort(); // A no-op check for trees write_tree wrote
+    return true;
 }
 
-Commit MiniGit::parse_commit_data(const std::string &commit_hash, const std::string &commit_data)
+Commit MiniGit::parse_commit_data(const std::string &commit_hash, const std::string &commit_data, bool with_snapshot)
 {
+    Trace::Span span("parse_commit_data");
     Commit c_obj;
     c_obj.hash = commit_hash;
     std::stringstream ss(commit_data);
@@ -399,8 +3200,16 @@ Commit MiniGit::parse_commit_data(const std::string &commit_hash, const std::str
         {
             c_obj.timestamp = static_cast<std::time_t>(std::stoll(line.substr(11)));
         }
+        else if (!in_snapshot_section && line.rfind("tree: ", 0) == 0)
+        {
+            c_obj.tree_hash = line.substr(6);
+        }
         else if (line == "---snapshot---")
         {
+            if (!with_snapshot)
+            {
+                break;
+            }
             in_snapshot_section = true;
         }
         else if (in_snapshot_section)
@@ -414,6 +3223,10 @@ Commit MiniGit::parse_commit_data(const std::string &commit_hash, const std::str
             }
         }
     }
+    if (with_snapshot && !c_obj.tree_hash.empty())
+    {
+        flatten_tree(c_obj.tree_hash, "", snapshot_map);
+    }
     c_obj.snapshot = snapshot_map;
     return c_obj;
 }
@@ -429,7 +3242,12 @@ std::string MiniGit::serialize_commit_data(const Commit &commit_obj)
     ss << "message: " << commit_obj.message << "\n";
     ss << "author: " << commit_obj.author << "\n";
     ss << "timestamp: " << commit_obj.timestamp << "\n";
-    ss << "---snapshot---\n";
+    if (!commit_obj.tree_hash.empty())
+    {
+        ss << "tree: " << commit_obj.tree_hash << "\n";
+        return ss.str();
+    }
+    ss << "---snapshot---\n"; // Old format, kept for commits made without a tree
     for (const auto &pair : commit_obj.snapshot)
     {
         ss << pair.first << " " << pair.second << "\n";
@@ -437,14 +3255,320 @@ std::string MiniGit::serialize_commit_data(const Commit &commit_obj)
     return ss.str();
 }
 
+std::string MiniGit::write_tree(const Snapshot &snapshot)
+{
+    Trace::Span span("write_tree");
+    return write_tree(snapshot, 0, snapshot.size(), 0);
+}
+
+std::string MiniGit::write_tree(const Snapshot &snapshot, size_t begin, size_t end, size_t prefix_length)
+{
+    // The paths below one directory are contiguous in a sorted snapshot, so each subtree is
+    // a sub-range; snapshot order also matches the tree entry order (a subtree sorts as "name/")
+    std::string content;
+    size_t i = begin;
+    while (i < end)
+    {
+        std::string_view path = snapshot.path(snapshot[i]);
+        size_t slash = path.find('/', prefix_length);
+        if (slash == std::string_view::npos)
+        {
+            // A conflicted path has no blob yet; callers resolve or refuse before writing a tree
+            if (snapshot[i].conflicted())
+                printErrorAndExit("Cannot write a tree with the unmerged path " + std::string(path));
+            char blob[40];
+            snapshot[i].blob.hex(blob);
+            append_tree_line(content, "blob", std::string_view(blob, 40), path.substr(prefix_length));
+            ++i;
+            continue;
+        }
+        size_t child_prefix = slash + 1;
+        std::string_view directory = path.substr(0, child_prefix);
+        size_t sub_end = i;
+        while (sub_end < end && snapshot.path(snapshot[sub_end]).size() > child_prefix &&
+               snapshot.path(snapshot[sub_end]).compare(0, child_prefix, directory) == 0)
+        {
+            ++sub_end;
+        }
+        std::string subtree = write_tree(snapshot, i, sub_end, child_prefix);
+        append_tree_line(content, "tree", subtree, path.substr(prefix_length, slash - prefix_length));
+        i = sub_end;
+    }
+    return write_object("tree", content);
+}
+
+std::string MiniGit::hash_index_tree(const IndexEntries &entries, size_t begin, size_t end, size_t prefix_length)
+{
+    // Same layout as write_tree, but the trees are only hashed and kept in index_trees
+    std::vector<TreeEntry> tree;
+    std::string content;
+    size_t i = begin;
+    while (i < end)
+    {
+        const std::string &path = entries[i].first;
+        size_t slash = path.find('/', prefix_length);
+        if (slash == std::string::npos)
+        {
+            const std::string &blob = entries[i].second.hash;
+            if (!blob.empty()) // Conflicted paths have no blob yet
+            {
+                tree.push_back({path.substr(prefix_length), blob, false});
+                content += "blob " + blob + " " + tree.back().name + "\n";
+            }
+            ++i;
+            continue;
+        }
+        size_t child_prefix = slash + 1;
+        size_t sub_end = i;
+        while (sub_end < end && entries[sub_end].first.size() > child_prefix &&
+               entries[sub_end].first.compare(0, child_prefix, path, 0, child_prefix) == 0)
+        {
+            ++sub_end;
+        }
+        std::string subtree = hash_index_tree(entries, i, sub_end, child_prefix);
+        tree.push_back({path.substr(prefix_length, slash - prefix_length), subtree, true});
+        content += "tree " + subtree + " " + tree.back().name + "\n";
+        i = sub_end;
+    }
+    std::string hash = Utils::hashObject("tree", content);
+    index_trees.emplace(hash, std::move(tree));
+    return hash;
+}
+
+void MiniGit::diff_head_index(const IndexEntries &entries,
+                              const std::function<void(const std::string &, const std::string &, const std::string &)> &fn)
+{
+    Trace::Span span("diff_head_index");
+    std::string head_hash = get_head_commit_hash();
+    uint32_t head_id = head_hash.empty() ? CommitCache::NONE : commits.id(head_hash);
+    std::string head_tree = head_id == CommitCache::NONE ? "" : commits.info(head_id).tree_hash;
+    if (head_id != CommitCache::NONE && head_tree.empty())
+    {
+        // HEAD stores a flat snapshot
+        std::map<std::string, std::string> staged;
+        for (const auto &entry : entries)
+            staged.emplace_hint(staged.end(), entry.first, entry.second.hash);
+        diff_snapshots(*commits.snapshot(head_id), staged, fn);
+        return;
+    }
+
+    // The index's trees are hashed in memory, so directories whose tree matches HEAD's are
+    // skipped without reading HEAD's tree objects, exactly like between two commits
+    std::string index_tree = hash_index_tree(entries, 0, entries.size(), 0);
+    diff_trees(head_tree, index_tree, "", fn);
+    index_trees.clear();
+}
+
+bool MiniGit::read_tree(const std::string &tree_hash, std::vector<TreeEntry> &entries)
+{
+    Trace::Span span("read_tree");
+    auto cached = index_trees.find(tree_hash);
+    if (cached != index_trees.end())
+    {
+        entries = cached->second;
+        return true;
+    }
+    entries.clear();
+    std::string type;
+    std::string content;
+    if (!read_object(tree_hash, type, content) || type != "tree")
+    {
+        return false;
+    }
+    bool valid = parse_tree(content, [&entries](bool is_tree, std::string_view hash, std::string_view name)
+                            { entries.push_back({std::string(name), std::string(hash), is_tree}); });
+    if (!valid)
+    {
+        std::cerr << "Error: Malformed tree object " << tree_hash << std::endl;
+    }
+    return valid;
+}
+
+void MiniGit::flatten_tree(const std::string &tree_hash, const std::string &prefix, std::map<std::string, std::string> &snapshot)
+{
+    std::vector<TreeEntry> entries;
+    read_tree(tree_hash, entries);
+    for (const TreeEntry &entry : entries)
+    {
+        if (entry.is_tree)
+        {
+            flatten_tree(entry.hash, prefix + entry.name + "/", snapshot);
+        }
+        else
+        {
+            snapshot.emplace_hint(snapshot.end(), prefix + entry.name, entry.hash);
+        }
+    }
+}
+
+void MiniGit::flatten_tree(const std::string &tree_hash, std::string &prefix, Snapshot &snapshot)
+{
+    // One prefix buffer for the whole walk, and blob hashes decoded straight from the
+    // object's text: a file costs no allocation beyond its snapshot entry
+    size_t prefix_length = prefix.size();
+    auto visit = [&](bool is_tree, std::string_view hash, std::string_view name)
+    {
+        prefix.append(name.data(), name.size());
+        if (is_tree)
+        {
+            prefix += '/';
+            flatten_tree(std::string(hash), prefix, snapshot);
+        }
+        else
+        {
+            ObjectId blob;
+            ObjectId::fromHex(hash, blob);
+            snapshot.push_back(prefix, blob);
+        }
+        prefix.resize(prefix_length);
+    };
+    auto cached = index_trees.find(tree_hash);
+    if (cached != index_trees.end())
+    {
+        for (const TreeEntry &entry : cached->second)
+            visit(entry.is_tree, entry.hash, entry.name);
+        return;
+    }
+    std::string type;
+    std::string content;
+    if (!read_object(tree_hash, type, content) || type != "tree")
+    {
+        return;
+    }
+    if (!parse_tree(content, visit))
+    {
+        std::cerr << "Error: Malformed tree object " << tree_hash << std::endl;
+    }
+}
+
+std::string MiniGit::tree_entry_hash(const std::string &tree_hash, const std::string &path)
+{
+    std::string hash = tree_hash;
+    std::vector<TreeEntry> entries;
+    size_t pos = 0;
+    while (!hash.empty() && pos < path.size())
+    {
+        size_t slash = path.find('/', pos);
+        if (slash == std::string::npos)
+            slash = path.size();
+        std::string_view name(path.data() + pos, slash - pos);
+        if (!read_tree(hash, entries))
+        {
+            return "";
+        }
+        hash.clear();
+        for (const TreeEntry &entry : entries)
+        {
+            if (entry.name == name && (entry.is_tree || slash == path.size()))
+            {
+                hash = entry.hash;
+                break;
+            }
+        }
+        pos = slash + 1;
+    }
+    return hash;
+}
+
+bool MiniGit::paths_differ(uint32_t from_id, uint32_t to_id, const std::vector<std::string> &paths)
+{
+    std::string from_tree = from_id == CommitCache::NONE ? "" : commits.info(from_id).tree_hash;
+    std::string to_tree = commits.info(to_id).tree_hash;
+    if ((from_id == CommitCache::NONE || !from_tree.empty()) && !to_tree.empty())
+    {
+        // Equal hashes at a path mean equal contents below it
+        for (const std::string &path : paths)
+        {
+            if (tree_entry_hash(from_tree, path) != tree_entry_hash(to_tree, path))
+                return true;
+        }
+        return false;
+    }
+    // A flat snapshot: compare the whole commits and look for a path under one of them
+    bool differ = false;
+    diff_commits(from_id, to_id, [&](const std::string &changed, const std::string &, const std::string &)
+                 {
+                     for (const std::string &path : paths)
+                     {
+                         if (path.empty() || changed == path ||
+                             (changed.size() > path.size() && changed.compare(0, path.size(), path) == 0 && changed[path.size()] == '/'))
+                             differ = true;
+                     }
+                 });
+    return differ;
+}
+
+void MiniGit::diff_trees(const std::string &old_tree, const std::string &new_tree, const std::string &prefix,
+                         const std::function<void(const std::string &, const std::string &, const std::string &)> &fn)
+{
+    if (old_tree == new_tree)
+    {
+        return;
+    }
+    std::vector<TreeEntry> old_entries;
+    std::vector<TreeEntry> new_entries;
+    if (!old_tree.empty())
+        read_tree(old_tree, old_entries);
+    if (!new_tree.empty())
+        read_tree(new_tree, new_entries);
+
+    // Both lists are sorted by key, so one merge pass pairs up the entries
+    size_t i = 0;
+    size_t j = 0;
+    while (i < old_entries.size() || j < new_entries.size())
+    {
+        int cmp;
+        if (i == old_entries.size())
+            cmp = 1;
+        else if (j == new_entries.size())
+            cmp = -1;
+        else
+            cmp = old_entries[i].sort_key().compare(new_entries[j].sort_key());
+
+        if (cmp == 0)
+        {
+            const TreeEntry &a = old_entries[i++];
+            const TreeEntry &b = new_entries[j++];
+            if (a.hash == b.hash)
+                continue;
+            if (a.is_tree)
+                diff_trees(a.hash, b.hash, prefix + a.name + "/", fn);
+            else
+                fn(prefix + a.name, a.hash, b.hash);
+        }
+        else if (cmp < 0)
+        {
+            const TreeEntry &a = old_entries[i++];
+            if (a.is_tree)
+                diff_trees(a.hash, "", prefix + a.name + "/", fn);
+            else
+                fn(prefix + a.name, a.hash, "");
+        }
+        else
+        {
+            const TreeEntry &b = new_entries[j++];
+            if (b.is_tree)
+                diff_trees("", b.hash, prefix + b.name + "/", fn);
+            else
+                fn(prefix + b.name, "", b.hash);
+        }
+    }
+}
+
 std::string MiniGit::get_file_content_from_blob_hash(const std::string &blob_hash)
 {
-    fs::path blob_path = objects_path / blob_hash;
-    return Utils::readFile(blob_path.string());
+    std::string type;
+    std::string content;
+    if (!read_object(blob_hash, type, content))
+    {
+        return "";
+    }
+    return content;
 }
 
 bool MiniGit::is_ancestor(const std::string &ancestor_hash, const std::string &descendant_hash)
 {
+    Trace::Span span("is_ancestor");
     if (ancestor_hash.empty())
         return true;
     if (descendant_hash.empty())
@@ -453,33 +3577,40 @@ bool MiniGit::is_ancestor(const std::string &ancestor_hash, const std::string &d
     if (ancestor_hash == descendant_hash)
         return true;
 
-    std::queue<std::string> q;
-    std::set<std::string> visited;
-    q.push(descendant_hash);
-    visited.insert(descendant_hash);
+    uint32_t start = commits.id(descendant_hash);
+    uint32_t target = commits.id(ancestor_hash);
+    if (start == CommitCache::NONE || target == CommitCache::NONE)
+        return false;
 
-    while (!q.empty())
-    {
-        std::string current = q.front();
-        q.pop();
+    // Generations strictly decrease along parent links, so nothing below the
+    // ancestor's generation can lead to it
+    uint32_t min_generation = commits.generation(target);
+    if (commits.generation(start) <= min_generation)
+        return false;
 
-        Commit current_commit = get_commit(current);
-        if (current_commit.hash.empty())
-            continue;
+    std::vector<uint32_t> stack(1, start);
+    std::vector<char> visited(commits.size(), 0); // Indexed by commit id, grown as commits load
+    visited[start] = 1;
 
-        if (!current_commit.parent_hash.empty() && visited.find(current_commit.parent_hash) == visited.end())
-        {
-            if (current_commit.parent_hash == ancestor_hash)
-                return true;
-            q.push(current_commit.parent_hash);
-            visited.insert(current_commit.parent_hash);
-        }
-        if (!current_commit.second_parent_hash.empty() && visited.find(current_commit.second_parent_hash) == visited.end())
+    while (!stack.empty())
+    {
+        uint32_t current = stack.back();
+        stack.pop_back();
+
+        for (int which = 0; which < 2; ++which)
         {
-            if (current_commit.second_parent_hash == ancestor_hash)
+            uint32_t parent = commits.parent(current, which);
+            if (parent == CommitCache::NONE)
+                continue;
+            if (parent == target)
                 return true;
-            q.push(current_commit.second_parent_hash);
-            visited.insert(current_commit.second_parent_hash);
+            if (parent >= visited.size())
+                visited.resize(commits.size(), 0);
+            if (!visited[parent] && commits.generation(parent) > min_generation)
+            {
+                visited[parent] = 1;
+                stack.push_back(parent);
+            }
         }
     }
     return false;
@@ -487,6 +3618,7 @@ bool MiniGit::is_ancestor(const std::string &ancestor_hash, const std::string &d
 
 std::string MiniGit::find_lca(const std::string &commit1_hash, const std::string &commit2_hash)
 {
+    Trace::Span span("find_lca");
     if (commit1_hash.empty() || commit2_hash.empty())
     {
         return "";
@@ -494,169 +3626,279 @@ std::string MiniGit::find_lca(const std::string &commit1_hash, const std::string
     if (commit1_hash == commit2_hash)
         return commit1_hash;
 
-    std::queue<std::string> q1;
-    std::set<std::string> ancestors1;
-    q1.push(commit1_hash);
-    ancestors1.insert(commit1_hash);
+    uint32_t start1 = commits.id(commit1_hash);
+    uint32_t start2 = commits.id(commit2_hash);
+    if (start1 == CommitCache::NONE || start2 == CommitCache::NONE)
+        return "";
 
-    while (!q1.empty())
+    // Paint both sides' ancestors, always expanding the commit with the highest generation.
+    // A commit reached from both sides is a common ancestor; its own ancestors are marked
+    // stale, and the walk stops once only stale commits are queued. Nothing older than the
+    // merge bases is visited.
+    const char FROM1 = 1;
+    const char FROM2 = 2;
+    const char STALE = 4;
+    const char RESULT = 8;
+    std::vector<char> marks(commits.size(), 0);
+    std::vector<std::pair<uint32_t, uint32_t>> queue; // Max-heap of (generation, id)
+    auto push = [&](uint32_t id)
     {
-        std::string current_hash = q1.front();
-        q1.pop();
-
-        Commit current_commit = get_commit(current_hash);
-        if (current_commit.hash.empty())
-            continue;
+        queue.emplace_back(commits.generation(id), id);
+        std::push_heap(queue.begin(), queue.end());
+    };
+    auto has_nonstale = [&]()
+    {
+        for (const auto &entry : queue)
+            if (!(marks[entry.second] & STALE))
+                return true;
+        return false;
+    };
+    marks[start1] |= FROM1;
+    marks[start2] |= FROM2;
+    push(start1);
+    push(start2);
 
-        if (!current_commit.parent_hash.empty() && ancestors1.find(current_commit.parent_hash) == ancestors1.end())
+    std::vector<uint32_t> bases;
+    while (has_nonstale())
+    {
+        std::pop_heap(queue.begin(), queue.end());
+        uint32_t current = queue.back().second;
+        queue.pop_back();
+        char flags = marks[current] & (FROM1 | FROM2 | STALE);
+        if (flags == (FROM1 | FROM2))
+        {
+            if (!(marks[current] & RESULT))
+            {
+                marks[current] |= RESULT;
+                bases.push_back(current);
+            }
+            flags |= STALE;
+        }
+        for (int which = 0; which < 2; ++which)
         {
-            q1.push(current_commit.parent_hash);
-            ancestors1.insert(current_commit.parent_hash);
+            uint32_t parent = commits.parent(current, which);
+            if (parent == CommitCache::NONE)
+                continue;
+            if (parent >= marks.size())
+                marks.resize(commits.size(), 0);
+            if ((marks[parent] & flags) == flags)
+                continue;
+            marks[parent] |= flags;
+            push(parent);
         }
-        if (!current_commit.second_parent_hash.empty() && ancestors1.find(current_commit.second_parent_hash) == ancestors1.end())
+    }
+
+    // Several bases only happen with criss-cross merges. A base that turned stale later is
+    // an ancestor of another base and is skipped; of the rest, prefer the newest
+    std::string best_lca = "";
+    uint32_t best = CommitCache::NONE;
+    for (uint32_t base : bases)
+    {
+        if (marks[base] & STALE)
+            continue;
+        if (best == CommitCache::NONE || commits.generation(base) > commits.generation(best) ||
+            (commits.generation(base) == commits.generation(best) && commits.timestamp(base) > commits.timestamp(best)))
         {
-            q1.push(current_commit.second_parent_hash);
-            ancestors1.insert(current_commit.second_parent_hash);
+            best = base;
         }
     }
+    if (best != CommitCache::NONE)
+    {
+        best_lca = commits.hash(best);
+    }
 
-    std::queue<std::string> q2;
-    std::set<std::string> visited2;
-    q2.push(commit2_hash);
-    visited2.insert(commit2_hash);
+    return best_lca;
+}
 
-    std::vector<std::string> lca_candidates;
+std::vector<Snapshot::Change> MiniGit::apply_merge_changes(
+    const Snapshot &current_snapshot,
+    const Snapshot &other_snapshot,
+    const Snapshot &lca_snapshot,
+    bool &conflicts_occurred)
+{
+    Trace::Span span("apply_merge_changes");
+    conflicts_occurred = false;
 
-    while (!q2.empty())
+    // What a path needs beyond its message; only the file actions read any content
+    enum Action
+    {
+        REPORT,        // Nothing to do to the result or the working tree
+        TAKE_OTHER,    // Changed only in other: write other's version
+        DELETE,        // Deleted only in other
+        DELETE_MODIFY, // Deleted in current, modified in other (conflict)
+        MODIFY_DELETE, // Modified in current, deleted in other (conflict)
+        CONTENT        // Modified differently on both sides: line-level merge
+    };
+    struct FileMerge
     {
-        std::string current_hash = q2.front();
-        q2.pop();
+        std::string_view path;
+        const ObjectId *current; // nullptr where the side does not have the path
+        const ObjectId *other;
+        const ObjectId *lca;
+        Action action;
+        std::string message; // Printed in path order once every file is done
+        bool conflicted;
+        ObjectId merged_blob; // CONTENT merged cleanly
+    };
 
-        if (ancestors1.count(current_hash))
+    // 1. Merge-join of the three sorted snapshots. A path is decided from its three blob
+    //    hashes; content is only read for the files that have to change.
+    auto same = [](const ObjectId *a, const ObjectId *b)
+    { return a == b || (a && b && *a == *b); };
+    std::vector<FileMerge> merges;
+    size_t c = 0, o = 0, l = 0;
+    while (c < current_snapshot.size() || o < other_snapshot.size() || l < lca_snapshot.size())
+    {
+        std::string_view path; // The smallest path at the three positions
+        bool found = false;
+        auto consider = [&path, &found](const Snapshot &snapshot, size_t i)
+        {
+            if (i < snapshot.size() && (!found || snapshot.path(snapshot[i]) < path))
+            {
+                path = snapshot.path(snapshot[i]);
+                found = true;
+            }
+        };
+        consider(current_snapshot, c);
+        consider(other_snapshot, o);
+        consider(lca_snapshot, l);
+        auto take = [&path](const Snapshot &snapshot, size_t &i) -> const ObjectId *
+        {
+            if (i == snapshot.size() || snapshot.path(snapshot[i]) != path)
+                return nullptr;
+            return &snapshot[i++].blob;
+        };
+        const ObjectId *current = take(current_snapshot, c);
+        const ObjectId *other = take(other_snapshot, o);
+        const ObjectId *lca = take(lca_snapshot, l);
+
+        FileMerge merge{path, current, other, lca, REPORT, "", false, ObjectId()};
+        std::string name(path);
+        if (same(current, other))
         {
-            lca_candidates.push_back(current_hash);
+            if (same(current, lca))
+                continue; // Identical everywhere
+            merge.message = current ? "Modified file (both same): " + name : "Deleted file: " + name;
         }
-
-        Commit current_commit = get_commit(current_hash);
-        if (current_commit.hash.empty())
-            continue;
-
-        if (!current_commit.parent_hash.empty() && visited2.find(current_commit.parent_hash) == visited2.end())
+        else if (same(other, lca))
+        {
+            merge.message = current ? "Modified file (current): " + name : "Deleted file (current): " + name;
+        }
+        else if (same(current, lca))
+        {
+            merge.action = other ? TAKE_OTHER : DELETE;
+            merge.message = !other ? "Deleted file (other): " + name
+                                   : (current ? "Modified file (other): " : "Added file: ") + name;
+        }
+        else if (!current)
+        {
+            merge.action = DELETE_MODIFY;
+            merge.message = "CONFLICT (delete/modify): " + name + " deleted in current, modified in other.";
+        }
+        else if (!other)
         {
-            q2.push(current_commit.parent_hash);
-            visited2.insert(current_commit.parent_hash);
+            merge.action = MODIFY_DELETE;
+            merge.message = "CONFLICT (modify/delete): " + name + " modified in current, deleted in other.";
         }
-        if (!current_commit.second_parent_hash.empty() && visited2.find(current_commit.second_parent_hash) == visited2.end())
+        else
         {
-            q2.push(current_commit.second_parent_hash);
-            visited2.insert(current_commit.second_parent_hash);
+            merge.action = CONTENT;
         }
+        merges.push_back(std::move(merge));
     }
 
-    if (lca_candidates.empty())
+    // 2. The working tree is updated in batches: deletions first (a file may be replaced by
+    //    a directory), then the parent directories of every file to write, so the workers
+    //    below never race on creating them
+    std::vector<FileMerge *> work;
+    for (FileMerge &merge : merges)
     {
-        return "";
+        if (merge.action == DELETE)
+        {
+            std::error_code ec;
+            fs::path full_path = repo_path / merge.path;
+            fs::remove(full_path, ec);
+            for (fs::path dir = full_path.parent_path(); dir != repo_path && fs::is_empty(dir, ec); dir = dir.parent_path())
+            {
+                fs::remove(dir, ec);
+            }
+        }
+        else if (merge.action != REPORT)
+        {
+            work.push_back(&merge);
+        }
     }
-
-    std::string best_lca = "";
-    time_t latest_timestamp = 0;
-
-    for (const std::string &lca_candidate_hash : lca_candidates)
+    for (FileMerge *merge : work)
     {
-        Commit lca_candidate_commit = get_commit(lca_candidate_hash);
-        if (lca_candidate_commit.hash.empty())
-            continue;
-
-        if (lca_candidate_commit.timestamp > latest_timestamp)
+        fs::path parent = (repo_path / merge->path).parent_path();
+        std::error_code ec;
+        if (!fs::is_directory(parent, ec))
         {
-            latest_timestamp = lca_candidate_commit.timestamp;
-            best_lca = lca_candidate_hash;
+            fs::create_directories(parent, ec);
         }
     }
 
-    return best_lca;
-}
-
-std::map<std::string, std::string> MiniGit::apply_merge_changes(
-    const std::map<std::string, std::string> &current_snapshot,
-    const std::map<std::string, std::string> &other_snapshot,
-    const std::map<std::string, std::string> &lca_snapshot,
-    bool &conflicts_occurred)
-{
-    conflicts_occurred = false;
-    std::map<std::string, std::string> merged_snapshot = current_snapshot;
-
-    std::set<std::string> all_filepaths;
-    for (const auto &pair : current_snapshot)
-        all_filepaths.insert(pair.first);
-    for (const auto &pair : other_snapshot)
-        all_filepaths.insert(pair.first);
-    for (const auto &pair : lca_snapshot)
-        all_filepaths.insert(pair.first);
-
-    for (const std::string &filepath : all_filepaths)
-    {
-        std::string current_blob = current_snapshot.count(filepath) ? current_snapshot.at(filepath) : "";
-        std::string other_blob = other_snapshot.count(filepath) ? other_snapshot.at(filepath) : "";
-        std::string lca_blob = lca_snapshot.count(filepath) ? lca_snapshot.at(filepath) : "";
-
-        if (lca_blob.empty() && current_blob.empty() && !other_blob.empty())
-        { // File added in other branch
-            merged_snapshot[filepath] = other_blob;
-            std::cout << "Added file: " << filepath << std::endl;
-        }
-        else if (!lca_blob.empty() && current_blob.empty() && !other_blob.empty())
-        { // File deleted in current, modified in other (conflict)
-            std::cout << "CONFLICT (delete/modify): " << filepath << " deleted in current, modified in other." << std::endl;
-            std::string current_content = "";
-            std::string other_content = get_file_content_from_blob_hash(other_blob);
-            std::string lca_content = get_file_content_from_blob_hash(lca_blob);
-            write_file_with_conflict_markers(filepath, current_content, other_content, lca_content);
-            conflicts_occurred = true;
-            merged_snapshot[filepath] = ""; // Mark as conflicted
-        }
-        else if (!lca_blob.empty() && !current_blob.empty() && other_blob.empty())
-        { // File deleted in other, modified in current (conflict)
-            std::cout << "CONFLICT (modify/delete): " << filepath << " modified in current, deleted in other." << std::endl;
-            std::string current_content = get_file_content_from_blob_hash(current_blob);
-            std::string other_content = "";
-            std::string lca_content = get_file_content_from_blob_hash(lca_blob);
-            write_file_with_conflict_markers(filepath, current_content, other_content, lca_content);
-            conflicts_occurred = true;
-            merged_snapshot[filepath] = ""; // Mark as conflicted
-        }
-        else if (!lca_blob.empty() && current_blob.empty() && other_blob.empty())
-        { // File deleted in both (no conflict)
-            merged_snapshot.erase(filepath);
-            std::cout << "Deleted file: " << filepath << std::endl;
-        }
-        else if (!current_blob.empty() && !lca_blob.empty() && current_blob != lca_blob && other_blob == lca_blob)
-        { // File modified in current only
-            std::cout << "Modified file (current): " << filepath << std::endl;
-        }
-        else if (!other_blob.empty() && !lca_blob.empty() && other_blob != lca_blob && current_blob == lca_blob)
-        { // File modified in other only
-            merged_snapshot[filepath] = other_blob;
-            std::cout << "Modified file (other): " << filepath << std::endl;
-        }
-        else if (!current_blob.empty() && current_blob != lca_blob && other_blob != lca_blob && current_blob == other_blob)
-        { // File modified in both, no conflict (same changes)
-            merged_snapshot[filepath] = current_blob;
-            std::cout << "Modified file (both same): " << filepath << std::endl;
-        }
-        else if (!current_blob.empty() && !other_blob.empty() && current_blob != other_blob && current_blob != lca_blob && other_blob != lca_blob)
-        { // File modified in both, different changes (conflict!)
-            std::cout << "CONFLICT (content): both modified " << filepath << std::endl;
-            std::string current_content = get_file_content_from_blob_hash(current_blob);
-            std::string other_content = get_file_content_from_blob_hash(other_blob);
-            std::string lca_content = get_file_content_from_blob_hash(lca_blob);
-
-            write_file_with_conflict_markers(filepath, current_content, other_content, lca_content);
+    // 3. Files that need content, in parallel: each reads its blobs, merges and writes its
+    //    own file, and stores a clean merge result as a new blob
+    ThreadPool::parallel_for(work.size(), thread_count, [&](size_t i)
+                             {
+                                 FileMerge &merge = *work[i];
+                                 std::string filepath(merge.path);
+                                 auto content = [this](const ObjectId *blob)
+                                 { return blob ? get_file_content_from_blob_hash(blob->hex()) : std::string(); };
+                                 if (merge.action == TAKE_OTHER)
+                                 {
+                                     checkout_blob(merge.other->hex(), repo_path / filepath);
+                                     return;
+                                 }
+                                 std::string current_content = content(merge.current);
+                                 std::string other_content = content(merge.other);
+                                 std::string lca_content = content(merge.lca);
+                                 merge.conflicted = true;
+                                 if (merge.action != CONTENT || Diff::is_binary(current_content) ||
+                                     Diff::is_binary(other_content) || Diff::is_binary(lca_content))
+                                 {
+                                     write_file_with_conflict_markers(filepath, current_content, other_content, lca_content);
+                                     return;
+                                 }
+                                 // Line-level merge: only the regions changed differently on both sides conflict
+                                 std::string merged_content;
+                                 size_t conflict_count = Diff::merge3(lca_content, current_content, other_content, "HEAD", "MERGE_BRANCH", merged_content);
+                                 Utils::writeFile(repo_path / filepath, merged_content);
+                                 if (conflict_count == 0)
+                                 {
+                                     merge.message = "Auto-merged " + filepath;
+                                     merge.conflicted = false;
+                                     ObjectId::fromHex(write_object("blob", merged_content), merge.merged_blob);
+                                 }
+                                 else
+                                 {
+                                     merge.message = "CONFLICT (content): " + std::to_string(conflict_count) +
+                                                     " conflicting region(s) in " + filepath;
+                                 }
+                             });
+
+    // 4. Messages in path order, and the changes to current's snapshot
+    std::vector<Snapshot::Change> changes;
+    std::string report;
+    for (const FileMerge &merge : merges)
+    {
+        if (!merge.message.empty())
+            report += merge.message + "\n";
+        if (merge.conflicted)
+        {
             conflicts_occurred = true;
-            merged_snapshot[filepath] = ""; // Mark as conflicted
+            changes.push_back({merge.path, false, ObjectId()}); // Marked as conflicted
         }
+        else if (merge.action == TAKE_OTHER)
+            changes.push_back({merge.path, false, *merge.other});
+        else if (merge.action == DELETE)
+            changes.push_back({merge.path, true, ObjectId()});
+        else if (merge.action == CONTENT)
+            changes.push_back({merge.path, false, merge.merged_blob});
     }
-    return merged_snapshot;
+    std::cout << report << std::flush;
+    return changes;
 }
 
 void MiniGit::write_file_with_conflict_markers(const std::string &filepath, const std::string &current_content, const std::string &other_content, const std::string &lca_content)
@@ -678,6 +3920,7 @@ void MiniGit::write_file_with_conflict_markers(const std::string &filepath, cons
 
 void MiniGit::merge(const std::string &branch_name)
 {
+    Trace::Span span("merge");
     if (branch_name.empty())
     {
         std::cerr << "Error: Merge branch name cannot be empty." << std::endl;
@@ -685,10 +3928,10 @@ void MiniGit::merge(const std::string &branch_name)
     }
 
     std::string current_branch_name = "";
-    std::string head_content = Utils::readFile(head_path.string());
+    std::string head_content = refs.read_head();
     if (head_content.rfind("ref: ", 0) == 0)
     {
-        current_branch_name = fs::path(head_content.substr(5)).filename().string();
+        current_branch_name = RefStore::head_branch(head_content);
     }
     else
     {
@@ -702,15 +3945,14 @@ void MiniGit::merge(const std::string &branch_name)
         return;
     }
 
-    fs::path merge_branch_path = refs_path / "heads" / branch_name;
-    if (!fs::exists(merge_branch_path))
+    std::string merge_commit_hash = refs.read(branch_name);
+    if (merge_commit_hash.empty())
     {
         std::cerr << "Error: Branch '" << branch_name << "' does not exist." << std::endl;
         return;
     }
 
     std::string current_commit_hash = get_head_commit_hash();
-    std::string merge_commit_hash = Utils::readFile(merge_branch_path.string());
 
     if (current_commit_hash.empty() || merge_commit_hash.empty())
     {
@@ -718,9 +3960,6 @@ void MiniGit::merge(const std::string &branch_name)
         return;
     }
 
-    Commit current_commit = get_commit(current_commit_hash);
-    Commit merge_commit = get_commit(merge_commit_hash);
-
     if (is_ancestor(merge_commit_hash, current_commit_hash))
     {
         std::cout << "Already up to date." << std::endl;
@@ -729,42 +3968,11 @@ void MiniGit::merge(const std::string &branch_name)
     if (is_ancestor(current_commit_hash, merge_commit_hash))
     {
         std::cout << "Fast-forward merge detected." << std::endl;
-        update_head(merge_commit_hash, true, current_branch_name);
-
-        // Cleanup for fast-forward: Only remove files not in new snapshot or protected.
-        std::set<std::string> protected_files = {
-            ".minigit",
-            "main.cpp", "minigit.cpp", "minigit.h", "utils.cpp", "utils.h",
-            "Makefile",
-            "minigit"};
-        for (const auto &entry : fs::directory_iterator(repo_path))
-        {
-            std::string filename = entry.path().filename().string();
-            if (protected_files.count(filename))
-            {
-                continue;
-            }
-            if (!merge_commit.snapshot.count(filename) || fs::is_directory(entry.path()))
-            {
-                fs::remove_all(entry.path());
-            }
-        }
-        // Write files from merge_commit's snapshot
-        for (const auto &pair : merge_commit.snapshot)
+        if (!update_worktree(current_commit_hash, merge_commit_hash))
         {
-            const std::string &filepath = pair.first;
-            const std::string &blob_hash = pair.second;
-            std::string content = get_file_content_from_blob_hash(blob_hash);
-            if (!content.empty())
-            {
-                Utils::writeFile(repo_path / filepath, content);
-            }
-            else
-            {
-                Utils::writeFile(repo_path / filepath, ""); // Ensure file is created, even if empty
-            }
+            return;
         }
-        write_index(merge_commit.snapshot);
+        update_head(merge_commit_hash, true, current_branch_name);
         std::cout << "Fast-forward to " << merge_commit_hash.substr(0, 7) << std::endl;
         return;
     }
@@ -777,13 +3985,71 @@ void MiniGit::merge(const std::string &branch_name)
         return;
     }
 
-    Commit lca_commit = get_commit(lca_hash);
-
     std::cout << "LCA: " << lca_hash.substr(0, 7) << std::endl;
 
+    uint32_t current_id = commits.id(current_commit_hash);
+    std::string current_tree = commits.info(current_id).tree_hash;
+    std::string merge_tree = commits.info(commits.id(merge_commit_hash)).tree_hash;
+    std::string lca_tree = commits.info(commits.id(lca_hash)).tree_hash;
+
     bool conflicts_occurred = false;
-    std::map<std::string, std::string> merged_snapshot = apply_merge_changes(
-        current_commit.snapshot, merge_commit.snapshot, lca_commit.snapshot, conflicts_occurred);
+    PathPool paths; // Shared by the snapshots of this merge
+    Snapshot merged_snapshot(paths);
+    load_snapshot(current_commit_hash, merged_snapshot);
+    Snapshot lca_side(paths);
+    Snapshot current_side(paths);
+    Snapshot other_side(paths);
+    std::vector<Snapshot::Change> changes;
+    if (!current_tree.empty() && !merge_tree.empty() && !lca_tree.empty())
+    {
+        // Only paths changed on either side since the LCA can need merging. Diffing the
+        // trees finds them in path order, without reading directories that are the same on
+        // both sides; the two lists are then joined into three small snapshots.
+        struct TreeChange
+        {
+            std::string path;
+            std::string lca_blob;
+            std::string new_blob;
+        };
+        std::vector<TreeChange> ours;
+        std::vector<TreeChange> theirs;
+        diff_trees(lca_tree, current_tree, "", [&ours](const std::string &path, const std::string &old_blob, const std::string &new_blob)
+                   { ours.push_back({path, old_blob, new_blob}); });
+        diff_trees(lca_tree, merge_tree, "", [&theirs](const std::string &path, const std::string &old_blob, const std::string &new_blob)
+                   { theirs.push_back({path, old_blob, new_blob}); });
+        auto add = [](Snapshot &side, const std::string &path, const std::string &blob)
+        {
+            ObjectId id;
+            if (ObjectId::fromHex(blob, id)) // "" is a missing side
+                side.push_back(path, id);
+        };
+        size_t a = 0;
+        size_t b = 0;
+        while (a < ours.size() || b < theirs.size())
+        {
+            // A side that did not touch a path still has the LCA's version
+            bool in_ours = a < ours.size() && (b == theirs.size() || ours[a].path <= theirs[b].path);
+            bool in_theirs = b < theirs.size() && (a == ours.size() || theirs[b].path <= ours[a].path);
+            const TreeChange &change = in_ours ? ours[a] : theirs[b];
+            add(lca_side, change.path, change.lca_blob);
+            add(current_side, change.path, in_ours ? ours[a].new_blob : change.lca_blob);
+            add(other_side, change.path, in_theirs ? theirs[b].new_blob : change.lca_blob);
+            a += in_ours;
+            b += in_theirs;
+        }
+        for (Snapshot *side : {&lca_side, &current_side, &other_side})
+            side->sort();
+        changes = apply_merge_changes(current_side, other_side, lca_side, conflicts_occurred);
+    }
+    else
+    {
+        // A side still stores its flat snapshot: join the full snapshots
+        load_snapshot(merge_commit_hash, other_side);
+        load_snapshot(lca_hash, lca_side);
+        changes = apply_merge_changes(merged_snapshot, other_side, lca_side, conflicts_occurred);
+    }
+    // The result is HEAD's snapshot with the merged paths replaced, in one pass
+    merged_snapshot.apply(changes);
 
     if (conflicts_occurred)
     {
@@ -794,21 +4060,19 @@ void MiniGit::merge(const std::string &branch_name)
     {
         std::cout << "Merge completed successfully. Creating a merge commit." << std::endl;
 
-        std::map<std::string, std::string> final_merge_snapshot;
-        for (const auto &pair : merged_snapshot)
+        // A path without a blob is stored from the working tree file
+        std::vector<Snapshot::Change> stored;
+        for (const SnapshotEntry &entry : merged_snapshot)
         {
-            if (!pair.second.empty())
-            {
-                final_merge_snapshot[pair.first] = pair.second;
-            }
-            else
+            if (entry.conflicted())
             {
-                std::string current_content_of_file = Utils::readFile(pair.first);
-                std::string new_blob_hash = Utils::sha1(current_content_of_file);
-                final_merge_snapshot[pair.first] = new_blob_hash;
-                Utils::writeFile((objects_path / new_blob_hash).string(), current_content_of_file);
+                std::string_view path = merged_snapshot.path(entry);
+                Snapshot::Change change{path, false, ObjectId()};
+                ObjectId::fromHex(create_blob(std::string(path)), change.blob);
+                stored.push_back(change);
             }
         }
+        merged_snapshot.apply(stored);
 
         std::string merge_message = "Merge branch '" + branch_name + "' into " + current_branch_name;
 
@@ -818,16 +4082,14 @@ void MiniGit::merge(const std::string &branch_name)
         new_merge_commit_obj.message = merge_message;
         new_merge_commit_obj.author = "MiniGit Merge";
         new_merge_commit_obj.timestamp = std::time(nullptr);
-        new_merge_commit_obj.snapshot = final_merge_snapshot;
-
-        std::string new_merge_commit_hash = Utils::sha1(serialize_commit_data(new_merge_commit_obj));
-        new_merge_commit_obj.hash = new_merge_commit_hash;
+        new_merge_commit_obj.tree_hash = write_tree(merged_snapshot);
 
-        Utils::writeFile((objects_path / new_merge_commit_obj.hash).string(), serialize_commit_data(new_merge_commit_obj));
+        new_merge_commit_obj.hash = write_object("commit", serialize_commit_data(new_merge_commit_obj));
+        update_commit_graph({new_merge_commit_obj.hash});
 
         update_head(new_merge_commit_obj.hash, true, current_branch_name);
-        write_index(new_merge_commit_obj.snapshot);
+        write_index(merged_snapshot);
 
         std::cout << "Merge commit created: " << new_merge_commit_obj.hash.substr(0, 7) << std::endl;
     }
-}
\ No newline at end of file
+}
@@ -7,6 +7,18 @@
 #include <set>          // Added from the incoming version - necessary for set operations in minigit.cpp
 #include <ctime>        // From HEAD - For std::time_t
 #include <filesystem>   // From HEAD - For std::filesystem::path
+#include <memory>       // For std::unique_ptr
+#include <mutex>        // For std::mutex
+#include <functional>   // For std::function
+#include <unordered_map> // For std::unordered_map
+#include "commit_cache.h" // For CommitCache
+#include "snapshot.h" // For Snapshot
+#include "refs.h" // For RefStore
+
+class PackReader; // pack.h
+class CommitGraph; // commit_graph.h
+struct IndexEntry; // index.h
+class Index; // index.h
 
 // Structure to represent a commit object
 // This is from your HEAD version and is crucial.
@@ -17,12 +29,34 @@ struct Commit {
     std::string message;
     std::string author;
     std::time_t timestamp;
+    std::string tree_hash; // Root tree; empty for commits that store the flat snapshot
     std::map<std::string, std::string> snapshot; // Maps filepath to blob_hash
 
     // Default constructor to initialize members
     Commit() : timestamp(0) {}
 };
 
+// One line of a tree object: "<blob|tree> <hash> <name>". Entries are sorted by name,
+// with a subtree's name compared as if it ended in '/'.
+struct TreeEntry {
+    std::string name;
+    std::string hash;
+    bool is_tree;
+
+    std::string sort_key() const { return is_tree ? name + "/" : name; }
+};
+
+// What `minigit log` shows
+struct LogOptions {
+    long max_count = -1;            // -n: at most this many commits (-1: no limit)
+    std::time_t since = 0;          // --since: only commits at or after this time (0: no limit)
+    std::time_t until = 0;          // --until: only commits at or before this time (0: no limit)
+    std::string author;             // --author: only commits whose author contains this
+    std::vector<std::string> paths; // Only commits that change a file at or below one of these
+    bool first_parent = false;      // --first-parent: follow only the first parent of merges
+    bool topo_order = false;        // --topo-order: never show a parent before all its children
+};
+
 class MiniGit {
 public:
     MiniGit();
@@ -30,11 +64,40 @@ public:
 
     void init();
     void add(const std::string& filepath); // Using 'filepath' from HEAD as it's more descriptive
+    void add(const std::vector<std::string>& paths); // Files and directories ("." for the whole tree)
     void commit(const std::string& message);
-    void log();
+    // History from HEAD, newest first: every parent is followed, in commit date order
+    // (or topological order), and the walk stops as soon as enough commits were shown
+    void log(const LogOptions& options = LogOptions());
     void branch(const std::string& branch_name);
+    void branch_list(); // Every branch, the current one marked with '*'
+    void pack_refs(); // Move every loose branch into packed-refs
     void checkout(const std::string& branch_name_or_commit_hash); // Using 'branch_name_or_commit_hash' from HEAD
     void merge(const std::string& branch_name);
+    void config(const std::string& key, const std::string& value);
+    void repack(); // Pack every object into a single delta-compressed packfile
+    // Packs refs, prunes unreachable objects, repacks what is left (dropping packed objects
+    // that are unreachable and past the grace period) and rewrites the commit-graph
+    void gc();
+    // Deletes the loose objects no branch, HEAD or index entry reaches that were last written
+    // more than expire_seconds ago (-1: gc.pruneExpire, two weeks by default)
+    void prune(long expire_seconds = -1);
+    void migrate_objects(); // Move objects from the old flat layout into fanout directories
+    void write_commit_graph(); // Rewrite the commit-graph file from every branch and HEAD
+    void status(); // Staged, modified, deleted and untracked files
+    void daemon(const std::string& action); // "run": watch the working tree; "stop"
+    void diff_worktree(); // Working tree against the index
+    void diff_cached(); // Index against HEAD
+    void diff(const std::string& commit1, const std::string& commit2); // Two commits (revisions, see resolve_commit)
+    void rev_parse(const std::vector<std::string>& revisions); // Prints the commit hash of each revision
+    // Re-hashes every stored object, checks the syntax of commits, trees and chunk lists and
+    // that every object, branch and index entry they reference exists; exits with an error
+    // if anything is wrong
+    void fsck();
+
+    // For an instance that serves many commands (`minigit serve`): rereads the settings and
+    // drops cached state another process may have invalidated (packs, commit-graph)
+    void refresh();
 
 private:
     // These are from HEAD and are consistent with minigit.cpp's usage.
@@ -43,19 +106,165 @@ private:
     std::filesystem::path refs_path;
     std::filesystem::path head_path;
     std::filesystem::path index_path; // Staging area
+    std::filesystem::path config_path; // Repository settings ("key value" lines)
+    std::filesystem::path fsmonitor_path; // Daemon token and unclean paths from the last status
+
+    int compression_level; // zlib level for new objects (core.compression)
+    size_t thread_count;   // Worker threads for parallel operations (core.threads)
+    long long chunk_threshold; // Files of at least this many bytes are stored as chunks (core.chunkThreshold; 0: never)
+    void load_settings();  // Sets the three above and core.fsync from the config and environment
+
+    // Packfiles under objects/pack, opened on first use
+    std::vector<std::unique_ptr<PackReader>> packs;
+    bool packs_loaded;
+    std::string packs_stamp; // file_stamp of objects/pack when the packs were loaded
+    std::mutex packs_mutex;
+
+    // Branches and HEAD (loose and packed), cached for the command
+    RefStore refs;
+
+    // Parsed commits and the commit graph, shared by log, merge and repack
+    CommitCache commits;
+    // objects/info/commit-graph as it was when this instance started; used by commits
+    std::unique_ptr<CommitGraph> commit_graph;
+    std::string commit_graph_stamp; // file_stamp of the file commit_graph was read from
+    void load_commit_graph();
+
+    // Repository configuration
+    std::map<std::string, std::string> read_config();
+    int read_config_int(const std::string& key, int default_value);
+
+    // Object store: every object is a zlib stream of "<type> <size>\0<content>",
+    // named by the SHA-1 of that header plus content and stored as objects/<2 hex>/<38 hex>.
+    // Uncompressed objects (named by their content alone) and the old flat objects/<40 hex>
+    // layout are still readable.
+    std::filesystem::path object_path(const std::string& hash);
+    std::filesystem::path loose_object_file(const std::string& hash); // Existing file in either layout, or empty
+    bool object_exists(const std::string& hash);
+    // object_exists for writers: an object found stored gets a new mtime (its pack's, if
+    // packed), so prune treats an object that is about to be referenced again as new
+    bool freshen_object(const std::string& hash);
+    // The type of a stored object without reading all of it: a loose object's header is
+    // inflated from its first bytes, a packed one's comes from its entry. Thread-safe.
+    bool stored_object_type(const std::string& hash, std::string& type);
+    std::string write_object(const std::string& type, const std::string& content);
+    // A blob stored as chunks is read back whole, as type "blob"
+    bool read_object(const std::string& hash, std::string& type, std::string& content);
+    // The object as stored: a chunked blob is its "chunked" manifest (for repack)
+    bool read_stored_object(const std::string& hash, std::string& type, std::string& content);
+
+    // Large files are split into content-defined chunks (Chunker), each stored as a blob and
+    // so deduplicated across versions and files. The file's blob is then a "chunked" object:
+    // one "<chunk hash> <size>" line per chunk, stored under the hash of the whole content
+    // like any blob, so trees, the index and status cannot tell the difference.
+    std::string create_chunked_blob(const std::string& filepath); // Returns the blob hash, "" on error
+    // Calls fn(content) for each chunk of a manifest in order; false if a chunk is missing,
+    // has the wrong size, or fn returns false
+    bool read_chunks(const std::string& manifest, const std::function<bool(const std::string&)>& fn);
+    // Writes a blob to a working tree file (atomically); a chunked blob is streamed chunk
+    // by chunk instead of being assembled in memory. Thread-safe.
+    bool checkout_blob(const std::string& hash, const std::filesystem::path& path);
+    void load_packs();
+    std::vector<std::string> list_loose_objects();
+
+    // Garbage collection. Marking walks every commit reachable from HEAD and the branches,
+    // then their trees level by level and the index's blobs, reading objects on worker
+    // threads; chunked blobs keep their chunks. A reachable object that cannot be read makes
+    // it return false, so nothing is deleted on a partial view. reachable is sorted.
+    bool mark_reachable(std::vector<ObjectId>& reachable);
+    // Marks, then deletes the unreachable loose objects and leftover temp files last
+    // modified before cutoff, one fanout directory per task. Callers hold gc.lock.
+    bool prune_objects(std::time_t cutoff, std::vector<ObjectId>& reachable);
+    std::time_t prune_cutoff(long expire_seconds); // -1: gc.pruneExpire
+    // repack; with reachable given, unreachable objects are left out of the pack: loose
+    // ones stay loose, packed ones are written loose if their pack is newer than cutoff
+    // and dropped otherwise
+    void repack_objects(const std::vector<ObjectId>* reachable, std::time_t cutoff);
+    // fsck of one stored copy of an object (pack is nullptr for the loose file). A loose
+    // object is inflated and hashed as it streams through a fixed buffer; only commits,
+    // trees and chunk lists are kept whole, to be parsed. References are looked up in
+    // known (sorted). Appends to problems and adds the bytes hashed. Thread-safe.
+    void fsck_object(const std::string& hash, PackReader* pack, const std::vector<ObjectId>& known,
+                     std::vector<std::string>& problems, uint64_t& bytes);
 
     // All these helper function declarations are from HEAD and align with minigit.cpp
-    std::map<std::string, std::string> read_index();
-    void write_index(const std::map<std::string, std::string>& index_map);
-    std::string create_blob(const std::string& filepath);
+    // Makes the index hold exactly this snapshot, rewriting only the entries that differ
+    // (the others keep their stat data). stat_worktree: the working tree files were just
+    // written from these blobs, so their stat data can be cached and later adds/status
+    // skip re-hashing them.
+    void write_index(const Snapshot& snapshot, bool stat_worktree = false);
+    std::string create_blob(const std::string& filepath); // Thread-safe; returns "" if the file cannot be read
+    std::string normalize_path(const std::string& path); // Repo-relative generic path, "" if outside the repo
+    void collect_files(const std::string& dir, std::set<std::string>& files);
+    // Moves the working tree and index from one commit to another, touching only the paths
+    // that differ. Returns false, changing nothing, if that would lose local changes.
+    bool update_worktree(const std::string& from_commit, const std::string& to_commit);
+    // With `minigit daemon` running: the paths that may differ from the index, i.e. those
+    // changed since the last status plus those it reported. Returns false when the whole
+    // tree has to be scanned instead. new_token receives the token to save after a scan.
+    bool worktree_changes(const Index& index, std::set<std::string>& paths, std::string* new_token = nullptr);
+    void save_worktree_token(const std::string& token, const std::vector<std::string>& pending);
     std::string get_head_commit_hash();
+    // A revision to a commit hash, or "" with the reason in error. A revision is a base
+    // followed by any number of ~<n> (n-th first-parent ancestor, ~ alone is ~1) and ^<n>
+    // (n-th parent, ^ alone is ^1, ^0 the commit itself) suffixes. The base is HEAD or @,
+    // a branch, a full or unique abbreviated (4+ digits) commit hash, or <branch>@<hash>:
+    // a commit on that branch, whose abbreviation only has to be unique within its history.
+    std::string resolve_commit(const std::string& revision, std::string& error);
+    // Full names of the objects whose name starts with a hex prefix, sorted: binary searches
+    // of the commit-graph and pack indexes, plus the one loose object directory it selects
+    std::vector<std::string> find_objects_by_prefix(const std::string& prefix);
     void update_head(const std::string& commit_hash, bool is_branch, const std::string& branch_name = "");
 
     // Commit related functions
     Commit get_commit(const std::string& commit_hash);
-    Commit parse_commit_data(const std::string& commit_hash, const std::string& commit_data);
+    // with_snapshot=false stops at the snapshot section (metadata only)
+    Commit parse_commit_data(const std::string& commit_hash, const std::string& commit_data, bool with_snapshot = true);
+    bool load_commit_info(const std::string& commit_hash, CommitInfo& info); // CommitCache loader
+    // A commit's files in compact form, walking its tree without building a map; false if
+    // the commit cannot be read
+    bool load_snapshot(const std::string& commit_hash, Snapshot& snapshot);
+
+    // Trees: one object per directory, so unchanged directories are shared between commits
+    std::string write_tree(const Snapshot& snapshot); // Returns the root tree hash
+    std::string write_tree(const Snapshot& snapshot, size_t begin, size_t end, size_t prefix_length);
+    bool read_tree(const std::string& tree_hash, std::vector<TreeEntry>& entries);
+    // Hash of the blob or tree at path below a tree ("" for the tree itself), or "" if
+    // there is none; reads only the trees along the path
+    std::string tree_entry_hash(const std::string& tree_hash, const std::string& path);
+    // True if a file at or below one of the paths differs between two commits (from_id may
+    // be CommitCache::NONE: the empty tree). No blob is read.
+    bool paths_differ(uint32_t from_id, uint32_t to_id, const std::vector<std::string>& paths);
+    // The index as trees: hashed like write_tree would store them, but kept in index_trees
+    // (which read_tree serves first) instead of being written
+    using IndexEntries = std::vector<std::pair<std::string, IndexEntry>>;
+    std::string hash_index_tree(const IndexEntries& entries, size_t begin, size_t end, size_t prefix_length);
+    std::unordered_map<std::string, std::vector<TreeEntry>> index_trees;
+    // Calls fn(path, head_blob, index_blob) for every path that differs between HEAD and the
+    // index; a conflicted path in the index has an empty blob, like a missing one
+    void diff_head_index(const IndexEntries& entries,
+                         const std::function<void(const std::string&, const std::string&, const std::string&)>& fn);
+    void flatten_tree(const std::string& tree_hash, const std::string& prefix, std::map<std::string, std::string>& snapshot);
+    void flatten_tree(const std::string& tree_hash, std::string& prefix, Snapshot& snapshot); // prefix is restored
+    // Calls fn(path, old_blob, new_blob) for every path that differs ("" for a missing side).
+    // Subtrees with equal hashes are skipped without being read; "" is the empty tree.
+    void diff_trees(const std::string& old_tree, const std::string& new_tree, const std::string& prefix,
+                    const std::function<void(const std::string&, const std::string&, const std::string&)>& fn);
+    // Calls fn(path, old_blob, new_blob) for every path that differs between two commits
+    // (CommitCache::NONE for none), using diff_trees when both have trees
+    void diff_commits(uint32_t from_id, uint32_t to_id,
+                      const std::function<void(const std::string&, const std::string&, const std::string&)>& fn);
+    void diff_snapshots(const std::map<std::string, std::string>& from_snapshot,
+                        const std::map<std::string, std::string>& to_snapshot,
+                        const std::function<void(const std::string&, const std::string&, const std::string&)>& fn);
+    // Writes one file's unified diff to std::cout; an empty blob hash is a missing side
+    void print_file_diff(const std::string& path, const std::string& old_blob, const std::string& new_blob,
+                         const std::string& old_content, const std::string& new_content);
     std::string serialize_commit_data(const Commit& commit_obj);
     void commit(const std::string& hash, const std::string& parent1_hash, const std::string& parent2_hash, const std::map<std::string, std::string>& snapshot_map);
+    // Adds the commits reachable from tips to the commit-graph file; rewrite drops
+    // everything already in the file first (e.g. commits gc found unreachable)
+    void update_commit_graph(const std::vector<std::string>& tips, bool rewrite = false);
 
     // File content from blob hash
     std::string get_file_content_from_blob_hash(const std::string& blob_hash);
@@ -63,13 +272,16 @@ private:
     // Merge related functions
     bool is_ancestor(const std::string& ancestor_hash, const std::string& descendant_hash);
     std::string find_lca(const std::string& commit1_hash, const std::string& commit2_hash);
-    std::map<std::string, std::string> apply_merge_changes(
-        const std::map<std::string, std::string>& current_snapshot,
-        const std::map<std::string, std::string>& other_snapshot,
-        const std::map<std::string, std::string>& lca_snapshot,
+    // Three-way merge of snapshots in path order (a path missing from one is absent on that
+    // side). Updates the working tree and returns the changes, in path order, that turn
+    // current_snapshot into the result; a conflicted path gets an all-zero blob.
+    std::vector<Snapshot::Change> apply_merge_changes(
+        const Snapshot& current_snapshot,
+        const Snapshot& other_snapshot,
+        const Snapshot& lca_snapshot,
         bool& conflicts_occurred
     );
     void write_file_with_conflict_markers(const std::string& filepath, const std::string& current_content, const std::string& other_content, const std::string& lca_content);
 };
 
-#endif // MINIGIT_H
\ No newline at end of file
+#endif // MINIGIT_H
@@ -0,0 +1,142 @@
+#include "object_writer.h"
+#include "trace.h"
+#include <cerrno>
+#include <cstdlib>   // For mkstemp
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Chunk size for streaming files: large enough to amortize syscalls, small enough
+// that adding a multi-gigabyte file needs only a few megabytes of memory
+const size_t CHUNK_SIZE = 1 << 20;
+
+} // namespace
+
+ObjectWriter::ObjectWriter(const fs::path &objects_dir, int compression_level)
+    : dir(objects_dir), level(compression_level), fd(-1), expected(0), written(0), hashing(true)
+{
+}
+
+ObjectWriter::~ObjectWriter()
+{
+    deflater.reset();
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+    if (!temp_path.empty())
+    {
+        unlink(temp_path.c_str());
+    }
+}
+
+bool ObjectWriter::begin(const std::string &type, uint64_t size, const ObjectId *id)
+{
+    std::string pattern = (dir / "tmp_obj_XXXXXX").string();
+    std::vector<char> name(pattern.begin(), pattern.end());
+    name.push_back('\0');
+    fd = mkstemp(name.data());
+    if (fd < 0)
+    {
+        return false;
+    }
+    temp_path = name.data();
+    expected = size;
+    deflater = std::make_unique<DeflateStream>(level, fd);
+
+    std::string header = Utils::objectHeader(type, size);
+    hashing = id == nullptr;
+    if (hashing)
+        hasher.update(header.data(), header.size());
+    else
+        known = *id;
+    return deflater->write(header.data(), header.size());
+}
+
+bool ObjectWriter::write(const void *data, size_t length)
+{
+    if (hashing)
+        hasher.update(data, length);
+    written += length;
+    return deflater->write(data, length);
+}
+
+bool ObjectWriter::finish(ObjectId &id)
+{
+    bool ok = deflater && deflater->finish() && written == expected;
+    deflater.reset();
+    ok = ok && (!Utils::durableWrites() || fsync(fd) == 0);
+    ok = (close(fd) == 0) && ok;
+    fd = -1;
+    if (hashing)
+        hasher.finish(id);
+    else
+        id = known;
+    return ok;
+}
+
+bool ObjectWriter::install(const fs::path &final_path)
+{
+    if (rename(temp_path.c_str(), final_path.c_str()) != 0)
+    {
+        // The fanout directory (objects/ab/) may not exist yet
+        std::error_code ec;
+        fs::create_directories(final_path.parent_path(), ec);
+        if (rename(temp_path.c_str(), final_path.c_str()) != 0)
+        {
+            return false;
+        }
+    }
+    temp_path.clear();
+    Trace::count(Trace::OBJECTS_WRITTEN);
+    if (Utils::durableWrites())
+    {
+        // Make the new directory entry itself durable
+        int dir_fd = open(final_path.parent_path().c_str(), O_RDONLY | O_DIRECTORY);
+        if (dir_fd >= 0)
+        {
+            fsync(dir_fd);
+            close(dir_fd);
+        }
+    }
+    return true;
+}
+
+bool ObjectWriter::write_file(const std::string &filepath, const std::string &type, ObjectId &id)
+{
+    int in = open(filepath.c_str(), O_RDONLY);
+    if (in < 0)
+    {
+        return false;
+    }
+    struct stat st;
+    if (fstat(in, &st) != 0 || !begin(type, static_cast<uint64_t>(st.st_size)))
+    {
+        close(in);
+        return false;
+    }
+    posix_fadvise(in, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    std::vector<char> buffer(CHUNK_SIZE);
+    bool ok = true;
+    while (ok)
+    {
+        ssize_t n = read(in, buffer.data(), buffer.size());
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+        {
+            ok = (n == 0);
+            break;
+        }
+        ok = write(buffer.data(), static_cast<size_t>(n));
+    }
+    close(in);
+    // finish() fails if the file changed size while it was being read
+    return finish(id) && ok;
+}
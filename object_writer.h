@@ -0,0 +1,47 @@
+#ifndef OBJECT_WRITER_H
+#define OBJECT_WRITER_H
+
+#include "utils.h" // For ObjectId, Sha1Hasher, DeflateStream
+#include <string>
+#include <memory>
+#include <cstdint>
+#include <filesystem>
+
+// Writes one object into the store in a single pass. The content is hashed and
+// deflated into a temp file as it arrives, so nothing larger than one chunk is
+// ever held in memory; install() then renames the temp file to the object's name.
+// The object name is the SHA-1 of the header and content, like Utils::hashObject.
+class ObjectWriter {
+public:
+    ObjectWriter(const std::filesystem::path& objects_dir, int compression_level);
+    ~ObjectWriter(); // Removes the temp file unless the object was installed
+
+    ObjectWriter(const ObjectWriter&) = delete;
+    ObjectWriter& operator=(const ObjectWriter&) = delete;
+
+    // Starts the object; size must be exact, since it is written into the header up front.
+    // A caller that already knows the name passes it as id, and the content is not hashed again.
+    bool begin(const std::string& type, uint64_t size, const ObjectId* id = nullptr);
+    bool write(const void* data, size_t length);
+    // Ends the stream and checks the size (fsync'ed when durable writes are on); id receives the object name
+    bool finish(ObjectId& id);
+    // Moves the finished object to its final path, creating its fanout directory if needed
+    bool install(const std::filesystem::path& final_path);
+
+    // Streams a whole file: reads it once in large chunks through the steps above
+    bool write_file(const std::string& filepath, const std::string& type, ObjectId& id);
+
+private:
+    std::filesystem::path dir;
+    std::filesystem::path temp_path;
+    int level;
+    int fd;
+    uint64_t expected;
+    uint64_t written;
+    Sha1Hasher hasher;
+    bool hashing;   // False when begin() was given the name
+    ObjectId known; // That name
+    std::unique_ptr<DeflateStream> deflater;
+};
+
+#endif // OBJECT_WRITER_H
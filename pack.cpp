@@ -0,0 +1,442 @@
+#include "pack.h"
+#include "delta.h"
+#include "trace.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <unistd.h> // For getpid, fsync
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const char PACK_MAGIC[4] = {'M', 'P', 'A', 'K'};
+const char IDX_MAGIC[4] = {'M', 'I', 'D', 'X'};
+const uint32_t PACK_VERSION = 1;
+const int DELTA_CODE = 7;
+const size_t ID_LEN = 20;
+
+// Objects larger than this are stored whole and never used as delta bases
+const size_t MAX_DELTA_SIZE = 512 * 1024 * 1024;
+
+// Delta chains longer than this are treated as corrupt rather than followed
+const int MAX_CHAIN_READ = 10000;
+
+// Limits for the per-reader cache of inflated delta bases
+const size_t CACHE_ENTRY_LIMIT = 4 * 1024 * 1024;
+const size_t CACHE_TOTAL_LIMIT = 32 * 1024 * 1024;
+
+uint32_t read_u32(const unsigned char *p)
+{
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+           (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+uint64_t read_u64(const unsigned char *p)
+{
+    return static_cast<uint64_t>(read_u32(p)) | (static_cast<uint64_t>(read_u32(p + 4)) << 32);
+}
+
+// Flushes a file or directory to disk; open() with O_RDONLY is enough for fsync
+bool sync_path(const fs::path &path, int flags = 0)
+{
+    int fd = open(path.c_str(), O_RDONLY | flags);
+    if (fd < 0)
+        return false;
+    bool ok = fsync(fd) == 0;
+    return (close(fd) == 0) && ok;
+}
+
+void put_u32(std::string &out, uint32_t v)
+{
+    for (int i = 0; i < 4; ++i)
+        out.push_back(static_cast<char>((v >> (8 * i)) & 0xff));
+}
+
+void put_u64(std::string &out, uint64_t v)
+{
+    for (int i = 0; i < 8; ++i)
+        out.push_back(static_cast<char>((v >> (8 * i)) & 0xff));
+}
+
+const char *type_name(int code)
+{
+    switch (code)
+    {
+    case 1:
+        return "commit";
+    case 2:
+        return "tree";
+    case 3:
+        return "blob";
+    case 4:
+        return "chunked";
+    default:
+        return nullptr;
+    }
+}
+
+} // namespace
+
+int pack_type_code(const std::string &type)
+{
+    for (int code = 1; code < DELTA_CODE; ++code)
+    {
+        const char *name = type_name(code);
+        if (name != nullptr && type == name)
+            return code;
+    }
+    return 0;
+}
+
+// --- PackReader ---
+
+PackReader::PackReader(const fs::path &idx_path)
+    : idx(idx_path.string()), pack(fs::path(idx_path).replace_extension(".pack").string()),
+      pack_path(fs::path(idx_path).replace_extension(".pack")), is_valid(false), count(0),
+      fanout(nullptr), ids(nullptr), offsets(nullptr)
+{
+    if (!idx.valid() || idx.size() < 8 + 256 * 4 + ID_LEN || std::memcmp(idx.data(), IDX_MAGIC, 4) != 0)
+    {
+        return;
+    }
+    const unsigned char *base = reinterpret_cast<const unsigned char *>(idx.data());
+    if (read_u32(base + 4) != PACK_VERSION)
+    {
+        return;
+    }
+    fanout = base + 8;
+    count = read_u32(fanout + 255 * 4);
+    if (idx.size() != 8 + 256 * 4 + static_cast<size_t>(count) * (ID_LEN + 8) + ID_LEN)
+    {
+        return;
+    }
+    ids = fanout + 256 * 4;
+    offsets = ids + static_cast<size_t>(count) * ID_LEN;
+
+    if (!pack.valid() || pack.size() < 8 + ID_LEN || std::memcmp(pack.data(), PACK_MAGIC, 4) != 0)
+    {
+        return;
+    }
+    is_valid = true;
+}
+
+std::string PackReader::object_id(size_t i) const
+{
+    return Utils::toHex(ids + i * ID_LEN, ID_LEN);
+}
+
+bool PackReader::find(const std::string &hash, uint64_t &offset) const
+{
+    ObjectId id;
+    if (!is_valid || !ObjectId::fromHex(hash, id))
+    {
+        return false;
+    }
+    uint32_t lo = id.bytes[0] == 0 ? 0 : read_u32(fanout + (id.bytes[0] - 1) * 4);
+    uint32_t hi = read_u32(fanout + id.bytes[0] * 4);
+    while (lo < hi)
+    {
+        uint32_t mid = lo + (hi - lo) / 2;
+        int cmp = std::memcmp(ids + static_cast<size_t>(mid) * ID_LEN, id.bytes, ID_LEN);
+        if (cmp == 0)
+        {
+            offset = read_u64(offsets + static_cast<size_t>(mid) * 8);
+            return true;
+        }
+        if (cmp < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return false;
+}
+
+bool PackReader::contains(const std::string &hash) const
+{
+    uint64_t offset = 0;
+    return find(hash, offset);
+}
+
+void PackReader::find_prefix(std::string_view prefix, std::vector<std::string> &out) const
+{
+    uint32_t first = 0;
+    uint32_t last = 0;
+    if (!is_valid || !ObjectId::prefixRange(prefix, fanout, ids, first, last))
+    {
+        return;
+    }
+    for (uint32_t i = first; i < last; ++i)
+        out.push_back(object_id(i));
+}
+
+bool PackReader::read(const std::string &hash, std::string &type, std::string &content)
+{
+    Trace::Span span("PackReader::read");
+    uint64_t offset = 0;
+    if (!find(hash, offset))
+    {
+        return false;
+    }
+    return read_at(offset, type, content, 0);
+}
+
+bool PackReader::type(const std::string &hash, std::string &type) const
+{
+    uint64_t offset = 0;
+    if (!find(hash, offset))
+    {
+        return false;
+    }
+    size_t data_end = pack.size() - ID_LEN;
+    for (int depth = 0; depth <= MAX_CHAIN_READ && offset >= 8 && offset < data_end; ++depth)
+    {
+        const char *p = pack.data() + offset;
+        const char *end = pack.data() + data_end;
+        int code = static_cast<unsigned char>(*p++);
+        unsigned long long size = 0;
+        if (!Delta::getVarint(p, end, size))
+        {
+            return false;
+        }
+        if (code != DELTA_CODE)
+        {
+            const char *name = type_name(code);
+            if (name == nullptr)
+            {
+                return false;
+            }
+            type = name;
+            return true;
+        }
+        unsigned long long distance = 0;
+        if (!Delta::getVarint(p, end, distance) || distance == 0 || distance > offset)
+        {
+            return false;
+        }
+        offset -= distance;
+    }
+    return false;
+}
+
+bool PackReader::read_at(uint64_t offset, std::string &type, std::string &content, int depth)
+{
+    size_t data_end = pack.size() - ID_LEN;
+    if (depth > MAX_CHAIN_READ || offset < 8 || offset >= data_end)
+    {
+        return false;
+    }
+
+    const char *p = pack.data() + offset;
+    const char *end = pack.data() + data_end;
+    int code = static_cast<unsigned char>(*p++);
+    unsigned long long size = 0;
+    if (!Delta::getVarint(p, end, size))
+    {
+        return false;
+    }
+
+    if (code != DELTA_CODE)
+    {
+        const char *name = type_name(code);
+        if (name == nullptr || !Utils::decompress(p, end - p, content) || content.size() != size)
+        {
+            return false;
+        }
+        type = name;
+        return true;
+    }
+
+    unsigned long long distance = 0;
+    if (!Delta::getVarint(p, end, distance) || distance == 0 || distance > offset)
+    {
+        return false;
+    }
+    uint64_t base_offset = offset - distance;
+
+    std::string base_type;
+    std::string base_content;
+    bool cached = false;
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        auto it = base_cache.find(base_offset);
+        if (it != base_cache.end())
+        {
+            base_type = it->second.first;
+            base_content = it->second.second;
+            cached = true;
+        }
+    }
+    if (!cached)
+    {
+        if (!read_at(base_offset, base_type, base_content, depth + 1))
+        {
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        if (base_content.size() <= CACHE_ENTRY_LIMIT)
+        {
+            if (base_cache_bytes + base_content.size() > CACHE_TOTAL_LIMIT)
+            {
+                base_cache.clear();
+                base_cache_bytes = 0;
+            }
+            base_cache_bytes += base_content.size();
+            base_cache[base_offset] = {base_type, base_content};
+        }
+    }
+
+    std::string delta;
+    if (!Utils::decompress(p, end - p, delta) || delta.size() != size)
+    {
+        return false;
+    }
+    type = base_type;
+    return Delta::apply(base_content, delta.data(), delta.size(), content);
+}
+
+// --- PackWriter ---
+
+PackWriter::PackWriter(const fs::path &pack_dir, int compression_level, int window_size, int max_chain_depth)
+    : dir(pack_dir), level(compression_level), window(window_size < 0 ? 0 : window_size),
+      max_depth(max_chain_depth), offset(0), delta_count(0)
+{
+    fs::create_directories(dir);
+    temp_path = dir / ("tmp-pack-" + std::to_string(getpid()));
+    out.open(temp_path, std::ios::binary | std::ios::trunc);
+    if (!out.is_open())
+    {
+        printErrorAndExit("Could not create packfile: " + temp_path.string());
+    }
+    std::string header(PACK_MAGIC, 4);
+    put_u32(header, PACK_VERSION);
+    emit(header);
+}
+
+void PackWriter::emit(const std::string &bytes)
+{
+    out.write(bytes.data(), bytes.size());
+    hasher.update(bytes.data(), bytes.size());
+    offset += bytes.size();
+}
+
+void PackWriter::add(const std::string &hash, const std::string &type, const std::string &content, const std::string &delta_group)
+{
+    Entry entry;
+    if (!ObjectId::fromHex(hash, entry.id))
+    {
+        std::cerr << "Warning: Skipping object with invalid name '" << hash << "' while packing." << std::endl;
+        return;
+    }
+    entry.offset = offset;
+
+    // Try every candidate of the same group in the window, keeping the smallest delta
+    std::string best_delta;
+    const Candidate *best_base = nullptr;
+    for (auto it = recent.rbegin(); content.size() <= MAX_DELTA_SIZE && it != recent.rend(); ++it)
+    {
+        if (it->group != delta_group || it->depth >= max_depth)
+            continue;
+        std::string delta = Delta::create(it->content, content);
+        if (best_base == nullptr || delta.size() < best_delta.size())
+        {
+            best_delta = std::move(delta);
+            best_base = &*it;
+        }
+        if (best_delta.size() < content.size() / 20)
+            break; // Good enough; skip the rest of the window
+    }
+
+    std::string record;
+    int depth = 0;
+    if (best_base != nullptr && best_delta.size() < content.size() / 2)
+    {
+        record.push_back(static_cast<char>(DELTA_CODE));
+        Delta::putVarint(record, best_delta.size());
+        Delta::putVarint(record, entry.offset - best_base->offset);
+        record += Utils::compress(best_delta, level);
+        depth = best_base->depth + 1;
+        ++delta_count;
+    }
+    else
+    {
+        record.push_back(static_cast<char>(pack_type_code(type)));
+        Delta::putVarint(record, content.size());
+        record += Utils::compress(content, level);
+    }
+    emit(record);
+    entries.push_back(entry);
+
+    if (window > 0 && content.size() <= MAX_DELTA_SIZE)
+    {
+        recent.push_back({entry.offset, depth, content, delta_group});
+        if (recent.size() > window)
+            recent.pop_front();
+    }
+}
+
+bool PackWriter::finish()
+{
+    recent.clear();
+    ObjectId checksum;
+    hasher.finish(checksum);
+    out.write(reinterpret_cast<const char *>(checksum.bytes), ID_LEN);
+    offset += ID_LEN;
+    out.close();
+    if (!out)
+    {
+        std::cerr << "Error: Failed writing packfile " << temp_path.string() << std::endl;
+        return false;
+    }
+
+    std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b)
+              { return a.id < b.id; });
+
+    std::string index(IDX_MAGIC, 4);
+    put_u32(index, PACK_VERSION);
+    uint32_t fan[256] = {0};
+    for (const Entry &e : entries)
+        ++fan[e.id.bytes[0]];
+    uint32_t running = 0;
+    for (int b = 0; b < 256; ++b)
+    {
+        running += fan[b];
+        put_u32(index, running);
+    }
+    for (const Entry &e : entries)
+        index.append(reinterpret_cast<const char *>(e.id.bytes), ID_LEN);
+    for (const Entry &e : entries)
+        put_u64(index, e.offset);
+    index.append(reinterpret_cast<const char *>(checksum.bytes), ID_LEN);
+
+    std::string name = "pack-" + checksum.hex();
+    final_pack_path = dir / (name + ".pack");
+    fs::path temp_idx = dir / ("tmp-idx-" + std::to_string(getpid()));
+    Utils::writeFile(temp_idx, index);
+
+    // Repack deletes the loose copies once this returns, so the pack is flushed even
+    // without core.fsync
+    if (!sync_path(temp_path) || !sync_path(temp_idx))
+    {
+        std::cerr << "Error: Could not flush packfile " << name << " to disk" << std::endl;
+        return false;
+    }
+
+    // The pack goes into place first: readers only discover packs through their index
+    std::error_code ec;
+    fs::rename(temp_path, final_pack_path, ec);
+    if (!ec)
+        fs::rename(temp_idx, dir / (name + ".idx"), ec);
+    if (ec)
+    {
+        std::cerr << "Error: Could not install packfile " << name << ": " << ec.message() << std::endl;
+        return false;
+    }
+    if (!sync_path(dir, O_DIRECTORY))
+    {
+        std::cerr << "Error: Could not flush " << dir.string() << " to disk" << std::endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,111 @@
+#ifndef PACK_H
+#define PACK_H
+
+#include "utils.h" // For MappedFile, Sha1Hasher, ObjectId
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <fstream>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+
+// Packfiles hold many objects in one file, storing similar objects as deltas.
+//
+// pack-<sha>.pack: "MPAK" | u32 version | entries... | 20-byte SHA-1 of the preceding bytes
+//   entry: u8 type | varint size | [varint distance back to the base entry, deltas only] | zlib payload
+//   type: 1 commit, 2 tree, 3 blob, 4 chunked (a large blob's chunk list), 7 delta
+// pack-<sha>.idx:  "MIDX" | u32 version | u32 fanout[256] | 20-byte ids (sorted) | u64 offsets | pack SHA-1
+//   fanout[b] is the number of ids whose first byte is <= b, so a lookup only
+//   binary-searches the ids sharing the first byte.
+// All integers are little-endian.
+
+// Reads objects out of one pack through its index; both files are memory-mapped
+class PackReader {
+public:
+    explicit PackReader(const std::filesystem::path& idx_path);
+
+    bool valid() const { return is_valid; }
+    const std::filesystem::path& pack_file() const { return pack_path; }
+    size_t object_count() const { return count; }
+
+    // Hex id of the i-th object in sorted order
+    std::string object_id(size_t i) const;
+
+    bool contains(const std::string& hash) const;
+    // Appends the hex ids of the objects whose name starts with a hex prefix
+    void find_prefix(std::string_view prefix, std::vector<std::string>& out) const;
+    bool read(const std::string& hash, std::string& type, std::string& content);
+    // Type of an object from its entry header alone (a delta's is its base's); nothing is inflated
+    bool type(const std::string& hash, std::string& type) const;
+
+private:
+    MappedFile idx;
+    MappedFile pack;
+    std::filesystem::path pack_path;
+    bool is_valid;
+    uint32_t count;
+    const unsigned char* fanout;  // 256 little-endian u32
+    const unsigned char* ids;     // count * 20 bytes
+    const unsigned char* offsets; // count little-endian u64
+
+    // Recently inflated delta bases, keyed by pack offset; cleared when it grows too big.
+    // Guarded by cache_mutex so one reader can serve several threads.
+    std::mutex cache_mutex;
+    std::map<uint64_t, std::pair<std::string, std::string>> base_cache;
+    size_t base_cache_bytes = 0;
+
+    bool find(const std::string& hash, uint64_t& offset) const;
+    bool read_at(uint64_t offset, std::string& type, std::string& content, int depth);
+};
+
+// Writes a new pack and its index. Objects passed with the same delta group
+// (e.g. versions of the same path) are delta candidates for one another, so callers
+// should add each group contiguously.
+class PackWriter {
+public:
+    PackWriter(const std::filesystem::path& pack_dir, int compression_level, int window, int max_depth);
+
+    void add(const std::string& hash, const std::string& type, const std::string& content, const std::string& delta_group);
+
+    // Writes the trailer and index and renames both into place; returns false on I/O failure
+    bool finish();
+
+    const std::filesystem::path& pack_file() const { return final_pack_path; }
+    size_t objects() const { return entries.size(); }
+    size_t deltas() const { return delta_count; }
+    uint64_t pack_bytes() const { return offset; }
+
+private:
+    struct Entry {
+        ObjectId id;
+        uint64_t offset;
+    };
+    struct Candidate {
+        uint64_t offset;
+        int depth;
+        std::string content;
+        std::string group;
+    };
+
+    std::filesystem::path dir;
+    std::filesystem::path temp_path;
+    std::filesystem::path final_pack_path;
+    std::ofstream out;
+    Sha1Hasher hasher;
+    int level;
+    size_t window;
+    int max_depth;
+    uint64_t offset;
+    size_t delta_count;
+    std::vector<Entry> entries;
+    std::deque<Candidate> recent; // Sliding delta window
+
+    void emit(const std::string& bytes);
+};
+
+// Maps object type names to pack type codes (0 if the type cannot be packed)
+int pack_type_code(const std::string& type);
+
+#endif // PACK_H
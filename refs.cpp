@@ -0,0 +1,402 @@
+#include "refs.h"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <iostream>
+#include <string_view>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+
+const char PACKED_HEADER[] = "# pack-refs with: sorted\n";
+const std::string HEADS_PREFIX = "refs/heads/";
+const std::string HEAD_REF_PREFIX = "ref: refs/heads/";
+const size_t HASH_LEN = 40;
+
+// Content of a small file without trailing whitespace; false if it is missing or not a file
+bool read_small_file(const fs::path &path, std::string &content)
+{
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return false;
+    }
+    content.clear();
+    char buffer[256];
+    ssize_t n;
+    while ((n = read(fd, buffer, sizeof(buffer))) > 0)
+        content.append(buffer, static_cast<size_t>(n));
+    close(fd);
+    if (n < 0)
+    {
+        return false; // A directory, e.g. refs/heads/feature when feature/x exists
+    }
+    while (!content.empty() && std::isspace(static_cast<unsigned char>(content.back())))
+        content.pop_back();
+    return true;
+}
+
+using RefList = std::vector<std::pair<std::string, std::string>>;
+
+// Joins two lists sorted by name; a loose ref replaces the packed one
+void merge_refs(RefList &packed_refs, const RefList &loose_refs, RefList &out)
+{
+    out.clear();
+    out.reserve(packed_refs.size() + loose_refs.size());
+    size_t p = 0;
+    for (const auto &loose : loose_refs)
+    {
+        while (p < packed_refs.size() && packed_refs[p].first < loose.first)
+            out.push_back(std::move(packed_refs[p++]));
+        if (p < packed_refs.size() && packed_refs[p].first == loose.first)
+            ++p;
+        out.push_back(loose);
+    }
+    for (; p < packed_refs.size(); ++p)
+        out.push_back(std::move(packed_refs[p]));
+}
+
+} // namespace
+
+RefStore::RefStore(const fs::path &git_dir)
+    : git_dir(git_dir), heads_path(git_dir / "refs" / "heads"), packed_path(git_dir / "packed-refs"),
+      packed_fd(-1), packed_opened(false), packed_size(0), head_loaded(false)
+{
+}
+
+RefStore::~RefStore()
+{
+    clear_cache();
+}
+
+std::string RefStore::read(const std::string &name)
+{
+    auto cached = cache.find(name);
+    if (cached != cache.end())
+    {
+        return cached->second;
+    }
+    std::string hash;
+    if (valid_name(name) && !read_small_file(heads_path / name, hash))
+    {
+        hash = read_packed(name);
+    }
+    cache.emplace(name, hash);
+    return hash;
+}
+
+std::string RefStore::read_packed(const std::string &name)
+{
+    if (!packed_opened)
+    {
+        packed_opened = true;
+        packed_fd = open(packed_path.c_str(), O_RDONLY | O_CLOEXEC);
+        struct stat st;
+        if (packed_fd >= 0 && fstat(packed_fd, &st) == 0)
+            packed_size = static_cast<size_t>(st.st_size);
+    }
+    if (packed_fd < 0)
+    {
+        return "";
+    }
+    std::string key = HEADS_PREFIX + name;
+
+    // Bisect on byte offsets: each probe reads the first line that starts at or after the
+    // midpoint. Lines before lo are smaller than the key, lines starting at hi or later larger.
+    size_t lo = 0;
+    size_t hi = packed_size;
+    size_t line_start;
+    std::string line;
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if (!packed_line(mid == lo ? lo : mid - 1, mid == lo, line_start, line) || line_start >= hi)
+        {
+            hi = mid; // No line starts in [mid, hi)
+            continue;
+        }
+        if (line[0] == '#')
+        {
+            lo = line_start + line.size() + 1; // The header
+            continue;
+        }
+        if (line.size() < HASH_LEN + 2)
+        {
+            return ""; // Malformed line
+        }
+        int cmp = std::string_view(line).substr(HASH_LEN + 1).compare(key);
+        if (cmp == 0)
+        {
+            return line.substr(0, HASH_LEN);
+        }
+        if (cmp < 0)
+            lo = line_start + line.size() + 1;
+        else
+            hi = line_start;
+    }
+    return "";
+}
+
+bool RefStore::packed_line(size_t pos, bool at_start, size_t &line_start, std::string &line)
+{
+    std::string buffer;
+    size_t base = pos; // File offset of buffer[0]
+    char chunk[256];
+    while (true)
+    {
+        if (!at_start)
+        {
+            size_t newline = buffer.find('\n');
+            if (newline != std::string::npos)
+            {
+                buffer.erase(0, newline + 1);
+                base += newline + 1;
+                at_start = true;
+            }
+        }
+        if (at_start)
+        {
+            size_t newline = buffer.find('\n');
+            if (newline != std::string::npos || (base + buffer.size() >= packed_size && !buffer.empty()))
+            {
+                line_start = base;
+                line = buffer.substr(0, newline);
+                return true;
+            }
+        }
+        if (base + buffer.size() >= packed_size)
+        {
+            return false;
+        }
+        ssize_t n = pread(packed_fd, chunk, sizeof(chunk), static_cast<off_t>(base + buffer.size()));
+        if (n <= 0)
+        {
+            return false;
+        }
+        buffer.append(chunk, static_cast<size_t>(n));
+    }
+}
+
+bool RefStore::update(const std::string &name, const std::string &hash, const std::string *expected)
+{
+    if (!valid_name(name))
+    {
+        std::cerr << "Error: '" << name << "' is not a valid branch name." << std::endl;
+        return false;
+    }
+    fs::path path = heads_path / name;
+    std::error_code ec;
+    fs::create_directories(path.parent_path(), ec);
+    LockFile lock;
+    if (!lock.acquire(path))
+    {
+        return false;
+    }
+    if (expected != nullptr)
+    {
+        cache.erase(name); // Compared against the ref as it is now, under the lock
+        if (read(name) != *expected)
+        {
+            std::cerr << "Error: Branch '" << name << "' was changed by another process." << std::endl;
+            return false;
+        }
+    }
+    if (!commit_lock(lock, hash))
+    {
+        return false;
+    }
+    cache[name] = hash;
+    return true;
+}
+
+bool RefStore::commit_lock(LockFile &lock, const std::string &content)
+{
+    if (!lock.write(content.data(), content.size()) || (Utils::durableWrites() && fsync(lock.descriptor()) != 0))
+    {
+        std::cerr << "Error: Could not write " << content.size() << " bytes to a lock file: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    return lock.commit();
+}
+
+void RefStore::list(std::vector<std::pair<std::string, std::string>> &out)
+{
+    RefList packed_refs;
+    RefList loose_refs;
+    list_packed(packed_refs);
+    list_loose(heads_path, "", loose_refs);
+    std::sort(loose_refs.begin(), loose_refs.end());
+    merge_refs(packed_refs, loose_refs, out);
+}
+
+void RefStore::list_packed(std::vector<std::pair<std::string, std::string>> &out)
+{
+    std::string content = Utils::readFile(packed_path.string()); // One read; "" if there is none
+    const char *data = content.data();
+    size_t size = content.size();
+    size_t pos = 0;
+    while (pos < size)
+    {
+        const char *newline = static_cast<const char *>(std::memchr(data + pos, '\n', size - pos));
+        size_t end = newline ? static_cast<size_t>(newline - data) : size;
+        std::string_view line(data + pos, end - pos);
+        if (line.size() > HASH_LEN + 1 + HEADS_PREFIX.size() && line[0] != '#' &&
+            line.compare(HASH_LEN + 1, HEADS_PREFIX.size(), HEADS_PREFIX) == 0)
+        {
+            out.emplace_back(std::string(line.substr(HASH_LEN + 1 + HEADS_PREFIX.size())),
+                             std::string(line.substr(0, HASH_LEN)));
+        }
+        pos = end + 1;
+    }
+}
+
+void RefStore::list_loose(const fs::path &dir, const std::string &prefix,
+                          std::vector<std::pair<std::string, std::string>> &out)
+{
+    // Entry types come from the directory listing itself, so no ref is stat'ed
+    std::error_code ec;
+    for (fs::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec))
+    {
+        std::string name = prefix + it->path().filename().string();
+        if (it->is_directory(ec))
+        {
+            list_loose(it->path(), name + "/", out);
+            continue;
+        }
+        std::string hash;
+        if (valid_name(name) && read_small_file(it->path(), hash) && !hash.empty())
+        {
+            out.emplace_back(name, hash);
+        }
+    }
+}
+
+long RefStore::pack()
+{
+    LockFile packed_lock;
+    if (!packed_lock.acquire(packed_path))
+    {
+        return -1;
+    }
+    clear_cache();
+    RefList packed_refs;
+    RefList loose_refs;
+    list_packed(packed_refs);
+    list_loose(heads_path, "", loose_refs);
+    std::sort(loose_refs.begin(), loose_refs.end());
+    RefList refs;
+    merge_refs(packed_refs, loose_refs, refs);
+
+    std::string content = PACKED_HEADER;
+    content.reserve(content.size() + refs.size() * (HASH_LEN + HEADS_PREFIX.size() + 16));
+    for (const auto &ref : refs)
+    {
+        content += ref.second;
+        content += ' ';
+        content += HEADS_PREFIX;
+        content += ref.first;
+        content += '\n';
+    }
+    if (!commit_lock(packed_lock, content))
+    {
+        return -1;
+    }
+
+    // A loose ref is only removed if it still holds the packed hash; one updated in the
+    // meantime stays and keeps taking precedence
+    std::vector<fs::path> dirs; // Of nested names, removed once empty
+    for (const auto &ref : loose_refs)
+    {
+        fs::path path = heads_path / ref.first;
+        LockFile lock;
+        std::string hash;
+        if (lock.acquire(path, true) && read_small_file(path, hash) && hash == ref.second)
+        {
+            unlink(path.c_str());
+            if (path.parent_path() != heads_path && (dirs.empty() || dirs.back() != path.parent_path()))
+                dirs.push_back(path.parent_path());
+        }
+    }
+    // Deepest first, so a parent is tried after its subdirectories
+    std::sort(dirs.begin(), dirs.end(), [](const fs::path &a, const fs::path &b)
+              { return a.native().size() > b.native().size(); });
+    for (const fs::path &dir : dirs)
+    {
+        for (fs::path d = dir; d != heads_path && rmdir(d.c_str()) == 0;)
+            d = d.parent_path();
+    }
+    clear_cache();
+    return static_cast<long>(refs.size());
+}
+
+std::string RefStore::read_head()
+{
+    if (!head_loaded)
+    {
+        if (!read_small_file(git_dir / "HEAD", head))
+            head.clear();
+        head_loaded = true;
+    }
+    return head;
+}
+
+bool RefStore::write_head(const std::string &content)
+{
+    LockFile lock;
+    if (!lock.acquire(git_dir / "HEAD") || !commit_lock(lock, content))
+    {
+        return false;
+    }
+    head = content;
+    head_loaded = true;
+    return true;
+}
+
+std::string RefStore::head_branch(const std::string &head_content)
+{
+    return head_content.rfind(HEAD_REF_PREFIX, 0) == 0 ? head_content.substr(HEAD_REF_PREFIX.size()) : "";
+}
+
+bool RefStore::valid_name(const std::string &name)
+{
+    if (name.empty() || name.front() == '/' || name.back() == '/' || name.find("..") != std::string::npos)
+    {
+        return false;
+    }
+    size_t start = 0;
+    while (start <= name.size())
+    {
+        size_t end = name.find('/', start);
+        if (end == std::string::npos)
+            end = name.size();
+        std::string_view component(name.data() + start, end - start);
+        if (component.empty() || component[0] == '.' ||
+            (component.size() >= 5 && component.substr(component.size() - 5) == ".lock"))
+        {
+            return false;
+        }
+        start = end + 1;
+    }
+    for (unsigned char c : name)
+    {
+        if (c <= ' ' || c == 0x7f || std::strchr("~^:?*[\\", c) != nullptr)
+            return false;
+    }
+    return true;
+}
+
+void RefStore::clear_cache()
+{
+    if (packed_fd >= 0)
+        close(packed_fd);
+    packed_fd = -1;
+    packed_opened = false;
+    packed_size = 0;
+    cache.clear();
+    head_loaded = false;
+}
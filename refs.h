@@ -0,0 +1,76 @@
+#ifndef REFS_H
+#define REFS_H
+
+#include "utils.h" // For LockFile
+#include <string>
+#include <vector>
+#include <utility>
+#include <filesystem>
+#include <unordered_map>
+
+// Branches and HEAD. A branch is a loose file refs/heads/<name> holding its commit hash,
+// or a line of packed-refs, which holds many branches in one file:
+//
+//   packed-refs: "# pack-refs with: sorted\n" | "<40 hex> refs/heads/<name>\n"...
+//   Lines are sorted by ref name (byte order), so a branch is found by binary search,
+//   reading a few hundred bytes at each probe instead of the whole file.
+//
+// A loose ref takes precedence over a packed line of the same name: updates only ever
+// write loose refs, and pack() folds them into packed-refs. Every write goes through a
+// "<file>.lock" (LockFile), so concurrent updates fail cleanly instead of racing.
+// Refs read by a command are cached until clear_cache().
+class RefStore {
+public:
+    explicit RefStore(const std::filesystem::path& git_dir);
+    ~RefStore();
+    RefStore(const RefStore&) = delete;
+    RefStore& operator=(const RefStore&) = delete;
+
+    // Commit hash of a branch, "" if there is no such branch
+    std::string read(const std::string& name);
+    // Points a branch at a commit. With expected set, fails unless the branch currently
+    // holds *expected ("" means the branch must not exist yet). Returns false with a
+    // message on stderr on failure.
+    bool update(const std::string& name, const std::string& hash, const std::string* expected = nullptr);
+    // Every branch as (name, hash), sorted by name; reads no loose ref that is not there
+    void list(std::vector<std::pair<std::string, std::string>>& out);
+    // Moves every loose branch into packed-refs; returns the number of branches packed, or
+    // -1 if the file could not be written (nothing is lost then)
+    long pack();
+
+    // HEAD: "ref: refs/heads/<name>" or a detached commit hash
+    std::string read_head();
+    bool write_head(const std::string& content);
+    // The branch HEAD points at, "" when detached
+    static std::string head_branch(const std::string& head_content);
+
+    // Usable as a branch name: path components not starting with "." or ending in ".lock",
+    // and no "..", whitespace, control characters or any of ~ ^ : ? * [ \ characters
+    static bool valid_name(const std::string& name);
+
+    void clear_cache(); // For long-running processes: drops everything read so far
+
+private:
+    std::filesystem::path git_dir;
+    std::filesystem::path heads_path;
+    std::filesystem::path packed_path;
+
+    int packed_fd;      // packed-refs, opened on first lookup (-1: not open or missing)
+    bool packed_opened;
+    size_t packed_size;
+    std::unordered_map<std::string, std::string> cache; // Branch name -> hash ("" if absent)
+    std::string head;
+    bool head_loaded;
+
+    std::string read_packed(const std::string& name); // Binary search in packed-refs
+    // The line of packed-refs that starts at or after pos (pos itself when at_start), as
+    // [line_start, line_end); false at the end of the file
+    bool packed_line(size_t pos, bool at_start, size_t& line_start, std::string& line);
+    void list_packed(std::vector<std::pair<std::string, std::string>>& out);
+    void list_loose(const std::filesystem::path& dir, const std::string& prefix,
+                    std::vector<std::pair<std::string, std::string>>& out);
+    // Writes content into an acquired lock and renames it over the target
+    static bool commit_lock(LockFile& lock, const std::string& content);
+};
+
+#endif // REFS_H
@@ -0,0 +1,267 @@
+#include "server.h"
+#include "minigit.h"
+#include "utils.h" // For FatalError, setFatalErrorsThrow
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <poll.h>
+#include <sstream>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace
+{
+
+volatile std::sig_atomic_t stop_requested = 0;
+
+void on_signal(int)
+{
+    stop_requested = 1;
+}
+
+std::string json_string(const std::string &text)
+{
+    std::string out = "\"";
+    for (char c : text)
+    {
+        unsigned char byte = static_cast<unsigned char>(c);
+        if (c == '"' || c == '\\')
+        {
+            out += '\\';
+            out += c;
+        }
+        else if (c == '\n')
+            out += "\\n";
+        else if (c == '\t')
+            out += "\\t";
+        else if (byte < 0x20)
+        {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", byte);
+            out += escaped;
+        }
+        else
+            out += c;
+    }
+    return out + "\"";
+}
+
+bool send_all(int fd, const std::string &data)
+{
+    size_t sent = 0;
+    while (sent < data.size())
+    {
+        ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        sent += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// A command reports most errors as "Error: ..." on stderr and returns
+bool reported_error(const std::string &err)
+{
+    return err.rfind("Error:", 0) == 0 || err.find("\nError:") != std::string::npos;
+}
+
+} // namespace
+
+CommandServer::CommandServer(MiniGit &repository, Runner run_command)
+    : mg(repository), run(std::move(run_command)), next_id(1)
+{
+    setFatalErrorsThrow(true);
+}
+
+bool CommandServer::parse_request(const std::string &line, std::vector<std::string> &args)
+{
+    args.clear();
+    size_t i = 0;
+    while (i < line.size())
+    {
+        while (i < line.size() && (line[i] == ' ' || line[i] == '\t' || line[i] == '\r'))
+            ++i;
+        if (i == line.size())
+            break;
+        std::string arg;
+        while (i < line.size() && line[i] != ' ' && line[i] != '\t' && line[i] != '\r')
+        {
+            if (line[i] != '"')
+            {
+                arg += line[i++];
+                continue;
+            }
+            ++i; // Opening quote
+            while (i < line.size() && line[i] != '"')
+            {
+                if (line[i] == '\\' && i + 1 < line.size())
+                {
+                    char next = line[i + 1];
+                    arg += next == 'n' ? '\n' : next;
+                    i += 2;
+                }
+                else
+                    arg += line[i++];
+            }
+            if (i == line.size())
+                return false; // Unterminated quote
+            ++i; // Closing quote
+        }
+        args.push_back(arg);
+    }
+    return true;
+}
+
+std::string CommandServer::handle(const std::string &line)
+{
+    unsigned long long id = next_id++;
+    auto start = std::chrono::steady_clock::now();
+    std::ostringstream out;
+    std::ostringstream err;
+    bool failed = false;
+
+    std::streambuf *saved_out = std::cout.rdbuf(out.rdbuf());
+    std::streambuf *saved_err = std::cerr.rdbuf(err.rdbuf());
+    std::vector<std::string> args;
+    try
+    {
+        if (!parse_request(line, args))
+        {
+            std::cerr << "Error: Unterminated quote in request." << std::endl;
+            failed = true;
+        }
+        else if (args[0] == "serve" || args[0] == "daemon")
+        {
+            std::cerr << "Error: '" << args[0] << "' cannot run inside minigit serve." << std::endl;
+            failed = true;
+        }
+        else
+        {
+            mg.refresh();
+            run(args);
+        }
+    }
+    catch (const FatalError &)
+    {
+        failed = true; // printErrorAndExit already wrote the message
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "Error: " << e.what() << std::endl;
+        failed = true;
+    }
+    std::cout.rdbuf(saved_out);
+    std::cerr.rdbuf(saved_err);
+
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::string err_text = err.str();
+    char elapsed[32];
+    std::snprintf(elapsed, sizeof(elapsed), "%.3f", ms);
+    return "{\"id\":" + std::to_string(id) + ",\"ok\":" + (failed || reported_error(err_text) ? "false" : "true") +
+           ",\"ms\":" + elapsed + ",\"stdout\":" + json_string(out.str()) + ",\"stderr\":" + json_string(err_text) + "}\n";
+}
+
+int CommandServer::serve_stdio()
+{
+    std::string line;
+    while (std::getline(std::cin, line))
+    {
+        if (line == "quit")
+            break;
+        if (line.find_first_not_of(" \t\r") == std::string::npos)
+            continue;
+        std::cout << handle(line) << std::flush;
+    }
+    return 0;
+}
+
+int CommandServer::serve_socket(const std::string &path)
+{
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path))
+    {
+        std::cerr << "Error: Socket path is too long: " << path << std::endl;
+        return 1;
+    }
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+
+    int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (probe >= 0 && connect(probe, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == 0)
+    {
+        close(probe);
+        std::cerr << "Error: A server is already listening on " << path << std::endl;
+        return 1;
+    }
+    if (probe >= 0)
+        close(probe);
+    unlink(addr.sun_path); // Left behind by a server that did not exit cleanly
+
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0 || bind(listen_fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 ||
+        listen(listen_fd, 16) != 0)
+    {
+        std::cerr << "Error: Could not listen on " << path << ": " << std::strerror(errno) << std::endl;
+        if (listen_fd >= 0)
+            close(listen_fd);
+        return 1;
+    }
+    // No SA_RESTART, so a blocked poll or read returns and sees stop_requested
+    struct sigaction action;
+    std::memset(&action, 0, sizeof(action));
+    action.sa_handler = on_signal;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+    std::cout << "Serving " << path << std::endl;
+
+    bool running = true;
+    while (running && !stop_requested)
+    {
+        pollfd listener = {listen_fd, POLLIN, 0};
+        if (poll(&listener, 1, -1) <= 0)
+            continue;
+        int client = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (client < 0)
+            continue;
+        std::string buffer;
+        char chunk[4096];
+        bool open = true;
+        while (open && running && !stop_requested)
+        {
+            size_t eol;
+            while (open && running && (eol = buffer.find('\n')) != std::string::npos)
+            {
+                std::string line = buffer.substr(0, eol);
+                buffer.erase(0, eol + 1);
+                if (!line.empty() && line.back() == '\r')
+                    line.pop_back();
+                if (line == "quit")
+                    open = false;
+                else if (line == "shutdown")
+                    running = false;
+                else if (line.find_first_not_of(" \t") != std::string::npos)
+                    open = send_all(client, handle(line));
+            }
+            if (!open || !running)
+                break;
+            ssize_t n = read(client, chunk, sizeof(chunk));
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                break;
+            buffer.append(chunk, static_cast<size_t>(n));
+        }
+        close(client);
+    }
+    close(listen_fd);
+    unlink(addr.sun_path);
+    std::cout << "Server stopped." << std::endl;
+    return 0;
+}
@@ -0,0 +1,43 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <functional>
+#include <string>
+#include <vector>
+
+class MiniGit;
+
+// `minigit serve`: runs a stream of commands in one process, so the commit cache, the
+// commit-graph and the open packs stay warm between them instead of being rebuilt by a
+// new process each time.
+//
+// A request is one line holding a command as it would follow `minigit` on the command
+// line; arguments are split on spaces, and "double quotes" (with \" \\ \n escapes) keep
+// spaces in one argument. Each request is answered by one JSON line:
+//   {"id":1,"ok":true,"ms":0.412,"stdout":"...","stderr":"..."}
+// ok is false when the command failed or reported an error. "quit" ends the session;
+// over a socket, "shutdown" also stops the server. One client is served at a time.
+class CommandServer {
+public:
+    using Runner = std::function<void(const std::vector<std::string>&)>;
+
+    CommandServer(MiniGit& repository, Runner run_command);
+
+    // Requests on stdin, responses on stdout, until EOF or "quit". Returns the exit code.
+    int serve_stdio();
+    // Requests from clients of a Unix socket at path, until "shutdown", SIGINT or SIGTERM
+    int serve_socket(const std::string& path);
+
+    // Splits a request line into arguments; false on an unterminated quote
+    static bool parse_request(const std::string& line, std::vector<std::string>& args);
+
+private:
+    MiniGit& mg;
+    Runner run;
+    unsigned long long next_id;
+
+    // Runs one request and returns its JSON response line (with the newline)
+    std::string handle(const std::string& line);
+};
+
+#endif // SERVER_H
@@ -0,0 +1,116 @@
+#include "snapshot.h"
+#include <algorithm>
+#include <cstring>
+#include <functional>
+
+uint32_t PathPool::intern(std::string_view path)
+{
+    if ((paths.size() + 1) * 2 > slots.size())
+        grow(); // Load factor stays under one half
+    uint64_t hash = std::hash<std::string_view>()(path);
+    size_t mask = slots.size() - 1;
+    size_t pos = hash & mask;
+    while (slots[pos].id != UINT32_MAX)
+    {
+        if (slots[pos].hash == hash && paths[slots[pos].id] == path)
+            return slots[pos].id;
+        pos = (pos + 1) & mask;
+    }
+
+    if (chunks.empty() || chunk_used + path.size() > CHUNK_SIZE)
+    {
+        // A path longer than a chunk gets a chunk of its own
+        size_t size = std::max(CHUNK_SIZE, path.size());
+        chunks.emplace_back(new char[size]);
+        chunk_bytes += size;
+        chunk_used = 0;
+    }
+    char *dest = chunks.back().get() + chunk_used;
+    std::memcpy(dest, path.data(), path.size());
+    chunk_used += path.size();
+    paths.emplace_back(dest, path.size());
+    uint32_t id = static_cast<uint32_t>(paths.size() - 1);
+    slots[pos] = Slot{hash, id};
+    return id;
+}
+
+size_t PathPool::bytes() const
+{
+    return chunk_bytes + paths.capacity() * sizeof(std::string_view) + slots.capacity() * sizeof(Slot);
+}
+
+void PathPool::grow()
+{
+    std::vector<Slot> old;
+    old.swap(slots);
+    slots.assign(old.empty() ? 1024 : old.size() * 2, Slot{0, UINT32_MAX});
+    size_t mask = slots.size() - 1;
+    for (const Slot &slot : old)
+    {
+        if (slot.id == UINT32_MAX)
+            continue;
+        size_t pos = slot.hash & mask;
+        while (slots[pos].id != UINT32_MAX)
+            pos = (pos + 1) & mask;
+        slots[pos] = slot;
+    }
+}
+
+void Snapshot::push_back(std::string_view path, const ObjectId &blob)
+{
+    entries.push_back(SnapshotEntry{pool->intern(path), blob});
+}
+
+void Snapshot::sort()
+{
+    auto by_path = [this](const SnapshotEntry &a, const SnapshotEntry &b)
+    { return pool->path(a.path) < pool->path(b.path); };
+    if (!std::is_sorted(entries.begin(), entries.end(), by_path))
+        std::stable_sort(entries.begin(), entries.end(), by_path);
+}
+
+const SnapshotEntry *Snapshot::find(std::string_view path) const
+{
+    auto it = std::lower_bound(entries.begin(), entries.end(), path,
+                               [this](const SnapshotEntry &entry, std::string_view key)
+                               { return pool->path(entry.path) < key; });
+    return it != entries.end() && pool->path(it->path) == path ? &*it : nullptr;
+}
+
+void Snapshot::apply(const std::vector<Change> &changes)
+{
+    std::vector<SnapshotEntry> result;
+    result.reserve(entries.size() + changes.size());
+    auto it = entries.begin();
+    for (const Change &change : changes)
+    {
+        while (it != entries.end() && pool->path(it->path) < change.path)
+            result.push_back(*it++);
+        if (it != entries.end() && pool->path(it->path) == change.path)
+            ++it; // Replaced or removed
+        if (!change.removed)
+            result.push_back(SnapshotEntry{pool->intern(change.path), change.blob});
+    }
+    result.insert(result.end(), it, entries.end());
+    entries.swap(result);
+}
+
+void Snapshot::assign(const std::map<std::string, std::string> &snapshot)
+{
+    entries.clear();
+    entries.reserve(snapshot.size());
+    for (const auto &pair : snapshot)
+    {
+        ObjectId blob;
+        ObjectId::fromHex(pair.second, blob); // "" stays all zero: conflicted
+        push_back(pair.first, blob);
+    }
+}
+
+std::map<std::string, std::string> Snapshot::to_map() const
+{
+    std::map<std::string, std::string> result;
+    for (const SnapshotEntry &entry : entries)
+        result.emplace_hint(result.end(), std::string(path(entry)), entry.conflicted() ? "" : entry.blob.hex());
+    return result;
+}
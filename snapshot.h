@@ -0,0 +1,96 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "utils.h" // For ObjectId
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <memory>
+#include <cstdint>
+
+// The paths of one operation, each stored once and named by a dense id. The characters
+// live in large chunks freed together with the pool, so interning a path costs no
+// allocation of its own, and snapshots built from one pool share their paths.
+class PathPool {
+public:
+    PathPool() = default;
+    PathPool(const PathPool&) = delete;
+    PathPool& operator=(const PathPool&) = delete;
+
+    uint32_t intern(std::string_view path);
+    std::string_view path(uint32_t id) const { return paths[id]; }
+    size_t size() const { return paths.size(); }
+    size_t bytes() const; // Heap memory held by the pool
+
+private:
+    static constexpr size_t CHUNK_SIZE = 256 * 1024;
+
+    struct Slot {
+        uint64_t hash;
+        uint32_t id;
+    };
+    std::vector<std::unique_ptr<char[]>> chunks;
+    size_t chunk_used = 0; // In the last chunk
+    size_t chunk_bytes = 0;
+    std::vector<std::string_view> paths; // By id; point into the chunks
+    std::vector<Slot> slots;             // Open addressing, power-of-two size
+    void grow();
+};
+
+// One file of a snapshot: 24 bytes instead of two heap strings
+struct SnapshotEntry {
+    uint32_t path; // PathPool id
+    ObjectId blob; // All zero for a path left conflicted by a merge
+
+    bool conflicted() const { return blob == ObjectId(); }
+};
+
+// The files of a commit or of the index: entries sorted by path, which is also the order
+// of a tree walk, of write_tree and of the index. A snapshot is moved, never copied.
+class Snapshot {
+public:
+    // A change for apply(): sets the path's blob, or removes the path
+    struct Change {
+        std::string_view path;
+        bool removed;
+        ObjectId blob;
+    };
+
+    explicit Snapshot(PathPool& path_pool) : pool(&path_pool) {}
+    Snapshot(Snapshot&&) = default;
+    Snapshot& operator=(Snapshot&&) = default;
+    Snapshot(const Snapshot&) = delete;
+    Snapshot& operator=(const Snapshot&) = delete;
+
+    // Appends an entry. Loaders append in path order; sort() repairs anything else.
+    void push_back(std::string_view path, const ObjectId& blob);
+    void sort();
+    void reserve(size_t count) { entries.reserve(count); }
+    void clear() { entries.clear(); }
+
+    size_t size() const { return entries.size(); }
+    bool empty() const { return entries.empty(); }
+    const SnapshotEntry& operator[](size_t i) const { return entries[i]; }
+    std::vector<SnapshotEntry>::const_iterator begin() const { return entries.begin(); }
+    std::vector<SnapshotEntry>::const_iterator end() const { return entries.end(); }
+
+    std::string_view path(const SnapshotEntry& entry) const { return pool->path(entry.path); }
+    PathPool& paths() const { return *pool; }
+    const SnapshotEntry* find(std::string_view path) const; // Binary search; nullptr if absent
+
+    // Applies changes sorted by path in one pass over the entries
+    void apply(const std::vector<Change>& changes);
+
+    // The "path -> hex blob" form of commits that store a flat snapshot ("" is conflicted)
+    void assign(const std::map<std::string, std::string>& snapshot);
+    std::map<std::string, std::string> to_map() const;
+
+    size_t bytes() const { return entries.capacity() * sizeof(SnapshotEntry); }
+
+private:
+    PathPool* pool;
+    std::vector<SnapshotEntry> entries;
+};
+
+#endif // SNAPSHOT_H
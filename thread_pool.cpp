@@ -0,0 +1,146 @@
+#include "thread_pool.h"
+#include <atomic>
+
+ThreadPool::ThreadPool(size_t threads) : active(0), stopping(false)
+{
+    if (threads == 0)
+    {
+        threads = 1;
+    }
+    for (size_t i = 0; i < threads; ++i)
+    {
+        workers.emplace_back([this]
+                             { worker_loop(); });
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    task_ready.notify_all();
+    for (std::thread &worker : workers)
+    {
+        worker.join();
+    }
+}
+
+void ThreadPool::submit(std::function<void()> task)
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        tasks.push(std::move(task));
+    }
+    task_ready.notify_one();
+}
+
+void ThreadPool::wait()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    all_done.wait(lock, [this]
+                  { return tasks.empty() && active == 0; });
+    if (error)
+    {
+        std::exception_ptr thrown = error;
+        error = nullptr;
+        std::rethrow_exception(thrown);
+    }
+}
+
+void ThreadPool::worker_loop()
+{
+    while (true)
+    {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            task_ready.wait(lock, [this]
+                            { return stopping || !tasks.empty(); });
+            if (tasks.empty())
+            {
+                return; // Stopping and nothing left to do
+            }
+            task = std::move(tasks.front());
+            tasks.pop();
+            ++active;
+        }
+        std::exception_ptr thrown;
+        try
+        {
+            task();
+        }
+        catch (...)
+        {
+            thrown = std::current_exception();
+        }
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            if (thrown && !error)
+            {
+                error = thrown;
+            }
+            --active;
+            if (tasks.empty() && active == 0)
+            {
+                all_done.notify_all();
+            }
+        }
+    }
+}
+
+void ThreadPool::parallel_for(size_t count, size_t threads, const std::function<void(size_t)> &fn)
+{
+    if (threads > count)
+    {
+        threads = count;
+    }
+    if (threads <= 1)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            fn(i);
+        }
+        return;
+    }
+
+    // Workers claim indices one at a time, which balances uneven work (e.g. mixed file sizes)
+    std::atomic<size_t> next(0);
+    std::exception_ptr error;
+    std::mutex error_mutex;
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < threads; ++t)
+    {
+        workers.emplace_back([&]
+                             {
+            try
+            {
+                for (size_t i = next++; i < count; i = next++)
+                {
+                    fn(i);
+                }
+            }
+            catch (...)
+            {
+                next = count; // The other workers stop after their current index
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if (!error)
+                    error = std::current_exception();
+            } });
+    }
+    for (std::thread &worker : workers)
+    {
+        worker.join();
+    }
+    if (error)
+    {
+        std::rethrow_exception(error);
+    }
+}
+
+size_t ThreadPool::default_threads()
+{
+    unsigned int n = std::thread::hardware_concurrency();
+    return n == 0 ? 1 : n;
+}
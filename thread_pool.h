@@ -0,0 +1,50 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// Fixed-size pool of worker threads. Tasks must only touch shared state that is safe for
+// concurrent use. If a task throws, wait() rethrows the first exception once every task is done.
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t threads);
+    ~ThreadPool(); // Waits for queued tasks, then joins the workers
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void submit(std::function<void()> task);
+
+    // Blocks until every submitted task has finished; rethrows the first exception a task threw
+    void wait();
+
+    size_t size() const { return workers.size(); }
+
+    // Runs fn(i) for every i in [0, count) on up to `threads` threads (inline when threads <= 1).
+    // If fn throws, no further indices are started and the first exception is rethrown.
+    static void parallel_for(size_t count, size_t threads, const std::function<void(size_t)>& fn);
+
+    // Number of hardware threads, at least 1
+    static size_t default_threads();
+
+private:
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable task_ready;
+    std::condition_variable all_done;
+    size_t active;
+    bool stopping;
+    std::exception_ptr error; // First exception thrown by a task, until wait() rethrows it
+
+    void worker_loop();
+};
+
+#endif // THREAD_POOL_H
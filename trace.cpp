@@ -0,0 +1,206 @@
+#include "trace.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+namespace Trace {
+
+bool enabled = false;
+
+namespace {
+
+const char *const COUNTER_NAMES[COUNTER_COUNT] = {
+    "objects_read", "packed_objects_read", "object_bytes_read", "objects_written", "bytes_hashed",
+    "files_read", "file_bytes_read", "files_written", "file_bytes_written",
+    "commit_cache_hits", "commit_cache_misses", "snapshot_cache_hits", "snapshot_cache_misses"};
+
+// Chrome trace events kept per thread; past this the spans still count in the summary
+const size_t MAX_EVENTS_PER_THREAD = 1 << 20;
+
+struct Event
+{
+    const char *name;
+    uint64_t start_ns;
+    uint64_t duration_ns;
+};
+
+struct SpanStats
+{
+    uint64_t calls = 0;
+    uint64_t total_ns = 0;
+    uint64_t max_ns = 0;
+};
+
+// One per thread that recorded a span; owned by the registry so it outlives the thread
+struct ThreadLog
+{
+    uint32_t tid;
+    std::vector<Event> events;
+    std::unordered_map<const char *, SpanStats> stats;
+    uint64_t dropped = 0;
+};
+
+std::atomic<uint64_t> counters[COUNTER_COUNT];
+std::mutex registry_mutex;
+std::vector<std::unique_ptr<ThreadLog>> registry;
+thread_local ThreadLog *thread_log = nullptr;
+const std::chrono::steady_clock::time_point process_start = std::chrono::steady_clock::now();
+
+uint64_t elapsed_ns()
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                     std::chrono::steady_clock::now() - process_start)
+                                     .count());
+}
+
+ThreadLog &current_log()
+{
+    if (!thread_log)
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        registry.push_back(std::make_unique<ThreadLog>());
+        thread_log = registry.back().get();
+        thread_log->tid = static_cast<uint32_t>(registry.size());
+    }
+    return *thread_log;
+}
+
+void write_chrome_trace(const std::string &path, uint64_t end_ns)
+{
+    FILE *out = std::fopen(path.c_str(), "w");
+    if (!out)
+    {
+        std::fprintf(stderr, "Warning: Could not write trace file %s\n", path.c_str());
+        return;
+    }
+    int pid = static_cast<int>(getpid());
+    std::fprintf(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    std::fprintf(out, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"minigit\"}}", pid);
+    for (const auto &log : registry)
+    {
+        for (const Event &event : log->events)
+        {
+            std::fprintf(out, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                         event.name, pid, log->tid, event.start_ns / 1e3, event.duration_ns / 1e3);
+        }
+    }
+    std::fprintf(out, ",\n{\"name\":\"counters\",\"ph\":\"C\",\"pid\":%d,\"ts\":%.3f,\"args\":{", pid, end_ns / 1e3);
+    for (int i = 0; i < COUNTER_COUNT; ++i)
+    {
+        std::fprintf(out, "%s\"%s\":%llu", i ? "," : "", COUNTER_NAMES[i],
+                     static_cast<unsigned long long>(counters[i].load(std::memory_order_relaxed)));
+    }
+    std::fprintf(out, "}}\n]}\n");
+    std::fclose(out);
+}
+
+// Reads MINIGIT_TRACE at start-up and reports when the process exits (also through exit())
+class Reporter
+{
+public:
+    Reporter()
+    {
+        const char *env = std::getenv("MINIGIT_TRACE");
+        if (env && *env && std::strcmp(env, "0") != 0)
+        {
+            enabled = true;
+            if (std::strcmp(env, "1") != 0)
+                trace_file = env;
+        }
+    }
+
+    ~Reporter()
+    {
+        if (!enabled)
+            return;
+        enabled = false; // Spans ending from here on are not recorded
+        uint64_t end_ns = elapsed_ns();
+        std::lock_guard<std::mutex> lock(registry_mutex);
+
+        // Spans by name; the same literal may have different addresses in different files
+        std::map<std::string, SpanStats> totals;
+        uint64_t dropped = 0;
+        for (const auto &log : registry)
+        {
+            for (const auto &entry : log->stats)
+            {
+                SpanStats &total = totals[entry.first];
+                total.calls += entry.second.calls;
+                total.total_ns += entry.second.total_ns;
+                total.max_ns = std::max(total.max_ns, entry.second.max_ns);
+            }
+            dropped += log->dropped;
+        }
+        std::vector<std::pair<std::string, SpanStats>> sorted(totals.begin(), totals.end());
+        std::sort(sorted.begin(), sorted.end(), [](const auto &a, const auto &b)
+                  { return a.second.total_ns > b.second.total_ns; });
+
+        std::fprintf(stderr, "trace: %.3f ms wall, %zu thread(s)\n", end_ns / 1e6, registry.size());
+        std::fprintf(stderr, "  %-28s %10s %12s %12s %12s\n", "span", "calls", "total_ms", "mean_us", "max_us");
+        for (const auto &entry : sorted)
+        {
+            const SpanStats &s = entry.second;
+            std::fprintf(stderr, "  %-28s %10llu %12.3f %12.3f %12.3f\n", entry.first.c_str(),
+                         static_cast<unsigned long long>(s.calls), s.total_ns / 1e6,
+                         s.total_ns / 1e3 / s.calls, s.max_ns / 1e3);
+        }
+        for (int i = 0; i < COUNTER_COUNT; ++i)
+        {
+            uint64_t value = counters[i].load(std::memory_order_relaxed);
+            if (value)
+                std::fprintf(stderr, "  %-28s %10llu\n", COUNTER_NAMES[i], static_cast<unsigned long long>(value));
+        }
+        if (!trace_file.empty())
+        {
+            write_chrome_trace(trace_file, end_ns);
+            std::fprintf(stderr, "trace: wrote %s%s\n", trace_file.c_str(),
+                         dropped ? " (some spans were left out to bound its size)" : "");
+        }
+    }
+
+private:
+    std::string trace_file;
+};
+
+// Destroyed before the registry it reads, which is defined earlier in this file
+Reporter reporter;
+
+} // namespace
+
+void add_counter(Counter counter, uint64_t amount)
+{
+    counters[counter].fetch_add(amount, std::memory_order_relaxed);
+}
+
+uint64_t Span::now_ns()
+{
+    return elapsed_ns();
+}
+
+void Span::finish()
+{
+    if (!enabled)
+        return; // Tracing was switched off by the exit report
+    uint64_t duration = now_ns() - start;
+    ThreadLog &log = current_log();
+    SpanStats &stats = log.stats[name];
+    ++stats.calls;
+    stats.total_ns += duration;
+    stats.max_ns = std::max(stats.max_ns, duration);
+    if (log.events.size() < MAX_EVENTS_PER_THREAD)
+        log.events.push_back({name, start, duration});
+    else
+        ++log.dropped;
+}
+
+} // namespace Trace
@@ -0,0 +1,63 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <cstdint>
+
+// Tracing of where a command spends its time, switched on by the MINIGIT_TRACE variable:
+//   MINIGIT_TRACE=1           a summary of spans and counters on stderr when the process exits
+//   MINIGIT_TRACE=<file>      the summary, plus every span as a Chrome trace-event JSON file
+//                             (load it in chrome://tracing or ui.perfetto.dev)
+// When tracing is off a span or counter costs a test of one global flag.
+namespace Trace {
+
+enum Counter {
+    OBJECTS_READ,        // Loose and packed
+    PACKED_OBJECTS_READ,
+    OBJECT_BYTES_READ,   // Inflated content
+    OBJECTS_WRITTEN,
+    BYTES_HASHED,
+    FILES_READ,          // Utils::readFile
+    FILE_BYTES_READ,
+    FILES_WRITTEN,       // Utils::writeFile
+    FILE_BYTES_WRITTEN,
+    COMMIT_CACHE_HITS,
+    COMMIT_CACHE_MISSES,
+    SNAPSHOT_CACHE_HITS,
+    SNAPSHOT_CACHE_MISSES,
+    COUNTER_COUNT
+};
+
+extern bool enabled;
+
+void add_counter(Counter counter, uint64_t amount);
+
+inline void count(Counter counter, uint64_t amount = 1)
+{
+    if (enabled)
+        add_counter(counter, amount);
+}
+
+// Times the enclosing scope. The name must be a string literal (only the pointer is kept).
+// Spans nest, so the summary's totals are inclusive of the spans inside them.
+class Span {
+public:
+    explicit Span(const char* span_name) : name(enabled ? span_name : nullptr), start(name ? now_ns() : 0) {}
+    ~Span()
+    {
+        if (name)
+            finish();
+    }
+    Span(const Span&) = delete;
+    Span& operator=(const Span&) = delete;
+
+private:
+    const char* name;
+    uint64_t start;
+
+    static uint64_t now_ns();
+    void finish();
+};
+
+} // namespace Trace
+
+#endif // TRACE_H
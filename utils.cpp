@@ -1,10 +1,13 @@
 #include "utils.h"
+#include "trace.h"
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <iomanip>      // For std::hex, std::setw, std::setfill
 #include <filesystem>   // For std::filesystem operations
 #include <stdexcept>    // Good practice for potential exceptions
+#include <algorithm>    // For std::min
+#include <atomic>       // For unique temp file names
 
 // For SHA-1 hashing with OpenSSL
 #include <openssl/sha.h>
@@ -14,12 +17,29 @@
 // For ZLIB compression/decompression (needed for compress/decompress functions)
 #include <zlib.h>
 
+// POSIX file I/O (readFile, MappedFile, LockFile, DeflateStream)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>      // For std::strerror
+
 namespace fs = std::filesystem; // Alias for std::filesystem
 
 // --- Freestanding Error Handling and Repository Check Functions ---
 // These are declared in utils.h and provide project-wide error handling.
+static std::atomic<bool> fatal_errors_throw(false);
+
+void setFatalErrorsThrow(bool enabled) {
+    fatal_errors_throw = enabled;
+}
+
 void printErrorAndExit(const std::string& message) {
     std::cerr << "Error: " << message << std::endl;
+    if (fatal_errors_throw) {
+        throw FatalError(message);
+    }
     exit(1); // Exit with a non-zero status to indicate an error
 }
 
@@ -41,40 +61,47 @@ bool isMiniGitRepo() {
 
 // --- Utils Class Static Method Implementations ---
 
-// Reads the entire content of a file into a string
+// Reads the entire content of a file into a string.
+// The string is sized from fstat and filled by read() directly, so the data is copied once.
 std::string Utils::readFile(const std::string& filepath) {
-    std::ifstream file(filepath, std::ios::binary); // Use binary mode for consistent reading
-    if (!file.is_open()) {
+    Trace::Span span("Utils::readFile");
+    int fd = open(filepath.c_str(), O_RDONLY);
+    if (fd < 0) {
         // For readFile, it's often better to return empty string or throw if file doesn't exist/can't be opened
-        // printErrorAndExit("Could not open file for reading: " + filepath); // Or handle more gracefully
         return "";
     }
-    std::stringstream buffer;
-    buffer << file.rdbuf();
-    file.close(); // Explicitly close the file
-    return buffer.str();
+    struct stat st;
+    std::string content;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        content.resize(static_cast<size_t>(st.st_size));
+    }
+    size_t filled = 0;
+    while (true) {
+        if (filled == content.size()) {
+            content.resize(content.size() + 64 * 1024); // The file grew, or fstat reported no size
+        }
+        ssize_t n = read(fd, &content[filled], content.size() - filled);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        filled += static_cast<size_t>(n);
+    }
+    close(fd);
+    content.resize(filled);
+    Trace::count(Trace::FILES_READ);
+    Trace::count(Trace::FILE_BYTES_READ, filled);
+    return content;
 }
 
 // Writes a string to a file, creating parent directories if necessary
 void Utils::writeFile(const std::string& filepath, const std::string& content) {
-    fs::path p(filepath);
-    if (p.has_parent_path() && !fs::exists(p.parent_path())) {
-        try {
-            fs::create_directories(p.parent_path());
-        } catch (const fs::filesystem_error& e) {
-            printErrorAndExit("Could not create parent directories for file: " + filepath + " - " + e.what());
-        }
-    }
-    std::ofstream file(filepath, std::ios::binary); // Use binary mode for consistent writing
-    if (!file.is_open()) {
-        printErrorAndExit("Could not open file for writing: " + filepath);
-    }
-    file << content;
-    file.close(); // Explicitly close the file
+    writeFile(fs::path(filepath), content);
 }
 
-// Overload for std::filesystem::path
+// Writes a file atomically: the content goes to a temp file next to the target, which is then
+// renamed over it, so a crash leaves either the old or the new content but never a partial file.
+// With durable writes enabled the data is fsync'ed before the rename.
 void Utils::writeFile(const std::filesystem::path& filepath, const std::string& content) {
+    Trace::Span span("Utils::writeFile");
     if (filepath.has_parent_path() && !fs::exists(filepath.parent_path())) {
         try {
             fs::create_directories(filepath.parent_path());
@@ -82,12 +109,38 @@ void Utils::writeFile(const std::filesystem::path& filepath, const std::string&
             printErrorAndExit("Could not create parent directories for file: " + filepath.string() + " - " + e.what());
         }
     }
-    std::ofstream file(filepath.string(), std::ios::binary); // Use binary mode and convert path to string
-    if (!file.is_open()) {
-        printErrorAndExit("Could not open file for writing (fs::path): " + filepath.string());
+
+    static std::atomic<unsigned long> temp_counter(0);
+    fs::path temp = filepath;
+    temp += ".tmp" + std::to_string(getpid()) + "_" + std::to_string(temp_counter++);
+    int fd = open(temp.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0666); // umask applies, like a normal create
+    if (fd < 0) {
+        printErrorAndExit("Could not open file for writing: " + filepath.string());
+    }
+    struct stat existing;
+    if (stat(filepath.c_str(), &existing) == 0) {
+        fchmod(fd, existing.st_mode & 07777); // Keep the permissions of the file being replaced
     }
-    file << content;
-    file.close(); // Explicitly close the file
+    bool ok = writeAll(fd, content.data(), content.size());
+    ok = ok && (!durable_writes || fsync(fd) == 0);
+    ok = (close(fd) == 0) && ok;
+    if (!ok || rename(temp.c_str(), filepath.c_str()) != 0) {
+        int saved_errno = errno;
+        unlink(temp.c_str());
+        printErrorAndExit("Could not write file: " + filepath.string() + " - " + std::strerror(saved_errno));
+    }
+    Trace::count(Trace::FILES_WRITTEN);
+    Trace::count(Trace::FILE_BYTES_WRITTEN, content.size());
+}
+
+bool Utils::durable_writes = false;
+
+void Utils::setDurableWrites(bool enabled) {
+    durable_writes = enabled;
+}
+
+bool Utils::durableWrites() {
+    return durable_writes;
 }
 
 // Creates a directory if it doesn't exist, including parent directories
@@ -103,34 +156,387 @@ void Utils::createDirectory(const std::string& dirpath) {
 
 // Computes the SHA-1 hash of a given string
 std::string Utils::sha1(const std::string& data) {
+    Trace::Span span("Utils::sha1");
+    Trace::count(Trace::BYTES_HASHED, data.size());
     unsigned char hash[SHA_DIGEST_LENGTH]; // 20 bytes for SHA-1
-    SHA1(reinterpret_cast<const unsigned char*>(data.c_str()), data.length(), hash);
+    SHA1(reinterpret_cast<const unsigned char*>(data.data()), data.length(), hash);
+    return toHex(hash, SHA_DIGEST_LENGTH);
+}
 
-    std::stringstream ss;
-    for (int i = 0; i < SHA_DIGEST_LENGTH; ++i) {
-        ss << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(hash[i]);
+std::string Utils::objectHeader(const std::string& type, uint64_t size) {
+    std::string header = type + " " + std::to_string(size);
+    header.push_back('\0');
+    return header;
+}
+
+std::string Utils::hashObject(const std::string& type, const std::string& content) {
+    Trace::Span span("Utils::hashObject");
+    // Hashed in two updates, so the content is never copied behind the header
+    Sha1Hasher hasher;
+    std::string header = objectHeader(type, content.size());
+    hasher.update(header.data(), header.size());
+    hasher.update(content.data(), content.size());
+    return hasher.hexdigest();
+}
+
+// Compresses a string into a zlib stream. Input is fed to deflate in fixed-size
+// chunks so the working buffer stays small regardless of the input size.
+std::string Utils::compress(const std::string& input, int level) {
+    Trace::Span span("Utils::compress");
+    z_stream zs{};
+    if (deflateInit(&zs, level) != Z_OK) {
+        printErrorAndExit("zlib deflateInit failed (compression level " + std::to_string(level) + ")");
     }
-    return ss.str();
+
+    const size_t CHUNK = 64 * 1024;
+    std::string output;
+    output.reserve(compressBound(static_cast<uLong>(input.size())));
+    char out_buf[CHUNK];
+    size_t offset = 0;
+    int flush = Z_NO_FLUSH;
+    do {
+        size_t in_len = std::min(CHUNK, input.size() - offset);
+        zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(input.data() + offset));
+        zs.avail_in = static_cast<uInt>(in_len);
+        offset += in_len;
+        flush = (offset == input.size()) ? Z_FINISH : Z_NO_FLUSH;
+        do {
+            zs.next_out = reinterpret_cast<Bytef*>(out_buf);
+            zs.avail_out = CHUNK;
+            deflate(&zs, flush);
+            output.append(out_buf, CHUNK - zs.avail_out);
+        } while (zs.avail_out == 0);
+    } while (flush != Z_FINISH);
+
+    deflateEnd(&zs);
+    return output;
 }
 
-// Compresses a string using zlib (placeholder implementation)
-std::string Utils::compress(const std::string& input) {
-    // This is a placeholder. A full implementation would use zlib functions like compress2 or deflate.
-    // Example:
-    // uLongf compressed_size = compressBound(input.length());
-    // std::vector<Bytef> compressed_data(compressed_size);
-    // int result = compress2(compressed_data.data(), &compressed_size,
-    //                        reinterpret_cast<const Bytef*>(input.data()), input.length(), Z_BEST_COMPRESSION);
-    // if (result != Z_OK) { /* handle error */ }
-    // return std::string(reinterpret_cast<char*>(compressed_data.data()), compressed_size);
+// Decompresses a zlib stream. Returns false if the input is not a complete, valid stream.
+bool Utils::decompress(const std::string& compressed_input, std::string& output) {
+    return decompress(compressed_input.data(), compressed_input.size(), output);
+}
 
-    std::cerr << "Warning: Utils::compress function is a placeholder and not fully implemented." << std::endl;
-    return input; // For now, return original string
+// Decompresses the zlib stream starting at data, stopping at the end of the stream
+bool Utils::decompress(const char* data, size_t length, std::string& output) {
+    Trace::Span span("Utils::decompress");
+    z_stream zs{};
+    if (inflateInit(&zs) != Z_OK) {
+        return false;
+    }
+
+    const size_t CHUNK = 64 * 1024;
+    char out_buf[CHUNK];
+    output.clear();
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+    zs.avail_in = static_cast<uInt>(length);
+    int ret = Z_OK;
+    while (ret == Z_OK) {
+        zs.next_out = reinterpret_cast<Bytef*>(out_buf);
+        zs.avail_out = CHUNK;
+        ret = inflate(&zs, Z_NO_FLUSH);
+        if (ret != Z_OK && ret != Z_STREAM_END) {
+            break;
+        }
+        output.append(out_buf, CHUNK - zs.avail_out);
+    }
+    inflateEnd(&zs);
+    return ret == Z_STREAM_END;
+}
+
+// Inflates only as much of the stream as fits in max_output bytes; the rest is never touched
+bool Utils::decompressPrefix(const char* data, size_t length, size_t max_output, std::string& output) {
+    z_stream zs{};
+    if (inflateInit(&zs) != Z_OK) {
+        return false;
+    }
+    output.resize(max_output);
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+    zs.avail_in = static_cast<uInt>(length);
+    zs.next_out = reinterpret_cast<Bytef*>(&output[0]);
+    zs.avail_out = static_cast<uInt>(max_output);
+    int ret = inflate(&zs, Z_SYNC_FLUSH);
+    output.resize(max_output - zs.avail_out);
+    inflateEnd(&zs);
+    return (ret == Z_OK || ret == Z_STREAM_END || ret == Z_BUF_ERROR) && !output.empty();
 }
 
-// Decompresses a string using zlib (placeholder implementation)
+// Decompresses a zlib stream, returning an empty string if the input is corrupt
 std::string Utils::decompress(const std::string& compressed_input) {
-    // This is a placeholder. A full implementation would use zlib functions like uncompress or inflate.
-    std::cerr << "Warning: Utils::decompress function is a placeholder and not fully implemented." << std::endl;
-    return compressed_input; // For now, return original string
-}
\ No newline at end of file
+    std::string output;
+    if (!decompress(compressed_input, output)) {
+        return "";
+    }
+    return output;
+}
+
+// Lowercase hex encoding of raw bytes, two output characters per table lookup
+void Utils::toHex(const unsigned char* bytes, size_t length, char* out) {
+    static const struct HexTable {
+        char pairs[512];
+        HexTable() {
+            const char digits[] = "0123456789abcdef";
+            for (int b = 0; b < 256; ++b) {
+                pairs[2 * b] = digits[b >> 4];
+                pairs[2 * b + 1] = digits[b & 0x0f];
+            }
+        }
+    } table;
+    for (size_t i = 0; i < length; ++i) {
+        std::memcpy(out + 2 * i, &table.pairs[2 * bytes[i]], 2);
+    }
+}
+
+std::string Utils::toHex(const unsigned char* bytes, size_t length) {
+    std::string hex(length * 2, '0');
+    toHex(bytes, length, &hex[0]);
+    return hex;
+}
+
+// Decodes hex into bytes; the string must be exactly 2*length characters
+bool Utils::fromHex(std::string_view hex, unsigned char* bytes, size_t length) {
+    if (hex.size() != length * 2) {
+        return false;
+    }
+    auto nibble = [](char c) -> int {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    };
+    for (size_t i = 0; i < length; ++i) {
+        int high = nibble(hex[2 * i]);
+        int low = nibble(hex[2 * i + 1]);
+        if (high < 0 || low < 0) {
+            return false;
+        }
+        bytes[i] = static_cast<unsigned char>((high << 4) | low);
+    }
+    return true;
+}
+
+// --- ObjectId ---
+
+std::string ObjectId::hex() const {
+    return Utils::toHex(bytes, RAW_SIZE);
+}
+
+void ObjectId::hex(char* out) const {
+    Utils::toHex(bytes, RAW_SIZE, out);
+}
+
+bool ObjectId::fromHex(std::string_view hex, ObjectId& out) {
+    return Utils::fromHex(hex, out.bytes, RAW_SIZE);
+}
+
+bool ObjectId::prefixRange(std::string_view prefix, const unsigned char* fanout, const unsigned char* ids,
+                           uint32_t& first, uint32_t& last) {
+    // The prefix padded with 0s and with fs bounds every id that starts with it
+    ObjectId low, high;
+    if (prefix.empty() || prefix.size() > 2 * RAW_SIZE ||
+        !fromHex(std::string(prefix) + std::string(2 * RAW_SIZE - prefix.size(), '0'), low) ||
+        !fromHex(std::string(prefix) + std::string(2 * RAW_SIZE - prefix.size(), 'f'), high)) {
+        return false;
+    }
+    auto count = [fanout](int b) -> uint32_t {
+        if (b < 0) return 0;
+        const unsigned char* p = fanout + 4 * b;
+        return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+               (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+    };
+    auto bisect = [ids](uint32_t lo, uint32_t hi, const ObjectId& key, bool after_equal) {
+        while (lo < hi) {
+            uint32_t mid = lo + (hi - lo) / 2;
+            int cmp = std::memcmp(ids + static_cast<size_t>(mid) * RAW_SIZE, key.bytes, RAW_SIZE);
+            if (cmp < 0 || (after_equal && cmp == 0))
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        return lo;
+    };
+    uint32_t lo = count(low.bytes[0] - 1);
+    uint32_t hi = count(high.bytes[0]);
+    first = bisect(lo, hi, low, false);
+    last = bisect(first, hi, high, true);
+    return true;
+}
+
+// --- Sha1Hasher ---
+
+Sha1Hasher::Sha1Hasher() : ctx(EVP_MD_CTX_new()) {
+    if (ctx == nullptr || EVP_DigestInit_ex(ctx, EVP_sha1(), nullptr) != 1) {
+        printErrorAndExit("Could not initialise SHA-1 context");
+    }
+}
+
+Sha1Hasher::~Sha1Hasher() {
+    EVP_MD_CTX_free(ctx);
+}
+
+void Sha1Hasher::update(const void* data, size_t length) {
+    Trace::count(Trace::BYTES_HASHED, length);
+    EVP_DigestUpdate(ctx, data, length);
+}
+
+void Sha1Hasher::finish(unsigned char* out) {
+    unsigned int length = 0;
+    EVP_DigestFinal_ex(ctx, out, &length);
+}
+
+std::string Sha1Hasher::hexdigest() {
+    unsigned char digest[SHA_DIGEST_LENGTH];
+    finish(digest);
+    return Utils::toHex(digest, SHA_DIGEST_LENGTH);
+}
+
+// --- DeflateStream ---
+
+bool writeAll(int fd, const void* data, size_t length) {
+    const char* p = static_cast<const char*>(data);
+    while (length > 0) {
+        ssize_t n = ::write(fd, p, length);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        p += n;
+        length -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+DeflateStream::DeflateStream(int level, int fd) : zs{}, out_fd(fd), ok(true) {
+    if (deflateInit(&zs, level) != Z_OK) {
+        printErrorAndExit("zlib deflateInit failed (compression level " + std::to_string(level) + ")");
+    }
+}
+
+DeflateStream::~DeflateStream() {
+    deflateEnd(&zs);
+}
+
+bool DeflateStream::pump(int flush) {
+    char out_buf[64 * 1024];
+    do {
+        zs.next_out = reinterpret_cast<Bytef*>(out_buf);
+        zs.avail_out = sizeof(out_buf);
+        int ret = deflate(&zs, flush);
+        if (ret == Z_STREAM_ERROR) {
+            return ok = false;
+        }
+        size_t produced = sizeof(out_buf) - zs.avail_out;
+        if (produced > 0 && !writeAll(out_fd, out_buf, produced)) {
+            return ok = false;
+        }
+    } while (zs.avail_out == 0);
+    return ok;
+}
+
+bool DeflateStream::write(const void* data, size_t length) {
+    const char* p = static_cast<const char*>(data);
+    // zlib counts input in uInt, so very large buffers are fed in slices
+    while (ok && length > 0) {
+        size_t slice = std::min<size_t>(length, 1u << 30);
+        zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(p));
+        zs.avail_in = static_cast<uInt>(slice);
+        pump(Z_NO_FLUSH);
+        p += slice;
+        length -= slice;
+    }
+    return ok;
+}
+
+bool DeflateStream::finish() {
+    zs.next_in = nullptr;
+    zs.avail_in = 0;
+    return pump(Z_FINISH);
+}
+
+// --- MappedFile ---
+
+MappedFile::MappedFile(const std::string& filepath) : data_(nullptr), size_(0) {
+    int fd = open(filepath.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0) {
+        size_ = static_cast<size_t>(st.st_size);
+        if (size_ == 0) {
+            valid_ = true;
+        } else {
+            void* mapped = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped != MAP_FAILED) {
+                data_ = static_cast<const char*>(mapped);
+                valid_ = true;
+            }
+        }
+    }
+    close(fd); // The mapping stays valid after the descriptor is closed
+}
+
+MappedFile::~MappedFile() {
+    if (data_ != nullptr) {
+        munmap(const_cast<char*>(data_), size_);
+    }
+}
+
+// --- LockFile ---
+
+LockFile::~LockFile() {
+    rollback();
+}
+
+bool LockFile::acquire(const fs::path& target, bool quiet) {
+    rollback();
+    target_path = target;
+    lock_path = target;
+    lock_path += ".lock";
+    fd = open(lock_path.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+    if (fd < 0) {
+        if (quiet) {
+            return false;
+        }
+        if (errno == EEXIST) {
+            std::cerr << "Error: Unable to create '" << lock_path.string() << "': File exists.\n"
+                      << "Another minigit process seems to be running in this repository. "
+                      << "If it crashed, remove the lock file and try again." << std::endl;
+        } else {
+            std::cerr << "Error: Unable to create '" << lock_path.string() << "': " << std::strerror(errno) << std::endl;
+        }
+        return false;
+    }
+    held = true;
+    return true;
+}
+
+bool LockFile::write(const void* data, size_t length) {
+    return writeAll(fd, data, length);
+}
+
+bool LockFile::commit() {
+    if (!held) {
+        return false;
+    }
+    bool ok = close(fd) == 0;
+    fd = -1;
+    ok = ok && rename(lock_path.c_str(), target_path.c_str()) == 0;
+    if (!ok) {
+        std::cerr << "Error: Could not update " << target_path.string() << ": " << std::strerror(errno) << std::endl;
+        unlink(lock_path.c_str());
+    }
+    held = false;
+    return ok;
+}
+
+void LockFile::rollback() {
+    if (fd >= 0) {
+        close(fd);
+        fd = -1;
+    }
+    if (held) {
+        unlink(lock_path.c_str());
+        held = false;
+    }
+}
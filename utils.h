@@ -2,38 +2,203 @@
 #define UTILS_H
 
 #include <string>         // For std::string
+#include <string_view>    // For hex parsing without a copy
 #include <vector>         // For std::vector (used in some utility functions)
 #include <iostream>       // For std::cerr (used by printErrorAndExit)
 #include <cstdlib>        // For exit()
 #include <filesystem>     // For filesystem operations
+#include <cstddef>        // For size_t
+#include <cstdint>        // For uint32_t
+#include <cstring>        // For memcmp in ObjectId
+#include <stdexcept>      // For FatalError
+#include <openssl/evp.h>  // For EVP_MD_CTX (incremental SHA-1)
+#include <zlib.h>         // For z_stream in DeflateStream
 
 // --- Error handling utilities ---
+// Prints "Error: <message>" and exits with status 1, or throws FatalError once
+// setFatalErrorsThrow(true) was called (`minigit serve`, which must outlive a failed command)
 void printErrorAndExit(const std::string& message);
 bool isMiniGitRepo();
 
+struct FatalError : std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+void setFatalErrorsThrow(bool enabled);
+
+// --- A SHA-1 object name kept as 20 raw bytes (hex only when printed or used as a file name) ---
+struct ObjectId {
+    static const size_t RAW_SIZE = 20;
+    unsigned char bytes[RAW_SIZE] = {0};
+
+    std::string hex() const;
+    void hex(char* out) const; // Writes the 40 characters (no terminator) without allocating
+    // Parses exactly 40 hex characters; returns false on anything else
+    static bool fromHex(std::string_view hex, ObjectId& out);
+    // The ids starting with a hex prefix (1 to 40 digits) in a sorted table of ids indexed
+    // by a fanout, as in pack indexes and the commit-graph: fanout[b] is the little-endian
+    // u32 count of ids whose first byte is <= b. Sets [first, last); false if not hex.
+    static bool prefixRange(std::string_view prefix, const unsigned char* fanout, const unsigned char* ids,
+                            uint32_t& first, uint32_t& last);
+
+    bool operator==(const ObjectId& other) const { return std::memcmp(bytes, other.bytes, RAW_SIZE) == 0; }
+    bool operator!=(const ObjectId& other) const { return !(*this == other); }
+    bool operator<(const ObjectId& other) const { return std::memcmp(bytes, other.bytes, RAW_SIZE) < 0; }
+};
+
+// Hash of an ObjectId for unordered containers: its first bytes, which are already uniform
+struct ObjectIdHash {
+    size_t operator()(const ObjectId& id) const {
+        size_t h;
+        std::memcpy(&h, id.bytes, sizeof(h));
+        return h;
+    }
+};
+
 // --- Utility class with static methods ---
 class Utils {
 public:
     // Computes the SHA-1 hash of a given string
     static std::string sha1(const std::string& input);
 
-    // Compresses a string using zlib
-    static std::string compress(const std::string& input);
+    // The "<type> <size>\0" header every stored object starts with
+    static std::string objectHeader(const std::string& type, uint64_t size);
+
+    // Object name: the SHA-1 of the header followed by the content, as git computes it
+    static std::string hashObject(const std::string& type, const std::string& content);
+
+    // Compresses a string using zlib (level -1 is zlib's default, 0-9 otherwise)
+    static std::string compress(const std::string& input, int level = -1);
 
-    // Decompresses a string using zlib
+    // Decompresses a zlib stream into output; returns false if the stream is corrupt
+    static bool decompress(const std::string& compressed_input, std::string& output);
+
+    // Decompresses a string using zlib (empty string on error)
     static std::string decompress(const std::string& compressed_input);
 
+    // Decompresses a zlib stream that starts at data; trailing bytes after the stream are ignored
+    static bool decompress(const char* data, size_t length, std::string& output);
+
+    // Inflates at most max_output bytes from the start of a zlib stream (e.g. an object's
+    // header); false if nothing could be inflated
+    static bool decompressPrefix(const char* data, size_t length, size_t max_output, std::string& output);
+
+    // Lowercase hex encoding of raw bytes
+    static std::string toHex(const unsigned char* bytes, size_t length);
+    // Same, into 2*length characters at out
+    static void toHex(const unsigned char* bytes, size_t length, char* out);
+
+    // Decodes 2*length hex characters into bytes; returns false on a malformed string
+    static bool fromHex(std::string_view hex, unsigned char* bytes, size_t length);
+
     // Reads the entire content of a file into a string
     static std::string readFile(const std::string& filepath);
 
-    // Writes a string to a file (overwrites existing content)
+    // Writes a string to a file atomically (temp file + rename; overwrites existing content)
     static void writeFile(const std::string& filepath, const std::string& content);
 
     // Overload: Writes content to a file using std::filesystem::path
     static void writeFile(const std::filesystem::path& filepath, const std::string& content);
 
+    // When enabled (core.fsync), file and object writes are fsync'ed before they are renamed into place
+    static void setDurableWrites(bool enabled);
+    static bool durableWrites();
+
     // Creates a directory if it doesn't exist
     static void createDirectory(const std::string& path);
+
+private:
+    static bool durable_writes;
+};
+
+// --- Incremental SHA-1 for data that arrives in pieces (e.g. while writing a packfile) ---
+class Sha1Hasher {
+public:
+    Sha1Hasher();
+    ~Sha1Hasher();
+    Sha1Hasher(const Sha1Hasher&) = delete;
+    Sha1Hasher& operator=(const Sha1Hasher&) = delete;
+
+    void update(const void* data, size_t length);
+    // Finishes the digest and writes the 20 raw bytes into out
+    void finish(unsigned char* out);
+    void finish(ObjectId& out) { finish(out.bytes); }
+    // Finishes the digest and returns it as 40 hex characters
+    std::string hexdigest();
+
+private:
+    EVP_MD_CTX* ctx;
+};
+
+// --- Streaming zlib compression straight into a file descriptor ---
+// Input of any size is compressed through a fixed 64 KiB output buffer.
+class DeflateStream {
+public:
+    DeflateStream(int level, int fd);
+    ~DeflateStream();
+    DeflateStream(const DeflateStream&) = delete;
+    DeflateStream& operator=(const DeflateStream&) = delete;
+
+    bool write(const void* data, size_t length);
+    // Flushes the end of the stream; no writes are allowed afterwards
+    bool finish();
+
+private:
+    z_stream zs;
+    int out_fd;
+    bool ok;
+
+    bool pump(int flush);
+};
+
+// Writes all of data to fd, retrying on short writes; returns false on error
+bool writeAll(int fd, const void* data, size_t length);
+
+// --- Read-only memory mapping of a whole file (unmapped on destruction) ---
+class MappedFile {
+public:
+    MappedFile() : data_(nullptr), size_(0) {}
+    explicit MappedFile(const std::string& filepath);
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // True if the file was opened and mapped (an empty file maps to size 0)
+    bool valid() const { return valid_; }
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    const char* data_;
+    size_t size_;
+    bool valid_ = false;
+};
+
+// --- Exclusive "<path>.lock" file used to update a file atomically ---
+// acquire() creates the lock with O_EXCL, so a second writer fails instead of racing.
+// The new content is written to the lock file and commit() renames it over the target;
+// a lock that is never committed is removed on destruction.
+class LockFile {
+public:
+    LockFile() : fd(-1), held(false) {}
+    ~LockFile();
+    LockFile(const LockFile&) = delete;
+    LockFile& operator=(const LockFile&) = delete;
+
+    // Returns false (with a message on stderr unless quiet) if another process holds the lock
+    bool acquire(const std::filesystem::path& target, bool quiet = false);
+    bool write(const void* data, size_t length);
+    // Descriptor of the lock file, for fstat/fsync by callers
+    int descriptor() const { return fd; }
+    // Replaces the target with what was written; returns false on failure
+    bool commit();
+    void rollback();
+    bool locked() const { return held; }
+
+private:
+    std::filesystem::path target_path;
+    std::filesystem::path lock_path;
+    int fd;
+    bool held;
 };
 
 #endif // UTILS_H
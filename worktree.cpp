@@ -0,0 +1,210 @@
+#include "worktree.h"
+#include "thread_pool.h"
+#include "trace.h"
+#include "utils.h"
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <sstream>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Record header returned by getdents64 (glibc only wraps it from 2.30 on); the
+// NUL-terminated name follows at NAME_OFFSET
+struct LinuxDirent64
+{
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+};
+const size_t NAME_OFFSET = 19;
+
+const size_t DIRENT_BUFFER = 64 * 1024;
+
+} // namespace
+
+IgnoreRules::IgnoreRules(const fs::path &repo_root)
+{
+    std::istringstream in(Utils::readFile((repo_root / ".minigitignore").string()));
+    std::string line;
+    while (std::getline(in, line))
+    {
+        while (!line.empty() && (line.back() == '\r' || line.back() == ' ' || line.back() == '\t'))
+            line.pop_back();
+        if (line.empty() || line[0] == '#')
+            continue;
+        Pattern pattern{line, false, false, false};
+        if (pattern.glob[0] == '!')
+        {
+            pattern.negate = true;
+            pattern.glob.erase(0, 1);
+        }
+        if (!pattern.glob.empty() && pattern.glob.back() == '/')
+        {
+            pattern.dir_only = true;
+            pattern.glob.pop_back();
+        }
+        if (pattern.glob.find('/') != std::string::npos)
+        {
+            pattern.whole_path = true;
+            if (pattern.glob[0] == '/')
+                pattern.glob.erase(0, 1);
+        }
+        if (!pattern.glob.empty())
+            patterns.push_back(pattern);
+    }
+}
+
+bool IgnoreRules::ignored(const std::string &path, bool is_dir) const
+{
+    size_t slash = path.rfind('/');
+    const char *name = path.c_str() + (slash == std::string::npos ? 0 : slash + 1);
+    for (auto it = patterns.rbegin(); it != patterns.rend(); ++it)
+    {
+        if (it->dir_only && !is_dir)
+            continue;
+        bool match = it->whole_path ? fnmatch(it->glob.c_str(), path.c_str(), FNM_PATHNAME) == 0
+                                    : fnmatch(it->glob.c_str(), name, 0) == 0;
+        if (match)
+            return !it->negate;
+    }
+    return false;
+}
+
+bool IgnoreRules::excluded(const std::string &path) const
+{
+    if (patterns.empty())
+        return false;
+    for (size_t slash = path.find('/'); slash != std::string::npos; slash = path.find('/', slash + 1))
+    {
+        if (ignored(path.substr(0, slash), true))
+            return true;
+    }
+    return ignored(path, false);
+}
+
+WorktreeScanner::WorktreeScanner(const fs::path &root, const IgnoreRules &ignore, size_t threads)
+    : root(root), ignore(ignore), threads(threads == 0 ? 1 : threads)
+{
+}
+
+bool WorktreeScanner::scan(const std::string &dir, std::vector<ScannedFile> &files)
+{
+    Trace::Span span("WorktreeScanner::scan");
+    files.clear();
+    int root_fd = open(root.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (root_fd < 0)
+    {
+        return false;
+    }
+
+    std::mutex mutex;
+    std::atomic<bool> failed(false);
+    std::atomic<size_t> scanned(0);
+    std::unique_ptr<ThreadPool> pool;
+    std::vector<std::string> pending; // Used instead of the pool when single-threaded
+
+    // Reads one directory ("" is the root): files are collected, subdirectories queued
+    std::function<void(const std::string &)> scan_directory = [&](const std::string &rel)
+    {
+        int fd = rel.empty() ? dup(root_fd) : openat(root_fd, rel.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        if (fd < 0)
+        {
+            failed = true;
+            return;
+        }
+        ++scanned;
+        std::vector<ScannedFile> found;
+        std::vector<std::string> subdirs;
+        std::vector<char> buffer(DIRENT_BUFFER);
+        while (true)
+        {
+            long n = syscall(SYS_getdents64, fd, buffer.data(), buffer.size());
+            if (n <= 0)
+            {
+                if (n < 0)
+                    failed = true;
+                break;
+            }
+            for (long pos = 0; pos < n;)
+            {
+                const LinuxDirent64 *entry = reinterpret_cast<const LinuxDirent64 *>(buffer.data() + pos);
+                pos += entry->d_reclen; // Records are 8-byte aligned
+                const char *name = reinterpret_cast<const char *>(entry) + NAME_OFFSET;
+                if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+                    continue;
+                if (std::strcmp(name, ".minigit") == 0)
+                    continue;
+
+                unsigned char type = entry->d_type;
+                struct stat st;
+                bool have_stat = false;
+                if (type == DT_UNKNOWN || type == DT_REG)
+                {
+                    // Regular files need their stat data anyway, for the index's stat cache
+                    if (fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0)
+                        continue;
+                    have_stat = true;
+                    type = S_ISREG(st.st_mode) ? DT_REG : S_ISDIR(st.st_mode) ? DT_DIR : DT_LNK;
+                }
+                if (type != DT_REG && type != DT_DIR)
+                    continue;
+                std::string path = rel.empty() ? std::string(name) : rel + "/" + name;
+                if (!ignore.empty() && ignore.ignored(path, type == DT_DIR))
+                    continue;
+                if (type == DT_DIR)
+                    subdirs.push_back(std::move(path));
+                else if (have_stat)
+                    found.push_back({std::move(path), st});
+            }
+        }
+        close(fd);
+
+        std::lock_guard<std::mutex> guard(mutex);
+        for (ScannedFile &file : found)
+            files.push_back(std::move(file));
+        for (std::string &subdir : subdirs)
+        {
+            if (pool)
+                pool->submit([&scan_directory, subdir]
+                             { scan_directory(subdir); });
+            else
+                pending.push_back(std::move(subdir));
+        }
+    };
+
+    std::string start = dir == "." ? "" : dir;
+    if (threads > 1)
+    {
+        pool.reset(new ThreadPool(threads));
+        pool->submit([&scan_directory, start]
+                     { scan_directory(start); });
+        pool->wait();
+        pool.reset();
+    }
+    else
+    {
+        pending.push_back(start);
+        while (!pending.empty())
+        {
+            std::string next = std::move(pending.back());
+            pending.pop_back();
+            scan_directory(next);
+        }
+    }
+    close(root_fd);
+    directory_count = scanned;
+
+    std::sort(files.begin(), files.end(), [](const ScannedFile &a, const ScannedFile &b)
+              { return a.path < b.path; });
+    return !failed;
+}
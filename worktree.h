@@ -0,0 +1,62 @@
+#ifndef WORKTREE_H
+#define WORKTREE_H
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <filesystem>
+#include <sys/stat.h>
+
+// Patterns from .minigitignore in the repository root, one per line, like .gitignore:
+//   "#" starts a comment, a trailing "/" only matches directories, a leading "!" re-includes
+//   a path, a pattern containing "/" is matched against the whole repo-relative path and
+//   any other pattern against the file or directory name at any depth. The last matching
+//   pattern wins. Files inside an ignored directory are never looked at.
+class IgnoreRules {
+public:
+    IgnoreRules() = default;
+    explicit IgnoreRules(const std::filesystem::path& repo_root);
+
+    bool ignored(const std::string& path, bool is_dir) const;
+    // True if path or one of the directories above it is ignored (a scan would not reach it)
+    bool excluded(const std::string& path) const;
+    bool empty() const { return patterns.empty(); }
+
+private:
+    struct Pattern {
+        std::string glob;
+        bool negate;
+        bool dir_only;
+        bool whole_path;
+    };
+    std::vector<Pattern> patterns;
+};
+
+// A regular file found by WorktreeScanner, with its lstat data
+struct ScannedFile {
+    std::string path; // Repo-relative, '/'-separated
+    struct stat st;
+};
+
+// Walks the working tree with one task per directory on a pool of threads. Directories are
+// opened with openat relative to the root and read with getdents64, whose entry types
+// save a stat call for everything but regular files. .minigit, ignored paths and anything
+// that is not a regular file or directory (symlinks, sockets, ...) are skipped.
+class WorktreeScanner {
+public:
+    WorktreeScanner(const std::filesystem::path& root, const IgnoreRules& ignore, size_t threads);
+
+    // Regular files below dir ("" for the whole tree), sorted by path. Returns false if a
+    // directory could not be read; what could be read is still returned.
+    bool scan(const std::string& dir, std::vector<ScannedFile>& files);
+
+    size_t directories_scanned() const { return directory_count; }
+
+private:
+    std::filesystem::path root;
+    const IgnoreRules& ignore;
+    size_t threads;
+    size_t directory_count = 0;
+};
+
+#endif // WORKTREE_H